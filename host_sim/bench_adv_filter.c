@@ -0,0 +1,206 @@
+/**
+ * @file bench_adv_filter.c
+ *
+ *
+ * @brief Host microbenchmark of the scan-result name matching: the original
+ *          resolve + strlen/strncmp loop (with and without the per-report
+ *          logging the handler used to do) against ble_adv_filter, cold (first
+ *          sight of every BDA) and warm (rejected BDAs cached), and the full
+ *          ble_adv_parse walk in front of it. Reports are a
+ *          mix of unrelated names, same-length near misses, nameless
+ *          advertisers and the wanted devices.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* ESP32 API (fakes) */
+#include "esp_gap_ble_api.h"
+/* API */
+#include "sim.h"
+#include "ble_adv_data.h"
+#include "ble_adv_filter.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BENCH_DEVICES       256U
+#define BENCH_NAMES         3U
+#define BENCH_REPORTS       2000000U
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct {
+    esp_bd_addr_t   bda;
+    uint8_t         adv[ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX];
+} bench_report_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static const char *s_names[BENCH_NAMES] = { "ESP_GATTS_DEMO_a", "ESP_GATTS_DEMO_b", "ESP_GATTS_DEMO_c" };
+static bench_report_t s_reports[BENCH_DEVICES];
+static volatile int s_sink;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+static void make_report(bench_report_t *report, uint32_t i)
+{
+    char name[32];
+    uint32_t r = sim_rand();
+    report->bda[0] = 0xC0;
+    report->bda[1] = 0xDE;
+    report->bda[2] = (uint8_t)(r >> 24);
+    report->bda[3] = (uint8_t)(r >> 16);
+    report->bda[4] = (uint8_t)(r >> 8);
+    report->bda[5] = (uint8_t)i;
+
+    /* 1 in 64 wanted, 1 in 8 same-length near miss, 1 in 8 nameless, the rest unrelated */
+    if (i % 64 == 0) {
+        snprintf(name, sizeof(name), "%s", s_names[(i / 64) % BENCH_NAMES]);
+    } else if (i % 8 == 1) {
+        snprintf(name, sizeof(name), "ESP_GATTS_DEMO_%c", 'd' + (int)(i % 20));
+    } else if (i % 8 == 2) {
+        name[0] = '\0';
+    } else {
+        snprintf(name, sizeof(name), "SENSOR_%0*X", (int)(2 + r % 6), (unsigned)(r & 0xFFFFFF));
+    }
+
+    uint8_t *p = report->adv;
+    *p++ = 2;
+    *p++ = ESP_BLE_AD_TYPE_FLAG;
+    *p++ = 0x06;
+    size_t len = strlen(name);
+    if (len) {
+        *p++ = (uint8_t)(len + 1);
+        *p++ = ESP_BLE_AD_TYPE_NAME_CMPL;
+        memcpy(p, name, len);
+    }
+}
+
+static int match_baseline(bench_report_t *report)
+{
+    /* Original ESP_GAP_SEARCH_INQ_RES_EVT matching */
+    uint8_t len = 0;
+    uint8_t *name = esp_ble_resolve_adv_data(report->adv, ESP_BLE_AD_TYPE_NAME_CMPL, &len);
+    if (name != NULL) {
+        for (uint8_t i = 0; i < BENCH_NAMES; i++) {
+            if (strlen(s_names[i]) == len && strncmp((char *)name, s_names[i], len) == 0) {
+                return i;
+            }
+        }
+    }
+    return BLE_ADV_FILTER_NO_MATCH;
+}
+
+static int match_baseline_logged(bench_report_t *report)
+{
+    /* Same, with the logging the handler did for every report before matching */
+    uint8_t len = 0;
+    ESP_LOGI("BENCH", "EVT: BLE Scan Result");
+    esp_log_buffer_hex("BENCH", report->bda, 6);
+    ESP_LOGI("BENCH", "Searched Adv Data Len %d, Scan Response Len %d", 31, 0);
+    uint8_t *name = esp_ble_resolve_adv_data(report->adv, ESP_BLE_AD_TYPE_NAME_CMPL, &len);
+    ESP_LOGI("BENCH", "Searched Device Name Len %d", len);
+    esp_log_buffer_char("BENCH", name, len);
+    ESP_LOGI("BENCH", "\n");
+    if (name != NULL) {
+        for (uint8_t i = 0; i < BENCH_NAMES; i++) {
+            if (strlen(s_names[i]) == len && strncmp((char *)name, s_names[i], len) == 0) {
+                return i;
+            }
+        }
+    }
+    return BLE_ADV_FILTER_NO_MATCH;
+}
+
+static void report(const char *label, uint64_t ns, uint32_t matched)
+{
+    printf("%-28s %8.1f ns/report %10.2f M reports/s  (%u matched)\n", label,
+           (double)ns / BENCH_REPORTS, (double)BENCH_REPORTS * 1e3 / (double)ns, matched);
+}
+
+int main(void)
+{
+    sim_init(1);
+    for (uint32_t i = 0; i < BENCH_DEVICES; i++) {
+        make_report(&s_reports[i], i);
+    }
+
+    ble_adv_filter_t filter;
+    ble_adv_filter_init(&filter);
+    for (uint8_t i = 0; i < BENCH_NAMES; i++) {
+        ble_adv_filter_add_name(&filter, s_names[i], i);
+    }
+
+    /* Logs are formatted as on target but only printed up to the simulation level (warnings) */
+    sim_set_log_level(ESP_LOG_WARN);
+    uint32_t matched = 0;
+    uint64_t t0 = sim_host_ns();
+    for (uint32_t n = 0; n < BENCH_REPORTS; n++) {
+        int id = match_baseline_logged(&s_reports[n % BENCH_DEVICES]);
+        matched += (id != BLE_ADV_FILTER_NO_MATCH);
+    }
+    report("original handler, logging", sim_host_ns() - t0, matched);
+
+    matched = 0;
+    t0 = sim_host_ns();
+    for (uint32_t n = 0; n < BENCH_REPORTS; n++) {
+        int id = match_baseline(&s_reports[n % BENCH_DEVICES]);
+        matched += (id != BLE_ADV_FILTER_NO_MATCH);
+    }
+    report("resolve + strncmp", sim_host_ns() - t0, matched);
+
+    /* Cold: every pass over the device set starts with an empty reject cache */
+    matched = 0;
+    t0 = sim_host_ns();
+    for (uint32_t n = 0; n < BENCH_REPORTS; n++) {
+        if (n % BENCH_DEVICES == 0) {
+            ble_adv_filter_clear_rejects(&filter);
+        }
+        int id = ble_adv_filter_match(&filter, s_reports[n % BENCH_DEVICES].bda, s_reports[n % BENCH_DEVICES].adv);
+        matched += (id != BLE_ADV_FILTER_NO_MATCH);
+    }
+    report("adv filter, cold", sim_host_ns() - t0, matched);
+
+    matched = 0;
+    filter.stats_reports = filter.stats_rejected_fast = 0;
+    t0 = sim_host_ns();
+    for (uint32_t n = 0; n < BENCH_REPORTS; n++) {
+        int id = ble_adv_filter_match(&filter, s_reports[n % BENCH_DEVICES].bda, s_reports[n % BENCH_DEVICES].adv);
+        matched += (id != BLE_ADV_FILTER_NO_MATCH);
+    }
+    report("adv filter, warm", sim_host_ns() - t0, matched);
+    printf("warm fast rejects: %.1f%% of reports\n", 100.0 * filter.stats_rejected_fast / filter.stats_reports);
+
+    /* The path taken with advertising decoders registered: every field in one walk, then the name */
+    matched = 0;
+    t0 = sim_host_ns();
+    for (uint32_t n = 0; n < BENCH_REPORTS; n++) {
+        if (n % BENCH_DEVICES == 0) {
+            ble_adv_filter_clear_rejects(&filter);
+        }
+        bench_report_t *r = &s_reports[n % BENCH_DEVICES];
+        ble_adv_fields_t fields;
+        ble_adv_parse(r->adv, ESP_BLE_ADV_DATA_LEN_MAX, &fields);
+        int id = ble_adv_filter_match_name(&filter, r->bda, fields.name, fields.name_len);
+        matched += (id != BLE_ADV_FILTER_NO_MATCH);
+    }
+    report("parse + name filter, cold", sim_host_ns() - t0, matched);
+
+    s_sink = (int)matched;
+    return 0;
+}
@@ -0,0 +1,290 @@
+/**
+ * @file bench_notify.c
+ *
+ *
+ * @brief Notification throughput benchmark: the real client (app_main and its
+ *          ESP_GATTC_NOTIFY_EVT path) against simulated servers notifying at a
+ *          fixed rate, swept over peer count and server MTU. Every case runs
+ *          in a forked child, as the client keeps its state in globals.
+ *
+ *          Reports per case, over a window after every peer subscribed:
+ *          offered and delivered notifications/s, payload kB/s, notifications
+ *          the servers could not queue (link saturated), values the client
+ *          rings dropped, and host time spent in the GATTC callback per
+ *          notification and per simulated second.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <sys/wait.h>
+#include <unistd.h>
+/* API */
+#include "sim.h"
+#include "ble_client.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BENCH_LIST_MAX  8
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct {
+    int         peers[BENCH_LIST_MAX];
+    int         n_peers;
+    int         mtus[BENCH_LIST_MAX];
+    int         n_mtus;
+    uint16_t    len;                    /* 0: MTU - 3 */
+    double      notify_ms;
+    double      conn_ms;
+    uint8_t     ce_pdus;
+    uint16_t    ll_octets;              /* Longest data PDU payload the servers take */
+    bool        phy_2m;                 /* Servers accept LE 2M, the client asks when built with BLE_50_FEATURES */
+    uint32_t    window_ms;
+    uint32_t    seed;
+} bench_options_t;
+
+typedef struct {
+    int         ok;
+    uint16_t    payload;
+    double      offered;                /* Notifications/s generated by the servers */
+    double      delivered;              /* Notifications/s into the client callback */
+    double      kbytes;                 /* Payload kB/s into the client callback */
+    uint32_t    queue_drops;
+    uint32_t    ring_drops;
+    double      cb_ns_per_notify;
+    double      cb_us_per_sec;          /* Host callback time per simulated second */
+} bench_result_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DECLARATIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Client entry point in main/ble_client.c */
+void app_main(void);
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static char s_peer_names[PROFILE_NUM][BLE_PEER_NAME_LEN_MAX + 1];
+
+/* * * * * * * * * * * * * * * *
+ * * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+static int parse_list(const char *val, int *list)
+{
+    int n = 0;
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", val);
+    for (char *tok = strtok(buf, ","); tok && n < BENCH_LIST_MAX; tok = strtok(NULL, ",")) {
+        list[n++] = atoi(tok);
+    }
+    return n;
+}
+
+static bool parse_args(int argc, char **argv, bench_options_t *opt)
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->n_peers   = parse_list("1,3,7", opt->peers);
+    opt->n_mtus    = parse_list("23,185,247,500", opt->mtus);
+    opt->notify_ms = 2.0;
+    opt->conn_ms   = 30.0;
+    opt->ce_pdus   = 6U;
+    opt->ll_octets = 251U;
+    opt->phy_2m    = true;
+    opt->window_ms = 5000U;
+    opt->seed      = 1U;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (!val) {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--peers") == 0) {
+            opt->n_peers = parse_list(val, opt->peers);
+        } else if (strcmp(arg, "--mtu") == 0) {
+            opt->n_mtus = parse_list(val, opt->mtus);
+        } else if (strcmp(arg, "--len") == 0) {
+            opt->len = (uint16_t)atoi(val);
+        } else if (strcmp(arg, "--notify-ms") == 0) {
+            opt->notify_ms = atof(val);
+        } else if (strcmp(arg, "--conn-ms") == 0) {
+            opt->conn_ms = atof(val);
+        } else if (strcmp(arg, "--ce-pdus") == 0) {
+            opt->ce_pdus = (uint8_t)atoi(val);
+        } else if (strcmp(arg, "--ll-octets") == 0) {
+            opt->ll_octets = (uint16_t)atoi(val);
+        } else if (strcmp(arg, "--phy-2m") == 0) {
+            opt->phy_2m = atoi(val) != 0;
+        } else if (strcmp(arg, "--window-ms") == 0) {
+            opt->window_ms = (uint32_t)atoi(val);
+        } else if (strcmp(arg, "--seed") == 0) {
+            opt->seed = (uint32_t)atoi(val);
+        } else {
+            return false;
+        }
+    }
+    return opt->n_peers > 0 && opt->n_mtus > 0 && opt->notify_ms > 0.0 && opt->ll_octets >= 27U &&
+           opt->ll_octets <= 251U;
+}
+
+static bool all_subscribed(void *arg)
+{
+    int servers = *(const int *)arg;
+    for (int i = 0; i < servers; i++) {
+        if (sim_get_server_stats(i)->t_subscribed == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void run_case(const bench_options_t *opt, int peers, int mtu, bench_result_t *res)
+{
+    memset(res, 0, sizeof(*res));
+    sim_init(opt->seed);
+    sim_set_log_level(ESP_LOG_NONE);
+
+    sim_server_cfg_t cfg;
+    sim_server_cfg_default(&cfg);
+    cfg.mtu              = (uint16_t)mtu;
+    cfg.conn_interval_us = (uint32_t)(opt->conn_ms * 1000.0);
+    cfg.notify_period_us = (uint32_t)(opt->notify_ms * 1000.0);
+    cfg.notify_len       = opt->len ? opt->len : ESP_GATT_MAX_MTU_SIZE;
+    cfg.ce_pdus          = opt->ce_pdus;
+    cfg.ll_octets_max    = opt->ll_octets;
+    cfg.phy_2m           = opt->phy_2m;
+    cfg.streams          = 1U;      /* One notifying characteristic per link, app_main skips the second */
+
+    char name[32];
+    for (int i = 0; i < peers; i++) {
+        snprintf(name, sizeof(name), "ESP_GATTS_DEMO_%c", 'a' + i);
+        sim_add_server(name, &cfg);
+    }
+    /* app_main adds the first three */
+    for (int i = 3; i < peers && i < (int)PROFILE_NUM; i++) {
+        snprintf(s_peer_names[i], sizeof(s_peer_names[i]), "ESP_GATTS_DEMO_%c", 'a' + i);
+        ble_peer_cfg_t peer = {
+            .name         = s_peer_names[i],
+            .service_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_SERVICE_UUID,}, },
+            .charact_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_NOTIFY_CHAR_UUID,}, },
+            .priority     = (uint8_t)i,
+        };
+        ble_peer_add(&peer, NULL);
+    }
+
+    sim_start_app(app_main);
+    if (!sim_run(SIM_SEC(30), all_subscribed, &peers)) {
+        return;
+    }
+    /* Notifications only: stop the polling reads app_main starts */
+    for (uint8_t id = 0; id < PROFILE_NUM; id++) {
+        ble_peer_poll(id, false);
+    }
+
+    uint64_t notifies0 = 0, bytes0 = 0, qdrops0 = 0, rdrops0 = 0;
+    for (int i = 0; i < peers; i++) {
+        notifies0 += sim_get_server_stats(i)->notifies;
+        bytes0    += sim_get_server_stats(i)->notify_bytes;
+        qdrops0   += sim_get_server_stats(i)->notify_drops;
+    }
+    for (uint8_t id = 0; id < PROFILE_NUM; id++) {
+        rdrops0 += ble_client.notify_ring[id].dropped;
+    }
+    uint64_t cb_ns0 = sim_get_stats()->cb_ns_total;
+
+    sim_run(sim_now_us() + SIM_MS(opt->window_ms), NULL, NULL);
+
+    uint64_t notifies = 0, bytes = 0, qdrops = 0, rdrops = 0;
+    for (int i = 0; i < peers; i++) {
+        notifies += sim_get_server_stats(i)->notifies;
+        bytes    += sim_get_server_stats(i)->notify_bytes;
+        qdrops   += sim_get_server_stats(i)->notify_drops;
+    }
+    for (uint8_t id = 0; id < PROFILE_NUM; id++) {
+        rdrops += ble_client.notify_ring[id].dropped;
+    }
+    double secs   = opt->window_ms / 1000.0;
+    uint64_t cb_ns = sim_get_stats()->cb_ns_total - cb_ns0;
+    notifies -= notifies0;
+
+    res->ok               = 1;
+    res->payload          = (uint16_t)((cfg.notify_len > mtu - 3) ? mtu - 3 : cfg.notify_len);
+    res->offered          = peers * 1000.0 / opt->notify_ms;
+    res->delivered        = notifies / secs;
+    res->kbytes           = (double)(bytes - bytes0) / 1000.0 / secs;
+    res->queue_drops      = (uint32_t)(qdrops - qdrops0);
+    res->ring_drops       = (uint32_t)(rdrops - rdrops0);
+    res->cb_ns_per_notify = notifies ? (double)cb_ns / (double)notifies : 0.0;
+    res->cb_us_per_sec    = (double)cb_ns / 1000.0 / secs;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t opt;
+    if (!parse_args(argc, argv, &opt)) {
+        printf("usage: %s [--peers 1,3,7] [--mtu 23,185,247,500] [--len N (0 = MTU - 3)]\n"
+               "          [--notify-ms 2] [--conn-ms 30] [--ce-pdus 6] [--ll-octets 251] [--phy-2m 1]\n"
+               "          [--window-ms 5000] [--seed 1]\n", argv[0]);
+        return 2;
+    }
+
+    printf("notify every %.1f ms per peer, %.1f ms connection interval, %u PDUs per event, servers take %u-byte PDUs%s, "
+           "%u ms window\n\n", opt.notify_ms, opt.conn_ms, opt.ce_pdus, opt.ll_octets, opt.phy_2m ? " and LE 2M" : "",
+           opt.window_ms);
+    printf("%5s %5s %7s %10s %10s %9s %8s %8s %10s %10s\n", "peers", "mtu", "payload", "offered/s", "notifs/s",
+           "kB/s", "qdrops", "rdrops", "cb ns/ntf", "cb us/s");
+
+    for (int p = 0; p < opt.n_peers; p++) {
+        for (int m = 0; m < opt.n_mtus; m++) {
+            int fds[2];
+            bench_result_t res = { 0 };
+            fflush(stdout);
+            if (pipe(fds) != 0) {
+                perror("pipe");
+                return 1;
+            }
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                run_case(&opt, opt.peers[p], opt.mtus[m], &res);
+                if (write(fds[1], &res, sizeof(res)) != (ssize_t)sizeof(res)) {
+                    _exit(1);
+                }
+                /* Simulated tasks are parked on the kernel; leave without joining them */
+                _exit(0);
+            }
+            close(fds[1]);
+            if (read(fds[0], &res, sizeof(res)) != (ssize_t)sizeof(res)) {
+                res.ok = 0;
+            }
+            close(fds[0]);
+            waitpid(pid, NULL, 0);
+
+            if (!res.ok) {
+                printf("%5d %5d  not all peers subscribed\n", opt.peers[p], opt.mtus[m]);
+                continue;
+            }
+            printf("%5d %5d %7u %10.0f %10.1f %9.2f %8u %8u %10.0f %10.1f\n", opt.peers[p], opt.mtus[m], res.payload,
+                   res.offered, res.delivered, res.kbytes, res.queue_drops, res.ring_drops, res.cb_ns_per_notify,
+                   res.cb_us_per_sec);
+        }
+    }
+    return 0;
+}
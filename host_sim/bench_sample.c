@@ -0,0 +1,139 @@
+/**
+ * @file bench_sample.c
+ *
+ *
+ * @brief Host microbenchmark of the notification sample decoding: a per-sample
+ *          float conversion, the obvious way to scale packed int16 samples,
+ *          against ble_sample_decode converting a whole value at a time, for
+ *          value lengths of the default to the largest MTU. The batch path is
+ *          checked against a scalar reference first, with random formats
+ *          and lengths.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdio.h>
+#include <string.h>
+/* API */
+#include "sim.h"
+#include "ble_sample.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BENCH_VALUES        64U             /* Distinct values cycled through, 32 KB of payload */
+#define BENCH_SAMPLES       100000000U      /* Samples converted per row */
+#define BENCH_CHECKS        20000U
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static const uint16_t s_lens[] = { 20U, 182U, 244U, 497U };
+static uint8_t s_values[BENCH_VALUES][2U * BLE_SAMPLE_MAX + 1U];
+static int32_t s_out[BLE_SAMPLE_MAX];
+static volatile uint32_t s_sink;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+static uint16_t decode_float(const uint8_t *data, uint16_t len, float scale, int32_t *out)
+{
+    /* One sample at a time through a float, as printed values are usually scaled. The bench is built with
+     * -fno-tree-vectorize, so the baseline stays the per-sample conversion whatever the build type. */
+    uint16_t n = len / 2U;
+    for (uint16_t i = 0; i < n; i++) {
+        int16_t raw;
+        memcpy(&raw, &data[2U * i], sizeof(raw));
+        out[i] = (int32_t)((float)raw * scale);
+    }
+    return n;
+}
+
+static uint32_t check(void)
+{
+    /* Every lane and tail position, shifts and offsets against the plain formula */
+    uint32_t mismatches = 0;
+    for (uint32_t n = 0; n < BENCH_CHECKS; n++) {
+        ble_sample_fmt_t fmt = {
+            .offset = (uint8_t)(sim_rand() % 4U),
+            .count  = (uint8_t)((sim_rand() % 4U) ? 0U : sim_rand() % 64U),
+            .shift  = (uint8_t)(sim_rand() % 16U),
+            .mul    = (int16_t)(sim_rand() % 0x10000U),
+            .add    = (int32_t)(sim_rand() % 0x20000U) - 0x10000,
+        };
+        const uint8_t *value = s_values[n % BENCH_VALUES];
+        uint16_t len = (uint16_t)(sim_rand() % sizeof(s_values[0]));
+        uint16_t got = ble_sample_decode(&fmt, value, len, s_out, BLE_SAMPLE_MAX);
+        uint16_t want = len < fmt.offset ? 0U : (uint16_t)((len - fmt.offset) / 2U);
+        if (fmt.count && want > fmt.count) {
+            want = fmt.count;
+        }
+        if (want > BLE_SAMPLE_MAX) {
+            want = BLE_SAMPLE_MAX;
+        }
+        mismatches += (got != want);
+        for (uint16_t i = 0; i < got && i < want; i++) {
+            const uint8_t *p   = &value[fmt.offset + 2U * i];
+            int16_t        raw = (int16_t)(p[0] | (p[1] << 8));
+            mismatches += (s_out[i] != (((int32_t)raw * fmt.mul + fmt.add) >> fmt.shift));
+        }
+    }
+    return mismatches;
+}
+
+static void report(const char *label, uint16_t len, uint64_t ns, uint64_t samples)
+{
+    printf("%-24s %4u bytes %8.2f ns/value %8.1f M samples/s\n", label, len,
+           (double)ns * (len / 2U) / (double)samples, (double)samples * 1e3 / (double)ns);
+}
+
+int main(void)
+{
+    sim_init(1);
+    for (uint32_t i = 0; i < BENCH_VALUES; i++) {
+        for (uint32_t j = 0; j < sizeof(s_values[0]); j++) {
+            s_values[i][j] = (uint8_t)sim_rand();
+        }
+    }
+#if defined(BLE_SAMPLE_SCALAR)
+    const char *path = "plain C";
+#elif defined(__SSE2__)
+    const char *path = "SSE2";
+#elif defined(__ARM_NEON)
+    const char *path = "NEON";
+#else
+    const char *path = "plain C";
+#endif
+    printf("batch path: %s, %u mismatches against the reference\n", path, (unsigned)check());
+
+    /* 0.01 units to 0.001, both ways */
+    const ble_sample_fmt_t fmt = { .mul = 10 };
+    for (size_t l = 0; l < sizeof(s_lens) / sizeof(s_lens[0]); l++) {
+        uint16_t len    = s_lens[l];
+        uint32_t values = BENCH_SAMPLES / (len / 2U);
+        uint64_t samples = 0;
+        uint64_t t0 = sim_host_ns();
+        for (uint32_t n = 0; n < values; n++) {
+            samples += decode_float(s_values[n % BENCH_VALUES], len, 10.0f, s_out);
+            s_sink += (uint32_t)s_out[0];
+        }
+        report("per sample, float", len, sim_host_ns() - t0, samples);
+
+        samples = 0;
+        t0 = sim_host_ns();
+        for (uint32_t n = 0; n < values; n++) {
+            samples += ble_sample_decode(&fmt, s_values[n % BENCH_VALUES], len, s_out, BLE_SAMPLE_MAX);
+            s_sink += (uint32_t)s_out[0];
+        }
+        report("ble_sample_decode", len, sim_host_ns() - t0, samples);
+    }
+    return 0;
+}
@@ -0,0 +1,312 @@
+/**
+ * @file bench_write.c
+ *
+ *
+ * @brief Write throughput benchmark: ble_peer_write against simulated
+ *          servers, swept over write mode and server MTU. Every peer keeps
+ *          --depth buffers queued, each completion queues the buffer again.
+ *          Every case runs in a forked child, as the client keeps its state
+ *          in globals.
+ *
+ *          Reports per case, over a window after every peer subscribed:
+ *          buffers and payload kB/s completed on the client, payload kB/s
+ *          the servers received, and write errors.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* POSIX */
+#include <sys/wait.h>
+#include <unistd.h>
+/* API */
+#include "sim.h"
+#include "ble_client.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BENCH_LIST_MAX  8
+#define BENCH_MODE_NUM  3
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct {
+    int         peers;
+    int         mtus[BENCH_LIST_MAX];
+    int         n_mtus;
+    uint16_t    len;                    /* 0: MTU - 3, BLE_WRITE_RSP is clipped to it anyway */
+    uint8_t     depth;
+    double      conn_ms;
+    uint8_t     ce_pdus;
+    uint16_t    ll_octets;              /* Longest data PDU payload the servers take */
+    bool        phy_2m;                 /* Servers accept LE 2M, the client asks when built with BLE_50_FEATURES */
+    uint32_t    window_ms;
+    uint32_t    seed;
+} bench_options_t;
+
+typedef struct {
+    int         ok;
+    uint16_t    payload;
+    double      writes;                 /* Buffers/s completed */
+    double      kbytes;                 /* Payload kB/s completed on the client */
+    double      server_kbytes;          /* Payload kB/s received by the servers */
+    uint32_t    errors;
+} bench_result_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DECLARATIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Client entry point in main/ble_client.c */
+void app_main(void);
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static const char *const s_mode_names[BENCH_MODE_NUM] = { "rsp", "no_rsp", "long" };
+
+static char             s_peer_names[PROFILE_NUM][BLE_PEER_NAME_LEN_MAX + 1];
+static uint8_t          s_buf[BLE_WRITE_LONG_MAX];
+static uint16_t         s_len;
+static ble_write_mode_t s_mode;
+static bool             s_running;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+static int parse_list(const char *val, int *list)
+{
+    int n = 0;
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", val);
+    for (char *tok = strtok(buf, ","); tok && n < BENCH_LIST_MAX; tok = strtok(NULL, ",")) {
+        list[n++] = atoi(tok);
+    }
+    return n;
+}
+
+static bool parse_args(int argc, char **argv, bench_options_t *opt)
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->peers     = 1;
+    opt->n_mtus    = parse_list("23,185,247,500", opt->mtus);
+    opt->depth     = 4U;
+    opt->conn_ms   = 30.0;
+    opt->ce_pdus   = 6U;
+    opt->ll_octets = 251U;
+    opt->phy_2m    = true;
+    opt->window_ms = 5000U;
+    opt->seed      = 1U;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (!val) {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--peers") == 0) {
+            opt->peers = atoi(val);
+        } else if (strcmp(arg, "--mtu") == 0) {
+            opt->n_mtus = parse_list(val, opt->mtus);
+        } else if (strcmp(arg, "--len") == 0) {
+            opt->len = (uint16_t)atoi(val);
+        } else if (strcmp(arg, "--depth") == 0) {
+            opt->depth = (uint8_t)atoi(val);
+        } else if (strcmp(arg, "--conn-ms") == 0) {
+            opt->conn_ms = atof(val);
+        } else if (strcmp(arg, "--ce-pdus") == 0) {
+            opt->ce_pdus = (uint8_t)atoi(val);
+        } else if (strcmp(arg, "--ll-octets") == 0) {
+            opt->ll_octets = (uint16_t)atoi(val);
+        } else if (strcmp(arg, "--phy-2m") == 0) {
+            opt->phy_2m = atoi(val) != 0;
+        } else if (strcmp(arg, "--window-ms") == 0) {
+            opt->window_ms = (uint32_t)atoi(val);
+        } else if (strcmp(arg, "--seed") == 0) {
+            opt->seed = (uint32_t)atoi(val);
+        } else {
+            return false;
+        }
+    }
+    return opt->peers > 0 && opt->peers <= (int)PROFILE_NUM && opt->n_mtus > 0 && opt->len <= BLE_WRITE_LONG_MAX &&
+           opt->depth > 0U && opt->depth <= BLE_WRITE_QUEUE_LEN && opt->ll_octets >= 27U && opt->ll_octets <= 251U;
+}
+
+static bool all_subscribed(void *arg)
+{
+    int servers = *(const int *)arg;
+    for (int i = 0; i < servers; i++) {
+        if (sim_get_server_stats(i)->t_subscribed == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void write_done(uint8_t peer_id, esp_err_t status, void *arg)
+{
+    (void)status;
+    (void)arg;
+    /* Keep the queue at depth: every completion hands the same buffer back */
+    if (s_running) {
+        ble_peer_write(peer_id, INVALID_HANDLE, s_buf, s_len, s_mode, write_done, NULL);
+    }
+}
+
+static void run_case(const bench_options_t *opt, ble_write_mode_t mode, int mtu, bench_result_t *res)
+{
+    memset(res, 0, sizeof(*res));
+    sim_init(opt->seed);
+    sim_set_log_level(ESP_LOG_NONE);
+
+    sim_server_cfg_t cfg;
+    sim_server_cfg_default(&cfg);
+    cfg.mtu              = (uint16_t)mtu;
+    cfg.conn_interval_us = (uint32_t)(opt->conn_ms * 1000.0);
+    cfg.ce_pdus          = opt->ce_pdus;
+    cfg.ll_octets_max    = opt->ll_octets;
+    cfg.phy_2m           = opt->phy_2m;
+    cfg.streams          = 1U;      /* One notifying characteristic per link, app_main skips the second */
+
+    char name[32];
+    for (int i = 0; i < opt->peers; i++) {
+        snprintf(name, sizeof(name), "ESP_GATTS_DEMO_%c", 'a' + i);
+        sim_add_server(name, &cfg);
+    }
+    /* app_main adds the first three */
+    for (int i = 3; i < opt->peers; i++) {
+        snprintf(s_peer_names[i], sizeof(s_peer_names[i]), "ESP_GATTS_DEMO_%c", 'a' + i);
+        ble_peer_cfg_t peer = {
+            .name         = s_peer_names[i],
+            .service_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_SERVICE_UUID,}, },
+            .charact_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_NOTIFY_CHAR_UUID,}, },
+            .priority     = (uint8_t)i,
+        };
+        ble_peer_add(&peer, NULL);
+    }
+
+    sim_start_app(app_main);
+    int peers = opt->peers;
+    if (!sim_run(SIM_SEC(30), all_subscribed, &peers)) {
+        return;
+    }
+    /* Writes only: stop the polling reads app_main starts and let its demo write go out */
+    for (uint8_t id = 0; id < PROFILE_NUM; id++) {
+        ble_peer_poll(id, false);
+    }
+    sim_run(sim_now_us() + SIM_MS(500), NULL, NULL);
+
+    /* The link MTU is the smaller of both sides, the client asks for 500 */
+    uint16_t link_mtu = (uint16_t)(mtu < 500 ? mtu : 500);
+    uint16_t max_len  = (mode == BLE_WRITE_RSP) ? (uint16_t)(link_mtu - 3U) :
+                        (mode == BLE_WRITE_LONG) ? (uint16_t)BLE_WRITE_LONG_MAX : (uint16_t)sizeof(s_buf);
+    s_len     = opt->len ? opt->len : (uint16_t)(link_mtu - 3U);
+    s_len     = (s_len < max_len) ? s_len : max_len;
+    s_mode    = mode;
+    s_running = true;
+    for (uint16_t i = 0; i < sizeof(s_buf); i++) {
+        s_buf[i] = (uint8_t)i;
+    }
+
+    ble_peer_stats_t st0[PROFILE_NUM];
+    uint64_t         server0 = 0;
+    for (uint8_t id = 0; id < PROFILE_NUM; id++) {
+        ble_peer_get_stats(id, &st0[id]);
+    }
+    for (int i = 0; i < opt->peers; i++) {
+        server0 += sim_get_server_stats(i)->write_bytes;
+    }
+    for (uint8_t id = 0; id < opt->peers; id++) {
+        for (uint8_t d = 0; d < opt->depth; d++) {
+            ble_peer_write(id, INVALID_HANDLE, s_buf, s_len, mode, write_done, NULL);
+        }
+    }
+
+    sim_run(sim_now_us() + SIM_MS(opt->window_ms), NULL, NULL);
+    s_running = false;
+
+    uint64_t writes = 0, bytes = 0, errors = 0, server = 0;
+    for (uint8_t id = 0; id < PROFILE_NUM; id++) {
+        ble_peer_stats_t st;
+        ble_peer_get_stats(id, &st);
+        writes += st.writes - st0[id].writes;
+        bytes  += st.write_bytes - st0[id].write_bytes;
+        errors += st.write_errors - st0[id].write_errors;
+    }
+    for (int i = 0; i < opt->peers; i++) {
+        server += sim_get_server_stats(i)->write_bytes;
+    }
+    double secs = opt->window_ms / 1000.0;
+
+    res->ok            = 1;
+    res->payload       = s_len;
+    res->writes        = writes / secs;
+    res->kbytes        = (double)bytes / 1000.0 / secs;
+    res->server_kbytes = (double)(server - server0) / 1000.0 / secs;
+    res->errors        = (uint32_t)errors;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t opt;
+    if (!parse_args(argc, argv, &opt)) {
+        printf("usage: %s [--peers 1] [--mtu 23,185,247,500] [--len N (0 = MTU - 3)] [--depth 4]\n"
+               "          [--conn-ms 30] [--ce-pdus 6] [--ll-octets 251] [--phy-2m 1] [--window-ms 5000] [--seed 1]\n", argv[0]);
+        return 2;
+    }
+
+    printf("%d peer(s), %u buffers queued per peer, %.1f ms connection interval, %u PDUs per event, "
+           "servers take %u-byte PDUs%s, %u ms window\n\n", opt.peers, opt.depth, opt.conn_ms, opt.ce_pdus, opt.ll_octets,
+           opt.phy_2m ? " and LE 2M" : "", opt.window_ms);
+    printf("%-7s %5s %7s %9s %9s %11s %7s\n", "mode", "mtu", "payload", "writes/s", "kB/s", "server kB/s", "errors");
+
+    for (int m = 0; m < BENCH_MODE_NUM; m++) {
+        for (int u = 0; u < opt.n_mtus; u++) {
+            int fds[2];
+            bench_result_t res = { 0 };
+            fflush(stdout);
+            if (pipe(fds) != 0) {
+                perror("pipe");
+                return 1;
+            }
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                run_case(&opt, (ble_write_mode_t)m, opt.mtus[u], &res);
+                if (write(fds[1], &res, sizeof(res)) != (ssize_t)sizeof(res)) {
+                    _exit(1);
+                }
+                /* Simulated tasks are parked on the kernel; leave without joining them */
+                _exit(0);
+            }
+            close(fds[1]);
+            if (read(fds[0], &res, sizeof(res)) != (ssize_t)sizeof(res)) {
+                res.ok = 0;
+            }
+            close(fds[0]);
+            waitpid(pid, NULL, 0);
+
+            if (!res.ok) {
+                printf("%-7s %5d  not all peers subscribed\n", s_mode_names[m], opt.mtus[u]);
+                continue;
+            }
+            printf("%-7s %5d %7u %9.1f %9.2f %11.2f %7u\n", s_mode_names[m], opt.mtus[u], res.payload, res.writes,
+                   res.kbytes, res.server_kbytes, res.errors);
+        }
+    }
+    return 0;
+}
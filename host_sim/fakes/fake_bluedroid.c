@@ -0,0 +1,2113 @@
+/**
+ * @file fake_bluedroid.c
+ *
+ *
+ * @brief Scriptable fake of the Bluedroid GAP/GATTC API and of the GATT
+ *          servers around the client. Timing model:
+ *          - Servers advertise every adv_interval plus 0-10 ms advDelay; a
+ *            report is delivered when the scanner is inside its scan window.
+ *          - One connection is initiated at a time; it completes on the
+ *            target's next advertising event.
+ *          - Every ATT request holds the link's bearer until its response,
+ *            which arrives one connection interval per round trip after the
+ *            next connection event.
+ *          - Connection events inside a scan window carry one PDU pair.
+ *          - Extended advertisers are only heard by extended scans, on their
+ *            primary PHY; a scan on both PHYs alternates them per interval.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* ESP32 API (fakes) */
+#include "esp_bt.h"
+#include "esp_bt_main.h"
+#include "esp_gap_ble_api.h"
+#include "esp_gattc_api.h"
+#include "esp_gatt_common_api.h"
+/* API */
+#include "sim_internal.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define SIM_APP_MAX             12U         /* BTA_GATTC_CL_MAX */
+#define SIM_SVC_MAX             8U
+#define SIM_CHAR_MAX            16U
+#define SIM_OPEN_QUEUE_MAX      32U
+#define SIM_CONN_MAX            CONFIG_BT_ACL_CONNECTIONS
+#define SIM_HCI_DELAY_US        200U        /* Host/controller command round trip */
+#define SIM_ADV_DELAY_MAX_US    10000U      /* advDelay, 0-10 ms per advertising event */
+#define SIM_CONN_TIMEOUT_US     SIM_SEC(30)
+#define SIM_VALUE_LEN           4U          /* Read response of the GATTS demo characteristics */
+#define SIM_HANDLE_FIRST_APP    40U         /* Application services start here, like the GATTS demo */
+#define SIM_DB_HASH_UUID        0x2B2AU     /* Database Hash, read only */
+#define SIM_DB_HASH_LEN         16U
+#define SIM_WHITELIST_MAX       12U         /* Controller filter accept list size */
+#define SIM_NOTIFY_QUEUE_MAX    16U         /* Server side notifications waiting for a connection event */
+#define SIM_LL_PAYLOAD          27U         /* LE data PDU payload without Data Length Extension */
+#define SIM_LL_PAYLOAD_MAX      251U
+#define SIM_L2CAP_ATT_HDR       7U          /* L2CAP header (4) + ATT opcode and handle (3) */
+#define SIM_PDU_PAIR_US         676U        /* 1M PHY: full 27-byte data PDU, IFS, empty ack, IFS */
+#define SIM_IFS_US              150U
+#define SIM_CODED_FIXED_US      400U        /* Coded S=8: preamble, access address and coding fields */
+#define SIM_WRITE_QUEUE_MAX     32U         /* Client write commands waiting for a connection event */
+#define SIM_ACL_CONGEST_PDUS    24U         /* L2CAP reports congestion above this many queued PDUs */
+#define SIM_PREP_QUEUE_MAX      512U        /* Server prepare queue, bytes */
+#define SIM_READING_PERIOD_US   SIM_SEC(1)  /* Advertised readings change this often */
+#define SIM_MFR_AD_LEN          8U          /* Length, type, company identifier, sequence number and value */
+#define SIM_STREAM_SVC_A        0x00FFU     /* Notifying characteristics of the GATTS demo profiles */
+#define SIM_STREAM_CHAR_A       0xFF01U
+#define SIM_STREAM_SVC_B        0x00EEU
+#define SIM_STREAM_CHAR_B       0xEE01U
+/* Later streams: 128-bit service and characteristics, byte 12 numbering the service (0) and its characteristics */
+#define SIM_STREAM_UUID128      { 0x3A, 0x9C, 0x51, 0x7E, 0x0B, 0xD2, 0x4F, 0x86, 0x91, 0x4C, 0x2E, 0x6B, 0x00, 0x00, 0xC0, 0x5E }
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct {
+    esp_bt_uuid_t   uuid;
+    uint16_t        start_handle;
+    uint16_t        end_handle;
+} sim_svc_t;
+
+typedef struct {
+    esp_bt_uuid_t   uuid;
+    uint16_t        svc;                    /* Index into the server's services */
+    uint16_t        handle;                 /* Value handle */
+    uint16_t        cccd_handle;            /* 0 if the characteristic has no CCCD */
+    uint8_t         properties;
+    uint16_t        cccd_value;
+    bool            cccd_acked;             /* The client got the response to the write enabling cccd_value */
+    uint32_t        notify_gen;
+} sim_char_t;
+
+/* A write command queued on the client side of a link */
+typedef struct {
+    esp_gatt_if_t   gattc_if;
+    uint16_t        handle;
+    uint16_t        len;
+} sim_write_cmd_t;
+
+typedef struct sim_server {
+    int                 idx;
+    sim_server_cfg_t    cfg;
+    sim_server_stats_t  st;
+    esp_ble_addr_type_t addr_type;
+    uint8_t             adv[ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX];
+    uint8_t             adv_len;
+    uint8_t             rsp_len;
+    uint8_t             mfr_pos;            /* Offset of the reading in adv, 0 without cfg.mfr_id */
+    uint32_t            adv_seq;            /* Bumped whenever adv changes, for duplicate filtering */
+    uint64_t            reading_at;         /* Next reading change */
+    uint32_t            adv_gen;
+    /* Link */
+    bool                connecting;
+    bool                connected;
+    bool                discovered;
+    bool                mtu_exchanged;
+    uint16_t            conn_id;
+    esp_gatt_if_t       owner_if;
+    uint16_t            mtu;
+    uint16_t            ll_payload;         /* Data PDU payload, SIM_LL_PAYLOAD until Data Length Extension */
+    esp_ble_gap_phy_mask_t conn_phys;       /* Initiating PHYs of esp_ble_gap_prefer_ext_connect_params_set */
+    uint64_t            t_conn;             /* Anchor of the connection event train */
+    uint32_t            ci_us;              /* Connection interval of the link, cfg.conn_interval_us until updated */
+    uint16_t            latency;            /* Peripheral latency: events the server may skip when it has nothing to send */
+    uint16_t            sup_timeout;        /* 10 ms units */
+    bool                upd_pending;        /* A parameter update waits for its instant */
+    uint16_t            upd_int;
+    uint16_t            upd_latency;
+    uint16_t            upd_timeout;
+    uint64_t            busy_until;         /* ATT bearer */
+    uint32_t            link_gen;
+    uint32_t            value_seq;
+    uint64_t            silent_until;       /* Out of range: no advertising reaches the scanner */
+    uint8_t             tx_q[SIM_NOTIFY_QUEUE_MAX];   /* Characteristic indexes of queued notifications */
+    uint8_t             tx_head;
+    uint8_t             tx_count;
+    uint16_t            tx_left;            /* Bytes of the head notification still to send, it may span events */
+    bool                tx_event;           /* A connection event is scheduled to drain tx_q or wr_q */
+    uint64_t            ev_at;              /* Anchor of the last connection event that carried data */
+    uint32_t            ev_tx_us;           /* Air time it already spent on notifications */
+    uint32_t            ev_wr_us;           /* and on write commands */
+    sim_write_cmd_t     wr_q[SIM_WRITE_QUEUE_MAX];
+    uint8_t             wr_head;
+    uint8_t             wr_count;
+    uint16_t            wr_left;            /* Bytes of the head write still to send */
+    uint32_t            wr_pending_pdus;    /* All PDUs queued in wr_q, drives congestion */
+    bool                congested;
+    uint16_t            prep_len;           /* Bytes in the prepare queue */
+    uint16_t            prep_handle;
+    /* Database */
+    sim_svc_t           svcs[SIM_SVC_MAX];
+    uint8_t             n_svcs;
+    sim_char_t          chars[SIM_CHAR_MAX];
+    uint8_t             n_chars;
+    uint16_t            next_handle;
+} sim_server_t;
+
+/* A GATTC callback scheduled for later delivery, with its own copy of the value */
+typedef struct {
+    esp_gattc_cb_event_t        event;
+    esp_gatt_if_t               gattc_if;
+    esp_ble_gattc_cb_param_t    param;
+    sim_server_t               *server;
+    uint32_t                    link_gen;
+    uint16_t                    value_len;
+    uint8_t                     value[];
+} sim_gattc_post_t;
+
+typedef struct {
+    esp_gap_ble_cb_event_t      event;
+    esp_ble_gap_cb_param_t      param;
+} sim_gap_post_t;
+
+typedef struct {
+    int             server;
+    esp_gatt_if_t   gattc_if;
+    bool            ext;                    /* esp_ble_gattc_aux_open, extended create connection */
+} sim_open_req_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static esp_gap_ble_cb_t         s_gap_cb;
+static esp_gattc_cb_t           s_gattc_cb;
+static esp_gatt_if_t            s_apps[SIM_APP_MAX];
+static uint8_t                  s_n_apps;
+static uint16_t                 s_local_mtu = ESP_GATT_MAX_MTU_SIZE;
+
+static sim_server_t             s_servers[SIM_SERVER_MAX];
+static int                      s_n_servers;
+static sim_server_t            *s_conns[SIM_CONN_MAX];
+
+static struct {
+    esp_ble_scan_params_t   params;         /* Extended scans keep theirs here too, one set for both PHYs */
+    bool                    ext;            /* Extended scan: reports every advertiser with EXT_ADV_REPORT */
+    esp_ble_ext_scan_cfg_mask_t phys;
+    bool                    active;
+    uint32_t                gen;
+    uint64_t                t_start;
+    uint32_t                num_resps;
+    uint32_t                seen[SIM_SERVER_MAX];   /* adv_seq + 1 of the last report per server, 0 if none */
+} s_scan;
+
+static esp_bd_addr_t            s_whitelist[SIM_WHITELIST_MAX];
+static uint8_t                  s_whitelist_count;
+
+static sim_open_req_t           s_open_queue[SIM_OPEN_QUEUE_MAX];
+static uint8_t                  s_open_head;
+static uint8_t                  s_open_count;
+static int                      s_open_current = -1;
+static uint32_t                 s_open_gen;
+static esp_gatt_if_t            s_open_if;
+static bool                     s_open_ext;
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DECLARATIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+static void adv_event(void *ctx, uint32_t gen, uint32_t unused);
+static void open_next(void);
+static void conn_update_event(void *ctx, uint32_t link_gen, uint32_t unused);
+static void data_len_event(void *ctx, uint32_t link_gen, uint32_t tx_len);
+static void phy_update_event(void *ctx, uint32_t link_gen, uint32_t masks);
+static bool scan_window_open(void);
+
+/* * * * * * * * * * * * * * * *
+ * * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Dispatch */
+static void gap_dispatch(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
+{
+    if (!s_gap_cb) {
+        return;
+    }
+    uint64_t t0 = sim_host_ns();
+    s_gap_cb(event, param);
+    sim_account_callback(true, (uint32_t)event, sim_host_ns() - t0);
+}
+
+static void gap_post_fire(void *ctx, uint32_t a, uint32_t b)
+{
+    (void)a;
+    (void)b;
+    sim_gap_post_t *post = ctx;
+    gap_dispatch(post->event, &post->param);
+    free(post);
+}
+
+static void gap_post(uint64_t at, esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t *param)
+{
+    sim_gap_post_t *post = calloc(1, sizeof(*post));
+    if (!post) {
+        abort();
+    }
+    post->event = event;
+    if (param) {
+        post->param = *param;
+    }
+    sim_schedule(at, gap_post_fire, post, 0, 0);
+}
+
+static void gattc_dispatch(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
+{
+    if (!s_gattc_cb) {
+        return;
+    }
+    uint64_t t0 = sim_host_ns();
+    s_gattc_cb(event, gattc_if, param);
+    sim_account_callback(false, (uint32_t)event, sim_host_ns() - t0);
+}
+
+static void record_milestone(sim_server_t *server, esp_gattc_cb_event_t event, const esp_ble_gattc_cb_param_t *param)
+{
+    uint64_t now = sim_now_us();
+    switch (event) {
+        case ESP_GATTC_OPEN_EVT:
+            if (param->open.status == ESP_GATT_OK) {
+                server->st.connects++;
+                server->st.t_open = now;
+            }
+            break;
+        case ESP_GATTC_CFG_MTU_EVT:
+            server->st.t_mtu = now;
+            break;
+        case ESP_GATTC_SEARCH_CMPL_EVT:
+            if (param->search_cmpl.status == ESP_GATT_OK) {
+                server->st.t_discovered = now;
+                server->st.discoveries++;
+            }
+            break;
+        case ESP_GATTC_WRITE_DESCR_EVT: {
+            /* Subscribed once the response to the last of the client's notifying characteristics is in, not on the
+             * first CCCD: the client writes them back to back */
+            uint8_t notifying = 0U;
+            uint8_t enabled   = 0U;
+            bool    cccd      = false;
+            for (uint8_t i = 0; i < server->n_chars; i++) {
+                sim_char_t *chr = &server->chars[i];
+                if (chr->cccd_handle == param->write.handle && param->write.status == ESP_GATT_OK) {
+                    chr->cccd_acked = chr->cccd_value != 0U;
+                    cccd            = true;
+                }
+                if (chr->properties & ESP_GATT_CHAR_PROP_BIT_NOTIFY) {
+                    notifying++;
+                    enabled += chr->cccd_acked;
+                }
+            }
+            uint8_t wanted = server->cfg.subscriptions ? server->cfg.subscriptions : notifying;
+            if (cccd && enabled >= wanted && server->st.t_subscribed < server->st.t_open) {
+                server->st.t_subscribed = now;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void gattc_post_fire(void *ctx, uint32_t a, uint32_t b)
+{
+    (void)a;
+    (void)b;
+    sim_gattc_post_t *post = ctx;
+    /* Responses for a link that went down in the meantime are dropped, as on air */
+    if (!post->server || post->link_gen == post->server->link_gen) {
+        if (post->value_len && post->event == ESP_GATTC_NOTIFY_EVT) {
+            post->param.notify.value = post->value;
+        } else if (post->value_len) {
+            post->param.read.value = post->value;
+        }
+        gattc_dispatch(post->event, post->gattc_if, &post->param);
+        if (post->server) {
+            record_milestone(post->server, post->event, &post->param);
+        }
+    }
+    free(post);
+}
+
+static void gattc_post(uint64_t at, esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, const esp_ble_gattc_cb_param_t *param,
+                       sim_server_t *server, const uint8_t *value, uint16_t value_len)
+{
+    sim_gattc_post_t *post = calloc(1, sizeof(*post) + value_len);
+    if (!post) {
+        abort();
+    }
+    post->event    = event;
+    post->gattc_if = gattc_if;
+    post->param    = *param;
+    post->server   = server;
+    post->link_gen = server ? server->link_gen : 0;
+    if (value_len) {
+        memcpy(post->value, value, value_len);
+        post->value_len = value_len;
+    }
+    sim_schedule(at, gattc_post_fire, post, 0, 0);
+}
+
+/* Helpers */
+static bool uuid_equal(const esp_bt_uuid_t *x, const esp_bt_uuid_t *y)
+{
+    if (x->len != y->len) {
+        return false;
+    }
+    switch (x->len) {
+        case ESP_UUID_LEN_16:   return x->uuid.uuid16 == y->uuid.uuid16;
+        case ESP_UUID_LEN_32:   return x->uuid.uuid32 == y->uuid.uuid32;
+        default:                return memcmp(x->uuid.uuid128, y->uuid.uuid128, ESP_UUID_LEN_128) == 0;
+    }
+}
+
+static esp_bt_uuid_t uuid16(uint16_t value)
+{
+    esp_bt_uuid_t uuid = { .len = ESP_UUID_LEN_16, .uuid = { .uuid16 = value } };
+    return uuid;
+}
+
+static uint32_t uuid_word(const esp_bt_uuid_t *uuid)
+{
+    /* 16-bit UUIDs as they are, longer ones folded */
+    if (uuid->len == ESP_UUID_LEN_16) {
+        return uuid->uuid.uuid16;
+    }
+    uint32_t word = 2166136261U;
+    for (uint8_t i = 0; i < uuid->len; i++) {
+        word = (word ^ uuid->uuid.uuid128[i]) * 16777619U;
+    }
+    return word;
+}
+
+static sim_server_t *server_by_bda(const esp_bd_addr_t bda)
+{
+    for (int i = 0; i < s_n_servers; i++) {
+        if (memcmp(s_servers[i].st.bda, bda, ESP_BD_ADDR_LEN) == 0) {
+            return &s_servers[i];
+        }
+    }
+    return NULL;
+}
+
+static sim_server_t *server_by_conn(uint16_t conn_id)
+{
+    return conn_id < SIM_CONN_MAX ? s_conns[conn_id] : NULL;
+}
+
+static bool whitelisted(const esp_bd_addr_t bda)
+{
+    for (uint8_t i = 0; i < s_whitelist_count; i++) {
+        if (memcmp(s_whitelist[i], bda, ESP_BD_ADDR_LEN) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static sim_char_t *char_by_handle(sim_server_t *server, uint16_t handle)
+{
+    for (uint8_t i = 0; i < server->n_chars; i++) {
+        if (server->chars[i].handle == handle) {
+            return &server->chars[i];
+        }
+    }
+    return NULL;
+}
+
+static sim_char_t *char_by_cccd(sim_server_t *server, uint16_t handle)
+{
+    for (uint8_t i = 0; i < server->n_chars; i++) {
+        if (server->chars[i].cccd_handle && server->chars[i].cccd_handle == handle) {
+            return &server->chars[i];
+        }
+    }
+    return NULL;
+}
+
+static uint64_t next_event_every(const sim_server_t *server, uint64_t t, uint64_t stride)
+{
+    if (t <= server->t_conn) {
+        return server->t_conn;
+    }
+    return server->t_conn + ((t - server->t_conn + stride - 1) / stride) * stride;
+}
+
+static uint64_t next_conn_event(const sim_server_t *server, uint64_t t)
+{
+    return next_event_every(server, t, server->ci_us);
+}
+
+/* Completion time of an ATT exchange of the given number of round trips; holds the bearer. With peripheral
+ * latency an idle server only listens every latency + 1 events, so the request waits for one of those. */
+static uint64_t att_exchange(sim_server_t *server, uint8_t rtts)
+{
+    uint64_t start  = sim_now_us() > server->busy_until ? sim_now_us() : server->busy_until;
+    bool     idle   = server->tx_count == 0U && server->wr_count == 0U && server->busy_until <= sim_now_us();
+    uint64_t stride = (uint64_t)server->ci_us * (idle ? server->latency + 1U : 1U);
+    uint64_t done   = next_event_every(server, start, stride) + (uint64_t)rtts * server->ci_us;
+    server->busy_until = done;
+    return done;
+}
+
+/* Data PDUs of an ATT PDU carrying len bytes of value on the link */
+static uint32_t link_pdus(const sim_server_t *server, uint16_t len)
+{
+    return (len + SIM_L2CAP_ATT_HDR + server->ll_payload - 1U) / server->ll_payload;
+}
+
+/* Data PDU of octets payload, IFS, empty ack, IFS: 10 bytes of framing at 1 us per bit on 1M, 11 at 0.5 us on 2M,
+ * 400 us plus 5 bytes at 64 us per byte on Coded S=8 */
+static uint32_t pdu_pair_us(const sim_server_t *server, uint32_t octets)
+{
+    if (server->st.phy == ESP_BLE_GAP_PHY_2M) {
+        return (octets + 11U) * 4U + SIM_IFS_US + 11U * 4U + SIM_IFS_US;
+    }
+    if (server->st.phy == ESP_BLE_GAP_PHY_CODED) {
+        return SIM_CODED_FIXED_US + (octets + 5U) * 64U + SIM_IFS_US + SIM_CODED_FIXED_US + 5U * 64U + SIM_IFS_US;
+    }
+    return (octets + 10U) * 8U + SIM_IFS_US + 10U * 8U + SIM_IFS_US;
+}
+
+/* Radio time a link gets per connection event: its share of the interval, at most the ce_pdus pairs of full
+ * 27-byte PDUs on 1M the controller schedules. The radio is shared with the scanner: an event falling inside
+ * a scan window gets no time, so it is cut after its first pair and the controller goes back to listening. */
+static uint32_t link_event_us(const sim_server_t *server)
+{
+    if (scan_window_open()) {
+        return 0U;
+    }
+    uint32_t links = 0U;
+    for (uint32_t i = 0; i < SIM_CONN_MAX; i++) {
+        links += (s_conns[i] != NULL);
+    }
+    uint32_t event_us = server->ci_us / (links ? links : 1U);
+    if (server->cfg.ce_pdus && event_us > server->cfg.ce_pdus * SIM_PDU_PAIR_US) {
+        event_us = server->cfg.ce_pdus * SIM_PDU_PAIR_US;
+    }
+    return event_us;
+}
+
+/* Sends data PDUs of an L2CAP PDU with *left bytes to go while the event has time, the first pair of an event
+ * always goes. Short PDUs take less time, so an event holds fewer long PDUs and more short or 2M ones. False
+ * once the event is full. */
+static bool link_send(const sim_server_t *server, uint16_t *left, uint32_t event_us, uint32_t *used_us, uint32_t *pdus)
+{
+    while (*left) {
+        uint16_t octets = (*left < server->ll_payload) ? *left : server->ll_payload;
+        uint32_t us     = pdu_pair_us(server, octets);
+        if (*used_us && *used_us + us > event_us) {
+            return false;
+        }
+        *used_us += us;
+        *left     = (uint16_t)(*left - octets);
+        (*pdus)++;
+    }
+    return true;
+}
+
+/* A request carrying len bytes of value: one round trip, plus the connection events its fragments overflow */
+static uint64_t att_request(sim_server_t *server, uint16_t len)
+{
+    uint32_t event_us = link_event_us(server);
+    uint16_t left     = (uint16_t)(len + SIM_L2CAP_ATT_HDR);
+    uint32_t used_us  = 0U, pdus = 0U;
+    uint8_t  events   = 1U;
+    while (!link_send(server, &left, event_us, &used_us, &pdus)) {
+        events++;
+        used_us = 0U;
+    }
+    return att_exchange(server, events);
+}
+
+static void fill_value(sim_server_t *server, uint8_t *value, uint16_t len)
+{
+    uint32_t seq = server->value_seq++;
+    for (uint16_t i = 0; i < len; i++) {
+        value[i] = (uint8_t)(seq >> (8 * (i % 4)));
+    }
+}
+
+/* Database */
+static void db_hash(const sim_server_t *server, uint8_t hash[SIM_DB_HASH_LEN])
+{
+    /* Stands in for the AES-CMAC of the attribute layout: any change to handles, types or properties changes it */
+    uint32_t words[4] = { 2166136261U, 0x9E3779B9U, 0x85EBCA6BU, 0xC2B2AE35U };
+    for (uint8_t w = 0; w < 4; w++) {
+        for (uint8_t i = 0; i < server->n_svcs; i++) {
+            words[w] = (words[w] ^ uuid_word(&server->svcs[i].uuid)) * 16777619U;
+            words[w] = (words[w] ^ ((uint32_t)server->svcs[i].start_handle << 16 | server->svcs[i].end_handle)) * 16777619U;
+        }
+        for (uint8_t i = 0; i < server->n_chars; i++) {
+            words[w] = (words[w] ^ uuid_word(&server->chars[i].uuid)) * 16777619U;
+            words[w] = (words[w] ^ ((uint32_t)server->chars[i].handle << 16 | server->chars[i].cccd_handle)) * 16777619U;
+            words[w] = (words[w] ^ server->chars[i].properties) * 16777619U;
+        }
+    }
+    memcpy(hash, words, SIM_DB_HASH_LEN);
+}
+
+static uint16_t char_value(sim_server_t *server, const sim_char_t *chr, uint8_t *value)
+{
+    esp_bt_uuid_t hash_uuid = uuid16(SIM_DB_HASH_UUID);
+    if (uuid_equal(&chr->uuid, &hash_uuid)) {
+        db_hash(server, value);
+        return SIM_DB_HASH_LEN;
+    }
+    fill_value(server, value, SIM_VALUE_LEN);
+    return SIM_VALUE_LEN;
+}
+
+static sim_svc_t *svc_get_or_add(sim_server_t *server, const esp_bt_uuid_t *uuid)
+{
+    for (uint8_t i = 0; i < server->n_svcs; i++) {
+        if (uuid_equal(&server->svcs[i].uuid, uuid)) {
+            return &server->svcs[i];
+        }
+    }
+    if (server->n_svcs == SIM_SVC_MAX) {
+        return NULL;
+    }
+    if (server->n_svcs == 1) {
+        server->next_handle = SIM_HANDLE_FIRST_APP;
+    }
+    sim_svc_t *svc   = &server->svcs[server->n_svcs++];
+    svc->uuid         = *uuid;
+    svc->start_handle = server->next_handle++;
+    svc->end_handle   = svc->start_handle;
+    return svc;
+}
+
+int sim_server_add_char(int idx, uint16_t svc_uuid, uint16_t char_uuid, uint8_t properties)
+{
+    esp_bt_uuid_t svc = uuid16(svc_uuid);
+    esp_bt_uuid_t chr = uuid16(char_uuid);
+    return sim_server_add_char_uuid(idx, &svc, &chr, properties);
+}
+
+int sim_server_add_char_uuid(int idx, const esp_bt_uuid_t *svc_uuid, const esp_bt_uuid_t *char_uuid, uint8_t properties)
+{
+    sim_server_t *server = &s_servers[idx];
+    sim_svc_t    *svc    = svc_get_or_add(server, svc_uuid);
+    if (!svc || server->n_chars == SIM_CHAR_MAX || svc->end_handle + 1 != server->next_handle) {
+        return -1;
+    }
+    sim_char_t *chr  = &server->chars[server->n_chars];
+    chr->uuid        = *char_uuid;
+    chr->svc         = (uint16_t)(svc - server->svcs);
+    chr->properties  = properties;
+    chr->handle      = (uint16_t)(server->next_handle + 1);     /* Declaration, then value */
+    server->next_handle += 2;
+    if (properties & (ESP_GATT_CHAR_PROP_BIT_NOTIFY | ESP_GATT_CHAR_PROP_BIT_INDICATE)) {
+        chr->cccd_handle = server->next_handle++;
+    }
+    svc->end_handle = (uint16_t)(server->next_handle - 1);
+    return server->n_chars++;
+}
+
+/* Advertising */
+static void adv_schedule(sim_server_t *server, uint64_t from)
+{
+    uint64_t at = from + server->cfg.adv_interval_us + sim_rand() % SIM_ADV_DELAY_MAX_US;
+    sim_schedule(at, adv_event, server, server->adv_gen, 0);
+}
+
+static bool scan_window_open(void)
+{
+    uint64_t interval = (uint64_t)s_scan.params.scan_interval * 625U;
+    uint64_t window   = (uint64_t)s_scan.params.scan_window * 625U;
+    if (!s_scan.active || interval == 0) {
+        return false;
+    }
+    return ((sim_now_us() - s_scan.t_start) % interval) < window;
+}
+
+/* Primary PHY the scanner listens on now, 0 outside its windows. Scanning both PHYs, it alternates per interval. */
+static uint8_t scan_window_phy(void)
+{
+    if (!scan_window_open()) {
+        return 0U;
+    }
+    if (!s_scan.ext || s_scan.phys == ESP_BLE_GAP_EXT_SCAN_CFG_UNCODE_MASK) {
+        return ESP_BLE_GAP_PRI_PHY_1M;
+    }
+    if (s_scan.phys == ESP_BLE_GAP_EXT_SCAN_CFG_CODE_MASK) {
+        return ESP_BLE_GAP_PRI_PHY_CODED;
+    }
+    uint64_t interval = (uint64_t)s_scan.params.scan_interval * 625U;
+    return (((sim_now_us() - s_scan.t_start) / interval) & 1U) ? ESP_BLE_GAP_PRI_PHY_CODED : ESP_BLE_GAP_PRI_PHY_1M;
+}
+
+/* Whether the pending connection request reaches this advertiser: extended ones only take an extended create
+ * connection that initiates on their primary PHY */
+static bool open_hears(const sim_server_t *server)
+{
+    if (!server->cfg.adv_phy) {
+        return !s_open_ext || (server->conn_phys & ESP_BLE_GAP_PHY_1M_PREF_MASK);
+    }
+    if (!s_open_ext) {
+        return false;
+    }
+    return (server->cfg.adv_phy == ESP_BLE_GAP_PRI_PHY_CODED) ? (server->conn_phys & ESP_BLE_GAP_PHY_CODED_PREF_MASK) != 0
+                                                               : (server->conn_phys & ESP_BLE_GAP_PHY_1M_PREF_MASK) != 0;
+}
+
+static void link_up(sim_server_t *server)
+{
+    int slot = -1;
+    for (int i = 0; i < (int)SIM_CONN_MAX; i++) {
+        if (!s_conns[i]) {
+            slot = i;
+            break;
+        }
+    }
+
+    esp_ble_gattc_cb_param_t param = { 0 };
+    uint64_t now = sim_now_us();
+    server->connecting = false;
+    if (slot < 0) {
+        param.open.status = ESP_GATT_NO_RESOURCES;
+        memcpy(param.open.remote_bda, server->st.bda, ESP_BD_ADDR_LEN);
+        gattc_post(now, ESP_GATTC_OPEN_EVT, s_open_if, &param, NULL, NULL, 0);
+        adv_schedule(server, now);
+        return;
+    }
+
+    s_conns[slot]         = server;
+    server->connected     = true;
+    server->discovered    = false;
+    server->mtu_exchanged = false;
+    server->conn_id       = (uint16_t)slot;
+    server->owner_if      = s_open_if;
+    server->mtu           = ESP_GATT_DEF_BLE_MTU_SIZE;
+    server->ll_payload    = SIM_LL_PAYLOAD;
+    server->st.ll_octets  = SIM_LL_PAYLOAD;
+    /* A connection made from a Coded advertisement stays on Coded */
+    server->st.phy        = (server->cfg.adv_phy == ESP_BLE_GAP_PRI_PHY_CODED) ? ESP_BLE_GAP_PHY_CODED : ESP_BLE_GAP_PHY_1M;
+    server->t_conn        = now;
+    server->ci_us         = server->cfg.conn_interval_us;
+    server->latency       = 0U;
+    server->sup_timeout   = 400U;
+    server->upd_pending   = false;
+    server->busy_until    = now;
+    server->tx_count      = 0U;
+    server->tx_left       = 0U;
+    server->tx_event      = false;
+    server->wr_count      = 0U;
+    server->wr_left       = 0U;
+    server->wr_pending_pdus = 0U;
+    server->congested     = false;
+    server->prep_len      = 0U;
+    server->link_gen++;
+
+    /* Every registered profile sees the link come up; only the opener gets OPEN */
+    param.connect.conn_id = server->conn_id;
+    memcpy(param.connect.remote_bda, server->st.bda, ESP_BD_ADDR_LEN);
+    param.connect.conn_params.interval = (uint16_t)(server->ci_us / 1250U);
+    param.connect.conn_params.latency  = server->latency;
+    param.connect.conn_params.timeout  = server->sup_timeout;
+    for (uint8_t i = 0; i < s_n_apps; i++) {
+        gattc_post(now, ESP_GATTC_CONNECT_EVT, s_apps[i], &param, server, NULL, 0);
+    }
+
+    memset(&param, 0, sizeof(param));
+    param.open.status  = ESP_GATT_OK;
+    param.open.conn_id = server->conn_id;
+    param.open.mtu     = server->mtu;
+    memcpy(param.open.remote_bda, server->st.bda, ESP_BD_ADDR_LEN);
+    gattc_post(now, ESP_GATTC_OPEN_EVT, server->owner_if, &param, server, NULL, 0);
+
+    /* The peripheral asks for its preferred parameters shortly after connecting, the same as the current ones */
+    sim_schedule(now + 6ULL * server->ci_us, conn_update_event, server, server->link_gen, 0);
+}
+
+static void conn_update_event(void *ctx, uint32_t link_gen, uint32_t unused)
+{
+    (void)unused;
+    sim_server_t *server = ctx;
+    if (!server->connected || link_gen != server->link_gen) {
+        return;
+    }
+    /* The instant: the event train restarts here with the new parameters */
+    if (server->upd_pending) {
+        server->upd_pending = false;
+        server->t_conn      = sim_now_us();
+        server->ci_us       = server->upd_int * 1250U;
+        server->latency     = server->upd_latency;
+        server->sup_timeout = server->upd_timeout;
+        server->st.conn_updates++;
+    }
+    server->st.conn_interval_us = server->ci_us;
+    server->st.conn_latency     = server->latency;
+
+    esp_ble_gap_cb_param_t gap = { 0 };
+    gap.update_conn_params.status   = ESP_BT_STATUS_SUCCESS;
+    gap.update_conn_params.min_int  = (uint16_t)(server->ci_us / 1250U);
+    gap.update_conn_params.max_int  = (uint16_t)(server->ci_us / 1250U);
+    gap.update_conn_params.conn_int = (uint16_t)(server->ci_us / 1250U);
+    gap.update_conn_params.latency  = server->latency;
+    gap.update_conn_params.timeout  = server->sup_timeout;
+    memcpy(gap.update_conn_params.bda, server->st.bda, ESP_BD_ADDR_LEN);
+    gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, &gap);
+}
+
+static void data_len_event(void *ctx, uint32_t link_gen, uint32_t tx_len)
+{
+    /* LL_LENGTH_REQ/RSP done: both directions use the shorter of what the two sides take. A server without
+     * Data Length Extension answers LL_UNKNOWN_RSP and the link keeps 27 bytes. */
+    sim_server_t *server = ctx;
+    esp_ble_gap_cb_param_t gap = { 0 };
+    gap.pkt_data_lenth_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    if (!server->connected || link_gen != server->link_gen) {
+        gap.pkt_data_lenth_cmpl.status = ESP_BT_STATUS_RMT_DEV_DOWN;
+    } else if (server->cfg.ll_octets_max <= SIM_LL_PAYLOAD) {
+        gap.pkt_data_lenth_cmpl.status = ESP_BT_STATUS_UNSUPPORTED;
+    } else {
+        server->ll_payload   = (uint16_t)((tx_len < server->cfg.ll_octets_max) ? tx_len : server->cfg.ll_octets_max);
+        server->st.ll_octets = server->ll_payload;
+    }
+    gap.pkt_data_lenth_cmpl.params.tx_len = server->ll_payload;
+    gap.pkt_data_lenth_cmpl.params.rx_len = server->ll_payload;
+    gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT, &gap);
+}
+
+static void phy_update_event(void *ctx, uint32_t link_gen, uint32_t masks)
+{
+    /* The instant of LL_PHY_UPDATE_IND, or LL_UNKNOWN_RSP from a server without LE 2M */
+    sim_server_t *server = ctx;
+    if (!server->connected || link_gen != server->link_gen) {
+        return;
+    }
+    esp_ble_gap_cb_param_t gap = { 0 };
+    bool want_2m = (masks & ESP_BLE_GAP_PHY_2M_PREF_MASK) && (masks >> 8) & ESP_BLE_GAP_PHY_2M_PREF_MASK;
+    if (want_2m && server->cfg.phy_2m) {
+        server->st.phy = ESP_BLE_GAP_PHY_2M;
+        gap.phy_update.status = ESP_BT_STATUS_SUCCESS;
+    } else {
+        gap.phy_update.status = ESP_BT_STATUS_UNSUPPORTED;
+    }
+    gap.phy_update.tx_phy = server->st.phy;
+    gap.phy_update.rx_phy = server->st.phy;
+    memcpy(gap.phy_update.bda, server->st.bda, ESP_BD_ADDR_LEN);
+    gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT, &gap);
+}
+
+static void link_down(sim_server_t *server, esp_gatt_conn_reason_t reason)
+{
+    if (!server->connected) {
+        return;
+    }
+    uint64_t now = sim_now_us();
+    s_conns[server->conn_id] = NULL;
+    server->connected  = false;
+    server->discovered = false;
+    server->tx_count     = 0U;
+    server->tx_left      = 0U;
+    server->tx_event     = false;
+    server->wr_count     = 0U;
+    server->wr_left      = 0U;
+    server->wr_pending_pdus = 0U;
+    server->congested    = false;
+    server->prep_len     = 0U;
+    server->link_gen++;
+    server->st.disconnects++;
+    for (uint8_t i = 0; i < server->n_chars; i++) {
+        server->chars[i].cccd_value = 0;
+        server->chars[i].cccd_acked = false;
+        server->chars[i].notify_gen++;
+    }
+
+    esp_ble_gattc_cb_param_t param = { 0 };
+    param.disconnect.reason  = reason;
+    param.disconnect.conn_id = server->conn_id;
+    memcpy(param.disconnect.remote_bda, server->st.bda, ESP_BD_ADDR_LEN);
+    for (uint8_t i = 0; i < s_n_apps; i++) {
+        gattc_post(now, ESP_GATTC_DISCONNECT_EVT, s_apps[i], &param, NULL, NULL, 0);
+    }
+    memset(&param, 0, sizeof(param));
+    param.close.status  = ESP_GATT_OK;
+    param.close.conn_id = server->conn_id;
+    param.close.reason  = reason;
+    memcpy(param.close.remote_bda, server->st.bda, ESP_BD_ADDR_LEN);
+    gattc_post(now, ESP_GATTC_CLOSE_EVT, server->owner_if, &param, NULL, NULL, 0);
+
+    /* Back to advertising */
+    server->adv_gen++;
+    adv_schedule(server, now);
+}
+
+static void adv_event(void *ctx, uint32_t gen, uint32_t unused)
+{
+    (void)unused;
+    sim_server_t *server = ctx;
+    if (gen != server->adv_gen || server->connected) {
+        return;
+    }
+    uint64_t now = sim_now_us();
+    if (now < server->silent_until) {
+        adv_schedule(server, now);
+        return;
+    }
+
+    /* A pending connection request to this device completes on its advertising event */
+    if (server->connecting && s_open_current == server->idx && open_hears(server)) {
+        s_open_current = -1;
+        s_open_gen++;
+        server->adv_gen++;
+        link_up(server);
+        open_next();
+        return;
+    }
+
+    /* A sensor renews its reading on the first advertising event of every period */
+    if (server->mfr_pos && now >= server->reading_at) {
+        uint16_t seq   = (uint16_t)++server->st.readings;
+        int16_t  value = (int16_t)(2000 + (int)(sim_rand() % 500));
+        server->adv[server->mfr_pos]      = (uint8_t)seq;
+        server->adv[server->mfr_pos + 1U] = (uint8_t)(seq >> 8);
+        server->adv[server->mfr_pos + 2U] = (uint8_t)value;
+        server->adv[server->mfr_pos + 3U] = (uint8_t)((uint16_t)value >> 8);
+        server->adv_seq++;
+        server->reading_at = now + SIM_READING_PERIOD_US;
+    }
+
+    /* The controller drops reports from devices outside the accept list before they reach the host, and
+     * duplicates by address and data: a changed reading is reported again */
+    uint8_t phy    = scan_window_phy();
+    bool    report = s_scan.ext ? phy == (server->cfg.adv_phy ? server->cfg.adv_phy : ESP_BLE_GAP_PRI_PHY_1M)
+                                : phy && !server->cfg.adv_phy;
+    report = report && !(s_scan.params.scan_duplicate == BLE_SCAN_DUPLICATE_ENABLE && s_scan.seen[server->idx] == server->adv_seq + 1U) &&
+             !(s_scan.params.scan_filter_policy == BLE_SCAN_FILTER_ALLOW_ONLY_WLST && !whitelisted(server->st.bda));
+    if (report && s_scan.ext) {
+        /* One report with advertising data and scan response; an extended advertiser sends both in its AUX PDU */
+        esp_ble_gap_cb_param_t param = { 0 };
+        esp_ble_gap_ext_adv_reprot_t *rpt = &param.ext_adv_report.params;
+        bool rsp = server->cfg.adv_phy || s_scan.params.scan_type == BLE_SCAN_TYPE_ACTIVE;
+        if (server->cfg.adv_phy) {
+            rpt->event_type   = server->cfg.connectable ? ESP_BLE_GAP_SET_EXT_ADV_PROP_CONNECTABLE : 0;
+            rpt->primary_phy  = server->cfg.adv_phy;
+            rpt->secondly_phy = server->cfg.adv_phy;
+        } else {
+            rpt->event_type   = ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY | ESP_BLE_GAP_SET_EXT_ADV_PROP_SCANNABLE |
+                                (server->cfg.connectable ? ESP_BLE_GAP_SET_EXT_ADV_PROP_CONNECTABLE : 0);
+            rpt->primary_phy  = ESP_BLE_GAP_PRI_PHY_1M;
+        }
+        rpt->addr_type    = server->addr_type;
+        rpt->sid          = 0xFF;
+        rpt->tx_power     = 127;
+        rpt->rssi         = (int8_t)(-40 - (int)(sim_rand() % 50));
+        rpt->data_status  = ESP_BLE_GAP_EXT_ADV_DATA_COMPLETE;
+        rpt->adv_data_len = (uint8_t)(server->adv_len + (rsp ? server->rsp_len : 0));
+        memcpy(rpt->addr, server->st.bda, ESP_BD_ADDR_LEN);
+        memcpy(rpt->adv_data, server->adv, rpt->adv_data_len);
+        s_scan.seen[server->idx] = server->adv_seq + 1U;
+        s_scan.num_resps++;
+        server->st.adv_reports++;
+        gap_dispatch(ESP_GAP_BLE_EXT_ADV_REPORT_EVT, &param);
+    } else if (report) {
+        esp_ble_gap_cb_param_t param = { 0 };
+        param.scan_rst.search_evt    = ESP_GAP_SEARCH_INQ_RES_EVT;
+        param.scan_rst.dev_type      = ESP_BT_DEVICE_TYPE_BLE;
+        param.scan_rst.ble_addr_type = server->addr_type;
+        param.scan_rst.ble_evt_type  = server->cfg.connectable ? ESP_BLE_EVT_CONN_ADV : ESP_BLE_EVT_NON_CONN_ADV;
+        param.scan_rst.rssi          = -40 - (int)(sim_rand() % 50);
+        param.scan_rst.adv_data_len  = server->adv_len;
+        param.scan_rst.scan_rsp_len  = s_scan.params.scan_type == BLE_SCAN_TYPE_ACTIVE ? server->rsp_len : 0;
+        memcpy(param.scan_rst.bda, server->st.bda, ESP_BD_ADDR_LEN);
+        memcpy(param.scan_rst.ble_adv, server->adv, (size_t)server->adv_len + param.scan_rst.scan_rsp_len);
+        s_scan.seen[server->idx] = server->adv_seq + 1U;
+        s_scan.num_resps++;
+        server->st.adv_reports++;
+        gap_dispatch(ESP_GAP_BLE_SCAN_RESULT_EVT, &param);
+    }
+    adv_schedule(server, now);
+}
+
+/* Connection initiation, one at a time */
+static void open_timeout(void *ctx, uint32_t gen, uint32_t unused)
+{
+    (void)unused;
+    sim_server_t *server = ctx;
+    if (gen != s_open_gen || s_open_current != server->idx) {
+        return;
+    }
+    server->connecting = false;
+    s_open_current     = -1;
+    s_open_gen++;
+
+    esp_ble_gattc_cb_param_t param = { 0 };
+    param.open.status = ESP_GATT_ERROR;
+    memcpy(param.open.remote_bda, server->st.bda, ESP_BD_ADDR_LEN);
+    gattc_dispatch(ESP_GATTC_OPEN_EVT, s_open_if, &param);
+    open_next();
+}
+
+static void open_next(void)
+{
+    while (s_open_current < 0 && s_open_count) {
+        sim_open_req_t req = s_open_queue[s_open_head];
+        s_open_head = (uint8_t)((s_open_head + 1) % SIM_OPEN_QUEUE_MAX);
+        s_open_count--;
+
+        sim_server_t *server = &s_servers[req.server];
+        if (server->connected) {
+            esp_ble_gattc_cb_param_t param = { 0 };
+            param.open.status  = ESP_GATT_ALREADY_OPEN;
+            param.open.conn_id = server->conn_id;
+            memcpy(param.open.remote_bda, server->st.bda, ESP_BD_ADDR_LEN);
+            gattc_post(sim_now_us(), ESP_GATTC_OPEN_EVT, req.gattc_if, &param, NULL, NULL, 0);
+            continue;
+        }
+        s_open_current     = req.server;
+        s_open_if          = req.gattc_if;
+        s_open_ext         = req.ext;
+        server->connecting = true;
+        sim_schedule(sim_now_us() + SIM_CONN_TIMEOUT_US, open_timeout, server, ++s_open_gen, 0);
+    }
+}
+
+static void drop_event(void *ctx, uint32_t silent_ms, uint32_t b)
+{
+    (void)b;
+    sim_server_t *server = ctx;
+    server->silent_until = sim_now_us() + SIM_MS(silent_ms);
+    link_down(server, ESP_GATT_CONN_TIMEOUT);
+}
+
+static void close_event(void *ctx, uint32_t link_gen, uint32_t b)
+{
+    (void)b;
+    sim_server_t *server = ctx;
+    if (server->link_gen == link_gen) {
+        link_down(server, ESP_GATT_CONN_TERMINATE_LOCAL_HOST);
+    }
+}
+
+static void db_change_event(void *ctx, uint32_t a, uint32_t b)
+{
+    (void)a;
+    (void)b;
+    sim_server_t *server = ctx;
+    /* Two attributes appear in front of the application services, moving all their handles */
+    for (uint8_t i = 0; i < server->n_svcs; i++) {
+        if (server->svcs[i].start_handle >= SIM_HANDLE_FIRST_APP) {
+            server->svcs[i].start_handle += 2;
+            server->svcs[i].end_handle   += 2;
+        }
+    }
+    for (uint8_t i = 0; i < server->n_chars; i++) {
+        if (server->chars[i].handle >= SIM_HANDLE_FIRST_APP) {
+            server->chars[i].handle      += 2;
+            server->chars[i].cccd_handle += server->chars[i].cccd_handle ? 2 : 0;
+        }
+    }
+    server->next_handle += 2;
+    server->discovered   = false;
+    if (!server->connected) {
+        return;
+    }
+    /* Service Changed indication, reported to the app owning the link */
+    esp_ble_gattc_cb_param_t param = { 0 };
+    memcpy(param.srvc_chg.remote_bda, server->st.bda, ESP_BD_ADDR_LEN);
+    gattc_post(next_conn_event(server, sim_now_us()), ESP_GATTC_SRVC_CHG_EVT, server->owner_if, &param, server, NULL, 0);
+}
+
+static uint16_t notify_len(const sim_server_t *server)
+{
+    return (server->cfg.notify_len > server->mtu - 3) ? (uint16_t)(server->mtu - 3) : server->cfg.notify_len;
+}
+
+static void link_event(void *ctx, uint32_t link_gen, uint32_t unused)
+{
+    /* One connection event: the server sends queued notifications and the client queued write commands, for
+     * as long as the event lasts; each pair carries one PDU each way, so both directions get the full time.
+     * Links on the same interval share the radio, so each gets its share of the interval, and the controller
+     * stops after the time of ce_pdus pairs. ATT requests are timed by att_exchange and not charged here. */
+    (void)unused;
+    sim_server_t *server = ctx;
+    if (!server->connected || link_gen != server->link_gen) {
+        return;
+    }
+    uint32_t event_us = link_event_us(server);
+    uint32_t tx_us    = 0U, wr_us = 0U, pdus = 0U;
+    uint16_t len      = notify_len(server);
+    if (server->ev_at == sim_now_us()) {
+        /* Data queued while the event runs goes out in what is left of it */
+        tx_us = server->ev_tx_us;
+        wr_us = server->ev_wr_us;
+    }
+
+    while (server->tx_count) {
+        /* L2CAP fragments of one notification continue in the next event when this one is full */
+        if (server->tx_left == 0U) {
+            server->tx_left = (uint16_t)(len + SIM_L2CAP_ATT_HDR);
+        }
+        if (!link_send(server, &server->tx_left, event_us, &tx_us, &pdus)) {
+            break;
+        }
+        sim_char_t *chr = &server->chars[server->tx_q[server->tx_head]];
+        server->tx_head = (uint8_t)((server->tx_head + 1U) % SIM_NOTIFY_QUEUE_MAX);
+        server->tx_count--;
+
+        uint8_t value[ESP_GATT_MAX_MTU_SIZE];
+        fill_value(server, value, len);
+        esp_ble_gattc_cb_param_t param = { 0 };
+        param.notify.conn_id   = server->conn_id;
+        param.notify.handle    = chr->handle;
+        param.notify.value_len = len;
+        param.notify.value     = value;
+        param.notify.is_notify = true;
+        memcpy(param.notify.remote_bda, server->st.bda, ESP_BD_ADDR_LEN);
+        server->st.notifies++;
+        server->st.notify_bytes += len;
+        gattc_dispatch(ESP_GATTC_NOTIFY_EVT, server->owner_if, &param);
+        if (!server->connected || link_gen != server->link_gen) {
+            return;
+        }
+    }
+    while (server->wr_count) {
+        sim_write_cmd_t *cmd = &server->wr_q[server->wr_head];
+        if (server->wr_left == 0U) {
+            server->wr_left = (uint16_t)(cmd->len + SIM_L2CAP_ATT_HDR);
+        }
+        pdus = 0U;
+        bool sent = link_send(server, &server->wr_left, event_us, &wr_us, &pdus);
+        server->wr_pending_pdus -= pdus;
+        if (!sent) {
+            break;
+        }
+        esp_gatt_if_t gattc_if = cmd->gattc_if;
+        esp_ble_gattc_cb_param_t param = { 0 };
+        param.write.status  = ESP_GATT_OK;
+        param.write.conn_id = server->conn_id;
+        param.write.handle  = cmd->handle;
+        server->wr_head = (uint8_t)((server->wr_head + 1U) % SIM_WRITE_QUEUE_MAX);
+        server->wr_count--;
+        server->st.writes++;
+        server->st.write_bytes += cmd->len;
+        /* Bluedroid reports a write command once it is handed to the controller */
+        gattc_dispatch(ESP_GATTC_WRITE_CHAR_EVT, gattc_if, &param);
+        if (!server->connected || link_gen != server->link_gen) {
+            return;
+        }
+    }
+    if (server->congested && server->wr_pending_pdus <= SIM_ACL_CONGEST_PDUS / 2U) {
+        esp_ble_gattc_cb_param_t param = { 0 };
+        server->congested         = false;
+        param.congest.conn_id   = server->conn_id;
+        param.congest.congested = false;
+        gattc_dispatch(ESP_GATTC_CONGEST_EVT, server->owner_if, &param);
+        if (!server->connected || link_gen != server->link_gen) {
+            return;
+        }
+    }
+
+    server->ev_at    = sim_now_us();
+    server->ev_tx_us = tx_us;
+    server->ev_wr_us = wr_us;
+    server->tx_event = server->tx_count != 0U || server->wr_count != 0U;
+    if (server->tx_event) {
+        sim_schedule(next_conn_event(server, sim_now_us() + 1U), link_event, server, link_gen, 0);
+    }
+}
+
+static void notify_tick(void *ctx, uint32_t chr_idx, uint32_t gen)
+{
+    sim_server_t *server = ctx;
+    sim_char_t   *chr    = &server->chars[chr_idx];
+    if (!server->connected || gen != chr->notify_gen || !(chr->cccd_value & 0x0001)) {
+        return;
+    }
+    /* The application hands the value to its stack; it goes out at the next connection event with room */
+    if (server->tx_count == SIM_NOTIFY_QUEUE_MAX) {
+        server->st.notify_drops++;
+    } else {
+        server->tx_q[(server->tx_head + server->tx_count) % SIM_NOTIFY_QUEUE_MAX] = (uint8_t)chr_idx;
+        server->tx_count++;
+        if (!server->tx_event) {
+            server->tx_event = true;
+            sim_schedule(next_conn_event(server, sim_now_us()), link_event, server, server->link_gen, 0);
+        }
+    }
+    sim_schedule(sim_now_us() + server->cfg.notify_period_us, notify_tick, server, chr_idx, gen);
+}
+
+/* Driver API */
+void sim_stream_uuid(uint8_t stream, esp_bt_uuid_t *svc_uuid, esp_bt_uuid_t *char_uuid)
+{
+    static const uint8_t base[ESP_UUID_LEN_128] = SIM_STREAM_UUID128;
+    if (stream < 2U) {
+        *svc_uuid  = uuid16(stream ? SIM_STREAM_SVC_B : SIM_STREAM_SVC_A);
+        *char_uuid = uuid16(stream ? SIM_STREAM_CHAR_B : SIM_STREAM_CHAR_A);
+        return;
+    }
+    svc_uuid->len = ESP_UUID_LEN_128;
+    memcpy(svc_uuid->uuid.uuid128, base, ESP_UUID_LEN_128);
+    *char_uuid = *svc_uuid;
+    char_uuid->uuid.uuid128[12] = (uint8_t)(stream - 1U);
+}
+
+void sim_server_cfg_default(sim_server_cfg_t *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->adv_interval_us  = 100000U;
+    cfg->conn_interval_us = 30000U;
+    cfg->mtu              = 500U;
+    cfg->discovery_rtts   = 6U;
+    cfg->notify_period_us = 0U;
+    cfg->notify_len       = 20U;
+    cfg->streams          = 2U;
+    cfg->ce_pdus          = 6U;
+    cfg->connectable      = true;
+    cfg->db_hash          = true;
+    cfg->ll_octets_max    = SIM_LL_PAYLOAD_MAX;
+    cfg->phy_2m           = true;
+    cfg->read_multi       = true;
+}
+
+int sim_add_server(const char *name, const sim_server_cfg_t *cfg)
+{
+    if (s_n_servers == (int)SIM_SERVER_MAX) {
+        return -1;
+    }
+    sim_server_t *server = &s_servers[s_n_servers];
+    memset(server, 0, sizeof(*server));
+    server->idx         = s_n_servers;
+    server->cfg         = *cfg;
+    server->addr_type   = BLE_ADDR_TYPE_PUBLIC;
+    server->next_handle = 1;
+    strncpy(server->st.name, name, sizeof(server->st.name) - 1);
+    server->st.connectable = cfg->connectable;
+
+    uint32_t r = sim_rand();
+    uint8_t bda[ESP_BD_ADDR_LEN] = { 0x24, 0x0A, (uint8_t)(r >> 8), (uint8_t)r, (uint8_t)(server->idx >> 8), (uint8_t)server->idx };
+    memcpy(server->st.bda, bda, ESP_BD_ADDR_LEN);
+
+    /* Adv: flags + complete name (+ manufacturer data); scan response: 16-bit service list */
+    size_t name_max = ESP_BLE_ADV_DATA_LEN_MAX - 5 - (cfg->mfr_id ? SIM_MFR_AD_LEN : 0U);
+    size_t name_len = strlen(server->st.name);
+    if (name_len > name_max) {
+        name_len = name_max;
+    }
+    uint8_t *adv = server->adv;
+    adv[0] = 0x02;
+    adv[1] = ESP_BLE_AD_TYPE_FLAG;
+    adv[2] = 0x06;
+    adv[3] = (uint8_t)(name_len + 1);
+    adv[4] = ESP_BLE_AD_TYPE_NAME_CMPL;
+    memcpy(&adv[5], server->st.name, name_len);
+    server->adv_len = (uint8_t)(5 + name_len);
+    if (cfg->mfr_id) {
+        uint8_t *mfr = &adv[server->adv_len];
+        mfr[0] = SIM_MFR_AD_LEN - 1U;
+        mfr[1] = ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE;
+        mfr[2] = (uint8_t)cfg->mfr_id;
+        mfr[3] = (uint8_t)(cfg->mfr_id >> 8);
+        memset(&mfr[4], 0, 4);
+        server->mfr_pos    = (uint8_t)(server->adv_len + 4U);
+        server->adv_len    = (uint8_t)(server->adv_len + SIM_MFR_AD_LEN);
+        server->reading_at = sim_now_us();
+    }
+    uint8_t *rsp = &adv[server->adv_len];
+    rsp[0] = 0x03;
+    rsp[1] = ESP_BLE_AD_TYPE_16SRV_CMPL;
+    rsp[2] = 0xFF;
+    rsp[3] = 0x00;
+    server->rsp_len = 4;
+
+    /* GATT service with Service Changed, then the demo services the client looks for */
+    sim_server_add_char(server->idx, 0x1801, ESP_GATT_UUID_GATT_SRV_CHGD, ESP_GATT_CHAR_PROP_BIT_INDICATE);
+    if (cfg->db_hash) {
+        sim_server_add_char(server->idx, 0x1801, SIM_DB_HASH_UUID, ESP_GATT_CHAR_PROP_BIT_READ);
+    }
+    for (uint8_t i = 0; i < (cfg->streams ? cfg->streams : 1U); i++) {
+        esp_bt_uuid_t svc, chr;
+        sim_stream_uuid(i, &svc, &chr);
+        sim_server_add_char_uuid(server->idx, &svc, &chr,
+                                 ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_NOTIFY);
+    }
+
+    sim_schedule(sim_rand() % (cfg->adv_interval_us ? cfg->adv_interval_us : 1U), adv_event, server, 0, 0);
+    return s_n_servers++;
+}
+
+void sim_drop_link_at(int server, uint64_t at_us, uint32_t silent_ms)
+{
+    sim_schedule(at_us, drop_event, &s_servers[server], silent_ms, 0);
+}
+
+void sim_db_change_at(int server, uint64_t at_us)
+{
+    sim_schedule(at_us, db_change_event, &s_servers[server], 0, 0);
+}
+
+int sim_server_count(void)
+{
+    return s_n_servers;
+}
+
+const sim_server_stats_t *sim_get_server_stats(int server)
+{
+    return &s_servers[server].st;
+}
+
+/* Controller & host stack */
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *cfg)
+{
+    (void)cfg;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode)
+{
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode)
+{
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_enable(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_disable(void)
+{
+    return ESP_OK;
+}
+
+/* GAP */
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback)
+{
+    s_gap_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_scan_params(esp_ble_scan_params_t *scan_params)
+{
+    esp_ble_gap_cb_param_t param = { 0 };
+    if (scan_params->scan_window > scan_params->scan_interval || scan_params->scan_interval < 4) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_scan.params = *scan_params;
+    s_scan.ext    = false;
+    param.scan_param_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT, &param);
+    return ESP_OK;
+}
+
+static void scan_timeout(void *ctx, uint32_t gen, uint32_t unused)
+{
+    (void)ctx;
+    (void)unused;
+    if (!s_scan.active || gen != s_scan.gen) {
+        return;
+    }
+    s_scan.active = false;
+    s_scan.gen++;
+    esp_ble_gap_cb_param_t param = { 0 };
+    if (s_scan.ext) {
+        gap_dispatch(ESP_GAP_BLE_SCAN_TIMEOUT_EVT, &param);
+        return;
+    }
+    param.scan_rst.search_evt = ESP_GAP_SEARCH_INQ_CMPL_EVT;
+    param.scan_rst.num_resps  = (int)s_scan.num_resps;
+    gap_dispatch(ESP_GAP_BLE_SCAN_RESULT_EVT, &param);
+}
+
+/* Starts the scan set up last, legacy or extended; the duration in us, 0 until stopped */
+static bool scan_start(uint64_t duration_us)
+{
+    uint64_t now = sim_now_us();
+    if (s_scan.active || s_scan.params.scan_interval == 0) {
+        return false;
+    }
+    sim_stats_t *stats = sim_stats_mut();
+    if (stats->scan_starts++ == 0) {
+        stats->t_scan_start = now;
+    }
+    s_scan.active    = true;
+    s_scan.t_start   = now + SIM_HCI_DELAY_US;
+    s_scan.num_resps = 0;
+    s_scan.gen++;
+    memset(s_scan.seen, 0, sizeof(s_scan.seen));
+    if (duration_us) {
+        sim_schedule(s_scan.t_start + duration_us, scan_timeout, NULL, s_scan.gen, 0);
+    }
+    return true;
+}
+
+esp_err_t esp_ble_gap_start_scanning(uint32_t duration)
+{
+    esp_ble_gap_cb_param_t param = { 0 };
+    if (s_scan.ext) {
+        /* Set up for an extended scan: the controller rejects mixing legacy and extended commands */
+        param.scan_start_cmpl.status = ESP_BT_STATUS_FAIL;
+    } else {
+        param.scan_start_cmpl.status = scan_start(SIM_SEC(duration)) ? ESP_BT_STATUS_SUCCESS : ESP_BT_STATUS_FAIL;
+    }
+    gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_SCAN_START_COMPLETE_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_stop_scanning(void)
+{
+    esp_ble_gap_cb_param_t param = { 0 };
+    s_scan.active = false;
+    s_scan.gen++;
+    param.scan_stop_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_ext_scan_params(const esp_ble_ext_scan_params_t *params)
+{
+    const esp_ble_ext_scan_cfg_t *cfg = (params->cfg_mask & ESP_BLE_GAP_EXT_SCAN_CFG_UNCODE_MASK) ? &params->uncoded_cfg
+                                                                                                  : &params->coded_cfg;
+    if (!(params->cfg_mask & (ESP_BLE_GAP_EXT_SCAN_CFG_UNCODE_MASK | ESP_BLE_GAP_EXT_SCAN_CFG_CODE_MASK)) ||
+        cfg->scan_window > cfg->scan_interval || cfg->scan_interval < 4) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_scan.params.scan_type          = cfg->scan_type;
+    s_scan.params.scan_interval      = cfg->scan_interval;
+    s_scan.params.scan_window        = cfg->scan_window;
+    s_scan.params.own_addr_type      = params->own_addr_type;
+    s_scan.params.scan_filter_policy = params->filter_policy;
+    s_scan.params.scan_duplicate     = params->scan_duplicate;
+    s_scan.ext  = true;
+    s_scan.phys = params->cfg_mask;
+    esp_ble_gap_cb_param_t param = { 0 };
+    param.set_ext_scan_params.status = ESP_BT_STATUS_SUCCESS;
+    gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_SET_EXT_SCAN_PARAMS_COMPLETE_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_start_ext_scan(uint32_t duration, uint16_t period)
+{
+    (void)period;
+    esp_ble_gap_cb_param_t param = { 0 };
+    bool ok = s_scan.ext && scan_start((uint64_t)duration * 10000U);
+    param.ext_scan_start.status = ok ? ESP_BT_STATUS_SUCCESS : ESP_BT_STATUS_FAIL;
+    gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_EXT_SCAN_START_COMPLETE_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_stop_ext_scan(void)
+{
+    esp_ble_gap_cb_param_t param = { 0 };
+    s_scan.active = false;
+    s_scan.gen++;
+    param.ext_scan_stop.status = ESP_BT_STATUS_SUCCESS;
+    gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_EXT_SCAN_STOP_COMPLETE_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_prefer_ext_connect_params_set(esp_bd_addr_t addr, esp_ble_gap_phy_mask_t phy_mask,
+                                                    const esp_ble_gap_conn_params_t *phy_1m_conn_params,
+                                                    const esp_ble_gap_conn_params_t *phy_2m_conn_params,
+                                                    const esp_ble_gap_conn_params_t *phy_coded_conn_params)
+{
+    (void)phy_1m_conn_params;
+    (void)phy_2m_conn_params;
+    (void)phy_coded_conn_params;
+    esp_ble_gap_cb_param_t param = { 0 };
+    sim_server_t *server = server_by_bda(addr);
+    if (server) {
+        server->conn_phys = phy_mask;
+    }
+    param.set_ext_conn_params.status = ESP_BT_STATUS_SUCCESS;
+    gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_PREFER_EXT_CONN_PARAMS_SET_COMPLETE_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t *params)
+{
+    sim_server_t *server = server_by_bda(params->bda);
+    if (!server || !server->connected) {
+        return ESP_FAIL;
+    }
+    /* Core spec ranges; the central takes the shortest interval asked for */
+    bool valid = params->min_int >= 6U && params->max_int <= 3200U && params->min_int <= params->max_int &&
+                 params->latency <= 499U && params->timeout >= 10U && params->timeout <= 3200U &&
+                 (uint32_t)params->timeout * 10000U > (1U + params->latency) * params->max_int * 1250U * 2U;
+    if (!valid) {
+        esp_ble_gap_cb_param_t gap = { 0 };
+        gap.update_conn_params.status = ESP_BT_STATUS_PARM_INVALID;
+        memcpy(gap.update_conn_params.bda, server->st.bda, ESP_BD_ADDR_LEN);
+        gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, &gap);
+        return ESP_OK;
+    }
+    /* A request made before the instant replaces the pending one */
+    bool scheduled      = server->upd_pending;
+    server->upd_pending = true;
+    server->upd_int     = params->min_int;
+    server->upd_latency = params->latency;
+    server->upd_timeout = params->timeout;
+    if (!scheduled) {
+        sim_schedule(next_conn_event(server, sim_now_us()) + 6ULL * server->ci_us, conn_update_event, server, server->link_gen, 0);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t remote_device, uint16_t tx_data_length)
+{
+    sim_server_t *server = server_by_bda(remote_device);
+    if (!server || !server->connected) {
+        return ESP_FAIL;
+    }
+    if (tx_data_length < SIM_LL_PAYLOAD || tx_data_length > SIM_LL_PAYLOAD_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    /* Request in the next connection event, response in the one after */
+    sim_schedule(next_conn_event(server, sim_now_us()) + server->ci_us, data_len_event, server, server->link_gen,
+                 tx_data_length);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_prefered_phy(esp_bd_addr_t bd_addr, esp_ble_gap_all_phys_t all_phys_mask, esp_ble_gap_phy_mask_t tx_phy_mask,
+                                       esp_ble_gap_phy_mask_t rx_phy_mask, esp_ble_gap_prefer_phy_options_t phy_options)
+{
+    (void)all_phys_mask;
+    (void)phy_options;
+    sim_server_t *server = server_by_bda(bd_addr);
+    if (!server || !server->connected) {
+        return ESP_FAIL;
+    }
+    esp_ble_gap_cb_param_t gap = { 0 };
+    gap.set_perf_phy.status = ESP_BT_STATUS_SUCCESS;
+    gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_SET_PREFERED_PHY_COMPLETE_EVT, &gap);
+    /* LL_PHY_REQ/RSP, then the update instant a few events later */
+    sim_schedule(next_conn_event(server, sim_now_us()) + 3ULL * server->ci_us, phy_update_event, server, server->link_gen,
+                 (uint32_t)tx_phy_mask | ((uint32_t)rx_phy_mask << 8));
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_update_whitelist(bool add_remove, esp_bd_addr_t remote_bda, esp_ble_wl_addr_type_t wl_addr_type)
+{
+    (void)wl_addr_type;
+    esp_ble_gap_cb_param_t param = { 0 };
+    uint8_t i = 0;
+    while (i < s_whitelist_count && memcmp(s_whitelist[i], remote_bda, ESP_BD_ADDR_LEN) != 0) {
+        i++;
+    }
+    param.update_whitelist_cmpl.status      = ESP_BT_STATUS_SUCCESS;
+    param.update_whitelist_cmpl.wl_opration = add_remove ? ESP_BLE_WHITELIST_ADD : ESP_BLE_WHITELIST_REMOVE;
+    if (add_remove && i == s_whitelist_count) {
+        if (s_whitelist_count == SIM_WHITELIST_MAX) {
+            param.update_whitelist_cmpl.status = ESP_BT_STATUS_FAIL;
+        } else {
+            memcpy(s_whitelist[s_whitelist_count++], remote_bda, ESP_BD_ADDR_LEN);
+        }
+    } else if (!add_remove && i < s_whitelist_count) {
+        memcpy(s_whitelist[i], s_whitelist[--s_whitelist_count], ESP_BD_ADDR_LEN);
+    }
+    gap_post(sim_now_us() + SIM_HCI_DELAY_US, ESP_GAP_BLE_UPDATE_WHITELIST_COMPLETE_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_clear_whitelist(void)
+{
+    s_whitelist_count = 0;
+    return ESP_OK;
+}
+
+uint8_t *esp_ble_resolve_adv_data(uint8_t *adv_data, uint8_t type, uint8_t *length)
+{
+    /* Same walk as the Bluedroid implementation: adv data and scan response back to back */
+    uint8_t pos = 0;
+    while (adv_data && pos < ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX) {
+        uint8_t ad_len = adv_data[pos];
+        if (ad_len == 0 || pos + ad_len >= ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX) {
+            break;
+        }
+        if (adv_data[pos + 1] == type) {
+            *length = (uint8_t)(ad_len - 1);
+            return &adv_data[pos + 2];
+        }
+        pos = (uint8_t)(pos + ad_len + 1);
+    }
+    *length = 0;
+    return NULL;
+}
+
+/* GATT client */
+esp_err_t esp_ble_gattc_register_callback(esp_gattc_cb_t callback)
+{
+    s_gattc_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_app_register(uint16_t app_id)
+{
+    esp_ble_gattc_cb_param_t param = { 0 };
+    esp_gatt_if_t gattc_if = ESP_GATT_IF_NONE;
+    param.reg.app_id = app_id;
+    if (s_n_apps == SIM_APP_MAX) {
+        param.reg.status = ESP_GATT_NO_RESOURCES;
+    } else {
+        gattc_if = (esp_gatt_if_t)(s_n_apps + 3U);  /* Bluedroid hands out small interface numbers */
+        s_apps[s_n_apps++] = gattc_if;
+        param.reg.status = ESP_GATT_OK;
+    }
+    /* Registration never leaves the host stack */
+    gattc_post(sim_now_us(), ESP_GATTC_REG_EVT, gattc_if, &param, NULL, NULL, 0);
+    sim_btc_yield();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_app_unregister(esp_gatt_if_t gattc_if)
+{
+    for (uint8_t i = 0; i < s_n_apps; i++) {
+        if (s_apps[i] == gattc_if) {
+            s_apps[i] = s_apps[--s_n_apps];
+            return ESP_OK;
+        }
+    }
+    return ESP_FAIL;
+}
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu)
+{
+    if (mtu < ESP_GATT_DEF_BLE_MTU_SIZE || mtu > ESP_GATT_MAX_MTU_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s_local_mtu = mtu;
+    return ESP_OK;
+}
+
+static esp_err_t open_request(esp_gatt_if_t gattc_if, esp_bd_addr_t remote_bda, bool ext)
+{
+    sim_server_t *server = server_by_bda(remote_bda);
+    sim_stats_mut()->opens++;
+    if (!server || !server->cfg.connectable || s_open_count == SIM_OPEN_QUEUE_MAX) {
+        esp_ble_gattc_cb_param_t param = { 0 };
+        param.open.status = ESP_GATT_ERROR;
+        memcpy(param.open.remote_bda, remote_bda, ESP_BD_ADDR_LEN);
+        gattc_post(sim_now_us() + SIM_CONN_TIMEOUT_US, ESP_GATTC_OPEN_EVT, gattc_if, &param, NULL, NULL, 0);
+        return ESP_OK;
+    }
+    uint8_t tail = (uint8_t)((s_open_head + s_open_count) % SIM_OPEN_QUEUE_MAX);
+    s_open_queue[tail].server   = server->idx;
+    s_open_queue[tail].gattc_if = gattc_if;
+    s_open_queue[tail].ext      = ext;
+    s_open_count++;
+    open_next();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_open(esp_gatt_if_t gattc_if, esp_bd_addr_t remote_bda, esp_ble_addr_type_t remote_addr_type, bool is_direct)
+{
+    (void)remote_addr_type;
+    (void)is_direct;
+    return open_request(gattc_if, remote_bda, false);
+}
+
+esp_err_t esp_ble_gattc_aux_open(esp_gatt_if_t gattc_if, esp_bd_addr_t remote_bda, esp_ble_addr_type_t remote_addr_type, bool is_direct)
+{
+    (void)remote_addr_type;
+    (void)is_direct;
+    return open_request(gattc_if, remote_bda, true);
+}
+
+esp_err_t esp_ble_gattc_close(esp_gatt_if_t gattc_if, uint16_t conn_id)
+{
+    (void)gattc_if;
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server) {
+        return ESP_FAIL;
+    }
+    sim_schedule(next_conn_event(server, sim_now_us()), close_event, server, server->link_gen, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_send_mtu_req(esp_gatt_if_t gattc_if, uint16_t conn_id)
+{
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server || server->mtu_exchanged) {
+        return ESP_FAIL;
+    }
+    server->mtu_exchanged = true;
+    uint16_t mtu = s_local_mtu < server->cfg.mtu ? s_local_mtu : server->cfg.mtu;
+    uint64_t at  = att_exchange(server, 1);
+    server->mtu  = mtu;
+
+    esp_ble_gattc_cb_param_t param = { 0 };
+    param.cfg_mtu.status  = ESP_GATT_OK;
+    param.cfg_mtu.conn_id = conn_id;
+    param.cfg_mtu.mtu     = mtu;
+    gattc_post(at, ESP_GATTC_CFG_MTU_EVT, gattc_if, &param, server, NULL, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_search_service(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_bt_uuid_t *filter_uuid)
+{
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server) {
+        return ESP_FAIL;
+    }
+    /* The full database is discovered once per connection; later searches read the local copy */
+    uint64_t at = server->discovered ? sim_now_us() + SIM_HCI_DELAY_US : att_exchange(server, server->cfg.discovery_rtts);
+    server->discovered = true;
+
+    esp_ble_gattc_cb_param_t param = { 0 };
+    param.dis_srvc_cmpl.status  = ESP_GATT_OK;
+    param.dis_srvc_cmpl.conn_id = conn_id;
+    gattc_post(at, ESP_GATTC_DIS_SRVC_CMPL_EVT, gattc_if, &param, server, NULL, 0);
+
+    for (uint8_t i = 0; i < server->n_svcs; i++) {
+        if (filter_uuid && !uuid_equal(filter_uuid, &server->svcs[i].uuid)) {
+            continue;
+        }
+        memset(&param, 0, sizeof(param));
+        param.search_res.conn_id        = conn_id;
+        param.search_res.start_handle   = server->svcs[i].start_handle;
+        param.search_res.end_handle     = server->svcs[i].end_handle;
+        param.search_res.srvc_id.uuid   = server->svcs[i].uuid;
+        param.search_res.srvc_id.inst_id = 0;
+        param.search_res.is_primary     = true;
+        gattc_post(at, ESP_GATTC_SEARCH_RES_EVT, gattc_if, &param, server, NULL, 0);
+    }
+
+    memset(&param, 0, sizeof(param));
+    param.search_cmpl.status                  = ESP_GATT_OK;
+    param.search_cmpl.conn_id                 = conn_id;
+    param.search_cmpl.searched_service_source = ESP_GATT_SERVICE_FROM_REMOTE_DEVICE;
+    gattc_post(at, ESP_GATTC_SEARCH_CMPL_EVT, gattc_if, &param, server, NULL, 0);
+    return ESP_OK;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_service(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_bt_uuid_t *svc_uuid,
+                                            esp_gattc_service_elem_t *result, uint16_t *count, uint16_t offset)
+{
+    (void)gattc_if;
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server || !server->discovered) {
+        *count = 0;
+        return ESP_GATT_INVALID_HANDLE;
+    }
+    uint16_t found = 0, skipped = 0;
+    for (uint8_t i = 0; i < server->n_svcs && found < *count; i++) {
+        if (svc_uuid && !uuid_equal(svc_uuid, &server->svcs[i].uuid)) {
+            continue;
+        }
+        if (skipped++ < offset) {
+            continue;
+        }
+        result[found].is_primary   = true;
+        result[found].start_handle = server->svcs[i].start_handle;
+        result[found].end_handle   = server->svcs[i].end_handle;
+        result[found].uuid         = server->svcs[i].uuid;
+        found++;
+    }
+    *count = found;
+    return found ? ESP_GATT_OK : ESP_GATT_NOT_FOUND;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_all_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t start_handle, uint16_t end_handle,
+                                             esp_gattc_char_elem_t *result, uint16_t *count, uint16_t offset)
+{
+    (void)gattc_if;
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server || !server->discovered) {
+        *count = 0;
+        return ESP_GATT_INVALID_HANDLE;
+    }
+    uint16_t found = 0, skipped = 0;
+    for (uint8_t i = 0; i < server->n_chars && found < *count; i++) {
+        const sim_char_t *chr = &server->chars[i];
+        if (chr->handle < start_handle || chr->handle > end_handle || skipped++ < offset) {
+            continue;
+        }
+        result[found].char_handle = chr->handle;
+        result[found].properties  = chr->properties;
+        result[found].uuid        = chr->uuid;
+        found++;
+    }
+    *count = found;
+    return found ? ESP_GATT_OK : ESP_GATT_NOT_FOUND;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_attr_count(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_gatt_db_attr_type_t type,
+                                               uint16_t start_handle, uint16_t end_handle, uint16_t char_handle, uint16_t *count)
+{
+    (void)gattc_if;
+    sim_server_t *server = server_by_conn(conn_id);
+    *count = 0;
+    if (!server || !server->discovered) {
+        return ESP_GATT_INVALID_HANDLE;
+    }
+    switch (type) {
+        case ESP_GATT_DB_PRIMARY_SERVICE:
+            for (uint8_t i = 0; i < server->n_svcs; i++) {
+                *count += server->svcs[i].start_handle >= start_handle && server->svcs[i].end_handle <= end_handle;
+            }
+            break;
+        case ESP_GATT_DB_CHARACTERISTIC:
+            for (uint8_t i = 0; i < server->n_chars; i++) {
+                *count += server->chars[i].handle >= start_handle && server->chars[i].handle <= end_handle;
+            }
+            break;
+        case ESP_GATT_DB_DESCRIPTOR: {
+            sim_char_t *chr = char_by_handle(server, char_handle);
+            *count = (chr && chr->cccd_handle) ? 1 : 0;
+            break;
+        }
+        default:
+            return ESP_GATT_ILLEGAL_PARAMETER;
+    }
+    return ESP_GATT_OK;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_char_by_uuid(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t start_handle, uint16_t end_handle,
+                                                 esp_bt_uuid_t char_uuid, esp_gattc_char_elem_t *result, uint16_t *count)
+{
+    (void)gattc_if;
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server || !server->discovered) {
+        *count = 0;
+        return ESP_GATT_INVALID_HANDLE;
+    }
+    uint16_t found = 0;
+    for (uint8_t i = 0; i < server->n_chars && found < *count; i++) {
+        const sim_char_t *chr = &server->chars[i];
+        if (chr->handle < start_handle || chr->handle > end_handle || !uuid_equal(&chr->uuid, &char_uuid)) {
+            continue;
+        }
+        result[found].char_handle = chr->handle;
+        result[found].properties  = chr->properties;
+        result[found].uuid        = chr->uuid;
+        found++;
+    }
+    *count = found;
+    return found ? ESP_GATT_OK : ESP_GATT_NOT_FOUND;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_descr_by_char_handle(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t char_handle,
+                                                         esp_bt_uuid_t descr_uuid, esp_gattc_descr_elem_t *result, uint16_t *count)
+{
+    (void)gattc_if;
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server || !server->discovered) {
+        *count = 0;
+        return ESP_GATT_INVALID_HANDLE;
+    }
+    esp_bt_uuid_t cccd = uuid16(ESP_GATT_UUID_CHAR_CLIENT_CONFIG);
+    sim_char_t   *chr  = char_by_handle(server, char_handle);
+    if (!chr || !chr->cccd_handle || *count == 0 || !uuid_equal(&descr_uuid, &cccd)) {
+        *count = 0;
+        return ESP_GATT_NOT_FOUND;
+    }
+    result[0].handle = chr->cccd_handle;
+    result[0].uuid   = cccd;
+    *count = 1;
+    return ESP_GATT_OK;
+}
+
+esp_err_t esp_ble_gattc_read_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, esp_gatt_auth_req_t auth_req)
+{
+    (void)auth_req;
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server) {
+        return ESP_FAIL;
+    }
+    esp_ble_gattc_cb_param_t param = { 0 };
+    uint8_t value[SIM_DB_HASH_LEN];
+    uint16_t len = 0;
+    sim_char_t *chr = char_by_handle(server, handle);
+    param.read.conn_id = conn_id;
+    param.read.handle  = handle;
+    if (!chr) {
+        param.read.status = ESP_GATT_INVALID_HANDLE;
+    } else if (!(chr->properties & ESP_GATT_CHAR_PROP_BIT_READ)) {
+        param.read.status = ESP_GATT_READ_NOT_PERMIT;
+    } else {
+        param.read.status = ESP_GATT_OK;
+        len = char_value(server, chr, value);
+        param.read.value_len = len;
+    }
+    server->st.reads++;
+    gattc_post(att_exchange(server, 1), ESP_GATTC_READ_CHAR_EVT, gattc_if, &param, server, value, len);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_read_multiple(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_gattc_multi_t *read_multi, esp_gatt_auth_req_t auth_req)
+{
+    (void)auth_req;
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server || !read_multi || read_multi->num_attr == 0U || read_multi->num_attr > ESP_GATTC_MULTI_MAX) {
+        return ESP_FAIL;
+    }
+    /* Values concatenated in one Read Multiple response, cut at MTU - 1; the first failing handle fails it all */
+    esp_ble_gattc_cb_param_t param = { 0 };
+    uint8_t  value[ESP_GATTC_MULTI_MAX * SIM_DB_HASH_LEN];
+    uint8_t  one[SIM_DB_HASH_LEN];
+    uint16_t len = 0;
+    param.read.conn_id = conn_id;
+    param.read.handle  = read_multi->handles[0];
+    param.read.status  = server->cfg.read_multi ? ESP_GATT_OK : ESP_GATT_REQ_NOT_SUPPORTED;
+    for (uint8_t i = 0; i < read_multi->num_attr && param.read.status == ESP_GATT_OK; i++) {
+        sim_char_t *chr = char_by_handle(server, read_multi->handles[i]);
+        if (!chr) {
+            param.read.status = ESP_GATT_INVALID_HANDLE;
+            param.read.handle = read_multi->handles[i];
+        } else if (!(chr->properties & ESP_GATT_CHAR_PROP_BIT_READ)) {
+            param.read.status = ESP_GATT_READ_NOT_PERMIT;
+            param.read.handle = read_multi->handles[i];
+        } else {
+            uint16_t n = char_value(server, chr, one);
+            if (n > server->mtu - 1U - len) {
+                n = (uint16_t)(server->mtu - 1U - len);
+            }
+            memcpy(&value[len], one, n);
+            len = (uint16_t)(len + n);
+        }
+    }
+    if (param.read.status != ESP_GATT_OK) {
+        len = 0;
+    }
+    param.read.value_len = len;
+    server->st.reads++;
+    gattc_post(att_exchange(server, 1), ESP_GATTC_READ_MULTIPLE_EVT, gattc_if, &param, server, value, len);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_read_by_type(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t start_handle, uint16_t end_handle,
+                                     esp_bt_uuid_t *uuid, esp_gatt_auth_req_t auth_req)
+{
+    (void)auth_req;
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server || !uuid) {
+        return ESP_FAIL;
+    }
+    /* First matching value in the range, as a single Read By Type request */
+    esp_ble_gattc_cb_param_t param = { 0 };
+    uint8_t value[SIM_DB_HASH_LEN];
+    uint16_t len = 0;
+    sim_char_t *chr = NULL;
+    for (uint8_t i = 0; i < server->n_chars && !chr; i++) {
+        if (server->chars[i].handle >= start_handle && server->chars[i].handle <= end_handle &&
+            uuid_equal(&server->chars[i].uuid, uuid)) {
+            chr = &server->chars[i];
+        }
+    }
+    param.read.conn_id = conn_id;
+    if (!chr) {
+        param.read.status = ESP_GATT_NOT_FOUND;
+    } else if (!(chr->properties & ESP_GATT_CHAR_PROP_BIT_READ)) {
+        param.read.status = ESP_GATT_READ_NOT_PERMIT;
+        param.read.handle = chr->handle;
+    } else {
+        param.read.status    = ESP_GATT_OK;
+        param.read.handle    = chr->handle;
+        len                  = char_value(server, chr, value);
+        param.read.value_len = len;
+    }
+    server->st.reads++;
+    gattc_post(att_exchange(server, 1), ESP_GATTC_READ_CHAR_EVT, gattc_if, &param, server, value, len);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len, uint8_t *value,
+                                   esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req)
+{
+    (void)value;
+    (void)auth_req;
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server) {
+        return ESP_FAIL;
+    }
+    esp_ble_gattc_cb_param_t param = { 0 };
+    sim_char_t *chr = char_by_handle(server, handle);
+    param.write.conn_id = conn_id;
+    param.write.handle  = handle;
+    if (!chr || value_len > server->mtu - 3) {
+        param.write.status = chr ? ESP_GATT_INVALID_ATTR_LEN : ESP_GATT_INVALID_HANDLE;
+    } else {
+        param.write.status = ESP_GATT_OK;
+    }
+    if (write_type == ESP_GATT_WRITE_TYPE_NO_RSP && param.write.status == ESP_GATT_OK) {
+        /* Write commands do not hold the bearer; they queue for the link, see link_event */
+        if (server->wr_count == SIM_WRITE_QUEUE_MAX) {
+            return ESP_FAIL;
+        }
+        sim_write_cmd_t *cmd = &server->wr_q[(server->wr_head + server->wr_count) % SIM_WRITE_QUEUE_MAX];
+        cmd->gattc_if = gattc_if;
+        cmd->handle   = handle;
+        cmd->len      = value_len;
+        server->wr_count++;
+        server->wr_pending_pdus += link_pdus(server, value_len);
+        if (!server->congested && server->wr_pending_pdus > SIM_ACL_CONGEST_PDUS) {
+            server->congested = true;
+            esp_ble_gattc_cb_param_t cong = { 0 };
+            cong.congest.conn_id   = conn_id;
+            cong.congest.congested = true;
+            gattc_post(sim_now_us(), ESP_GATTC_CONGEST_EVT, server->owner_if, &cong, server, NULL, 0);
+        }
+        if (!server->tx_event) {
+            server->tx_event = true;
+            sim_schedule(next_conn_event(server, sim_now_us()), link_event, server, server->link_gen, 0);
+        }
+        return ESP_OK;
+    }
+    server->st.writes++;
+    server->st.write_bytes += value_len;
+    uint64_t at = write_type == ESP_GATT_WRITE_TYPE_NO_RSP ? next_conn_event(server, sim_now_us()) : att_request(server, value_len);
+    gattc_post(at, ESP_GATTC_WRITE_CHAR_EVT, gattc_if, &param, server, NULL, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_prepare_write(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t offset, uint16_t value_len,
+                                      uint8_t *value, esp_gatt_auth_req_t auth_req)
+{
+    (void)value;
+    (void)auth_req;
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server) {
+        return ESP_FAIL;
+    }
+    esp_ble_gattc_cb_param_t param = { 0 };
+    sim_char_t *chr = char_by_handle(server, handle);
+    param.write.conn_id = conn_id;
+    param.write.handle  = handle;
+    param.write.offset  = offset;
+    if (!chr) {
+        param.write.status = ESP_GATT_INVALID_HANDLE;
+    } else if (value_len > server->mtu - 5) {
+        param.write.status = ESP_GATT_INVALID_ATTR_LEN;
+    } else if ((uint32_t)offset + value_len > SIM_PREP_QUEUE_MAX) {
+        param.write.status = ESP_GATT_PREPARE_Q_FULL;
+    } else {
+        param.write.status  = ESP_GATT_OK;
+        server->prep_handle = handle;
+        if (offset + value_len > server->prep_len) {
+            server->prep_len = (uint16_t)(offset + value_len);
+        }
+    }
+    gattc_post(att_request(server, (uint16_t)(value_len + 2U)), ESP_GATTC_PREP_WRITE_EVT, gattc_if, &param, server, NULL, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_execute_write(esp_gatt_if_t gattc_if, uint16_t conn_id, bool is_execute)
+{
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server) {
+        return ESP_FAIL;
+    }
+    esp_ble_gattc_cb_param_t param = { 0 };
+    param.exec_cmpl.conn_id = conn_id;
+    param.exec_cmpl.status  = ESP_GATT_OK;
+    if (is_execute && server->prep_len) {
+        server->st.writes++;
+        server->st.write_bytes += server->prep_len;
+    }
+    server->prep_len = 0U;
+    gattc_post(att_exchange(server, 1), ESP_GATTC_EXEC_EVT, gattc_if, &param, server, NULL, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len, uint8_t *value,
+                                         esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req)
+{
+    (void)write_type;
+    (void)auth_req;
+    sim_server_t *server = server_by_conn(conn_id);
+    if (!server) {
+        return ESP_FAIL;
+    }
+    esp_ble_gattc_cb_param_t param = { 0 };
+    sim_char_t *chr = char_by_cccd(server, handle);
+    uint64_t at = att_exchange(server, 1);
+    param.write.conn_id = conn_id;
+    param.write.handle  = handle;
+    param.write.status  = chr ? ESP_GATT_OK : ESP_GATT_INVALID_HANDLE;
+    if (chr && value_len >= 2) {
+        chr->cccd_value = (uint16_t)(value[0] | (value[1] << 8));
+        chr->notify_gen++;
+        if ((chr->cccd_value & 0x0001) && server->cfg.notify_period_us) {
+            sim_schedule(at + server->cfg.notify_period_us, notify_tick, server, (uint32_t)(chr - server->chars), chr->notify_gen);
+        }
+    }
+    gattc_post(at, ESP_GATTC_WRITE_DESCR_EVT, gattc_if, &param, server, NULL, 0);
+    return ESP_OK;
+}
+
+esp_gatt_status_t esp_ble_gattc_register_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda, uint16_t handle)
+{
+    esp_ble_gattc_cb_param_t param = { 0 };
+    param.reg_for_notify.status = server_by_bda(server_bda) ? ESP_GATT_OK : ESP_GATT_ERROR;
+    param.reg_for_notify.handle = handle;
+    gattc_post(sim_now_us(), ESP_GATTC_REG_FOR_NOTIFY_EVT, gattc_if, &param, NULL, NULL, 0);
+    sim_btc_yield();
+    return ESP_GATT_OK;
+}
+
+esp_gatt_status_t esp_ble_gattc_unregister_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda, uint16_t handle)
+{
+    esp_ble_gattc_cb_param_t param = { 0 };
+    param.unreg_for_notify.status = server_by_bda(server_bda) ? ESP_GATT_OK : ESP_GATT_ERROR;
+    param.unreg_for_notify.handle = handle;
+    gattc_post(sim_now_us(), ESP_GATTC_UNREG_FOR_NOTIFY_EVT, gattc_if, &param, NULL, NULL, 0);
+    sim_btc_yield();
+    return ESP_GATT_OK;
+}
+
+esp_err_t esp_ble_gattc_cache_refresh(esp_bd_addr_t remote_bda)
+{
+    sim_server_t *server = server_by_bda(remote_bda);
+    if (server) {
+        server->discovered = false;
+    }
+    return ESP_OK;
+}
+
+/* Report */
+void sim_print_report(void)
+{
+    const sim_stats_t *stats = sim_get_stats();
+    uint64_t t0 = stats->t_scan_start;
+    uint64_t events = stats->gap_events + stats->gattc_events;
+
+    printf("\n%-20s %5s %10s %10s %10s %10s %6s %6s %6s %8s %6s\n",
+           "server", "conn", "open ms", "mtu ms", "disc ms", "sub ms", "discs", "reads", "drops", "notifies", "nqfull");
+    for (int i = 0; i < s_n_servers; i++) {
+        const sim_server_stats_t *st = &s_servers[i].st;
+        if (!st->connectable) {
+            continue;
+        }
+        #define REL_MS(t) ((t) ? (double)((t) - t0) / 1000.0 : -1.0)
+        printf("%-20s %5u %10.1f %10.1f %10.1f %10.1f %6u %6u %6u %8u %6u\n", st->name, st->connects,
+               REL_MS(st->t_open), REL_MS(st->t_mtu), REL_MS(st->t_discovered), REL_MS(st->t_subscribed),
+               st->discoveries, st->reads, st->disconnects, st->notifies, st->notify_drops);
+        #undef REL_MS
+    }
+    printf("\ncallbacks: %llu gap + %llu gattc, %.3f ms host time, %.0f events/s\n",
+           (unsigned long long)stats->gap_events, (unsigned long long)stats->gattc_events,
+           (double)stats->cb_ns_total / 1e6, stats->cb_ns_total ? (double)events * 1e9 / (double)stats->cb_ns_total : 0.0);
+    printf("callback time: p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us (%s event %u)\n",
+           (double)sim_callback_percentile_ns(500U) / 1e3, (double)sim_callback_percentile_ns(990U) / 1e3,
+           (double)sim_callback_percentile_ns(999U) / 1e3, (double)stats->cb_ns_max / 1e3,
+           stats->cb_max_gap ? "gap" : "gattc", (unsigned)stats->cb_max_event);
+    printf("scan starts: %llu, opens: %llu, blocking calls from callbacks: %llu\n",
+           (unsigned long long)stats->scan_starts, (unsigned long long)stats->opens,
+           (unsigned long long)stats->dispatcher_blocks);
+}
@@ -0,0 +1,291 @@
+/**
+ * @file fake_esp.c
+ *
+ *
+ * @brief Host fakes for the non-Bluetooth ESP-IDF services the client uses:
+ *          logging, error names, esp_timer, esp_random and a RAM backed NVS.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+/* ESP32 API (fakes) */
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "esp_system.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+/* API */
+#include "sim_internal.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define NVS_NAMESPACE_MAX   8U
+#define NVS_ENTRY_MAX       128U
+#define NVS_KEY_LEN         16U     /* NVS_KEY_NAME_MAX_SIZE, including the terminator */
+#define NVS_BLOB_MAX        512U
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct {
+    bool        used;
+    uint32_t    ns;
+    char        key[NVS_KEY_LEN];
+    size_t      len;
+    uint8_t     data[NVS_BLOB_MAX];
+} nvs_entry_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static char         s_log_scratch[512];
+static char         s_namespaces[NVS_NAMESPACE_MAX][NVS_KEY_LEN];
+static nvs_entry_t  s_nvs[NVS_ENTRY_MAX];
+static bool         s_nvs_ready;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Logging */
+static void log_emit(esp_log_level_t level, const char *tag, const char *msg)
+{
+    static const char letters[] = "NEWIDV";
+    if (level <= sim_log_level()) {
+        printf("%c (%llu) %s: %s\n", letters[level], (unsigned long long)(sim_now_us() / 1000ULL), tag, msg);
+    }
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    /* Always format, so the cost a UART sink would pay stays inside the callback timings */
+    va_list args;
+    va_start(args, format);
+    vsnprintf(s_log_scratch, sizeof(s_log_scratch), format, args);
+    va_end(args);
+    log_emit(level, tag, s_log_scratch);
+}
+
+void esp_log_buffer_hex_internal(const char *tag, const void *buffer, uint16_t buff_len, esp_log_level_t level)
+{
+    const uint8_t *bytes = buffer;
+    for (uint16_t off = 0; off < buff_len; off += 16) {
+        size_t pos = 0;
+        for (uint16_t i = off; i < buff_len && i < off + 16; i++) {
+            pos += (size_t)snprintf(&s_log_scratch[pos], sizeof(s_log_scratch) - pos, "%02x ", bytes[i]);
+        }
+        log_emit(level, tag, s_log_scratch);
+    }
+}
+
+void esp_log_buffer_char_internal(const char *tag, const void *buffer, uint16_t buff_len, esp_log_level_t level)
+{
+    const char *chars = buffer;
+    for (uint16_t off = 0; off < buff_len; off += 16) {
+        uint16_t n = (uint16_t)(buff_len - off < 16 ? buff_len - off : 16);
+        memcpy(s_log_scratch, &chars[off], n);
+        s_log_scratch[n] = '\0';
+        log_emit(level, tag, s_log_scratch);
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    (void)tag;
+    sim_set_log_level(level);
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(sim_now_us() / 1000ULL);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:                        return "ESP_OK";
+        case ESP_FAIL:                      return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:                return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:           return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:         return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:          return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:             return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:         return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:               return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_NVS_NOT_FOUND:         return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_INVALID_LENGTH:    return "ESP_ERR_NVS_INVALID_LENGTH";
+        default:                            return "UNKNOWN ERROR";
+    }
+}
+
+/* Power management */
+esp_err_t esp_pm_configure(const void *config)
+{
+    return config ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/* Time & entropy */
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)sim_now_us();
+}
+
+uint32_t esp_random(void)
+{
+    return sim_rand();
+}
+
+/* NVS */
+static nvs_entry_t *nvs_find(nvs_handle_t handle, const char *key)
+{
+    for (size_t i = 0; i < NVS_ENTRY_MAX; i++) {
+        if (s_nvs[i].used && s_nvs[i].ns == handle && strncmp(s_nvs[i].key, key, NVS_KEY_LEN) == 0) {
+            return &s_nvs[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    s_nvs_ready = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    memset(s_nvs, 0, sizeof(s_nvs));
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    (void)open_mode;
+    if (!s_nvs_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (strlen(name) >= NVS_KEY_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (uint32_t i = 0; i < NVS_NAMESPACE_MAX; i++) {
+        if (s_namespaces[i][0] == '\0') {
+            strcpy(s_namespaces[i], name);
+        }
+        if (strcmp(s_namespaces[i], name) == 0) {
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    if (strlen(key) >= NVS_KEY_LEN || length > NVS_BLOB_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    nvs_entry_t *entry = nvs_find(handle, key);
+    for (size_t i = 0; !entry && i < NVS_ENTRY_MAX; i++) {
+        if (!s_nvs[i].used) {
+            entry = &s_nvs[i];
+            entry->used = true;
+            entry->ns   = handle;
+            strcpy(entry->key, key);
+        }
+    }
+    if (!entry) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(entry->data, value, length);
+    entry->len = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    nvs_entry_t *entry = nvs_find(handle, key);
+    if (!entry) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value == NULL) {
+        *length = entry->len;
+        return ESP_OK;
+    }
+    if (*length < entry->len) {
+        *length = entry->len;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, entry->data, entry->len);
+    *length = entry->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    nvs_entry_t *entry = nvs_find(handle, key);
+    if (!entry) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    entry->used = false;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    for (size_t i = 0; i < NVS_ENTRY_MAX; i++) {
+        if (s_nvs[i].ns == handle) {
+            s_nvs[i].used = false;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    return ESP_OK;
+}
+
+void sim_nvs_load(const char *path)
+{
+    /* A missing file is an erased flash */
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return;
+    }
+    if (fread(s_namespaces, sizeof(s_namespaces), 1, f) != 1 || fread(s_nvs, sizeof(s_nvs), 1, f) != 1) {
+        memset(s_namespaces, 0, sizeof(s_namespaces));
+        memset(s_nvs, 0, sizeof(s_nvs));
+    }
+    fclose(f);
+}
+
+void sim_nvs_save(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return;
+    }
+    fwrite(s_namespaces, sizeof(s_namespaces), 1, f);
+    fwrite(s_nvs, sizeof(s_nvs), 1, f);
+    fclose(f);
+}
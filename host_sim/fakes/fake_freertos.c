@@ -0,0 +1,493 @@
+/**
+ * @file fake_freertos.c
+ *
+ *
+ * @brief FreeRTOS task, queue, semaphore, event group and software timer
+ *          fakes on top of the simulator kernel.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+/* FreeRTOS (fakes) */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "freertos/timers.h"
+/* API */
+#include "sim_internal.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+struct sim_task {
+    pthread_t       thread;
+    TaskFunction_t  fn;
+    void           *arg;
+    char            name[16];
+    uint32_t        notify;
+    UBaseType_t     priority;
+};
+
+struct sim_queue {
+    uint8_t        *storage;
+    UBaseType_t     length;
+    UBaseType_t     item_size;
+    UBaseType_t     head;
+    UBaseType_t     count;
+    bool            owns_storage;
+};
+
+struct sim_event_group {
+    EventBits_t     bits;
+};
+
+struct sim_timer {
+    const char             *name;
+    TickType_t              period;
+    bool                    auto_reload;
+    bool                    active;
+    uint32_t                generation;
+    void                   *id;
+    TimerCallbackFunction_t cb;
+};
+
+typedef struct {
+    EventGroupHandle_t  group;
+    EventBits_t         bits;
+    bool                all;
+} event_wait_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static __thread struct sim_task *s_self;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Tasks */
+static void *task_trampoline(void *param)
+{
+    struct sim_task *task = param;
+    sim_kernel_lock();
+    s_self = task;
+    sim_task_priority(task->priority);
+    task->fn(task->arg);
+    /* Returning from a FreeRTOS task is an error on target; treat it as vTaskDelete(NULL) */
+    sim_task_exited();
+    sim_kernel_unlock();
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char * const pcName, const uint32_t usStackDepth,
+                       void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask)
+{
+    (void)usStackDepth;
+    struct sim_task *task = calloc(1, sizeof(*task));
+    if (!task) {
+        return pdFAIL;
+    }
+    task->fn       = pxTaskCode;
+    task->arg      = pvParameters;
+    task->priority = uxPriority;
+    strncpy(task->name, pcName ? pcName : "", sizeof(task->name) - 1);
+
+    sim_task_started();
+    if (pthread_create(&task->thread, NULL, task_trampoline, task) != 0) {
+        sim_task_exited();
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    if (pxCreatedTask) {
+        *pxCreatedTask = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char * const pcName, const uint32_t usStackDepth,
+                                   void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask,
+                                   const BaseType_t xCoreID)
+{
+    (void)xCoreID;
+    return xTaskCreate(pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    if (xTaskToDelete != NULL && xTaskToDelete != s_self) {
+        /* Deleting another task is not modelled; it simply never runs again once blocked. */
+        return;
+    }
+    sim_task_exited();
+    sim_kernel_unlock();
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    if (xTicksToDelay == 0) {
+        return;
+    }
+    uint64_t wake = (sim_now_us() / SIM_TICK_US + xTicksToDelay) * SIM_TICK_US;
+    sim_block(NULL, NULL, wake);
+}
+
+void vTaskDelayUntil(TickType_t * const pxPreviousWakeTime, const TickType_t xTimeIncrement)
+{
+    TickType_t wake = *pxPreviousWakeTime + xTimeIncrement;
+    *pxPreviousWakeTime = wake;
+    if ((uint64_t)wake * SIM_TICK_US > sim_now_us()) {
+        sim_block(NULL, NULL, (uint64_t)wake * SIM_TICK_US);
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(sim_now_us() / SIM_TICK_US);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_self;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    xTaskToNotify->notify++;
+    sim_wake();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    xTaskNotifyGive(xTaskToNotify);
+}
+
+static bool notify_ready(void *arg)
+{
+    return ((struct sim_task *)arg)->notify > 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    struct sim_task *self = s_self;
+    if (!self) {
+        return 0;
+    }
+    sim_block(notify_ready, self, sim_ticks_deadline(xTicksToWait));
+    uint32_t value = self->notify;
+    if (value) {
+        self->notify = xClearCountOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+/* Queues */
+static bool queue_not_full(void *arg)
+{
+    QueueHandle_t q = arg;
+    return q->count < q->length;
+}
+
+static bool queue_not_empty(void *arg)
+{
+    QueueHandle_t q = arg;
+    return q->count > 0;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    QueueHandle_t q = calloc(1, sizeof(*q));
+    if (!q) {
+        return NULL;
+    }
+    q->length       = uxQueueLength;
+    q->item_size    = uxItemSize;
+    q->owns_storage = true;
+    if (uxItemSize) {
+        q->storage = calloc(uxQueueLength, uxItemSize);
+        if (!q->storage) {
+            free(q);
+            return NULL;
+        }
+    }
+    return q;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t uxQueueLength, UBaseType_t uxItemSize, uint8_t *pucQueueStorage, void *pxStaticQueue)
+{
+    (void)pxStaticQueue;
+    QueueHandle_t q = calloc(1, sizeof(*q));
+    if (!q) {
+        return NULL;
+    }
+    q->length    = uxQueueLength;
+    q->item_size = uxItemSize;
+    q->storage   = pucQueueStorage;
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    while (!queue_not_full(xQueue)) {
+        if (!sim_block(queue_not_full, xQueue, sim_ticks_deadline(xTicksToWait))) {
+            return errQUEUE_FULL;
+        }
+    }
+    /* Semaphores pass NULL with an item size of 0 */
+    if (xQueue->item_size && pvItemToQueue) {
+        UBaseType_t tail = (xQueue->head + xQueue->count) % xQueue->length;
+        memcpy(&xQueue->storage[tail * xQueue->item_size], pvItemToQueue, xQueue->item_size);
+    }
+    xQueue->count++;
+    sim_wake();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return xQueueSend(xQueue, pvItemToQueue, xTicksToWait);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t xQueue, const void *pvItemToQueue, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return xQueueSend(xQueue, pvItemToQueue, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    while (!queue_not_empty(xQueue)) {
+        if (!sim_block(queue_not_empty, xQueue, sim_ticks_deadline(xTicksToWait))) {
+            return errQUEUE_EMPTY;
+        }
+    }
+    if (xQueue->item_size && pvBuffer) {
+        memcpy(pvBuffer, &xQueue->storage[xQueue->head * xQueue->item_size], xQueue->item_size);
+    }
+    xQueue->head = (xQueue->head + 1) % xQueue->length;
+    xQueue->count--;
+    sim_wake();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+{
+    return xQueue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue)
+{
+    return xQueue->length - xQueue->count;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    if (xQueue->owns_storage) {
+        free(xQueue->storage);
+    }
+    free(xQueue);
+}
+
+/* Semaphores, as item-less queues */
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    if (sem) {
+        sem->count = 1;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
+{
+    SemaphoreHandle_t sem = xQueueCreate(uxMaxCount, 0);
+    if (sem) {
+        sem->count = uxInitialCount;
+    }
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime)
+{
+    return xQueueReceive(xSemaphore, NULL, xBlockTime);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    return xQueueSend(xSemaphore, NULL, 0);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t xSemaphore, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    return xQueueSendFromISR(xSemaphore, NULL, pxHigherPriorityTaskWoken);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore)
+{
+    vQueueDelete(xSemaphore);
+}
+
+/* Event groups */
+static bool event_bits_ready(void *arg)
+{
+    event_wait_t *wait = arg;
+    EventBits_t   set  = wait->group->bits & wait->bits;
+    return wait->all ? (set == wait->bits) : (set != 0);
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(struct sim_event_group));
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet)
+{
+    xEventGroup->bits |= uxBitsToSet;
+    sim_wake();
+    return xEventGroup->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear)
+{
+    EventBits_t prev = xEventGroup->bits;
+    xEventGroup->bits &= ~uxBitsToClear;
+    return prev;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t xEventGroup)
+{
+    return xEventGroup->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToWaitFor,
+                                const BaseType_t xClearOnExit, const BaseType_t xWaitForAllBits, TickType_t xTicksToWait)
+{
+    event_wait_t wait = {
+        .group = xEventGroup,
+        .bits  = uxBitsToWaitFor,
+        .all   = xWaitForAllBits != pdFALSE,
+    };
+    bool met = sim_block(event_bits_ready, &wait, sim_ticks_deadline(xTicksToWait));
+    EventBits_t bits = xEventGroup->bits;
+    if (met && xClearOnExit) {
+        xEventGroup->bits &= ~uxBitsToWaitFor;
+    }
+    return bits;
+}
+
+/* Software timers */
+static void timer_fire(void *ctx, uint32_t generation, uint32_t unused)
+{
+    (void)unused;
+    TimerHandle_t timer = ctx;
+    if (!timer->active || timer->generation != generation) {
+        return;
+    }
+    if (timer->auto_reload) {
+        sim_schedule(sim_now_us() + (uint64_t)timer->period * SIM_TICK_US, timer_fire, timer, generation, 0);
+    } else {
+        timer->active = false;
+    }
+    timer->cb(timer);
+}
+
+static void timer_arm(TimerHandle_t timer)
+{
+    timer->active = true;
+    timer->generation++;
+    sim_schedule(sim_now_us() + (uint64_t)timer->period * SIM_TICK_US, timer_fire, timer, timer->generation, 0);
+}
+
+TimerHandle_t xTimerCreate(const char * const pcTimerName, const TickType_t xTimerPeriodInTicks, const UBaseType_t uxAutoReload,
+                           void * const pvTimerID, TimerCallbackFunction_t pxCallbackFunction)
+{
+    TimerHandle_t timer = calloc(1, sizeof(*timer));
+    if (!timer) {
+        return NULL;
+    }
+    timer->name        = pcTimerName;
+    timer->period      = xTimerPeriodInTicks ? xTimerPeriodInTicks : 1;
+    timer->auto_reload = uxAutoReload != pdFALSE;
+    timer->id          = pvTimerID;
+    timer->cb          = pxCallbackFunction;
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    (void)xTicksToWait;
+    timer_arm(xTimer);
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    (void)xTicksToWait;
+    xTimer->active = false;
+    xTimer->generation++;
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    return xTimerStart(xTimer, xTicksToWait);
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t xTicksToWait)
+{
+    xTimer->period = xNewPeriod ? xNewPeriod : 1;
+    return xTimerStart(xTimer, xTicksToWait);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t xTimer)
+{
+    return xTimer->active ? pdTRUE : pdFALSE;
+}
+
+void *pvTimerGetTimerID(const TimerHandle_t xTimer)
+{
+    return xTimer->id;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    /* Pending fire events still reference the handle; keep it and just disarm. */
+    return xTimerStop(xTimer, xTicksToWait);
+}
+
+/* Driver hook */
+static void app_main_task(void *arg)
+{
+    void (* entry)(void) = (void (*)(void))arg;
+    entry();
+}
+
+void sim_start_app(void (* entry)(void))
+{
+    xTaskCreate(app_main_task, "main", 3584, (void *)entry, 1, NULL);
+}
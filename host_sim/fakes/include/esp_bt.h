@@ -0,0 +1,38 @@
+/**
+ * @file esp_bt.h
+ *
+ * @brief Host simulation fake of the Bluetooth controller API.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "esp_bt_defs.h"
+
+typedef enum {
+    ESP_BT_MODE_IDLE        = 0x00,
+    ESP_BT_MODE_BLE         = 0x01,
+    ESP_BT_MODE_CLASSIC_BT  = 0x02,
+    ESP_BT_MODE_BTDM        = 0x03,
+} esp_bt_mode_t;
+
+typedef struct {
+    uint16_t magic;
+    uint8_t  ble_max_act;
+    uint8_t  sleep_mode;
+    uint8_t  sleep_clock;
+} esp_bt_controller_config_t;
+
+#define BT_CONTROLLER_INIT_CONFIG_DEFAULT() {           \
+    .magic       = 0x5A5AA5A5 & 0xffff,                 \
+    .ble_max_act = CONFIG_BT_CTRL_BLE_MAX_ACT_EFF,      \
+    .sleep_mode  = 0,                                   \
+    .sleep_clock = 0,                                   \
+}
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *cfg);
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode);
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode);
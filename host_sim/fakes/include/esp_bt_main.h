@@ -0,0 +1,13 @@
+/**
+ * @file esp_bt_main.h
+ *
+ * @brief Host simulation fake of the Bluedroid host init API.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+
+esp_err_t esp_bluedroid_init(void);
+esp_err_t esp_bluedroid_enable(void);
+esp_err_t esp_bluedroid_disable(void);
@@ -0,0 +1,330 @@
+/**
+ * @file esp_gap_ble_api.h
+ *
+ * @brief Host simulation fake of the BLE GAP API (legacy scanning subset,
+ *          data length and, as with CONFIG_BT_BLE_50_FEATURES_SUPPORTED,
+ *          PHY selection, extended scanning and extended connections).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_bt_defs.h"
+
+#define ESP_BLE_ADV_DATA_LEN_MAX        31
+#define ESP_BLE_SCAN_RSP_DATA_LEN_MAX   31
+
+typedef enum {
+    ESP_BLE_AD_TYPE_FLAG                = 0x01,
+    ESP_BLE_AD_TYPE_16SRV_PART          = 0x02,
+    ESP_BLE_AD_TYPE_16SRV_CMPL          = 0x03,
+    ESP_BLE_AD_TYPE_32SRV_PART          = 0x04,
+    ESP_BLE_AD_TYPE_32SRV_CMPL          = 0x05,
+    ESP_BLE_AD_TYPE_128SRV_PART         = 0x06,
+    ESP_BLE_AD_TYPE_128SRV_CMPL         = 0x07,
+    ESP_BLE_AD_TYPE_NAME_SHORT          = 0x08,
+    ESP_BLE_AD_TYPE_NAME_CMPL           = 0x09,
+    ESP_BLE_AD_TYPE_TX_PWR              = 0x0A,
+    ESP_BLE_AD_TYPE_SERVICE_DATA        = 0x16,
+    ESP_BLE_AD_TYPE_32SERVICE_DATA      = 0x20,
+    ESP_BLE_AD_TYPE_128SERVICE_DATA     = 0x21,
+    ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE = 0xFF,
+} esp_ble_adv_data_type;
+
+typedef enum {
+    ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT        = 0,
+    ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_RESULT_EVT,
+    ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_RSP_DATA_RAW_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_ADV_START_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_START_COMPLETE_EVT,
+    ESP_GAP_BLE_AUTH_CMPL_EVT                    = 8,
+    ESP_GAP_BLE_KEY_EVT,
+    ESP_GAP_BLE_SEC_REQ_EVT,
+    ESP_GAP_BLE_PASSKEY_NOTIF_EVT,
+    ESP_GAP_BLE_PASSKEY_REQ_EVT,
+    ESP_GAP_BLE_OOB_REQ_EVT,
+    ESP_GAP_BLE_LOCAL_IR_EVT,
+    ESP_GAP_BLE_LOCAL_ER_EVT,
+    ESP_GAP_BLE_NC_REQ_EVT,
+    ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT,
+    ESP_GAP_BLE_SET_STATIC_RAND_ADDR_EVT,
+    ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT,
+    ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT,
+    ESP_GAP_BLE_SET_LOCAL_PRIVACY_COMPLETE_EVT,
+    ESP_GAP_BLE_REMOVE_BOND_DEV_COMPLETE_EVT,
+    ESP_GAP_BLE_CLEAR_BOND_DEV_COMPLETE_EVT,
+    ESP_GAP_BLE_GET_BOND_DEV_COMPLETE_EVT,
+    ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT,
+    ESP_GAP_BLE_UPDATE_WHITELIST_COMPLETE_EVT,
+    ESP_GAP_BLE_SET_PREFERED_PHY_COMPLETE_EVT,  /* BLE 5.0 API */
+    ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT,        /* BLE 5.0 API */
+    ESP_GAP_BLE_SET_EXT_SCAN_PARAMS_COMPLETE_EVT,
+    ESP_GAP_BLE_EXT_SCAN_START_COMPLETE_EVT,
+    ESP_GAP_BLE_EXT_SCAN_STOP_COMPLETE_EVT,
+    ESP_GAP_BLE_PREFER_EXT_CONN_PARAMS_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_EXT_ADV_REPORT_EVT,
+    ESP_GAP_BLE_SCAN_TIMEOUT_EVT,
+    ESP_GAP_BLE_EVT_MAX,
+} esp_gap_ble_cb_event_t;
+
+typedef enum {
+    BLE_SCAN_TYPE_PASSIVE   = 0x0,
+    BLE_SCAN_TYPE_ACTIVE    = 0x1,
+} esp_ble_scan_type_t;
+
+typedef enum {
+    BLE_SCAN_FILTER_ALLOW_ALL           = 0x0,
+    BLE_SCAN_FILTER_ALLOW_ONLY_WLST     = 0x1,
+    BLE_SCAN_FILTER_ALLOW_UND_RPA_DIR   = 0x2,
+    BLE_SCAN_FILTER_ALLOW_WLIST_RPA_DIR = 0x3,
+} esp_ble_scan_filter_t;
+
+typedef enum {
+    BLE_SCAN_DUPLICATE_DISABLE           = 0x0,
+    BLE_SCAN_DUPLICATE_ENABLE            = 0x1,
+    BLE_SCAN_DUPLICATE_MAX               = 0x2,
+} esp_ble_scan_duplicate_t;
+
+typedef struct {
+    esp_ble_scan_type_t     scan_type;
+    esp_ble_addr_type_t     own_addr_type;
+    esp_ble_scan_filter_t   scan_filter_policy;
+    uint16_t                scan_interval;      /* Units of 0.625 ms */
+    uint16_t                scan_window;        /* Units of 0.625 ms */
+    esp_ble_scan_duplicate_t scan_duplicate;
+} esp_ble_scan_params_t;
+
+typedef struct {
+    esp_bd_addr_t bda;
+    uint16_t min_int;                           /* Units of 1.25 ms */
+    uint16_t max_int;                           /* Units of 1.25 ms */
+    uint16_t latency;
+    uint16_t timeout;                           /* Units of 10 ms */
+} esp_ble_conn_update_params_t;
+
+typedef enum {
+    ESP_GAP_SEARCH_INQ_RES_EVT             = 0,
+    ESP_GAP_SEARCH_INQ_CMPL_EVT            = 1,
+    ESP_GAP_SEARCH_DISC_RES_EVT            = 2,
+    ESP_GAP_SEARCH_DISC_BLE_RES_EVT        = 3,
+    ESP_GAP_SEARCH_DISC_CMPL_EVT           = 4,
+    ESP_GAP_SEARCH_DI_DISC_CMPL_EVT        = 5,
+    ESP_GAP_SEARCH_SEARCH_CANCEL_CMPL_EVT  = 6,
+    ESP_GAP_SEARCH_INQ_DISCARD_NUM_EVT     = 7,
+} esp_gap_search_evt_t;
+
+typedef enum {
+    ESP_BLE_EVT_CONN_ADV         = 0x00,
+    ESP_BLE_EVT_CONN_DIR_ADV     = 0x01,
+    ESP_BLE_EVT_DISC_ADV         = 0x02,
+    ESP_BLE_EVT_NON_CONN_ADV     = 0x03,
+    ESP_BLE_EVT_SCAN_RSP         = 0x04,
+} esp_ble_evt_type_t;
+
+typedef enum {
+    ESP_BLE_WHITELIST_REMOVE     = 0X00,
+    ESP_BLE_WHITELIST_ADD        = 0X01,
+} esp_ble_wl_opration_t;
+
+typedef enum {
+    BLE_WL_ADDR_TYPE_PUBLIC      = 0x00,
+    BLE_WL_ADDR_TYPE_RANDOM      = 0x01,
+} esp_ble_wl_addr_type_t;
+
+typedef struct {
+    uint16_t rx_len;
+    uint16_t tx_len;
+} esp_ble_pkt_data_length_params_t;
+
+typedef uint8_t esp_ble_gap_phy_t;
+#define ESP_BLE_GAP_PHY_1M                  1
+#define ESP_BLE_GAP_PHY_2M                  2
+#define ESP_BLE_GAP_PHY_CODED               3
+
+typedef uint8_t esp_ble_gap_all_phys_t;
+#define ESP_BLE_GAP_NO_PREFER_TRANSMIT_PHY  (1 << 0)
+#define ESP_BLE_GAP_NO_PREFER_RECEIVE_PHY   (1 << 1)
+
+typedef uint8_t esp_ble_gap_phy_mask_t;
+#define ESP_BLE_GAP_PHY_1M_PREF_MASK        (1 << 0)
+#define ESP_BLE_GAP_PHY_2M_PREF_MASK        (1 << 1)
+#define ESP_BLE_GAP_PHY_CODED_PREF_MASK     (1 << 2)
+
+typedef uint16_t esp_ble_gap_prefer_phy_options_t;
+#define ESP_BLE_GAP_PHY_OPTIONS_NO_PREF     0
+
+/* Extended scanning and connections */
+#define ESP_BLE_GAP_EXT_SCAN_CFG_UNCODE_MASK    0x01
+#define ESP_BLE_GAP_EXT_SCAN_CFG_CODE_MASK      0x02
+
+typedef uint8_t esp_ble_ext_scan_cfg_mask_t;
+
+typedef struct {
+    esp_ble_scan_type_t scan_type;
+    uint16_t            scan_interval;
+    uint16_t            scan_window;
+} esp_ble_ext_scan_cfg_t;
+
+typedef struct {
+    esp_ble_addr_type_t         own_addr_type;
+    esp_ble_scan_filter_t       filter_policy;
+    esp_ble_scan_duplicate_t    scan_duplicate;
+    esp_ble_ext_scan_cfg_mask_t cfg_mask;
+    esp_ble_ext_scan_cfg_t      uncoded_cfg;
+    esp_ble_ext_scan_cfg_t      coded_cfg;
+} esp_ble_ext_scan_params_t;
+
+typedef struct {
+    uint16_t scan_interval;
+    uint16_t scan_window;
+    uint16_t interval_min;
+    uint16_t interval_max;
+    uint16_t latency;
+    uint16_t supervision_timeout;
+    uint16_t min_ce_len;
+    uint16_t max_ce_len;
+} esp_ble_gap_conn_params_t;
+
+typedef uint16_t esp_ble_gap_adv_type_t;
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_CONNECTABLE    (1 << 0)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_SCANNABLE      (1 << 1)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_DIRECTED       (1 << 2)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_HD_DIRECTED    (1 << 3)
+#define ESP_BLE_GAP_SET_EXT_ADV_PROP_LEGACY         (1 << 4)
+
+typedef uint8_t esp_ble_gap_pri_phy_t;
+#define ESP_BLE_GAP_PRI_PHY_1M      ESP_BLE_GAP_PHY_1M
+#define ESP_BLE_GAP_PRI_PHY_CODED   ESP_BLE_GAP_PHY_CODED
+
+typedef uint8_t esp_ble_gap_ext_adv_data_status_t;
+#define ESP_BLE_GAP_EXT_ADV_DATA_COMPLETE   0x00
+#define ESP_BLE_GAP_EXT_ADV_DATA_INCOMPLETE 0x01
+#define ESP_BLE_GAP_EXT_ADV_DATA_TRUNCATED  0x02
+
+typedef struct {
+    esp_ble_gap_adv_type_t  event_type;
+    uint8_t                 addr_type;
+    esp_bd_addr_t           addr;
+    esp_ble_gap_pri_phy_t   primary_phy;
+    esp_ble_gap_phy_t       secondly_phy;
+    uint8_t                 sid;
+    uint8_t                 tx_power;
+    int8_t                  rssi;
+    uint16_t                per_adv_interval;
+    uint8_t                 dir_addr_type;
+    esp_bd_addr_t           dir_addr;
+    esp_ble_gap_ext_adv_data_status_t data_status;
+    uint8_t                 adv_data_len;
+    uint8_t                 adv_data[251];
+} esp_ble_gap_ext_adv_reprot_t;
+
+typedef union {
+    struct ble_scan_param_cmpl_evt_param {
+        esp_bt_status_t status;
+    } scan_param_cmpl;
+
+    struct ble_scan_result_evt_param {
+        esp_gap_search_evt_t search_evt;
+        esp_bd_addr_t bda;
+        esp_bt_dev_type_t dev_type;
+        esp_ble_addr_type_t ble_addr_type;
+        esp_ble_evt_type_t ble_evt_type;
+        int rssi;
+        uint8_t  ble_adv[ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX];
+        int flag;
+        int num_resps;
+        uint8_t adv_data_len;
+        uint8_t scan_rsp_len;
+        uint32_t num_dis;
+    } scan_rst;
+
+    struct ble_scan_start_cmpl_evt_param {
+        esp_bt_status_t status;
+    } scan_start_cmpl;
+
+    struct ble_scan_stop_cmpl_evt_param {
+        esp_bt_status_t status;
+    } scan_stop_cmpl;
+
+    struct ble_adv_stop_cmpl_evt_param {
+        esp_bt_status_t status;
+    } adv_stop_cmpl;
+
+    struct ble_update_conn_params_evt_param {
+        esp_bt_status_t status;
+        esp_bd_addr_t bda;
+        uint16_t min_int;
+        uint16_t max_int;
+        uint16_t latency;
+        uint16_t conn_int;
+        uint16_t timeout;
+    } update_conn_params;
+
+    struct ble_update_whitelist_cmpl_evt_param {
+        esp_bt_status_t status;
+        esp_ble_wl_opration_t wl_opration;
+    } update_whitelist_cmpl;
+
+    struct ble_pkt_data_length_cmpl_evt_param {
+        esp_bt_status_t status;
+        esp_ble_pkt_data_length_params_t params;
+    } pkt_data_lenth_cmpl;
+
+    struct ble_set_perf_phy_cmpl_evt_param {
+        esp_bt_status_t status;
+    } set_perf_phy;
+
+    struct ble_phy_update_cmpl_param {
+        esp_bt_status_t status;
+        esp_bd_addr_t bda;
+        esp_ble_gap_phy_t tx_phy;
+        esp_ble_gap_phy_t rx_phy;
+    } phy_update;
+
+    struct ble_set_ext_scan_params_cmpl_param {
+        esp_bt_status_t status;
+    } set_ext_scan_params;
+
+    struct ble_ext_scan_start_cmpl_param {
+        esp_bt_status_t status;
+    } ext_scan_start;
+
+    struct ble_ext_scan_stop_cmpl_param {
+        esp_bt_status_t status;
+    } ext_scan_stop;
+
+    struct ble_set_ext_conn_params_cmpl_param {
+        esp_bt_status_t status;
+    } set_ext_conn_params;
+
+    struct ble_ext_adv_report_param {
+        esp_ble_gap_ext_adv_reprot_t params;
+    } ext_adv_report;
+} esp_ble_gap_cb_param_t;
+
+typedef void (* esp_gap_ble_cb_t)(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback);
+esp_err_t esp_ble_gap_set_scan_params(esp_ble_scan_params_t *scan_params);
+esp_err_t esp_ble_gap_start_scanning(uint32_t duration);
+esp_err_t esp_ble_gap_stop_scanning(void);
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t *params);
+esp_err_t esp_ble_gap_update_whitelist(bool add_remove, esp_bd_addr_t remote_bda, esp_ble_wl_addr_type_t wl_addr_type);
+esp_err_t esp_ble_gap_clear_whitelist(void);
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t remote_device, uint16_t tx_data_length);
+esp_err_t esp_ble_gap_set_prefered_phy(esp_bd_addr_t bd_addr, esp_ble_gap_all_phys_t all_phys_mask, esp_ble_gap_phy_mask_t tx_phy_mask,
+                                       esp_ble_gap_phy_mask_t rx_phy_mask, esp_ble_gap_prefer_phy_options_t phy_options);
+esp_err_t esp_ble_gap_set_ext_scan_params(const esp_ble_ext_scan_params_t *params);
+esp_err_t esp_ble_gap_start_ext_scan(uint32_t duration, uint16_t period);
+esp_err_t esp_ble_gap_stop_ext_scan(void);
+esp_err_t esp_ble_gap_prefer_ext_connect_params_set(esp_bd_addr_t addr, esp_ble_gap_phy_mask_t phy_mask,
+                                                    const esp_ble_gap_conn_params_t *phy_1m_conn_params,
+                                                    const esp_ble_gap_conn_params_t *phy_2m_conn_params,
+                                                    const esp_ble_gap_conn_params_t *phy_coded_conn_params);
+uint8_t  *esp_ble_resolve_adv_data(uint8_t *adv_data, uint8_t type, uint8_t *length);
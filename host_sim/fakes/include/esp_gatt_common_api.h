@@ -0,0 +1,13 @@
+/**
+ * @file esp_gatt_common_api.h
+ *
+ * @brief Host simulation fake of the GATT common API.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_gatt_defs.h"
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu);
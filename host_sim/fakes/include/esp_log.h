@@ -0,0 +1,61 @@
+/**
+ * @file esp_log.h
+ *
+ * @brief Host simulation fake of the ESP-IDF logging API. Messages above the
+ *          simulator print level are still formatted into a scratch buffer so
+ *          the cost of logging stays visible in callback timings.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL CONFIG_LOG_DEFAULT_LEVEL
+#endif
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+void esp_log_buffer_hex_internal(const char *tag, const void *buffer, uint16_t buff_len, esp_log_level_t level);
+void esp_log_buffer_char_internal(const char *tag, const void *buffer, uint16_t buff_len, esp_log_level_t level);
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+uint32_t esp_log_timestamp(void);
+
+#define ESP_LOG_LEVEL_LOCAL(level, tag, format, ...) do {                   \
+        if (LOG_LOCAL_LEVEL >= (level)) {                                   \
+            esp_log_write((level), (tag), format, ##__VA_ARGS__);           \
+        }                                                                   \
+    } while (0)
+
+/* Runtime level, as in ESP-IDF; the prefix is added by esp_log_write here */
+#define ESP_LOG_LEVEL(level, tag, format, ...) esp_log_write((level), (tag), format, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_ERROR,   tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_WARN,    tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_INFO,    tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_DEBUG,   tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#define ESP_LOG_BUFFER_HEX_LEVEL(tag, buffer, buff_len, level) do {         \
+        if (LOG_LOCAL_LEVEL >= (level)) {                                   \
+            esp_log_buffer_hex_internal((tag), (buffer), (buff_len), (level)); \
+        }                                                                   \
+    } while (0)
+
+#define ESP_LOG_BUFFER_CHAR_LEVEL(tag, buffer, buff_len, level) do {        \
+        if (LOG_LOCAL_LEVEL >= (level)) {                                   \
+            esp_log_buffer_char_internal((tag), (buffer), (buff_len), (level)); \
+        }                                                                   \
+    } while (0)
+
+#define esp_log_buffer_hex(tag, buffer, buff_len)  ESP_LOG_BUFFER_HEX_LEVEL(tag, buffer, buff_len, ESP_LOG_INFO)
+#define esp_log_buffer_char(tag, buffer, buff_len) ESP_LOG_BUFFER_CHAR_LEVEL(tag, buffer, buff_len, ESP_LOG_INFO)
@@ -0,0 +1,19 @@
+/**
+ * @file esp_pm.h
+ *
+ * @brief Host simulation fake of the power manager; the configuration is only
+ *          kept, the simulated CPU never sleeps or changes frequency.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef struct {
+    int     max_freq_mhz;
+    int     min_freq_mhz;
+    bool    light_sleep_enable;
+} esp_pm_config_esp32c3_t;
+
+esp_err_t esp_pm_configure(const void *config);
@@ -0,0 +1,13 @@
+/**
+ * @file esp_system.h
+ *
+ * @brief Host simulation fake of the esp_system helpers used by the client.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Deterministic, seeded by the simulator. */
+uint32_t esp_random(void);
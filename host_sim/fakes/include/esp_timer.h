@@ -0,0 +1,12 @@
+/**
+ * @file esp_timer.h
+ *
+ * @brief Host simulation fake of esp_timer; time is the simulator's virtual clock.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,40 @@
+/**
+ * @file FreeRTOS.h
+ *
+ * @brief Host simulation fake of the FreeRTOS kernel types. Tasks are host
+ *          threads that run one at a time on the simulator's virtual clock.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+typedef uint32_t      TickType_t;
+typedef int32_t       BaseType_t;
+typedef uint32_t      UBaseType_t;
+typedef uint32_t      StackType_t;
+
+#define pdFALSE                 ((BaseType_t)0)
+#define pdTRUE                  ((BaseType_t)1)
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define errQUEUE_EMPTY          ((BaseType_t)0)
+#define errQUEUE_FULL           ((BaseType_t)0)
+
+#define configTICK_RATE_HZ      CONFIG_FREERTOS_HZ
+#define configMAX_PRIORITIES    25
+#define configMINIMAL_STACK_SIZE 768
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS      ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((TickType_t)(xTimeInMs) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+#define tskNO_AFFINITY          0x7FFFFFFF
+
+#define portYIELD_FROM_ISR()    do { } while (0)
+#define portENTER_CRITICAL(mux) do { (void)(mux); } while (0)
+#define portEXIT_CRITICAL(mux)  do { (void)(mux); } while (0)
+#define portMUX_INITIALIZER_UNLOCKED 0
+
+typedef int portMUX_TYPE;
@@ -0,0 +1,19 @@
+/**
+ * @file event_groups.h
+ *
+ * @brief Host simulation fake of the FreeRTOS event group API.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_event_group *EventGroupHandle_t;
+typedef TickType_t EventBits_t;
+
+EventGroupHandle_t xEventGroupCreate(void);
+EventBits_t        xEventGroupSetBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet);
+EventBits_t        xEventGroupClearBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear);
+EventBits_t        xEventGroupGetBits(EventGroupHandle_t xEventGroup);
+EventBits_t        xEventGroupWaitBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToWaitFor,
+                                       const BaseType_t xClearOnExit, const BaseType_t xWaitForAllBits, TickType_t xTicksToWait);
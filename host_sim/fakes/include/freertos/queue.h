@@ -0,0 +1,26 @@
+/**
+ * @file queue.h
+ *
+ * @brief Host simulation fake of the FreeRTOS queue API.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize);
+QueueHandle_t xQueueCreateStatic(UBaseType_t uxQueueLength, UBaseType_t uxItemSize, uint8_t *pucQueueStorage, void *pxStaticQueue);
+BaseType_t    xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait);
+BaseType_t    xQueueSendToBack(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait);
+BaseType_t    xQueueSendFromISR(QueueHandle_t xQueue, const void *pvItemToQueue, BaseType_t *pxHigherPriorityTaskWoken);
+BaseType_t    xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait);
+UBaseType_t   uxQueueMessagesWaiting(QueueHandle_t xQueue);
+UBaseType_t   uxQueueSpacesAvailable(QueueHandle_t xQueue);
+void          vQueueDelete(QueueHandle_t xQueue);
+
+/* Static queue control block; storage is only used as an opaque placeholder. */
+typedef struct {
+    uint8_t dummy[96];
+} StaticQueue_t;
@@ -0,0 +1,20 @@
+/**
+ * @file semphr.h
+ *
+ * @brief Host simulation fake of the FreeRTOS semaphore API.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount);
+BaseType_t        xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime);
+BaseType_t        xSemaphoreGive(SemaphoreHandle_t xSemaphore);
+BaseType_t        xSemaphoreGiveFromISR(SemaphoreHandle_t xSemaphore, BaseType_t *pxHigherPriorityTaskWoken);
+void              vSemaphoreDelete(SemaphoreHandle_t xSemaphore);
@@ -0,0 +1,28 @@
+/**
+ * @file task.h
+ *
+ * @brief Host simulation fake of the FreeRTOS task API.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (* TaskFunction_t)(void *);
+typedef struct sim_task *TaskHandle_t;
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char * const pcName, const uint32_t usStackDepth,
+                       void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char * const pcName, const uint32_t usStackDepth,
+                                   void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask,
+                                   const BaseType_t xCoreID);
+void       vTaskDelete(TaskHandle_t xTaskToDelete);
+void       vTaskDelay(const TickType_t xTicksToDelay);
+void       vTaskDelayUntil(TickType_t * const pxPreviousWakeTime, const TickType_t xTimeIncrement);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+void       vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken);
+uint32_t   ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+
+#define taskYIELD()         vTaskDelay(0)
@@ -0,0 +1,23 @@
+/**
+ * @file timers.h
+ *
+ * @brief Host simulation fake of the FreeRTOS software timer API. Callbacks
+ *          run from the simulator dispatcher, standing in for the timer task.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_timer *TimerHandle_t;
+typedef void (* TimerCallbackFunction_t)(TimerHandle_t xTimer);
+
+TimerHandle_t xTimerCreate(const char * const pcTimerName, const TickType_t xTimerPeriodInTicks, const UBaseType_t uxAutoReload,
+                           void * const pvTimerID, TimerCallbackFunction_t pxCallbackFunction);
+BaseType_t    xTimerStart(TimerHandle_t xTimer, TickType_t xTicksToWait);
+BaseType_t    xTimerStop(TimerHandle_t xTimer, TickType_t xTicksToWait);
+BaseType_t    xTimerReset(TimerHandle_t xTimer, TickType_t xTicksToWait);
+BaseType_t    xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t xTicksToWait);
+BaseType_t    xTimerIsTimerActive(TimerHandle_t xTimer);
+void         *pvTimerGetTimerID(const TimerHandle_t xTimer);
+BaseType_t    xTimerDelete(TimerHandle_t xTimer, TickType_t xTicksToWait);
@@ -0,0 +1,12 @@
+/**
+ * @file nvs_flash.h
+ *
+ * @brief Host simulation fake of the NVS flash partition init API.
+ */
+
+#pragma once
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
@@ -0,0 +1,24 @@
+/**
+ * @file sdkconfig.h
+ *
+ * @brief Host simulation subset of the project sdkconfig. Values mirror the
+ *          esp32c3 configuration in the repository root.
+ */
+
+#pragma once
+
+#define CONFIG_IDF_TARGET                   "esp32c3"
+#define CONFIG_IDF_TARGET_ESP32C3           1
+#define CONFIG_FREERTOS_HZ                  100
+#define CONFIG_BT_ENABLED                   1
+#define CONFIG_BT_BLUEDROID_ENABLED         1
+#define CONFIG_BT_GATTC_ENABLE              1
+#define CONFIG_BT_CTRL_BLE_MAX_ACT          10
+#define CONFIG_BT_CTRL_BLE_MAX_ACT_EFF      10
+#define CONFIG_BT_ACL_CONNECTIONS           7
+#define CONFIG_BT_BLE_42_FEATURES_SUPPORTED 1
+#define CONFIG_BT_SOC_SUPPORT_5_0           1
+#define CONFIG_LOG_DEFAULT_LEVEL            3
+#ifndef CONFIG_BLE_CLIENT_HOT_LOG_LEVEL
+#define CONFIG_BLE_CLIENT_HOT_LOG_LEVEL     3
+#endif
@@ -0,0 +1,160 @@
+/**
+ * @file sim.h
+ *
+ *
+ * @brief Host simulation of the Bluedroid GAP/GATTC stack and the FreeRTOS
+ *          kernel the client runs on. Everything runs against a virtual clock
+ *          in microseconds; FreeRTOS tasks are host threads of which only one
+ *          runs at a time, and the dispatcher (standing in for the BTC task)
+ *          only advances the clock once every task is blocked.
+ *
+ *          Scenario drivers populate the world with simulated GATT servers,
+ *          start the client's app_main as the main task and call sim_run().
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdint.h>
+#include <stdbool.h>
+/* ESP32 API (fakes) */
+#include "esp_log.h"
+#include "esp_bt_defs.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define SIM_SERVER_MAX      64U
+#define SIM_FOREVER         UINT64_MAX
+#define SIM_MS(ms)          ((uint64_t)(ms) * 1000ULL)
+#define SIM_SEC(s)          ((uint64_t)(s) * 1000000ULL)
+#define SIM_CB_HIST_NS      100U    /* Callback duration histogram: bucket width, */
+#define SIM_CB_HIST_LEN     2000U   /* and buckets, the last one taking everything longer */
+
+/* * * * * * * * * * * * * * * *
+ * * * * * FN TYPEDEFS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Scheduled event handler, runs on the dispatcher thread with the kernel lock held */
+typedef void (* sim_event_fn_t)(void *ctx, uint32_t a, uint32_t b);
+
+/* Readiness predicate for blocking kernel waits */
+typedef bool (* sim_ready_fn_t)(void *arg);
+
+/* Run-loop termination predicate, evaluated whenever every task is blocked */
+typedef bool (* sim_done_fn_t)(void *arg);
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct sim_server_cfg {
+    uint32_t    adv_interval_us;        /* Advertising interval, 0-10 ms advDelay is added per event */
+    uint32_t    conn_interval_us;       /* Connection interval once connected */
+    uint16_t    mtu;                    /* Server side ATT MTU */
+    uint8_t     discovery_rtts;         /* ATT round trips needed for a full service discovery */
+    uint32_t    notify_period_us;       /* Notification period once the CCCD is written, 0 disables */
+    uint16_t    notify_len;             /* Notification payload length, clipped to MTU - 3 */
+    uint8_t     streams;                /* Notifying characteristics, see sim_stream_uuid, each on notify_period_us */
+    uint8_t     subscriptions;          /* CCCDs the client enables before t_subscribed is set, 0 = every notifying
+                                         * characteristic */
+    uint8_t     ce_pdus;                /* Most data PDUs per connection event, 0 = only the interval limits */
+    bool        connectable;            /* False for advertise-only noise devices */
+    bool        db_hash;                /* Expose a Database Hash characteristic in the GATT service */
+    uint16_t    ll_octets_max;          /* Longest data PDU payload the server takes, 27 refuses Data Length Extension */
+    bool        phy_2m;                 /* The server accepts LE 2M */
+    bool        read_multi;             /* The server takes Read Multiple, else answers Request Not Supported */
+    uint8_t     adv_phy;                /* 0 advertises legacy PDUs, ESP_BLE_GAP_PRI_PHY_1M or _CODED extended ones on that
+                                         * primary PHY, which only extended scans hear and aux_open connects to */
+    uint16_t    mfr_id;                 /* Non-zero: advertise a reading as manufacturer data of this company, a
+                                         * uint16 sequence number and an int16 value, renewed every second */
+} sim_server_cfg_t;
+
+typedef struct sim_server_stats {
+    char        name[32];
+    esp_bd_addr_t bda;
+    bool        connectable;
+    uint32_t    connects;               /* Successful OPEN events */
+    uint32_t    disconnects;
+    uint64_t    t_open;                 /* Virtual time of the last milestone, 0 if never reached */
+    uint64_t    t_mtu;
+    uint64_t    t_discovered;
+    uint64_t    t_subscribed;           /* Once cfg.subscriptions notifying characteristics are enabled */
+    uint32_t    discoveries;            /* Completed service discoveries */
+    uint32_t    adv_reports;            /* Advertising reports delivered to the client */
+    uint32_t    readings;               /* Readings advertised with cfg.mfr_id */
+    uint32_t    reads;                  /* ATT read requests, a Read Multiple counts once */
+    uint32_t    writes;                 /* Completed writes, a prepared long write counts once */
+    uint64_t    write_bytes;
+    uint32_t    notifies;               /* Sent over the air, each delivered to the client callback */
+    uint64_t    notify_bytes;
+    uint32_t    notify_drops;           /* Generated while the server's notification queue was full */
+    uint32_t    conn_updates;           /* Connection parameter updates applied */
+    uint32_t    conn_interval_us;       /* Interval and peripheral latency of the current or last link */
+    uint16_t    conn_latency;
+    uint16_t    ll_octets;              /* Data PDU payload and PHY (ESP_BLE_GAP_PHY_*) of the current or last link */
+    uint8_t     phy;
+} sim_server_stats_t;
+
+typedef struct sim_stats {
+    uint64_t    t_scan_start;           /* Virtual time of the first esp_ble_gap_start_scanning */
+    uint64_t    gap_events;
+    uint64_t    gattc_events;
+    uint64_t    cb_ns_total;            /* Host time spent inside client callbacks */
+    uint64_t    cb_ns_max;
+    bool        cb_max_gap;             /* Event of the longest callback */
+    uint32_t    cb_max_event;
+    uint32_t    cb_hist[SIM_CB_HIST_LEN];
+    uint64_t    scan_starts;
+    uint64_t    opens;
+    uint64_t    dispatcher_blocks;      /* Blocking kernel calls attempted from a callback */
+} sim_stats_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* World setup, called from the driver before sim_run */
+void     sim_init(uint32_t seed);
+void     sim_set_log_level(esp_log_level_t level);
+void     sim_server_cfg_default(sim_server_cfg_t *cfg);
+int      sim_add_server(const char *name, const sim_server_cfg_t *cfg);
+int      sim_server_add_char(int server, uint16_t svc_uuid, uint16_t char_uuid, uint8_t properties);
+int      sim_server_add_char_uuid(int server, const esp_bt_uuid_t *svc_uuid, const esp_bt_uuid_t *char_uuid, uint8_t properties);
+/* Service and characteristic of a server stream: 0x00FF/0xFF01 and 0x00EE/0xEE01 like the GATTS demo profiles,
+ * from the third on 128-bit characteristics of one 128-bit service */
+void     sim_stream_uuid(uint8_t stream, esp_bt_uuid_t *svc_uuid, esp_bt_uuid_t *char_uuid);
+void     sim_drop_link_at(int server, uint64_t at_us, uint32_t silent_ms);  /* Then out of range for silent_ms */
+void     sim_db_change_at(int server, uint64_t at_us);     /* Moves the application handles, indicates Service Changed */
+void     sim_nvs_load(const char *path);                    /* NVS contents survive runs, as across a reboot */
+void     sim_nvs_save(const char *path);
+void     sim_start_app(void (* entry)(void));
+
+/* Run loop; returns true if done() fired before until_us */
+bool     sim_run(uint64_t until_us, sim_done_fn_t done, void *arg);
+
+/* Results */
+uint64_t sim_now_us(void);
+int      sim_server_count(void);
+const sim_stats_t        *sim_get_stats(void);
+const sim_server_stats_t *sim_get_server_stats(int server);
+void     sim_print_report(void);
+
+/* Kernel, used by the fakes; all calls require the kernel lock (held by any running task or callback) */
+void     sim_schedule(uint64_t at_us, sim_event_fn_t fn, void *ctx, uint32_t a, uint32_t b);
+bool     sim_block(sim_ready_fn_t ready, void *arg, uint64_t deadline_us);
+void     sim_wake(void);
+void     sim_btc_yield(void);
+bool     sim_in_dispatcher(void);
+uint32_t sim_rand(void);
+uint64_t sim_host_ns(void);
+void     sim_account_callback(bool gap, uint32_t event, uint64_t ns);
+uint64_t sim_callback_percentile_ns(uint32_t permille);
+esp_log_level_t sim_log_level(void);
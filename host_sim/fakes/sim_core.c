@@ -0,0 +1,410 @@
+/**
+ * @file sim_core.c
+ *
+ *
+ * @brief Virtual clock, event heap and cooperative kernel of the host
+ *          simulation. A single mutex plays the role of the CPU: whoever holds
+ *          it is the running thread, blocking waits release it. Tasks woken
+ *          together run one after the other, highest priority first, as the
+ *          FreeRTOS scheduler would pick them.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+/* API */
+#include "sim.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct sim_event {
+    uint64_t        at;
+    uint64_t        seq;
+    sim_event_fn_t  fn;
+    void           *ctx;
+    uint32_t        a;
+    uint32_t        b;
+} sim_event_t;
+
+typedef struct sim_waiter {
+    sim_ready_fn_t      ready;
+    void               *arg;
+    uint64_t            deadline;
+    bool                woken;
+    bool                timed_out;
+    uint32_t            prio;
+    uint64_t            woken_seq;          /* Order of wake-ups, among equal priorities the first woken runs first */
+    struct sim_waiter  *next;
+} sim_waiter_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static pthread_mutex_t  s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   s_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t        s_dispatcher;
+static int              s_running;          /* Runnable task threads, dispatcher excluded */
+static uint64_t         s_now;
+static uint64_t         s_seq;
+static uint64_t         s_rng;
+static sim_waiter_t    *s_waiters;
+static sim_event_t     *s_heap;
+static size_t           s_heap_len;
+static size_t           s_heap_cap;
+static sim_stats_t      s_stats;
+static esp_log_level_t  s_log_level = ESP_LOG_WARN;
+static uint64_t         s_wake_seq;
+static bool             s_wake_pending;     /* Tasks woken from a callback, signalled once it returns */
+static __thread uint32_t s_prio;            /* Priority of the task running on this thread */
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Locals */
+static bool event_before(const sim_event_t *x, const sim_event_t *y)
+{
+    return (x->at < y->at) || (x->at == y->at && x->seq < y->seq);
+}
+
+static void heap_push(const sim_event_t *ev)
+{
+    if (s_heap_len == s_heap_cap) {
+        s_heap_cap = s_heap_cap ? s_heap_cap * 2 : 256;
+        s_heap = realloc(s_heap, s_heap_cap * sizeof(*s_heap));
+        if (!s_heap) {
+            abort();
+        }
+    }
+    size_t i = s_heap_len++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!event_before(ev, &s_heap[parent])) {
+            break;
+        }
+        s_heap[i] = s_heap[parent];
+        i = parent;
+    }
+    s_heap[i] = *ev;
+}
+
+static sim_event_t heap_pop(void)
+{
+    sim_event_t top  = s_heap[0];
+    sim_event_t last = s_heap[--s_heap_len];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= s_heap_len) {
+            break;
+        }
+        if (child + 1 < s_heap_len && event_before(&s_heap[child + 1], &s_heap[child])) {
+            child++;
+        }
+        if (!event_before(&s_heap[child], &last)) {
+            break;
+        }
+        s_heap[i] = s_heap[child];
+        i = child;
+    }
+    if (s_heap_len) {
+        s_heap[i] = last;
+    }
+    return top;
+}
+
+static uint64_t next_deadline(void)
+{
+    uint64_t next = SIM_FOREVER;
+    for (sim_waiter_t *w = s_waiters; w; w = w->next) {
+        if (!w->woken && w->deadline < next) {
+            next = w->deadline;
+        }
+    }
+    return next;
+}
+
+static void waiter_wake(sim_waiter_t *w)
+{
+    w->woken     = true;
+    w->woken_seq = s_wake_seq++;
+    s_running++;
+}
+
+static bool waiter_next(const sim_waiter_t *w)
+{
+    /* Woken and no other woken task goes before it */
+    if (!w->woken) {
+        return false;
+    }
+    for (const sim_waiter_t *o = s_waiters; o; o = o->next) {
+        if (o != w && o->woken && (o->prio > w->prio || (o->prio == w->prio && o->woken_seq < w->woken_seq))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void expire_waiters(void)
+{
+    for (sim_waiter_t *w = s_waiters; w; w = w->next) {
+        if (!w->woken && w->deadline <= s_now) {
+            w->timed_out = true;
+            waiter_wake(w);
+        }
+    }
+    pthread_cond_broadcast(&s_cond);
+}
+
+static void wait_quiescent(void)
+{
+    if (s_wake_pending) {
+        s_wake_pending = false;
+        pthread_cond_broadcast(&s_cond);
+    }
+    while (s_running > 0) {
+        pthread_cond_wait(&s_cond, &s_lock);
+    }
+}
+
+/* Kernel */
+void sim_schedule(uint64_t at_us, sim_event_fn_t fn, void *ctx, uint32_t a, uint32_t b)
+{
+    sim_event_t ev = {
+        .at  = at_us < s_now ? s_now : at_us,
+        .seq = s_seq++,
+        .fn  = fn,
+        .ctx = ctx,
+        .a   = a,
+        .b   = b,
+    };
+    heap_push(&ev);
+}
+
+bool sim_block(sim_ready_fn_t ready, void *arg, uint64_t deadline_us)
+{
+    if (ready && ready(arg)) {
+        return true;
+    }
+    if (deadline_us <= s_now) {
+        return false;
+    }
+    if (sim_in_dispatcher()) {
+        /* The dispatcher owns the clock and cannot sleep; a blocking call from
+         * inside a stack callback times out immediately, and is counted. */
+        s_stats.dispatcher_blocks++;
+        return false;
+    }
+
+    sim_waiter_t w = {
+        .ready    = ready,
+        .arg      = arg,
+        .deadline = deadline_us,
+        .prio     = s_prio,
+        .next     = s_waiters,
+    };
+    s_waiters = &w;
+    s_running--;
+    pthread_cond_broadcast(&s_cond);
+    while (!waiter_next(&w)) {
+        pthread_cond_wait(&s_cond, &s_lock);
+    }
+    for (sim_waiter_t **pp = &s_waiters; *pp; pp = &(*pp)->next) {
+        if (*pp == &w) {
+            *pp = w.next;
+            break;
+        }
+    }
+    return !w.timed_out;
+}
+
+void sim_wake(void)
+{
+    bool any = false;
+    for (sim_waiter_t *w = s_waiters; w; w = w->next) {
+        if (!w->woken && w->ready && w->ready(w->arg)) {
+            waiter_wake(w);
+            any = true;
+        }
+    }
+    if (any && sim_in_dispatcher()) {
+        /* Nothing woken can run before the callback returns, keep the host
+         * wake-up out of the callback time */
+        s_wake_pending = true;
+    } else if (any) {
+        pthread_cond_broadcast(&s_cond);
+    }
+}
+
+static bool btc_idle(void *arg)
+{
+    uint64_t t = *(uint64_t *)arg;
+    return s_heap_len == 0 || s_heap[0].at > t;
+}
+
+void sim_btc_yield(void)
+{
+    /* The BTC task outranks application tasks: whatever a stack call made due
+     * right now is dispatched before the calling task gets the CPU back. */
+    if (sim_in_dispatcher()) {
+        return;
+    }
+    uint64_t t = s_now;
+    sim_block(btc_idle, &t, SIM_FOREVER);
+}
+
+bool sim_in_dispatcher(void)
+{
+    return pthread_equal(pthread_self(), s_dispatcher);
+}
+
+void sim_task_priority(uint32_t prio)
+{
+    s_prio = prio;
+}
+
+void sim_task_started(void)
+{
+    s_running++;
+}
+
+void sim_task_exited(void)
+{
+    s_running--;
+    pthread_cond_broadcast(&s_cond);
+}
+
+void sim_kernel_lock(void)
+{
+    pthread_mutex_lock(&s_lock);
+}
+
+void sim_kernel_unlock(void)
+{
+    pthread_mutex_unlock(&s_lock);
+}
+
+uint32_t sim_rand(void)
+{
+    /* xorshift64* */
+    s_rng ^= s_rng >> 12;
+    s_rng ^= s_rng << 25;
+    s_rng ^= s_rng >> 27;
+    return (uint32_t)((s_rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+uint64_t sim_host_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void sim_account_callback(bool gap, uint32_t event, uint64_t ns)
+{
+    if (gap) {
+        s_stats.gap_events++;
+    } else {
+        s_stats.gattc_events++;
+    }
+    s_stats.cb_ns_total += ns;
+    if (ns > s_stats.cb_ns_max) {
+        s_stats.cb_ns_max    = ns;
+        s_stats.cb_max_gap   = gap;
+        s_stats.cb_max_event = event;
+    }
+    uint64_t bucket = ns / SIM_CB_HIST_NS;
+    s_stats.cb_hist[bucket < SIM_CB_HIST_LEN ? bucket : SIM_CB_HIST_LEN - 1U]++;
+}
+
+uint64_t sim_callback_percentile_ns(uint32_t permille)
+{
+    /* Upper bound of the bucket holding the permille-th duration, the maximum for the open ended one */
+    uint64_t events = s_stats.gap_events + s_stats.gattc_events;
+    uint64_t want   = (events * permille + 999U) / 1000U;
+    uint64_t seen   = 0U;
+    for (uint32_t b = 0; b < SIM_CB_HIST_LEN - 1U; b++) {
+        seen += s_stats.cb_hist[b];
+        if (seen >= want && seen) {
+            uint64_t ns = (uint64_t)(b + 1U) * SIM_CB_HIST_NS;
+            return (ns < s_stats.cb_ns_max) ? ns : s_stats.cb_ns_max;
+        }
+    }
+    return s_stats.cb_ns_max;
+}
+
+sim_stats_t *sim_stats_mut(void)
+{
+    return &s_stats;
+}
+
+esp_log_level_t sim_log_level(void)
+{
+    return s_log_level;
+}
+
+/* Driver API */
+void sim_init(uint32_t seed)
+{
+    pthread_mutex_lock(&s_lock);
+    s_dispatcher = pthread_self();
+    s_rng        = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)seed << 1 | 1U);
+    s_now        = 0;
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+void sim_set_log_level(esp_log_level_t level)
+{
+    s_log_level = level;
+}
+
+bool sim_run(uint64_t until_us, sim_done_fn_t done, void *arg)
+{
+    for (;;) {
+        wait_quiescent();
+        if (done && done(arg)) {
+            return true;
+        }
+
+        uint64_t t_ev = s_heap_len ? s_heap[0].at : SIM_FOREVER;
+        uint64_t t_wt = next_deadline();
+        uint64_t t    = t_ev < t_wt ? t_ev : t_wt;
+        if (t == SIM_FOREVER || t > until_us) {
+            s_now = until_us;
+            return false;
+        }
+        if (t > s_now) {
+            s_now = t;
+        }
+
+        /* Tasks whose timeout elapsed run before events sharing the same instant */
+        if (t_wt <= t_ev) {
+            expire_waiters();
+            continue;
+        }
+        sim_event_t ev = heap_pop();
+        ev.fn(ev.ctx, ev.a, ev.b);
+        sim_wake();
+    }
+}
+
+uint64_t sim_now_us(void)
+{
+    return s_now;
+}
+
+const sim_stats_t *sim_get_stats(void)
+{
+    return &s_stats;
+}
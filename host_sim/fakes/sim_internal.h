@@ -0,0 +1,44 @@
+/**
+ * @file sim_internal.h
+ *
+ *
+ * @brief Kernel hooks shared between the simulator core and the fakes.
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* API */
+#include "sim.h"
+#include "freertos/FreeRTOS.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define SIM_TICK_US     (1000000ULL / configTICK_RATE_HZ)
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+void         sim_task_started(void);
+void         sim_task_priority(uint32_t prio);      /* Of the calling task, orders tasks woken together */
+void         sim_task_exited(void);
+void         sim_kernel_lock(void);
+void         sim_kernel_unlock(void);
+sim_stats_t *sim_stats_mut(void);
+
+/* Absolute virtual deadline for a FreeRTOS block time */
+static inline uint64_t sim_ticks_deadline(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY) {
+        return SIM_FOREVER;
+    }
+    return sim_now_us() + (uint64_t)ticks * SIM_TICK_US;
+}
@@ -0,0 +1,447 @@
+/**
+ * @file sim_main.c
+ *
+ *
+ * @brief Scenario runner: N simulated GATTS demo servers plus optional
+ *          non-matching advertisers, with the real client app_main running on
+ *          the simulated kernel. Reports time-to-all-connected (virtual time)
+ *          and callback throughput (host time).
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* API */
+#include "sim.h"
+#include "ble_client.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define SIM_DROP_MAX    16
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct {
+    int         servers;
+    int         noise;
+    int         sensors;                /* Advertise-only sensors, read through the client's decoder */
+    int         coded;                  /* The last servers advertise extended on LE Coded */
+    uint32_t    seed;
+    uint32_t    duration_s;
+    uint32_t    settle_ms;
+    int         log_level;
+    sim_server_cfg_t cfg;
+    int         n_drops;
+    int         drop_server[SIM_DROP_MAX];
+    uint32_t    drop_ms[SIM_DROP_MAX];
+    uint32_t    drop_silent_ms[SIM_DROP_MAX];
+    int         n_db_changes;
+    int         db_change_server[SIM_DROP_MAX];
+    uint32_t    db_change_ms[SIM_DROP_MAX];
+    const char *nvs_path;
+    uint32_t    no_poll_mask;           /* Peers whose polling stops once every server is up */
+} sim_options_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DECLARATIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Client entry point in main/ble_client.c */
+void app_main(void);
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static char s_peer_names[PROFILE_NUM][BLE_PEER_NAME_LEN_MAX + 1];
+static ble_peer_sub_t s_peer_subs[BLE_PEER_SUB_MAX];
+static ble_peer_read_t s_peer_reads[BLE_PEER_READ_MAX];
+static const ble_sample_fmt_t s_sample_fmt = { .mul = 10 };    /* As app_main decodes its peers' streams */
+
+/* * * * * * * * * * * * * * * *
+ * * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+static void usage(const char *argv0)
+{
+    printf("usage: %s [options]\n"
+           "  --servers N        simulated GATT servers named ESP_GATTS_DEMO_a.. (3); app_main adds\n"
+           "                     peers a-c, the runner adds the others to the client's peer table\n"
+           "  --noise N          additional non-matching advertisers (0)\n"
+           "  --sensors N        advertise-only sensors with a reading in manufacturer data (0)\n"
+           "  --adv-ms MS        advertising interval (100)\n"
+           "  --conn-ms MS       connection interval (30)\n"
+           "  --disc-rtts N      ATT round trips per service discovery (6)\n"
+           "  --notify-ms MS     notification period once subscribed, 0 = off (0)\n"
+           "  --notify-len N     notification payload bytes (20)\n"
+           "  --streams N        notifying characteristics per server, 1-4: the two GATTS demo\n"
+           "                     profiles, then 128-bit ones; peers past c subscribe to and poll all (2)\n"
+           "  --ce-pdus N        data PDUs per connection event, 0 = interval limited (6)\n"
+           "  --drop I:MS[:OUT]  drop the link to server I at MS, then keep it out of range\n"
+           "                     for OUT ms (repeatable)\n"
+           "  --db-change I:MS   move server I's application handles at MS, with a Service\n"
+           "                     Changed indication if connected (repeatable)\n"
+           "  --no-db-hash       servers without a Database Hash characteristic\n"
+           "  --ll-octets N      longest data PDU payload the servers take, 27 = no DLE (251)\n"
+           "  --no-2m            servers without LE 2M\n"
+           "  --no-read-multi    servers refusing Read Multiple, polls fall back to one read each\n"
+           "  --coded N          the last N servers advertise extended on LE Coded, only\n"
+           "                     found when built with BLE_50_FEATURES (0)\n"
+           "  --no-poll I        stop polling peer I once every server is up (repeatable)\n"
+           "  --nvs FILE         load NVS from FILE and save it back on exit, to simulate reboots\n"
+           "  --duration S       virtual time limit in seconds (30)\n"
+           "  --settle MS        keep running after all servers are up (0)\n"
+           "  --seed N           RNG seed (1)\n"
+           "  --log N            print client logs up to level N, 0-5 (2)\n", argv0);
+}
+
+static bool parse_args(int argc, char **argv, sim_options_t *opt)
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->servers    = 3;
+    opt->seed       = 1;
+    opt->duration_s = 30;
+    opt->log_level  = ESP_LOG_WARN;
+    sim_server_cfg_default(&opt->cfg);
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--no-db-hash") == 0) {
+            opt->cfg.db_hash = false;
+            continue;
+        }
+        if (strcmp(arg, "--no-2m") == 0) {
+            opt->cfg.phy_2m = false;
+            continue;
+        }
+        if (strcmp(arg, "--no-read-multi") == 0) {
+            opt->cfg.read_multi = false;
+            continue;
+        }
+        if (strcmp(arg, "--help") == 0 || !val) {
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--servers") == 0) {
+            opt->servers = atoi(val);
+        } else if (strcmp(arg, "--coded") == 0) {
+            opt->coded = atoi(val);
+        } else if (strcmp(arg, "--noise") == 0) {
+            opt->noise = atoi(val);
+        } else if (strcmp(arg, "--sensors") == 0) {
+            opt->sensors = atoi(val);
+        } else if (strcmp(arg, "--adv-ms") == 0) {
+            opt->cfg.adv_interval_us = (uint32_t)(atof(val) * 1000.0);
+        } else if (strcmp(arg, "--conn-ms") == 0) {
+            opt->cfg.conn_interval_us = (uint32_t)(atof(val) * 1000.0);
+        } else if (strcmp(arg, "--disc-rtts") == 0) {
+            opt->cfg.discovery_rtts = (uint8_t)atoi(val);
+        } else if (strcmp(arg, "--notify-ms") == 0) {
+            opt->cfg.notify_period_us = (uint32_t)(atof(val) * 1000.0);
+        } else if (strcmp(arg, "--notify-len") == 0) {
+            opt->cfg.notify_len = (uint16_t)atoi(val);
+        } else if (strcmp(arg, "--streams") == 0 && atoi(val) >= 1 && atoi(val) <= (int)BLE_PEER_SUB_MAX) {
+            opt->cfg.streams = (uint8_t)atoi(val);
+        } else if (strcmp(arg, "--ce-pdus") == 0) {
+            opt->cfg.ce_pdus = (uint8_t)atoi(val);
+        } else if (strcmp(arg, "--ll-octets") == 0 && atoi(val) >= 27 && atoi(val) <= 251) {
+            opt->cfg.ll_octets_max = (uint16_t)atoi(val);
+        } else if (strcmp(arg, "--drop") == 0 && opt->n_drops < SIM_DROP_MAX) {
+            if (sscanf(val, "%d:%u:%u", &opt->drop_server[opt->n_drops], &opt->drop_ms[opt->n_drops],
+                       &opt->drop_silent_ms[opt->n_drops]) < 2) {
+                return false;
+            }
+            opt->n_drops++;
+        } else if (strcmp(arg, "--db-change") == 0 && opt->n_db_changes < SIM_DROP_MAX) {
+            if (sscanf(val, "%d:%u", &opt->db_change_server[opt->n_db_changes], &opt->db_change_ms[opt->n_db_changes]) != 2) {
+                return false;
+            }
+            opt->n_db_changes++;
+        } else if (strcmp(arg, "--no-poll") == 0 && atoi(val) >= 0 && atoi(val) < (int)PROFILE_NUM) {
+            opt->no_poll_mask |= 1U << atoi(val);
+        } else if (strcmp(arg, "--nvs") == 0) {
+            opt->nvs_path = val;
+        } else if (strcmp(arg, "--duration") == 0) {
+            opt->duration_s = (uint32_t)atoi(val);
+        } else if (strcmp(arg, "--settle") == 0) {
+            opt->settle_ms = (uint32_t)atoi(val);
+        } else if (strcmp(arg, "--seed") == 0) {
+            opt->seed = (uint32_t)strtoul(val, NULL, 0);
+        } else if (strcmp(arg, "--log") == 0) {
+            opt->log_level = atoi(val);
+        } else {
+            return false;
+        }
+    }
+    return opt->servers > 0 && opt->servers + opt->noise + opt->sensors <= (int)SIM_SERVER_MAX;
+}
+
+static bool all_subscribed(void *arg)
+{
+    /* Subscribed rather than discovered: peers with cached handles skip discovery */
+    int servers = *(int *)arg;
+    for (int i = 0; i < servers; i++) {
+        if (sim_get_server_stats(i)->t_subscribed == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    sim_options_t opt;
+    if (!parse_args(argc, argv, &opt)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    sim_init(opt.seed);
+    sim_set_log_level((esp_log_level_t)opt.log_level);
+
+    char name[32];
+    for (int i = 0; i < opt.servers; i++) {
+        sim_server_cfg_t cfg = opt.cfg;
+        cfg.adv_phy = (i >= opt.servers - opt.coded) ? ESP_BLE_GAP_PRI_PHY_CODED : 0U;
+        /* app_main's peers subscribe to the two GATTS demo streams only, the runner's to all */
+        cfg.subscriptions = (i < 3 && cfg.streams > 2U) ? 2U : 0U;
+        snprintf(name, sizeof(name), "ESP_GATTS_DEMO_%c", 'a' + i);
+        sim_add_server(name, &cfg);
+    }
+    sim_server_cfg_t noise = opt.cfg;
+    noise.connectable = false;
+    for (int i = 0; i < opt.noise; i++) {
+        snprintf(name, sizeof(name), "SENSOR_%04X", (unsigned)(sim_rand() & 0xFFFF));
+        sim_add_server(name, &noise);
+    }
+    sim_server_cfg_t sensor = noise;
+    sensor.mfr_id = DEMO_SENSOR_COMPANY_ID;
+    for (int i = 0; i < opt.sensors; i++) {
+        snprintf(name, sizeof(name), "SENSOR_%04X", (unsigned)(sim_rand() & 0xFFFF));
+        sim_add_server(name, &sensor);
+    }
+    for (int i = 0; i < opt.n_db_changes; i++) {
+        if (opt.db_change_server[i] >= 0 && opt.db_change_server[i] < opt.servers) {
+            sim_db_change_at(opt.db_change_server[i], SIM_MS(opt.db_change_ms[i]));
+        }
+    }
+    if (opt.nvs_path) {
+        sim_nvs_load(opt.nvs_path);
+    }
+    for (int i = 0; i < opt.n_drops; i++) {
+        if (opt.drop_server[i] >= 0 && opt.drop_server[i] < opt.servers) {
+            sim_drop_link_at(opt.drop_server[i], SIM_MS(opt.drop_ms[i]), opt.drop_silent_ms[i]);
+        }
+    }
+
+    /* app_main adds the first three; ble_peer_add works before the client starts */
+    for (uint8_t i = 0; i < opt.cfg.streams; i++) {
+        sim_stream_uuid(i, &s_peer_subs[i].service_uuid, &s_peer_subs[i].charact_uuid);
+        s_peer_subs[i].fmt           = &s_sample_fmt;
+        s_peer_reads[i].service_uuid = s_peer_subs[i].service_uuid;
+        s_peer_reads[i].charact_uuid = s_peer_subs[i].charact_uuid;
+        s_peer_reads[i].len          = REMOTE_READ_LEN;
+    }
+    for (int i = 3; i < opt.servers && i < (int)PROFILE_NUM; i++) {
+        snprintf(s_peer_names[i], sizeof(s_peer_names[i]), "ESP_GATTS_DEMO_%c", 'a' + i);
+        ble_peer_cfg_t peer = {
+            .name         = s_peer_names[i],
+            .service_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_SERVICE_UUID,}, },
+            .charact_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_NOTIFY_CHAR_UUID,}, },
+            .subs         = s_peer_subs,
+            .sub_count    = opt.cfg.streams,
+            .reads        = s_peer_reads,
+            .read_count   = opt.cfg.streams,
+            .priority     = (uint8_t)i,
+        };
+        uint8_t peer_id;
+#ifndef CONFIG_BLE_CLIENT_LOW_POWER
+        if (ble_peer_add(&peer, &peer_id) == ESP_OK) {
+            ble_peer_poll(peer_id, true);
+        }
+#else
+        /* Notifications only, as app_main does in low-power builds */
+        ble_peer_add(&peer, &peer_id);
+#endif
+    }
+
+    sim_start_app(app_main);
+
+    uint64_t host_t0 = sim_host_ns();
+    uint64_t until   = SIM_SEC(opt.duration_s);
+    bool     up      = sim_run(until, all_subscribed, &opt.servers);
+    uint64_t t_up    = sim_now_us();
+    uint32_t reads_up[PROFILE_NUM]    = {0};
+    uint32_t requests_up[PROFILE_NUM] = {0};
+    for (uint8_t id = 0; id < PROFILE_NUM; id++) {
+        reads_up[id]    = ble_client.cold.stats[id].reads;
+        requests_up[id] = ble_client.cold.stats[id].read_requests;
+    }
+    uint32_t frames_up   = ble_client.agg.frames;
+    uint32_t complete_up = ble_client.agg.complete;
+    ble_power_stats_t power_up;
+    ble_power_get(&power_up);
+    for (uint8_t id = 0; id < PROFILE_NUM; id++) {
+        if (opt.no_poll_mask & (1U << id)) {
+            ble_peer_poll(id, false);
+        }
+    }
+    if (up && opt.settle_ms) {
+        sim_run(t_up + SIM_MS(opt.settle_ms), NULL, NULL);
+    }
+    uint64_t host_ns = sim_host_ns() - host_t0;
+    if (opt.nvs_path) {
+        sim_nvs_save(opt.nvs_path);
+    }
+
+    /* Whatever the drain task has not printed yet */
+    ble_log_flush();
+    sim_print_report();
+
+    /* Link recovery as counted by the client */
+    for (uint8_t id = 0; id < PROFILE_NUM; id++) {
+        ble_peer_stats_t st;
+        if (ble_peer_get_stats(id, &st) == ESP_OK && st.disconnects) {
+            printf("recovery %-16s %u lost, %u back, %u retries, MTTR %.1f ms, max %u ms\n",
+                   ble_client.cold.remote_dev_name[id], st.disconnects, st.reconnects, st.retries,
+                   st.reconnects ? (double)st.recover_total_ms / st.reconnects : 0.0, st.recover_max_ms);
+        }
+    }
+
+    /* Polling throughput over the settle window, all links up */
+    if (up && opt.settle_ms) {
+        for (uint8_t id = 0; id < PROFILE_NUM; id++) {
+            ble_peer_stats_t st;
+            if (ble_peer_get_stats(id, &st) == ESP_OK && (ble_client.hot.poll_mask & (1U << id))) {
+                printf("poll %-16s %.1f reads/s in %.1f requests/s, %u errors\n", ble_client.cold.remote_dev_name[id],
+                       (double)(st.reads - reads_up[id]) * 1000.0 / opt.settle_ms,
+                       (double)(st.read_requests - requests_up[id]) * 1000.0 / opt.settle_ms, st.read_errors);
+            }
+        }
+    }
+
+    /* Connection parameters the policy settled on, as applied by the servers */
+    for (int i = 0; i < opt.servers; i++) {
+        const sim_server_stats_t *st = sim_get_server_stats(i);
+        if (st->conn_updates) {
+            printf("conn %-16s interval %.2f ms, latency %u, %u updates, LE %s, %u-byte PDUs\n", st->name,
+                   st->conn_interval_us / 1000.0, st->conn_latency, st->conn_updates,
+                   (st->phy == ESP_BLE_GAP_PHY_CODED) ? "Coded" : (st->phy == ESP_BLE_GAP_PHY_2M) ? "2M" : "1M", st->ll_octets);
+        }
+    }
+
+    /* Scan modes: what each cost in listening time and link traffic, and how fast it found peers */
+    ble_scan_sample();
+    printf("\n%-10s %9s %7s %6s %7s %5s %9s %9s %12s\n", "scan mode", "time ms", "listen", "starts", "reports",
+           "found", "avg ms", "max ms", "PDUs/s/link");
+    for (uint32_t m = 0; m < BLE_SCAN_MODE_NUM; m++) {
+        ble_scan_mode_stats_t st;
+        ble_scan_get_stats((ble_scan_mode_t)m, &st);
+        if (st.time_us) {
+            printf("%-10s %9.1f %6.1f%% %6u %7u %5u %9.1f %9.1f %12.1f\n", ble_scan_mode_name((ble_scan_mode_t)m),
+                   st.time_us / 1000.0, 100.0 * st.listen_us / st.time_us, st.starts, st.reports, st.found,
+                   st.found ? st.found_us_sum / 1000.0 / st.found : 0.0, st.found_us_max / 1000.0,
+                   st.link_us ? st.link_pdus * 1e6 / st.link_us : 0.0);
+        }
+    }
+    printf("\n");
+
+    /* Discovery arena use, against BLE_DISC_CHAR_MAX / BLE_DISC_DESCR_MAX */
+    for (uint8_t id = 0; id < PROFILE_NUM; id++) {
+        const ble_disc_arena_t *disc = &ble_client.cold.disc[id];
+        if (ble_client.peer_mask & (1U << id)) {
+            printf("arena %-16s chars %u/%u, descrs %u/%u, %u truncated\n", ble_client.cold.remote_dev_name[id],
+                   disc->char_hwm, BLE_DISC_CHAR_MAX, disc->descr_hwm, BLE_DISC_DESCR_MAX, (unsigned)disc->truncated);
+        }
+    }
+
+    /* Subscriptions carried by each link */
+    for (uint8_t id = 0; id < PROFILE_NUM; id++) {
+        ble_peer_link_t  link;
+        ble_peer_stats_t st;
+        if ((ble_client.peer_mask & (1U << id)) && ble_peer_get_link(id, &link) == ESP_OK &&
+            ble_peer_get_stats(id, &st) == ESP_OK) {
+            printf("streams %-16s %d/%u subscribed, %u notifications\n", ble_client.cold.remote_dev_name[id],
+                   __builtin_popcount(link.subscribed), ble_client.cold.sub_count[id], st.notifies);
+        }
+    }
+
+    /* Samples of all peers aggregated per time slot by app_main, over the settle window */
+    if (up && opt.settle_ms) {
+        printf("slots %u ms: %u frames, %u with every peer, %u late samples, %u ahead\n", BLE_AGG_WINDOW_MS,
+               ble_client.agg.frames - frames_up, ble_client.agg.complete - complete_up, ble_client.agg.late,
+               ble_client.agg.ahead);
+    }
+
+    /* Client task wakeups over the settle window; task code takes no virtual time, so the awake share is 0 here */
+    if (up && opt.settle_ms) {
+        ble_power_stats_t power;
+        ble_power_get(&power);
+        printf("power: %.1f client task wakeups/s over the settle window\n",
+               (double)(power.wakeups - power_up.wakeups) * 1000.0 / opt.settle_ms);
+    }
+
+    /* Where bring-up time goes, over all peers */
+    printf("\n%-10s %6s %9s %9s %9s %9s %9s\n", "stage", "n", "min ms", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    for (uint32_t st = 0; st < BLE_LAT_STAGE_NUM; st++) {
+        ble_lat_hist_t h;
+        ble_lat_get((ble_lat_stage_t)st, &h);
+        if (h.count) {
+            printf("%-10s %6u %9.1f %9.1f %9.1f %9.1f %9.1f\n", ble_lat_stage_name((ble_lat_stage_t)st), h.count,
+                   h.min_us / 1000.0, ble_lat_percentile(&h, 50) / 1000.0, ble_lat_percentile(&h, 90) / 1000.0,
+                   ble_lat_percentile(&h, 99) / 1000.0, h.max_us / 1000.0);
+        }
+    }
+    printf("\n");
+
+    ble_log_stats_t log;
+    ble_log_get_stats(&log);
+    printf("deferred log: %u queued, %u printed, %u over the rate limit, %u dropped, ring high-water %u/%u\n",
+           log.queued, log.printed, log.suppressed, log.dropped, log.ring_hwm, BLE_LOG_RING_LEN);
+
+    /* Handling takes no virtual time, the task's wait and run maxima stay at 0 here */
+    ble_evt_stats_t evt;
+    ble_evt_get_stats(&evt);
+    printf("client task: %u events, queue high-water %u/%u, %u dropped, %u lost, %u spilled\n",
+           evt.handled, evt.queue_hwm, BLE_EVT_QUEUE_LEN, evt.dropped, evt.lost, evt.spilled);
+
+    /* Sensor readings: advertised, and decoded into the client's ring during scan windows */
+    if (opt.sensors) {
+        uint32_t published = 0U;
+        for (int i = opt.servers + opt.noise; i < opt.servers + opt.noise + opt.sensors; i++) {
+            published += sim_get_server_stats(i)->readings;
+        }
+        ble_notify_ring_t *ring = ble_adv_ring();
+        printf("sensors: %d, %u readings advertised, %u decoded (%.0f%%), %u dropped by the ring\n", opt.sensors,
+               published, ring->pushed, published ? 100.0 * ring->pushed / published : 0.0, ring->dropped);
+    }
+
+    int subscribed = 0;
+    for (int i = 0; i < opt.servers; i++) {
+        subscribed += sim_get_server_stats(i)->t_subscribed != 0;
+    }
+    if (up) {
+        printf("time-to-all-connected: %.1f ms (%d servers, %d noise)\n",
+               (double)(t_up - sim_get_stats()->t_scan_start) / 1000.0, opt.servers, opt.noise);
+    } else {
+        printf("time-to-all-connected: not reached, %d/%d servers subscribed after %u s\n",
+               subscribed, opt.servers, opt.duration_s);
+    }
+    printf("simulated %.3f s in %.3f s host time\n", (double)sim_now_us() / 1e6, (double)host_ns / 1e9);
+
+    /* Tasks are parked inside the simulated kernel; leave without joining them */
+    fflush(stdout);
+    _Exit(up ? 0 : 1);
+}
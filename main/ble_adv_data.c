@@ -0,0 +1,156 @@
+/**
+ * @file ble_adv_data.c
+ *
+ *
+ * @brief Advertising data parsing, see ble_adv_data.h.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stddef.h>
+/* ESP32 API */
+#include "esp_gap_ble_api.h"
+/* API */
+#include "ble_adv_data.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define LE16(p)     ((uint16_t)((p)[0] | ((uint16_t)(p)[1] << 8)))
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Locals */
+static void adv_svc_data(ble_adv_fields_t *fields, const uint8_t *p, uint8_t len, uint8_t uuid_len)
+{
+    if (len < uuid_len) {
+        fields->dropped++;
+        return;
+    }
+    if (fields->svc_count == BLE_ADV_SVC_DATA_MAX) {
+        fields->dropped++;
+        return;
+    }
+    ble_adv_field_t *f = &fields->svc[fields->svc_count++];
+    f->id       = LE16(p);
+    f->uuid_len = uuid_len;
+    f->uuid     = p;
+    f->data     = p + uuid_len;
+    f->len      = (uint8_t)(len - uuid_len);
+}
+
+/* API */
+void ble_adv_parse(const uint8_t *data, uint16_t len, ble_adv_fields_t *fields)
+{
+    fields->name          = NULL;
+    fields->name_len      = 0U;
+    fields->name_complete = false;
+    fields->has_flags     = false;
+    fields->has_tx_power  = false;
+    fields->uuid16_count  = 0U;
+    fields->uuid128_count = 0U;
+    fields->svc_count     = 0U;
+    fields->mfr_count     = 0U;
+    fields->dropped       = 0U;
+    if (data == NULL) {
+        return;
+    }
+
+    /* Each structure is a length byte, then type and length - 1 bytes of payload */
+    for (uint16_t pos = 0; pos + 1U < len && data[pos] != 0U; pos += data[pos] + 1U) {
+        if (pos + 1U + data[pos] > len) {
+            fields->dropped++;
+            break;
+        }
+        const uint8_t *p  = &data[pos + 2U];
+        uint8_t        n  = (uint8_t)(data[pos] - 1U);
+        switch (data[pos + 1U]) {
+            case ESP_BLE_AD_TYPE_FLAG:
+                fields->has_flags = n >= 1U;
+                fields->flags     = n ? p[0] : 0U;
+                break;
+            case ESP_BLE_AD_TYPE_16SRV_PART:
+            case ESP_BLE_AD_TYPE_16SRV_CMPL:
+                for (uint8_t i = 0; i + 2U <= n; i += 2U) {
+                    if (fields->uuid16_count == BLE_ADV_UUID16_MAX) {
+                        fields->dropped++;
+                        break;
+                    }
+                    fields->uuid16[fields->uuid16_count++] = LE16(&p[i]);
+                }
+                break;
+            case ESP_BLE_AD_TYPE_128SRV_PART:
+            case ESP_BLE_AD_TYPE_128SRV_CMPL:
+                for (uint8_t i = 0; i + 16U <= n; i += 16U) {
+                    if (fields->uuid128_count == BLE_ADV_UUID128_MAX) {
+                        fields->dropped++;
+                        break;
+                    }
+                    fields->uuid128[fields->uuid128_count++] = &p[i];
+                }
+                break;
+            case ESP_BLE_AD_TYPE_NAME_SHORT:
+                /* A complete name wins wherever it comes */
+                if (!fields->name_complete) {
+                    fields->name     = p;
+                    fields->name_len = n;
+                }
+                break;
+            case ESP_BLE_AD_TYPE_NAME_CMPL:
+                if (!fields->name_complete) {
+                    fields->name          = p;
+                    fields->name_len      = n;
+                    fields->name_complete = true;
+                }
+                break;
+            case ESP_BLE_AD_TYPE_TX_PWR:
+                fields->has_tx_power = n >= 1U;
+                fields->tx_power     = n ? (int8_t)p[0] : 0;
+                break;
+            case ESP_BLE_AD_TYPE_SERVICE_DATA:
+                adv_svc_data(fields, p, n, 2U);
+                break;
+            case ESP_BLE_AD_TYPE_32SERVICE_DATA:
+                adv_svc_data(fields, p, n, 4U);
+                break;
+            case ESP_BLE_AD_TYPE_128SERVICE_DATA:
+                adv_svc_data(fields, p, n, 16U);
+                break;
+            case ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE:
+                if (n < 2U || fields->mfr_count == BLE_ADV_MFR_DATA_MAX) {
+                    fields->dropped++;
+                    break;
+                }
+                fields->mfr[fields->mfr_count++] = (ble_adv_field_t) {
+                    .id = LE16(p), .uuid_len = 0U, .len = (uint8_t)(n - 2U), .uuid = NULL, .data = p + 2U,
+                };
+                break;
+            default:
+                /* 32-bit UUID lists and everything else are skipped */
+                break;
+        }
+    }
+}
+
+const uint8_t *ble_adv_find(const uint8_t *data, uint16_t len, uint8_t type, uint8_t *ad_len)
+{
+    /* Same walk as esp_ble_resolve_adv_data, bounded by len: a structure running past the end is dropped */
+    for (uint16_t pos = 0; pos + 1U < len && data[pos] != 0U; pos += data[pos] + 1U) {
+        if (pos + 1U + data[pos] > len) {
+            break;
+        }
+        if (data[pos + 1U] == type) {
+            *ad_len = (uint8_t)(data[pos] - 1U);
+            return &data[pos + 2U];
+        }
+    }
+    return NULL;
+}
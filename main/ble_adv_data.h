@@ -0,0 +1,77 @@
+/**
+ * @file ble_adv_data.h
+ *
+ *
+ * @brief Advertising data parsing. ble_adv_parse walks the AD structures of
+ *          a report once and records the name, service UUID lists, service
+ *          data and manufacturer specific data it finds. Entries point into
+ *          the report buffer and are only valid while it is, e.g. inside the
+ *          GAP callback. Fixed capacities, no heap: entries beyond them are
+ *          counted in dropped.
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BLE_ADV_UUID16_MAX      8U      /* 16-bit service UUIDs, complete and incomplete lists together */
+#define BLE_ADV_UUID128_MAX     2U
+#define BLE_ADV_SVC_DATA_MAX    4U      /* Service data structures, any UUID size */
+#define BLE_ADV_MFR_DATA_MAX    2U      /* Manufacturer specific data structures */
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* One service data or manufacturer specific data structure */
+typedef struct ble_adv_field {
+    uint16_t        id;                 /* Company identifier, or the 16-bit service UUID (low 16 bits of longer ones) */
+    uint8_t         uuid_len;           /* Service data: 2, 4 or 16 bytes of UUID at uuid; 0 for manufacturer data */
+    uint8_t         len;                /* Bytes at data */
+    const uint8_t  *uuid;
+    const uint8_t  *data;               /* What follows the company identifier or UUID */
+} ble_adv_field_t;
+
+typedef struct ble_adv_fields {
+    const uint8_t  *name;               /* Local name, not terminated, NULL if none */
+    uint8_t         name_len;
+    bool            name_complete;      /* Complete rather than shortened local name */
+    bool            has_flags;
+    uint8_t         flags;
+    bool            has_tx_power;
+    int8_t          tx_power;           /* dBm */
+    uint8_t         uuid16_count;
+    uint8_t         uuid128_count;
+    uint8_t         svc_count;
+    uint8_t         mfr_count;
+    uint8_t         dropped;            /* Entries over the capacities above, and malformed structures */
+    uint16_t        uuid16[BLE_ADV_UUID16_MAX];
+    const uint8_t  *uuid128[BLE_ADV_UUID128_MAX];   /* 16 bytes each, little endian as on air */
+    ble_adv_field_t svc[BLE_ADV_SVC_DATA_MAX];
+    ble_adv_field_t mfr[BLE_ADV_MFR_DATA_MAX];
+} ble_adv_fields_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Fills fields from len bytes of AD structures, e.g. ble_adv of a legacy report (advertising data then
+ * scan response) or adv_data of an extended one. The walk stops at a zero length or a structure running
+ * past len. */
+void ble_adv_parse(const uint8_t *data, uint16_t len, ble_adv_fields_t *fields);
+
+/* First AD structure of a type within len bytes, its payload length in *ad_len; NULL if absent. For callers
+ * after a single field, it stops as soon as that one is found. */
+const uint8_t *ble_adv_find(const uint8_t *data, uint16_t len, uint8_t type, uint8_t *ad_len);
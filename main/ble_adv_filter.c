@@ -0,0 +1,195 @@
+/**
+ * @file ble_adv_filter.c
+ *
+ *
+ * @brief Advertising report prefilter, see ble_adv_filter.h.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <string.h>
+/* ESP32 API */
+#include "esp_gap_ble_api.h"
+/* API */
+#include "ble_adv_data.h"
+#include "ble_adv_filter.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define FNV1A_OFFSET    2166136261U
+#define FNV1A_PRIME     16777619U
+#define BDA_KEY_VALID   (1ULL << 48)    /* Keeps keys non-zero, 0 marks an empty reject slot */
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Locals */
+static uint32_t name_hash(const uint8_t *name, uint8_t len)
+{
+    uint32_t hash = FNV1A_OFFSET;
+    for (uint8_t i = 0; i < len; i++) {
+        hash = (hash ^ name[i]) * FNV1A_PRIME;
+    }
+    return hash;
+}
+
+static inline uint64_t bda_key(const esp_bd_addr_t bda)
+{
+    /* 48-bit address as one integer, compared in a single instruction instead of memcmp */
+    return ((uint64_t)bda[0] << 40) | ((uint64_t)bda[1] << 32) | ((uint64_t)bda[2] << 24) |
+           ((uint64_t)bda[3] << 16) | ((uint64_t)bda[4] << 8)  | (uint64_t)bda[5] | BDA_KEY_VALID;
+}
+
+static inline uint32_t reject_slot(uint64_t key)
+{
+    /* Fibonacci hashing, the low address bytes carry the entropy for public and random addresses */
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> (64U - BLE_ADV_FILTER_REJECT_BITS));
+}
+
+static int filter_match(ble_adv_filter_t *filter, const esp_bd_addr_t bda, const uint8_t *adv_data, uint16_t len,
+                        const uint8_t *name, uint8_t name_len)
+{
+    filter->stats_reports++;
+
+    /* 1. Known peers */
+    uint64_t key = bda_key(bda);
+    for (uint32_t mask = filter->allow_mask; mask; mask &= mask - 1U) {
+        int id = __builtin_ctz(mask);
+        if (filter->allow[id] == key) {
+            return id;
+        }
+    }
+
+    /* 2. Devices already rejected by name */
+    uint64_t *reject = &filter->reject[reject_slot(key)];
+    if (*reject == key) {
+        filter->stats_rejected_fast++;
+        return BLE_ADV_FILTER_NO_MATCH;
+    }
+
+    /* 3. Name lookup, unless the caller parsed it already; reports without a name are not cached, the name
+     * may come with the scan response */
+    if (adv_data) {
+        name = ble_adv_find(adv_data, len, ESP_BLE_AD_TYPE_NAME_CMPL, &name_len);
+    }
+    if (name == NULL) {
+        return BLE_ADV_FILTER_NO_MATCH;
+    }
+    if (name_len > BLE_ADV_FILTER_NAME_LEN_MAX || !(filter->len_mask & (1ULL << name_len))) {
+        filter->stats_rejected_fast++;
+        *reject = key;
+        return BLE_ADV_FILTER_NO_MATCH;
+    }
+
+    uint32_t hash = name_hash(name, name_len);
+    for (uint8_t i = 0; i < filter->name_count; i++) {
+        const ble_adv_name_entry_t *entry = &filter->names[i];
+        if (entry->hash == hash && entry->len == name_len && memcmp(entry->name, name, name_len) == 0) {
+            return entry->id;
+        }
+    }
+    *reject = key;
+    return BLE_ADV_FILTER_NO_MATCH;
+}
+
+/* API */
+void ble_adv_filter_init(ble_adv_filter_t *filter)
+{
+    memset(filter, 0, sizeof(*filter));
+}
+
+esp_err_t ble_adv_filter_add_name(ble_adv_filter_t *filter, const char *name, uint8_t id)
+{
+    ble_adv_name_entry_t entry;
+    esp_err_t ret = ble_adv_filter_name_entry(name, id, &entry);
+    if (ret == ESP_OK) {
+        ret = ble_adv_filter_insert(filter, &entry);
+    }
+    if (ret == ESP_OK) {
+        /* A cached reject may be the device that just became wanted */
+        ble_adv_filter_clear_rejects(filter);
+    }
+    return ret;
+}
+
+esp_err_t ble_adv_filter_name_entry(const char *name, uint8_t id, ble_adv_name_entry_t *entry)
+{
+    size_t len = strlen(name);
+    if (len > BLE_ADV_FILTER_NAME_LEN_MAX || id >= BLE_ADV_FILTER_NAMES_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    entry->name = name;
+    entry->len  = (uint8_t)len;
+    entry->id   = id;
+    entry->hash = name_hash((const uint8_t *)name, (uint8_t)len);
+    return ESP_OK;
+}
+
+esp_err_t ble_adv_filter_insert(ble_adv_filter_t *filter, const ble_adv_name_entry_t *entry)
+{
+    if (filter->name_count >= BLE_ADV_FILTER_NAMES_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    filter->names[filter->name_count++] = *entry;
+    filter->len_mask |= (1ULL << entry->len);
+    return ESP_OK;
+}
+
+void ble_adv_filter_remove(ble_adv_filter_t *filter, uint8_t id)
+{
+    uint8_t kept = 0;
+    filter->len_mask = 0;
+    for (uint8_t i = 0; i < filter->name_count; i++) {
+        if (filter->names[i].id != id) {
+            filter->names[kept] = filter->names[i];
+            filter->len_mask |= (1ULL << filter->names[kept].len);
+            kept++;
+        }
+    }
+    filter->name_count = kept;
+    ble_adv_filter_forget(filter, id);
+}
+
+void ble_adv_filter_allow(ble_adv_filter_t *filter, const esp_bd_addr_t bda, uint8_t id)
+{
+    if (id >= BLE_ADV_FILTER_NAMES_MAX) {
+        return;
+    }
+    filter->allow[id] = bda_key(bda);
+    filter->allow_mask |= (1U << id);
+}
+
+void ble_adv_filter_forget(ble_adv_filter_t *filter, uint8_t id)
+{
+    if (id < BLE_ADV_FILTER_NAMES_MAX) {
+        filter->allow_mask &= ~(1U << id);
+    }
+}
+
+void ble_adv_filter_clear_rejects(ble_adv_filter_t *filter)
+{
+    memset(filter->reject, 0, sizeof(filter->reject));
+}
+
+int ble_adv_filter_match(ble_adv_filter_t *filter, const esp_bd_addr_t bda, uint8_t *adv_data)
+{
+    return ble_adv_filter_match_len(filter, bda, adv_data, ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX);
+}
+
+int ble_adv_filter_match_len(ble_adv_filter_t *filter, const esp_bd_addr_t bda, const uint8_t *adv_data, uint16_t len)
+{
+    return filter_match(filter, bda, adv_data, len, NULL, 0U);
+}
+
+int ble_adv_filter_match_name(ble_adv_filter_t *filter, const esp_bd_addr_t bda, const uint8_t *name, uint8_t name_len)
+{
+    return filter_match(filter, bda, NULL, 0U, name, name_len);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file ble_adv_filter.h
+ *
+ *
+ * @brief Advertising report prefilter for the scan-result hot path.
+ *          Reports are checked against a BDA allow-list of already matched
+ *          peers and a direct-mapped cache of rejected BDAs before the
+ *          advertising data is touched. Remaining reports are matched by
+ *          complete local name through a length bitmap and an FNV-1a hash,
+ *          so only a real candidate reaches memcmp.
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdint.h>
+#include <stdbool.h>
+/* ESP32 API */
+#include "esp_err.h"
+#include "esp_bt_defs.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BLE_ADV_FILTER_NAMES_MAX        16U     /* Names that can be matched */
+#define BLE_ADV_FILTER_NAME_LEN_MAX     63U     /* Longest name, bounded by the length bitmap */
+#define BLE_ADV_FILTER_REJECT_BITS      8U
+#define BLE_ADV_FILTER_REJECT_SLOTS     (1U << BLE_ADV_FILTER_REJECT_BITS)  /* Rejected BDA cache entries */
+#define BLE_ADV_FILTER_NO_MATCH         (-1)
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct ble_adv_name_entry {
+    uint32_t        hash;
+    uint8_t         len;
+    uint8_t         id;
+    const char     *name;
+} ble_adv_name_entry_t;
+
+typedef struct ble_adv_filter {
+    uint64_t                len_mask;                                   /* Bit n set if some name is n bytes long */
+    uint8_t                 name_count;
+    ble_adv_name_entry_t    names[BLE_ADV_FILTER_NAMES_MAX];
+    uint32_t                allow_mask;                                 /* Bit n set if allow[n] holds the BDA of id n */
+    uint64_t                allow[BLE_ADV_FILTER_NAMES_MAX];            /* BDA keys already matched to a name, by id */
+    uint64_t                reject[BLE_ADV_FILTER_REJECT_SLOTS];        /* Rejected BDA keys, direct mapped, 0 if empty */
+    uint32_t                stats_reports;
+    uint32_t                stats_rejected_fast;                        /* Rejected by BDA cache or name length */
+} ble_adv_filter_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+void ble_adv_filter_init(ble_adv_filter_t *filter);
+
+/* Name is not copied and must outlive the filter; id is returned on match */
+esp_err_t ble_adv_filter_add_name(ble_adv_filter_t *filter, const char *name, uint8_t id);
+
+/* ble_adv_filter_add_name in two steps, so a lock around the filter covers no hashing: the entry is prepared
+ * without the filter, then inserted. The insert leaves the reject cache to the caller's next
+ * ble_adv_filter_clear_rejects. */
+esp_err_t ble_adv_filter_name_entry(const char *name, uint8_t id, ble_adv_name_entry_t *entry);
+
+esp_err_t ble_adv_filter_insert(ble_adv_filter_t *filter, const ble_adv_name_entry_t *entry);
+
+/* Drop the names and pinned BDA of an id */
+void ble_adv_filter_remove(ble_adv_filter_t *filter, uint8_t id);
+
+/* Pin a BDA to an id, later reports from it match without looking at the data */
+void ble_adv_filter_allow(ble_adv_filter_t *filter, const esp_bd_addr_t bda, uint8_t id);
+
+void ble_adv_filter_forget(ble_adv_filter_t *filter, uint8_t id);
+
+void ble_adv_filter_clear_rejects(ble_adv_filter_t *filter);
+
+/* Returns the matched id or BLE_ADV_FILTER_NO_MATCH; adv_data is the report's ble_adv buffer */
+int ble_adv_filter_match(ble_adv_filter_t *filter, const esp_bd_addr_t bda, uint8_t *adv_data);
+
+/* The same over len bytes of AD structures, e.g. the up to 251 bytes of an extended advertising report */
+int ble_adv_filter_match_len(ble_adv_filter_t *filter, const esp_bd_addr_t bda, const uint8_t *adv_data, uint16_t len);
+
+/* The same with the complete local name already taken out of the report, NULL if it has none */
+int ble_adv_filter_match_name(ble_adv_filter_t *filter, const esp_bd_addr_t bda, const uint8_t *name, uint8_t name_len);
@@ -0,0 +1,137 @@
+/**
+ * @file ble_agg.c
+ *
+ *
+ * @brief Time-aligned multi-peer aggregation, see ble_agg.h.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <string.h>
+/* API */
+#include "ble_agg.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Locals */
+static void agg_start(ble_agg_t *agg, int64_t time_us)
+{
+    if (!agg->started) {
+        agg->next    = time_us / agg->window_us;
+        agg->started = true;
+    }
+}
+
+/* API */
+void ble_agg_init(ble_agg_t *agg, uint32_t window_us, uint32_t grace_us)
+{
+    memset(agg, 0, sizeof(*agg));
+    agg->window_us = window_us ? window_us : 1U;
+    agg->grace_us  = grace_us;
+    if (agg->grace_us > (int64_t)(BLE_AGG_SLOTS - 1U) * agg->window_us) {
+        agg->grace_us = (int64_t)(BLE_AGG_SLOTS - 1U) * agg->window_us;
+    }
+}
+
+void ble_agg_expect(ble_agg_t *agg, uint32_t peer_mask)
+{
+    agg->expected = peer_mask;
+}
+
+bool ble_agg_add(ble_agg_t *agg, uint8_t peer, int64_t time_us, const int32_t *samples, uint16_t count)
+{
+    if (peer >= BLE_AGG_PEER_MAX || count == 0U) {
+        return count == 0U;
+    }
+    agg_start(agg, time_us);
+    int64_t w = time_us / agg->window_us;
+    if (w < agg->next) {
+        agg->late += count;
+        return false;
+    }
+    if (w >= agg->next + (int64_t)BLE_AGG_SLOTS) {
+        agg->ahead += count;
+        return false;
+    }
+
+    /* The slot of window w is free from the moment its previous window was emitted */
+    ble_agg_frame_t *slot = &agg->slot[w % BLE_AGG_SLOTS];
+    ble_agg_cell_t  *cell = &slot->cell[peer];
+    if (!(slot->present & (1U << peer))) {
+        slot->present |= (1U << peer);
+        cell->sum     = 0;
+        cell->min     = samples[0];
+        cell->max     = samples[0];
+        cell->count   = 0U;
+        cell->records = 0U;
+    }
+    int64_t sum = 0;
+    int32_t min = cell->min;
+    int32_t max = cell->max;
+    for (uint16_t i = 0; i < count; i++) {
+        sum += samples[i];
+        min  = samples[i] < min ? samples[i] : min;
+        max  = samples[i] > max ? samples[i] : max;
+    }
+    cell->sum  += sum;
+    cell->min   = min;
+    cell->max   = max;
+    cell->last  = samples[count - 1U];
+    cell->count = (uint16_t)(cell->count + count < UINT16_MAX ? cell->count + count : UINT16_MAX);
+    if (cell->records < UINT16_MAX) {
+        cell->records++;
+    }
+    return true;
+}
+
+bool ble_agg_poll(ble_agg_t *agg, int64_t now_us, ble_agg_frame_t *frame)
+{
+    agg_start(agg, now_us);
+    if (now_us < (agg->next + 1) * agg->window_us + agg->grace_us) {
+        return false;
+    }
+    ble_agg_frame_t *slot = &agg->slot[agg->next % BLE_AGG_SLOTS];
+    frame->start_us = agg->next * agg->window_us;
+    frame->present  = slot->present;
+    frame->missing  = agg->expected & ~slot->present;
+    for (uint8_t i = 0; i < BLE_AGG_PEER_MAX; i++) {
+        if (slot->present & (1U << i)) {
+            frame->cell[i] = slot->cell[i];
+        } else {
+            memset(&frame->cell[i], 0, sizeof(frame->cell[i]));
+        }
+    }
+    slot->present = 0U;
+    agg->next++;
+    agg->frames++;
+    if (frame->missing == 0U) {
+        agg->complete++;
+    }
+    return true;
+}
+
+int64_t ble_agg_due_us(const ble_agg_t *agg, int64_t now_us)
+{
+    if (!agg->started) {
+        return agg->window_us;
+    }
+    int64_t due = (agg->next + 1) * agg->window_us + agg->grace_us - now_us;
+    return due > 0 ? due : 0;
+}
+
+bool ble_agg_open(const ble_agg_t *agg)
+{
+    for (uint8_t i = 0; i < BLE_AGG_SLOTS; i++) {
+        if (agg->slot[i].present) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file ble_agg.h
+ *
+ *
+ * @brief Time-aligned aggregation of samples from several peers. Samples are
+ *          bucketed by their arrival time (ble_notify_rec_t time_us) into
+ *          fixed windows, the same for every peer. Each window is emitted as
+ *          one frame once it is over and a grace period for late records has
+ *          passed. The frame holds a summary per peer, which peers sent
+ *          samples, and which expected peers did not. A fixed set of window
+ *          slots is reused, with no allocation per sample or per frame. A
+ *          single task adds and polls.
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BLE_AGG_PEER_MAX        16U     /* Peers per frame, bits of the present and missing masks */
+#define BLE_AGG_SLOTS           4U      /* Windows open at once: the current one and those within the grace period */
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Samples of one peer in one window */
+typedef struct ble_agg_cell {
+    int64_t         sum;
+    int32_t         min;
+    int32_t         max;
+    int32_t         last;
+    uint16_t        count;              /* Samples, 0 if the peer sent none in the window */
+    uint16_t        records;            /* Values they came in */
+} ble_agg_cell_t;
+
+typedef struct ble_agg_frame {
+    int64_t         start_us;           /* Window start, esp_timer time; the window is [start_us, start_us + window_us) */
+    uint32_t        present;            /* Bit n set if cell[n] holds samples of peer n */
+    uint32_t        missing;            /* Expected peers without any sample in the window */
+    ble_agg_cell_t  cell[BLE_AGG_PEER_MAX];
+} ble_agg_frame_t;
+
+typedef struct ble_agg {
+    int64_t         window_us;
+    int64_t         grace_us;           /* How long after its end a window still takes samples */
+    int64_t         next;               /* Number of the oldest window not emitted yet */
+    bool            started;            /* next is set, by the first add or poll */
+    uint32_t        expected;           /* Peers reported missing when absent, see ble_agg_expect */
+    uint32_t        frames;             /* Emitted */
+    uint32_t        complete;           /* Emitted with every expected peer present */
+    uint32_t        late;               /* Samples for windows already emitted, dropped */
+    uint32_t        ahead;              /* Samples more than BLE_AGG_SLOTS windows ahead, dropped */
+    ble_agg_frame_t slot[BLE_AGG_SLOTS];
+} ble_agg_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Windows of window_us, aligned to multiples of it; grace_us is cut to BLE_AGG_SLOTS - 1 windows */
+void ble_agg_init(ble_agg_t *agg, uint32_t window_us, uint32_t grace_us);
+
+/* Peers expected in every frame, e.g. those configured; takes effect for frames emitted from now on */
+void ble_agg_expect(ble_agg_t *agg, uint32_t peer_mask);
+
+/* Adds count samples of a peer that arrived at time_us; false if they were dropped as late or too far ahead */
+bool ble_agg_add(ble_agg_t *agg, uint8_t peer, int64_t time_us, const int32_t *samples, uint16_t count);
+
+/* Emits the oldest window if it is over by now_us plus the grace period, true with frame filled. Call until it
+ * returns false; windows nobody sent to are emitted too, with every expected peer missing. */
+bool ble_agg_poll(ble_agg_t *agg, int64_t now_us, ble_agg_frame_t *frame);
+
+/* Time until the oldest open window is due, for the consumer's wait */
+int64_t ble_agg_due_us(const ble_agg_t *agg, int64_t now_us);
+
+/* Some window not emitted yet holds samples. If none does, the frames due until the next add are all empty and
+ * may be polled late, so the consumer need not wake for them. */
+bool ble_agg_open(const ble_agg_t *agg);
@@ -29,6 +29,10 @@
 #define TAG     "BLE_CLIENT_DEV"    /* TAG */
 #define DEBUG   1
 
+_Static_assert(PROFILE_NUM <= BLE_LAT_PEERS_MAX, "ble_latency keeps fewer peers than the client");
+_Static_assert(PROFILE_NUM <= BLE_AGG_PEER_MAX, "ble_agg frames hold fewer peers than the client");
+_Static_assert(BLE_SAMPLE_MAX >= (ESP_GATT_MAX_MTU_SIZE - 3U) / 2U, "A full-MTU value holds more samples than ble_sample decodes");
+
 /* * * * * * * * * * * * * * * *
  * * * * FN DECLARATIONS * * * *
  * * * * * * * * * * * * * * * */
@@ -36,7 +40,55 @@
 /* Declare static functions */
 static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
 static void esp_gattc_cb(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
+static void ble_evt_dispatch(ble_evt_t *evt, const uint8_t *payload);
+static void ble_gap_evt_handler(const ble_evt_t *evt, const uint8_t *payload);
+static void ble_gattc_evt_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
 static void gattc_profile_evt_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param, uint8_t idx);
+static void ble_conn_pipeline_kick(ble_gatt_client_t *client);
+static bool ble_peers_all(const ble_gatt_client_t *client, ble_conn_state_t state);
+static bool ble_uuid_equal(const esp_bt_uuid_t *a, const esp_bt_uuid_t *b);
+static void ble_collect_timer_cb(TimerHandle_t timer);
+static void ble_data_push(uint8_t peer, uint8_t type, uint16_t handle, const uint8_t *value, uint16_t len);
+static void ble_peer_ready(uint8_t peer, esp_gatt_if_t gattc_if);
+static void ble_peer_search(uint8_t peer, esp_gatt_if_t gattc_if);
+static bool ble_disc_char(uint8_t peer, esp_gatt_if_t gattc_if, uint16_t start, uint16_t end, esp_bt_uuid_t uuid,
+                          esp_gattc_char_elem_t *chr);
+static uint16_t ble_disc_cccd(uint8_t peer, esp_gatt_if_t gattc_if, uint16_t start, uint16_t end, uint16_t char_handle);
+static void ble_disc_subs(uint8_t peer, esp_gatt_if_t gattc_if);
+static void ble_disc_reads(uint8_t peer, esp_gatt_if_t gattc_if);
+static uint8_t ble_peer_sub_find(uint8_t peer, uint16_t handle, bool cccd);
+static void ble_peer_sub_progress(uint8_t peer, esp_gatt_if_t gattc_if);
+static void ble_cache_fill(uint8_t peer, esp_gatt_if_t gattc_if);
+static void ble_cache_db_hash_read(uint8_t peer, esp_gatt_if_t gattc_if, const struct gattc_read_char_evt_param *read);
+static void ble_cache_invalidate(uint8_t peer, esp_gatt_if_t gattc_if);
+static void ble_reconnect_backoff(uint8_t peer);
+static void ble_peer_setup_failed(uint8_t peer, esp_gatt_if_t gattc_if);
+static void ble_peer_recovered(uint8_t peer);
+static ble_scan_mode_t ble_scan_target(ble_gatt_client_t *client);
+static void ble_retry_timer_cb(TimerHandle_t timer);
+static void ble_poll_kick(ble_gatt_client_t *client);
+static esp_err_t ble_poll_issue(uint8_t peer);
+static void ble_trace(uint8_t peer, ble_lat_stage_t stage);
+static void ble_write_kick(uint8_t peer);
+static void ble_writes_queued(ble_gatt_client_t *client);
+static bool ble_write_chunk_done(uint8_t peer, esp_gatt_status_t status);
+static void ble_write_abort(uint8_t peer);
+static void ble_conn_timer_cb(TimerHandle_t timer);
+static void ble_conn_policy_run(ble_gatt_client_t *client);
+static void ble_collect_elapsed(ble_gatt_client_t *client);
+static void ble_peers_changed(ble_gatt_client_t *client);
+static void ble_scan_account(ble_scan_mode_t mode);
+static void ble_link_negotiate(uint8_t peer);
+static void ble_link_dle_next(void);
+static void ble_scan_report(const esp_bd_addr_t bda, esp_ble_addr_type_t addr_type, int8_t rssi, const uint8_t *adv, uint16_t len,
+                            uint8_t phy);
+static void ble_adv_decode(const esp_bd_addr_t bda, int8_t rssi, const ble_adv_fields_t *fields);
+static void ble_scan_started(esp_bt_status_t status);
+static void ble_scan_ended(bool elapsed);
+static esp_err_t ble_gap_scan_params_set(void);
+static esp_err_t ble_gap_scan_start(uint32_t duration);
+static esp_err_t ble_gap_scan_stop(void);
+static esp_err_t ble_gap_open(ble_gatt_client_t *client, uint8_t peer);
 
 /* * * * * * * * * * * * * * * *
  * * * * * * VARIABLES * * * * *
@@ -48,53 +100,60 @@ static void gattc_profile_evt_handler(esp_gattc_cb_event_t event, esp_gatt_if_t
 
 /* API Global */
 ble_gatt_client_t ble_client = {
-    .app_profiles = {
-        [PROFILE_A_APP_ID] = {
-            .gattc_cb = gattc_profile_evt_handler,
-            .gattc_if = ESP_GATT_IF_NONE,       /* Not get the gatt_if, so initial is ESP_GATT_IF_NONE */
-        },
-        [PROFILE_B_APP_ID] = {
-            .gattc_cb = gattc_profile_evt_handler,
-            .gattc_if = ESP_GATT_IF_NONE,       /* Not get the gatt_if, so initial is ESP_GATT_IF_NONE */
-        },
-        [PROFILE_C_APP_ID] = {
-            .gattc_cb = gattc_profile_evt_handler,
-            .gattc_if = ESP_GATT_IF_NONE,       /* Not get the gatt_if, so initial is ESP_GATT_IF_NONE */
-        },
-    },
-    .remote_dev_name = {
-        // "ESP_GATTS_DEMO"
-        "ESP_GATTS_DEMO_a", "ESP_GATTS_DEMO_b", "ESP_GATTS_DEMO_c"
-    },
-    .service_uuid = {
-        .len = ESP_UUID_LEN_16,
-        .uuid = {.uuid16 = REMOTE_SERVICE_UUID,},
-    },
-    .charact_uuid = {
-        .len = ESP_UUID_LEN_16,
-        .uuid = {.uuid16 = REMOTE_NOTIFY_CHAR_UUID,},
+    .hot = {
+        .gattc_if     = { [0 ... PROFILE_NUM - 1] = ESP_GATT_IF_NONE },     /* Not get the gatt_if, so initial is ESP_GATT_IF_NONE */
+        .if_to_peer   = { [0 ... BLE_GATTC_IF_NUM - 1] = INVALID_PEER },
+        .conn_to_peer = { [0 ... BLE_CONN_ID_NUM - 1] = INVALID_PEER },
     },
     .notify_descr_uuid = {
         .len = ESP_UUID_LEN_16,
         .uuid = {.uuid16 = ESP_GATT_UUID_CHAR_CLIENT_CONFIG,},
     },
-    .char_elem_result  = { NULL, NULL, NULL },
-    .descr_elem_result = { NULL, NULL, NULL},
-    .connections       = { false, false, false },
-    .service_found     = { false, false, false },
-    .charact_count     = { 0U, 0U, 0U },
+    .peer_mask         = 0U,
     .stop_scan_done    = false,
-    .is_connecting     = false
+    .is_connecting     = false,
+    .is_scanning       = false,
+    .is_started        = false,
+    .ll_pending        = INVALID_PEER
 };
 
+/* Guards the peer table and adv filter between ble_peer_add/remove and the client task */
+static portMUX_TYPE ble_peer_mux = portMUX_INITIALIZER_UNLOCKED;
+
 /* API Locals */
+/* Starts as BLE_SCAN_MODE_AGGRESSIVE, ble_scan_target switches it between the modes of ble_scan.h */
 static esp_ble_scan_params_t ble_scan_params = {
     .scan_type              = BLE_SCAN_TYPE_ACTIVE,
     .own_addr_type          = BLE_ADDR_TYPE_PUBLIC,
     .scan_filter_policy     = BLE_SCAN_FILTER_ALLOW_ALL,
-    .scan_interval          = 0x50,
-    .scan_window            = 0x30,
-    .scan_duplicate         = BLE_SCAN_DUPLICATE_DISABLE
+    .scan_interval          = BLE_SCAN_FAST_ITVL,
+    .scan_window            = BLE_SCAN_FAST_ITVL,
+    .scan_duplicate         = BLE_SCAN_DUPLICATE_ENABLE
+};
+
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+/* Extended connections: the initiator's own scan and the first link parameters, on whichever PHY is used */
+static const esp_ble_gap_conn_params_t ble_ext_conn_params = {
+    .scan_interval       = BLE_SCAN_FAST_ITVL,
+    .scan_window         = BLE_SCAN_FAST_ITVL,
+    .interval_min        = BLE_LINK_EXT_CONN_ITVL,
+    .interval_max        = BLE_LINK_EXT_CONN_ITVL,
+    .latency             = 0,
+    .supervision_timeout = BLE_CONN_SUP_TIMEOUT,
+    .min_ce_len          = 0,
+    .max_ce_len          = 0,
+};
+#endif
+
+static esp_bt_uuid_t ble_db_hash_uuid = {
+    .len  = ESP_UUID_LEN_16,
+    .uuid = {.uuid16 = BLE_GATT_DB_HASH_UUID,},
+};
+
+/* Written to every peer once subscribed, shared as ble_peer_write does not copy */
+static const uint8_t ble_demo_write[35] = {
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16,
+    17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34
 };
 
 /* * * * * * * * * * * * * * * *
@@ -104,18 +163,66 @@ static esp_ble_scan_params_t ble_scan_params = {
 /* API Locals */
 static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
 {
-    gattc_profile_inst_t *app_profiles  = ble_client.app_profiles;
-    // const char           **names        = ble_client.remote_dev_name;
-    bool                 *conn_devices  = ble_client.connections;
-    bool                 *is_connecting = &ble_client.is_connecting;
-    bool                 *stop_scan     = &ble_client.stop_scan_done;
+    /* BTC task: a copy into the client queue and nothing else, see ble_evt.h */
+    ble_evt_post_gap(event, param);
+}
 
-    uint8_t *adv_name = NULL;
-    uint8_t adv_name_len = 0;
+static void esp_gattc_cb(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
+{
+    ble_evt_post_gattc(event, gattc_if, param);
+}
 
-    switch (event) {
+static void ble_evt_dispatch(ble_evt_t *evt, const uint8_t *payload)
+{
+    /* Client task, one event at a time: timestamps are those of the callback, not of the handling */
+    ble_client.evt_us = evt->time_us;
+    switch (evt->src) {
+        case BLE_EVT_SRC_GAP:
+            ble_gap_evt_handler(evt, payload);
+            break;
+        case BLE_EVT_SRC_GATTC:
+            ble_gattc_evt_handler((esp_gattc_cb_event_t)evt->event, evt->gattc_if, &evt->p.gattc);
+            break;
+        case BLE_EVT_SRC_LOCAL:
+            switch (evt->event) {
+                case BLE_LOCAL_COLLECT:
+                    ble_collect_elapsed(&ble_client);
+                    break;
+                case BLE_LOCAL_RETRY:
+                    ble_conn_pipeline_kick(&ble_client);
+                    break;
+                case BLE_LOCAL_CONN_POLICY:
+                    ble_conn_policy_run(&ble_client);
+                    break;
+                case BLE_LOCAL_PEERS:
+                    ble_peers_changed(&ble_client);
+                    break;
+                case BLE_LOCAL_POLL:
+                    ble_poll_kick(&ble_client);
+                    break;
+                case BLE_LOCAL_START:
+                    ble_start_scan(&ble_client, true);
+                    break;
+                case BLE_LOCAL_WRITE:
+                    ble_writes_queued(&ble_client);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void ble_gap_evt_handler(const ble_evt_t *evt, const uint8_t *payload)
+{
+    ble_peer_cold_t      *cold          = &ble_client.cold;
+    ble_conn_state_t     *conn_state    = ble_client.hot.conn_state;
+
+    switch ((esp_gap_ble_cb_event_t)evt->event) {
         case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT: {
-            ESP_LOGI(TAG, "EVT: BLE Scan Parameters Set Completed");
+            BLE_LOGI(TAG, "EVT: BLE Scan Parameters Set Completed");
             // uint32_t duration = BLE_SCAN_TIME;          // The unit of the duration is second
             // esp_ble_gap_start_scanning(duration);
             // ble_start_scan(&ble_client, true);
@@ -123,81 +230,29 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
         }
 
         case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT:
-            ESP_LOGI(TAG, "EVT: BLE Scan Start");
-            // Scan start complete event to indicate scan start successfully or failed
-            if (param->scan_start_cmpl.status == ESP_BT_STATUS_SUCCESS) {
-                ESP_LOGI(TAG, "Scan start success");
-            } else{
-                ESP_LOGE(TAG, "Scan start failed");
-            }
+            BLE_LOGI(TAG, "EVT: BLE Scan Start");
+            ble_scan_started(evt->p.status);
             break;
 
         case ESP_GAP_BLE_SCAN_RESULT_EVT: {
-            ESP_LOGI(TAG, "EVT: BLE Scan Result");
-            esp_ble_gap_cb_param_t *scan_result = (esp_ble_gap_cb_param_t *)param;
-            switch (scan_result->scan_rst.search_evt) {
-                case ESP_GAP_SEARCH_INQ_RES_EVT:
-                    esp_log_buffer_hex(TAG, scan_result->scan_rst.bda, 6);
-                    ESP_LOGI(TAG, "Searched Adv Data Len %d, Scan Response Len %d", scan_result->scan_rst.adv_data_len, scan_result->scan_rst.scan_rsp_len);
-                    adv_name = esp_ble_resolve_adv_data(scan_result->scan_rst.ble_adv,
-                                                        ESP_BLE_AD_TYPE_NAME_CMPL, &adv_name_len);
-                    ESP_LOGI(TAG, "Searched Device Name Len %d", adv_name_len);
-                    esp_log_buffer_char(TAG, adv_name, adv_name_len);   /* Print Device Name */
-                    ESP_LOGI(TAG, "\n");
-
+            const ble_evt_report_t *report = &evt->p.report;
+            switch (report->search_evt) {
+                case ESP_GAP_SEARCH_INQ_RES_EVT: {
 #if CONFIG_EXAMPLE_DUMP_ADV_DATA_AND_SCAN_RESP
-                    if (scan_result->scan_rst.adv_data_len > 0) {
-                        ESP_LOGI(TAG, "Advertised data:");
-                        esp_log_buffer_hex(TAG, &scan_result->scan_rst.ble_adv[0], scan_result->scan_rst.adv_data_len);
-                    }
-                    if (scan_result->scan_rst.scan_rsp_len > 0) {
-                        ESP_LOGI(TAG, "Scan response:");
-                        esp_log_buffer_hex(TAG, &scan_result->scan_rst.ble_adv[scan_result->scan_rst.adv_data_len], scan_result->scan_rst.scan_rsp_len);
+                    /* Advertising data and scan response arrive concatenated */
+                    esp_log_buffer_hex(TAG, report->bda, 6);
+                    if (evt->len > 0) {
+                        ESP_LOGI(TAG, "Advertised data and scan response:");
+                        esp_log_buffer_hex(TAG, payload, evt->len);
                     }
 #endif
 
-                    if (*is_connecting) {
-                        ESP_LOGI(TAG, "BLE is connecting");
-                        break;
-                    }
-                    {
-                        bool ret = true;
-                        /* Check if all devices are connected. */
-                        for (uint i = 0; (i < PROFILE_NUM-1) && ret; i++)
-                            ret &= conn_devices[i];
-                        /* Check now stop scan is not set */
-                        if (ret && !*stop_scan) {
-                            *stop_scan = true;
-                            esp_ble_gap_stop_scanning();
-                            ESP_LOGW(TAG, "All devices are connected");
-                            break;
-                        }
-                    }
-                    // if (conn_devices[PROFILE_A_APP_ID] && conn_devices[PROFILE_B_APP_ID] && !*stop_scan) {
-                    //     *stop_scan = true;
-                    //     esp_ble_gap_stop_scanning();
-                    //     ESP_LOGW(TAG, "All devices are connected");
-                    //     break;
-                    // }
-                    if (adv_name != NULL) {
-                        /* Loop over all profiles to check if adv_name matches saved names. */
-                        for (uint8_t i = 0; i < PROFILE_NUM-1; i++)
-                        {
-                            if (strlen(ble_client.remote_dev_name[i]) == adv_name_len && strncmp((char *)adv_name, ble_client.remote_dev_name[i], adv_name_len) == 0) {
-                                if (conn_devices[i] == false) {
-                                    conn_devices[i] = true;
-                                    ESP_LOGW(TAG, "Searched device %s", ble_client.remote_dev_name[i]);
-                                    ESP_LOGW(TAG, "Attempting to connect to the remote device.");
-                                    *is_connecting = true;
-                                    esp_ble_gap_stop_scanning(); /* This takes some time to stop scanning, is_connecting flag will prevent to keep trying to connect to others in the meantime. */
-                                    esp_ble_gattc_open(app_profiles[i].gattc_if, scan_result->scan_rst.bda, scan_result->scan_rst.ble_addr_type, true);
-                                }
-                            // break;
-                            }
-                        }
-                    }
+                    ble_scan_report(report->bda, (esp_ble_addr_type_t)report->addr_type, report->rssi, payload, evt->len,
+                                    BLE_LINK_PHY_1M);
                     break;
+                }
                 case ESP_GAP_SEARCH_INQ_CMPL_EVT:
+                    ble_scan_ended(true);
                     break;
                 default:
                     break;
@@ -206,88 +261,200 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
         }
         
         case ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT:
-            ESP_LOGI(TAG, "EVT: BLE Scan Stop");
-            if (param->scan_stop_cmpl.status != ESP_BT_STATUS_SUCCESS){
-                ESP_LOGE(TAG, "Scan stop failed");
+            BLE_LOGI(TAG, "EVT: BLE Scan Stop");
+            if (evt->p.status != ESP_BT_STATUS_SUCCESS){
+                BLE_LOGE(TAG, "Scan stop failed");
                 break;
             }
-            ESP_LOGI(TAG, "Stop scan successfully");
+            BLE_LOGI(TAG, "Stop scan successfully");
+            ble_scan_ended(false);
             break;
         case ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT:
-            ESP_LOGI(TAG, "EVT: BLE Adv Stop");
-            if (param->adv_stop_cmpl.status != ESP_BT_STATUS_SUCCESS){
-                ESP_LOGE(TAG, "Adv stop failed");
+            BLE_LOGI(TAG, "EVT: BLE Adv Stop");
+            if (evt->p.status != ESP_BT_STATUS_SUCCESS){
+                BLE_LOGE(TAG, "Adv stop failed");
+                break;
+            }
+            BLE_LOGI(TAG, "Stop adv successfully");
+            break;
+        case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT: {
+            const struct ble_update_conn_params_evt_param *update = &evt->p.update_conn_params;
+            BLE_LOGI(TAG, "EVT: Update connection params status = %d, min_int = %d, max_int = %d,conn_int = %d,latency = %d, timeout = %d",
+                    update->status,
+                    update->min_int,
+                    update->max_int,
+                    update->conn_int,
+                    update->latency,
+                    update->timeout);
+            /* Either side may have started it, keep what the link runs with */
+            for (uint8_t i = 0; i < PROFILE_NUM; i++)
+            {
+                if (!(ble_client.peer_mask & (1U << i)) || ble_client.hot.conn_state[i] < BLE_CONN_CONNECTED ||
+                    memcmp(cold->remote_bda[i], update->bda, sizeof(esp_bd_addr_t)) != 0) {
+                    continue;
+                }
+                if (update->status == ESP_BT_STATUS_SUCCESS) {
+                    cold->stats[i].conn_updates += cold->conn_pending[i];
+                    cold->conn_int[i]     = update->conn_int;
+                    cold->conn_latency[i] = update->latency;
+                    cold->conn_timeout[i] = update->timeout;
+                }
+                cold->conn_pending[i] = false;
+                break;
+            }
+            break;
+        }
+        case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT: {
+            /* Answers the request of ble_client.ll_pending, see ble_link_dle_next */
+            const struct ble_pkt_data_length_cmpl_evt_param *dle = &evt->p.pkt_data_lenth_cmpl;
+            uint8_t peer = ble_client.ll_pending;
+            ble_client.ll_pending = INVALID_PEER;
+            if (peer != INVALID_PEER && conn_state[peer] >= BLE_CONN_CONNECTED) {
+                if (dle->status == ESP_BT_STATUS_SUCCESS) {
+                    cold->ll_tx_octets[peer] = dle->params.tx_len;
+                    cold->ll_rx_octets[peer] = dle->params.rx_len;
+                } else {
+                    /* Keep the default PDUs, and do not ask this peer again */
+                    cold->link_refused[peer] |= BLE_LINK_REFUSED_DLE;
+                }
+                BLE_LOGI(TAG, "%s: data length status %d, tx %u, rx %u", cold->remote_dev_name[peer],
+                         dle->status, cold->ll_tx_octets[peer], cold->ll_rx_octets[peer]);
+            }
+            ble_link_dle_next();
+            break;
+        }
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+        case ESP_GAP_BLE_SET_PREFERED_PHY_COMPLETE_EVT:
+            if (evt->p.status != ESP_BT_STATUS_SUCCESS) {
+                BLE_LOGE(TAG, "Set preferred PHY failed, status %d", evt->p.status);
+            }
+            break;
+        case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT: {
+            const struct ble_phy_update_cmpl_param *phy = &evt->p.phy_update;
+            for (uint8_t i = 0; i < PROFILE_NUM; i++)
+            {
+                if (!(ble_client.peer_mask & (1U << i)) || conn_state[i] < BLE_CONN_CONNECTED ||
+                    memcmp(cold->remote_bda[i], phy->bda, sizeof(esp_bd_addr_t)) != 0) {
+                    continue;
+                }
+                if (phy->status == ESP_BT_STATUS_SUCCESS) {
+                    cold->tx_phy[i] = phy->tx_phy;
+                    cold->rx_phy[i] = phy->rx_phy;
+                }
+                if (cold->tx_phy[i] != BLE_LINK_PHY_2M) {
+                    /* The link stays on LE 1M */
+                    cold->link_refused[i] |= BLE_LINK_REFUSED_2M;
+                }
+                BLE_LOGI(TAG, "%s: PHY status %d, tx %u, rx %u", cold->remote_dev_name[i], phy->status,
+                         cold->tx_phy[i], cold->rx_phy[i]);
+                break;
+            }
+            break;
+        }
+        case ESP_GAP_BLE_SET_EXT_SCAN_PARAMS_COMPLETE_EVT:
+            if (evt->p.status != ESP_BT_STATUS_SUCCESS) {
+                BLE_LOGE(TAG, "Set ext scan params failed, status %d", evt->p.status);
+            }
+            break;
+        case ESP_GAP_BLE_EXT_SCAN_START_COMPLETE_EVT:
+            BLE_LOGI(TAG, "EVT: BLE Ext Scan Start");
+            ble_scan_started(evt->p.status);
+            break;
+        case ESP_GAP_BLE_EXT_ADV_REPORT_EVT: {
+            /* Legacy and extended advertisers alike; a chained report is matched on the fragment it carries */
+            const ble_evt_report_t *report = &evt->p.report;
+            ble_scan_report(report->bda, (esp_ble_addr_type_t)report->addr_type, report->rssi, payload, evt->len,
+                            report->coded ? BLE_LINK_PHY_CODED : BLE_LINK_PHY_1M);
+            break;
+        }
+        case ESP_GAP_BLE_EXT_SCAN_STOP_COMPLETE_EVT:
+            BLE_LOGI(TAG, "EVT: BLE Ext Scan Stop");
+            if (evt->p.status != ESP_BT_STATUS_SUCCESS) {
+                BLE_LOGE(TAG, "Ext scan stop failed");
                 break;
             }
-            ESP_LOGI(TAG, "Stop adv successfully");
+            ble_scan_ended(false);
             break;
-        case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
-            ESP_LOGI(TAG, "EVT: Update connection params status = %d, min_int = %d, max_int = %d,conn_int = %d,latency = %d, timeout = %d",
-                    param->update_conn_params.status,
-                    param->update_conn_params.min_int,
-                    param->update_conn_params.max_int,
-                    param->update_conn_params.conn_int,
-                    param->update_conn_params.latency,
-                    param->update_conn_params.timeout);
+        case ESP_GAP_BLE_SCAN_TIMEOUT_EVT:
+            /* The extended scan duration elapsed, as ESP_GAP_SEARCH_INQ_CMPL_EVT for legacy scans */
+            ble_scan_ended(true);
+            break;
+        case ESP_GAP_BLE_PREFER_EXT_CONN_PARAMS_SET_COMPLETE_EVT:
+            if (evt->p.status != ESP_BT_STATUS_SUCCESS) {
+                BLE_LOGE(TAG, "Set ext conn params failed, status %d", evt->p.status);
+            }
             break;
+#endif
         default:
             break;
     }
 }
 
-static void esp_gattc_cb(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
+static void ble_gattc_evt_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
 {
-    ESP_LOGI(TAG, "EVT %d, gattc if %d, app_id %d", event, gattc_if, param->reg.app_id);
+    ble_peer_hot_t *hot = &ble_client.hot;
+    uint8_t         idx;
+    BLE_LOGD(TAG, "EVT %d, gattc if %d", event, gattc_if);
 
-    /* If event is register event, store the gattc_if for each profile */
-    if (event == ESP_GATTC_REG_EVT) {
-        if (param->reg.status == ESP_GATT_OK) {
-            ble_client.app_profiles[param->reg.app_id].gattc_if = gattc_if;
-        } else {
-            ESP_LOGI(TAG, "Reg app failed, app_id %04x, status %d",
-                    param->reg.app_id,
-                    param->reg.status);
-            return;
-        }
-    }
+    switch (event) {
+        case ESP_GATTC_REG_EVT:
+            /* If event is register event, store the gattc_if for each profile */
+            if (param->reg.status != ESP_GATT_OK || param->reg.app_id >= PROFILE_NUM) {
+                BLE_LOGI(TAG, "Reg app failed, app_id %04x, status %d",
+                        param->reg.app_id,
+                        param->reg.status);
+                return;
+            }
+            idx = (uint8_t)param->reg.app_id;
+            hot->gattc_if[idx]        = gattc_if;
+            hot->if_to_peer[gattc_if] = idx;
+            break;
 
-    /* If the gattc_if equal to profile A, call profile A cb handler,
-     * so here call each profile's callback */
-    do {
-        int idx;
-        for (idx = 0; idx < PROFILE_NUM; idx++) {
-            if (gattc_if == ESP_GATT_IF_NONE || /* ESP_GATT_IF_NONE, not specify a certain gatt_if, need to call every profile cb function */
-                    gattc_if == ble_client.app_profiles[idx].gattc_if) {
-                if (ble_client.app_profiles[idx].gattc_cb) {
-                    ble_client.app_profiles[idx].gattc_cb(event, gattc_if, param, idx);
+        case ESP_GATTC_DISCONNECT_EVT:
+            /* Every registered app gets a copy, only the one owning the link handles it */
+            idx = (param->disconnect.conn_id < BLE_CONN_ID_NUM) ? hot->conn_to_peer[param->disconnect.conn_id] : INVALID_PEER;
+            if (idx == INVALID_PEER || hot->if_to_peer[gattc_if] != idx) {
+                return;
+            }
+            break;
+
+        default:
+            if (gattc_if == ESP_GATT_IF_NONE) {
+                /* ESP_GATT_IF_NONE, not specify a certain gatt_if, need to call every profile cb function */
+                for (idx = 0; idx < PROFILE_NUM; idx++) {
+                    gattc_profile_evt_handler(event, gattc_if, param, idx);
                 }
+                return;
             }
-        }
-    } while (0);
+            idx = hot->if_to_peer[gattc_if];
+            if (idx == INVALID_PEER) {
+                return;
+            }
+            break;
+    }
+
+    /* One indexed lookup per event, see ble_peer_hot_t */
+    gattc_profile_evt_handler(event, gattc_if, param, idx);
 }
 
 static void gattc_profile_evt_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param, uint8_t idx)
 {
     esp_ble_gattc_cb_param_t *p_data      = (esp_ble_gattc_cb_param_t *)param;
     profiles_app_id_t         app_id      = (profiles_app_id_t)idx;
-    gattc_profile_inst_t     *app_profile = &ble_client.app_profiles[app_id];
-    esp_bt_uuid_t    remfilt_service_uuid = ble_client.service_uuid;
-    esp_bt_uuid_t       remfilt_char_uuid = ble_client.charact_uuid;
-    esp_bt_uuid_t       notify_descr_uuid = ble_client.notify_descr_uuid;
-    esp_gattc_char_elem_t      *char_elem = ble_client.char_elem_result[app_id];
-    esp_gattc_descr_elem_t    *descr_elem = ble_client.descr_elem_result[app_id];
-    bool                     *get_service = &ble_client.service_found[app_id];
-    bool                     *conn_device = &ble_client.connections[app_id];
-    uint16_t               *charact_count = &ble_client.charact_count[app_id];
+    ble_peer_hot_t                   *hot = &ble_client.hot;
+    ble_peer_cold_t                 *cold = &ble_client.cold;
+    ble_disc_arena_t                *disc = &ble_client.cold.disc[app_id];
+    bool                     *get_service = &ble_client.cold.service_found[app_id];
+    ble_conn_state_t          *conn_state = &ble_client.hot.conn_state[app_id];
 
     switch (event) {
         case ESP_GATTC_REG_EVT:
-            ESP_LOGI(TAG, "REG_EVT -> app_id: %d", idx);
+            BLE_LOGI(TAG, "REG_EVT -> app_id: %d", idx);
             /* Set scan parameters after first app register */
             if ((PROFILE_NUM - 1) == app_id) {
-                esp_err_t scan_ret = esp_ble_gap_set_scan_params(&ble_scan_params);
+                esp_err_t scan_ret = ble_gap_scan_params_set();
                 if (scan_ret) {
-                    ESP_LOGE(TAG, "Set scan params error, error code = %x", scan_ret);
+                    BLE_LOGE(TAG, "Set scan params error, error code = %x", scan_ret);
                 }
             }     
             break;
@@ -295,243 +462,430 @@ static void gattc_profile_evt_handler(esp_gattc_cb_event_t event, esp_gatt_if_t
         case ESP_GATTC_CONNECT_EVT:
             /* One device connect successfully, all profiles callback function will get the ESP_GATTC_CONNECT_EVT,
             so must compare the mac address to check which device is connected, so it is a good choice to use ESP_GATTC_OPEN_EVT. */
-            ESP_LOGI(TAG, "EVT: Connect.");
+            BLE_LOGI(TAG, "EVT: Connect.");
+            if (*conn_state == BLE_CONN_OPENING &&
+                memcmp(cold->remote_bda[app_id], p_data->connect.remote_bda, sizeof(esp_bd_addr_t)) == 0) {
+                /* Initial parameters, the policy starts from them */
+                cold->conn_int[app_id]     = p_data->connect.conn_params.interval;
+                cold->conn_latency[app_id] = p_data->connect.conn_params.latency;
+                cold->conn_timeout[app_id] = p_data->connect.conn_params.timeout;
+            }
             break;
 
         case ESP_GATTC_OPEN_EVT:
-            ESP_LOGI(TAG, "EVT: GATTC Open.");
+            BLE_LOGI(TAG, "EVT: GATTC Open.");
             if (p_data->open.status != ESP_GATT_OK) {
                 /* Open failed, ignore the device, connect the next device */
-                ESP_LOGE(TAG, "Connect device failed, status %d", p_data->open.status);
-                *conn_device = false;
+                BLE_LOGE(TAG, "Connect device failed, status %d", p_data->open.status);
+                *conn_state = BLE_CONN_IDLE;
+                ble_reconnect_backoff(app_id);
+                ble_client.is_connecting = false;
+                ble_conn_pipeline_kick(&ble_client);
+                break;
+            }
+            /* The initiator is free again: open the next found device while this link runs MTU/discovery */
+            ble_trace(app_id, BLE_LAT_CONNECT);
+            *conn_state = BLE_CONN_CONNECTED;
+            hot->conn_id[app_id] = p_data->open.conn_id;
+            if (p_data->open.conn_id < BLE_CONN_ID_NUM) {
+                hot->conn_to_peer[p_data->open.conn_id] = app_id;
+            }
+            memcpy(cold->remote_bda[app_id], p_data->open.remote_bda, sizeof(esp_bd_addr_t));
+            cold->mtu[app_id]          = ESP_GATT_DEF_BLE_MTU_SIZE;
+            cold->ll_tx_octets[app_id] = BLE_CONN_LL_PAYLOAD;
+            cold->ll_rx_octets[app_id] = BLE_CONN_LL_PAYLOAD;
+            /* Extended connections start on the PHY the peer advertised on, LE 1M otherwise */
+            cold->tx_phy[app_id]       = cold->adv_phy[app_id];
+            cold->rx_phy[app_id]       = cold->adv_phy[app_id];
+            if (!(ble_client.peer_mask & (1U << app_id))) {
+                /* Peer removed while opening */
+                esp_ble_gattc_close(gattc_if, p_data->open.conn_id);
+                ble_client.is_connecting = false;
+                ble_conn_pipeline_kick(&ble_client);
                 break;
             }
-            app_profile->conn_id = p_data->open.conn_id;
-            memcpy(app_profile->remote_bda, p_data->open.remote_bda, 6);
+            ble_client.is_connecting = false;
+            ble_conn_pipeline_kick(&ble_client);
+
+            BLE_LOGI(TAG, "Open success");
+            BLE_LOGI(TAG, "ESP_GATTC_OPEN_EVT conn_id %d, if %d, status %d, mtu %d, app_id %d", p_data->open.conn_id, gattc_if, p_data->open.status, p_data->open.mtu, app_id);
+            BLE_LOGI(TAG, "REMOTE BDA: %02x:%02x:%02x:%02x:%02x:%02x", BLE_LOG_BDA(p_data->open.remote_bda));
 
-            ESP_LOGI(TAG, "Open success");
-            ESP_LOGI(TAG, "ESP_GATTC_OPEN_EVT conn_id %d, if %d, status %d, mtu %d, app_id %d", p_data->open.conn_id, gattc_if, p_data->open.status, p_data->open.mtu, app_id);
-            ESP_LOGI(TAG, "REMOTE BDA:");
-            esp_log_buffer_hex(TAG, p_data->open.remote_bda, sizeof(esp_bd_addr_t));
+            /* Handles from an earlier connection are used once the MTU exchange is done */
+            cold->cache_state[app_id] = ble_gatt_cache_load(cold->remote_bda[app_id], cold->peer_key[app_id], &cold->cache[app_id]) ?
+                                        BLE_CACHE_LOADED : BLE_CACHE_NONE;
 
             esp_err_t mtu_ret = esp_ble_gattc_send_mtu_req (gattc_if, p_data->open.conn_id);
             if (mtu_ret) {
-                ESP_LOGE(TAG, "Config MTU error, error code = %x", mtu_ret);
+                BLE_LOGE(TAG, "Config MTU error, error code = %x", mtu_ret);
             }
+            ble_link_negotiate(app_id);
             break;
 
         case ESP_GATTC_CFG_MTU_EVT:
             if (param->cfg_mtu.status != ESP_GATT_OK) {
-                ESP_LOGE(TAG,"Config mtu failed");
+                BLE_LOGE(TAG,"Config mtu failed");
+            } else {
+                cold->mtu[app_id] = param->cfg_mtu.mtu;
+            }
+            ble_trace(app_id, BLE_LAT_MTU);
+            BLE_LOGI(TAG, "ESP_GATTC_CFG_MTU_EVT: Status %d, MTU %d, conn_id %d", param->cfg_mtu.status, param->cfg_mtu.mtu, param->cfg_mtu.conn_id);
+            if (cold->cache_state[app_id] == BLE_CACHE_LOADED) {
+                if (cold->cache[app_id].flags & BLE_GATT_CACHE_F_DB_HASH) {
+                    /* One read instead of a full discovery, compared in ESP_GATTC_READ_CHAR_EVT */
+                    cold->cache_state[app_id] = BLE_CACHE_VALIDATING;
+                    esp_ble_gattc_read_by_type(gattc_if, param->cfg_mtu.conn_id, 0x0001, 0xFFFF, &ble_db_hash_uuid, ESP_GATT_AUTH_REQ_NONE);
+                } else {
+                    /* No Database Hash on this server, the entry holds until a Service Changed or a handle error */
+                    BLE_LOGI(TAG, "%s: handles from cache", cold->remote_dev_name[app_id]);
+                    cold->cache_state[app_id] = BLE_CACHE_HIT;
+                    ble_peer_ready(app_id, gattc_if);
+                }
+                break;
             }
-            ESP_LOGI(TAG, "ESP_GATTC_CFG_MTU_EVT: Status %d, MTU %d, conn_id %d", param->cfg_mtu.status, param->cfg_mtu.mtu, param->cfg_mtu.conn_id);
-            esp_ble_gattc_search_service(gattc_if, param->cfg_mtu.conn_id, &remfilt_service_uuid);
+            ble_peer_search(app_id, gattc_if);
             break;
 
         case ESP_GATTC_DIS_SRVC_CMPL_EVT:
             if (param->dis_srvc_cmpl.status != ESP_GATT_OK){
-                ESP_LOGE(TAG, "discover service failed, status %d", param->dis_srvc_cmpl.status);
+                BLE_LOGE(TAG, "discover service failed, status %d", param->dis_srvc_cmpl.status);
                 break;
             }
-            ESP_LOGI(TAG, "discover service complete conn_id %d", param->dis_srvc_cmpl.conn_id);
+            BLE_LOGI(TAG, "discover service complete conn_id %d", param->dis_srvc_cmpl.conn_id);
             break;
 
         case ESP_GATTC_SEARCH_RES_EVT: {
-            ESP_LOGI(TAG, "SEARCH RES: conn_id = %x is primary service %d", p_data->search_res.conn_id, p_data->search_res.is_primary);
-            ESP_LOGI(TAG, "start handle %d end handle %d current handle value %d", p_data->search_res.start_handle, p_data->search_res.end_handle, p_data->search_res.srvc_id.inst_id);
-            if (p_data->search_res.srvc_id.uuid.len == ESP_UUID_LEN_16 && p_data->search_res.srvc_id.uuid.uuid.uuid16 == REMOTE_SERVICE_UUID) {
-                ESP_LOGI(TAG, "service found");
+            BLE_LOGI(TAG, "SEARCH RES: conn_id = %x is primary service %d", p_data->search_res.conn_id, p_data->search_res.is_primary);
+            BLE_LOGI(TAG, "start handle %d end handle %d current handle value %d", p_data->search_res.start_handle, p_data->search_res.end_handle, p_data->search_res.srvc_id.inst_id);
+            if (ble_uuid_equal(&p_data->search_res.srvc_id.uuid, &cold->service_uuid[app_id])) {
+                BLE_LOGI(TAG, "service found");
                 *get_service = true;
-                app_profile->service_start_handle = p_data->search_res.start_handle;
-                app_profile->service_end_handle   = p_data->search_res.end_handle;
-                ESP_LOGI(TAG, "UUID16: %x", p_data->search_res.srvc_id.uuid.uuid.uuid16);
+                hot->service_start_handle[app_id] = p_data->search_res.start_handle;
+                hot->service_end_handle[app_id]   = p_data->search_res.end_handle;
+            }
+            for (uint8_t i = 0; i < cold->sub_count[app_id]; i++)
+            {
+                if (ble_uuid_equal(&p_data->search_res.srvc_id.uuid, &cold->subs[app_id][i].service_uuid)) {
+                    disc->sub_start[i] = p_data->search_res.start_handle;
+                    disc->sub_end[i]   = p_data->search_res.end_handle;
+                }
+            }
+            for (uint8_t i = 0; i < cold->read_count[app_id]; i++)
+            {
+                if (ble_uuid_equal(&p_data->search_res.srvc_id.uuid, &cold->reads[app_id][i].service_uuid)) {
+                    disc->read_start[i] = p_data->search_res.start_handle;
+                    disc->read_end[i]   = p_data->search_res.end_handle;
+                }
             }
             break;
         }
 
         case ESP_GATTC_SEARCH_CMPL_EVT:
-            ESP_LOGI(TAG, "EVT: Search Completed.");
+            BLE_LOGI(TAG, "EVT: Search Completed.");
             if (p_data->search_cmpl.status != ESP_GATT_OK){
-                ESP_LOGE(TAG, "search service failed, error status = %x", p_data->search_cmpl.status);
+                BLE_LOGE(TAG, "search service failed, error status = %x", p_data->search_cmpl.status);
+                ble_peer_setup_failed(app_id, gattc_if);
                 break;
             }
 
             if(p_data->search_cmpl.searched_service_source == ESP_GATT_SERVICE_FROM_REMOTE_DEVICE) {
-                ESP_LOGI(TAG, "Get service information from remote device");
+                BLE_LOGI(TAG, "Get service information from remote device");
             } else if (p_data->search_cmpl.searched_service_source == ESP_GATT_SERVICE_FROM_NVS_FLASH) {
-                ESP_LOGI(TAG, "Get service information from flash");
+                BLE_LOGI(TAG, "Get service information from flash");
             } else {
-                ESP_LOGI(TAG, "unknown service source");
+                BLE_LOGI(TAG, "unknown service source");
             }
 
             if (*get_service) {
-                esp_gatt_status_t status = esp_ble_gattc_get_attr_count( gattc_if,
-                                                                        p_data->search_cmpl.conn_id,
-                                                                        ESP_GATT_DB_CHARACTERISTIC,
-                                                                        app_profile->service_start_handle,
-                                                                        app_profile->service_end_handle,
-                                                                        INVALID_HANDLE,
-                                                                        charact_count);
-                if (status != ESP_GATT_OK) {
-                    ESP_LOGE(TAG, "esp_ble_gattc_get_attr_count error");
-                }
-                
-                if (*charact_count > 0) {
-                    char_elem = (esp_gattc_char_elem_t *)malloc(sizeof(esp_gattc_char_elem_t) * (*charact_count));
-                    ESP_LOGI(TAG, "Char count %d", *charact_count);
-                    if (!char_elem) {
-                        ESP_LOGE(TAG, "gattc no mem");
-                    } 
-                    else {
-                        status = esp_ble_gattc_get_char_by_uuid( gattc_if,
-                                                                p_data->search_cmpl.conn_id,
-                                                                app_profile->service_start_handle,
-                                                                app_profile->service_end_handle,
-                                                                remfilt_char_uuid,
-                                                                char_elem,
-                                                                charact_count );
-                        if (status != ESP_GATT_OK) {
-                            ESP_LOGE(TAG, "esp_ble_gattc_get_char_by_uuid error");
-                        }
-
-                        /*  Every service have only one char in the ESP GATT SERVER implementation ', so we used first 'char_elem' */
-                        if (*charact_count > 0 && (char_elem[0].properties & ESP_GATT_CHAR_PROP_BIT_READ)) { // ESP_GATT_CHAR_PROP_BIT_NOTIFY
-                            app_profile->char_handle = char_elem[0].char_handle;
-                            /* Finished getting the charactistic handle after successfull conecction. */
-                            /* Start looking for other devices */
-                            ble_start_scan(&ble_client, false);
-                        }
-                    }
-                    /* free char_elem */
-                    free(char_elem);
-                } 
-                else {
-                    ESP_LOGE(TAG, "No char found");
+                /*  Every service have only one char in the ESP GATT SERVER implementation ', so we used the first match */
+                esp_gattc_char_elem_t chr;
+                if (ble_disc_char(app_id, gattc_if, hot->service_start_handle[app_id], hot->service_end_handle[app_id],
+                                  cold->charact_uuid[app_id], &chr) && (chr.properties & ESP_GATT_CHAR_PROP_BIT_READ)) {
+                    /* Kept for the next connection, stored once the Database Hash is known */
+                    ble_gatt_cache_entry_t *entry = &cold->cache[app_id];
+                    memset(entry, 0, sizeof(*entry));
+                    entry->version              = BLE_GATT_CACHE_VERSION;
+                    entry->char_props           = chr.properties;
+                    entry->peer_key             = cold->peer_key[app_id];
+                    entry->service_start_handle = hot->service_start_handle[app_id];
+                    entry->service_end_handle   = hot->service_end_handle[app_id];
+                    entry->char_handle          = chr.char_handle;
+                    ble_disc_subs(app_id, gattc_if);
+                    ble_disc_reads(app_id, gattc_if);
+                    cold->cache_state[app_id]   = BLE_CACHE_NONE;
+                    ble_peer_ready(app_id, gattc_if);
+                    break;
                 }
+                BLE_LOGE(TAG, "%s: characteristic not found or not readable", cold->remote_dev_name[app_id]);
+            } else {
+                BLE_LOGE(TAG, "%s: service not found", cold->remote_dev_name[app_id]);
             }
+            ble_peer_setup_failed(app_id, gattc_if);
             break;
 
         case ESP_GATTC_READ_CHAR_EVT:
-            ESP_LOGI(TAG, "ESP_GATTC_READ_CHAR_EVT");
+            BLE_LOGD(TAG, "ESP_GATTC_READ_CHAR_EVT");
+            if (cold->cache_state[app_id] == BLE_CACHE_VALIDATING ||
+                (cold->cache_state[app_id] == BLE_CACHE_FILLING &&
+                 !((hot->poll_inflight & (1U << app_id)) && hot->poll_count[app_id] &&
+                   p_data->read.handle == hot->poll_handle[app_id][hot->poll_pos[app_id]]))) {
+                /* The Database Hash, unless it is the polling read issued ahead of it when the link got ready */
+                ble_cache_db_hash_read(app_id, gattc_if, &p_data->read);
+                break;
+            }
+            if (hot->poll_inflight & (1U << app_id)) {
+                /* The link is free again, ble_poll_kick below issues its next read */
+                cold->link_pdus[app_id]  += 1U + ble_conn_pdus(p_data->read.value_len, cold->ll_rx_octets[app_id]);
+                cold->link_bytes[app_id] += 2U * BLE_CONN_ATT_HDR + p_data->read.value_len;
+                ble_lat_record(app_id, BLE_LAT_READ, ble_client.evt_us - cold->read_us[app_id]);
+                portENTER_CRITICAL(&ble_peer_mux);
+                hot->poll_inflight &= ~(1U << app_id);
+                portEXIT_CRITICAL(&ble_peer_mux);
+                cold->stats[app_id].read_requests++;
+                if (param->read.status == ESP_GATT_OK) {
+                    cold->stats[app_id].reads++;
+                } else {
+                    cold->stats[app_id].read_errors++;
+                }
+                if (hot->poll_count[app_id]) {
+                    hot->poll_pos[app_id] = (uint8_t)((hot->poll_pos[app_id] + 1U) % hot->poll_count[app_id]);
+                }
+            }
             if (param->read.status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "read failed, status %d", p_data->read.status);
+                BLE_LOGE(TAG, "read failed, status %d", p_data->read.status);
+                if (param->read.status == ESP_GATT_INVALID_HANDLE && cold->cache_state[app_id] == BLE_CACHE_HIT) {
+                    ble_cache_invalidate(app_id, gattc_if);
+                } else if ((param->read.status == ESP_GATT_INVALID_HANDLE || param->read.status == ESP_GATT_READ_NOT_PERMIT) &&
+                           hot->conn_state[app_id] == BLE_CONN_READY) {
+                    /* Would fail the same way at link speed; a read sent before its handles moved is left to the
+                     * discovery under way */
+                    BLE_LOGE(TAG, "%s: polling stopped", cold->remote_dev_name[app_id]);
+                    ble_peer_poll(app_id, false);
+                }
+            } else {
+                ble_data_push(app_id, BLE_NOTIFY_REC_READ, p_data->read.handle, p_data->read.value, p_data->read.value_len);
+            }
+            ble_poll_kick(&ble_client);
+            break;
+
+        case ESP_GATTC_READ_MULTIPLE_EVT: {
+            BLE_LOGD(TAG, "ESP_GATTC_READ_MULTIPLE_EVT");
+            if (!(hot->poll_inflight & (1U << app_id))) {
                 break;
             }
-            esp_log_buffer_hex(TAG, p_data->read.value, p_data->read.value_len); // esp_ble_gattc_cb_param_t
+            /* Polled values back to back in request order, split by their configured lengths */
+            uint8_t  pos   = hot->poll_pos[app_id];
+            uint8_t  n     = hot->poll_n[app_id];
+            uint8_t  count = hot->poll_count[app_id];
+            uint16_t total = 0;
+            for (uint8_t k = 0; count && k < n; k++)
+            {
+                total = (uint16_t)(total + hot->poll_len[app_id][(pos + k) % count]);
+            }
+            cold->link_pdus[app_id]  += 1U + ble_conn_pdus(p_data->read.value_len, cold->ll_rx_octets[app_id]);
+            cold->link_bytes[app_id] += 2U * BLE_CONN_ATT_HDR + 2U * (n - 1U) + p_data->read.value_len;
+            ble_lat_record(app_id, BLE_LAT_READ, ble_client.evt_us - cold->read_us[app_id]);
+            portENTER_CRITICAL(&ble_peer_mux);
+            hot->poll_inflight &= ~(1U << app_id);
+            portEXIT_CRITICAL(&ble_peer_mux);
+            cold->stats[app_id].read_requests++;
+            if (p_data->read.status == ESP_GATT_OK && count && p_data->read.value_len == total) {
+                const uint8_t *value = p_data->read.value;
+                for (uint8_t k = 0; k < n; k++)
+                {
+                    uint8_t i = (uint8_t)((pos + k) % count);
+                    ble_data_push(app_id, BLE_NOTIFY_REC_READ, hot->poll_handle[app_id][i], value, hot->poll_len[app_id][i]);
+                    value += hot->poll_len[app_id][i];
+                }
+                cold->stats[app_id].reads += n;
+                hot->poll_pos[app_id] = (uint8_t)((pos + n) % count);
+            } else if (p_data->read.status == ESP_GATT_INVALID_HANDLE || p_data->read.status == ESP_GATT_READ_NOT_PERMIT) {
+                /* A handle problem, not a refusal of Read Multiple: as for ESP_GATTC_READ_CHAR_EVT */
+                BLE_LOGE(TAG, "read multiple failed, status %d", p_data->read.status);
+                cold->stats[app_id].read_errors++;
+                if (p_data->read.status == ESP_GATT_INVALID_HANDLE && cold->cache_state[app_id] == BLE_CACHE_HIT) {
+                    ble_cache_invalidate(app_id, gattc_if);
+                } else if (hot->conn_state[app_id] == BLE_CONN_READY) {
+                    BLE_LOGE(TAG, "%s: polling stopped", cold->remote_dev_name[app_id]);
+                    ble_peer_poll(app_id, false);
+                }
+            } else {
+                cold->stats[app_id].read_errors++;
+                if (p_data->read.status != ESP_GATT_NO_RESOURCES) {
+                    /* Not taken, or values not of the configured lengths: the same handles go one by one */
+                    BLE_LOGW(TAG, "%s: read multiple status %d, %d of %d bytes, reading one by one",
+                             cold->remote_dev_name[app_id], p_data->read.status, p_data->read.value_len, total);
+                    cold->link_refused[app_id] |= BLE_LINK_REFUSED_READ_MULTI;
+                }
+            }
+            ble_poll_kick(&ble_client);
             break;
+        }
 
         case ESP_GATTC_REG_FOR_NOTIFY_EVT: {
-            ESP_LOGI(TAG, "ESP_GATTC_REG_FOR_NOTIFY_EVT");
+            BLE_LOGI(TAG, "ESP_GATTC_REG_FOR_NOTIFY_EVT");
+            uint8_t sub = ble_peer_sub_find(app_id, p_data->reg_for_notify.handle, false);
+            if (sub == BLE_PEER_SUB_MAX) {
+                break;
+            }
             if (p_data->reg_for_notify.status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "Reg Notify failed, error status =%x", p_data->reg_for_notify.status);
+                BLE_LOGE(TAG, "Reg Notify failed, error status =%x", p_data->reg_for_notify.status);
+                cold->sub_mask[app_id] &= ~(1U << sub);
+                ble_peer_sub_progress(app_id, gattc_if);
                 break;
             }
-            uint16_t count = 0;
-            uint16_t notify_en = 1;
-            esp_gatt_status_t ret_status = esp_ble_gattc_get_attr_count( gattc_if,
-                                                                        app_profile->conn_id,
-                                                                        ESP_GATT_DB_DESCRIPTOR,
-                                                                        app_profile->service_start_handle,
-                                                                        app_profile->service_end_handle,
-                                                                        app_profile->char_handle,
-                                                                        &count);
-            if (ret_status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "esp_ble_gattc_get_attr_count error");
-            }
-            if (count > 0) {
-                descr_elem = (esp_gattc_descr_elem_t *)malloc(sizeof(esp_gattc_descr_elem_t) * count);
-                if (!descr_elem) {
-                    ESP_LOGE(TAG, "malloc error, gattc no mem");
-                } else {
-                    ret_status = esp_ble_gattc_get_descr_by_char_handle( gattc_if,
-                                                                        app_profile->conn_id,
-                                                                        p_data->reg_for_notify.handle,
-                                                                        notify_descr_uuid,
-                                                                        descr_elem,
-                                                                        &count);
-                    if (ret_status != ESP_GATT_OK){
-                        ESP_LOGE(TAG, "esp_ble_gattc_get_descr_by_char_handle error");
-                    }
-
-                    /* Every char has only one descriptor in our 'ESP_GATTS_DEMO' demo, so we used first 'descr_elem' */
-                    if (count > 0 && descr_elem[0].uuid.len == ESP_UUID_LEN_16 && descr_elem[0].uuid.uuid.uuid16 == ESP_GATT_UUID_CHAR_CLIENT_CONFIG){
-                        ret_status = esp_ble_gattc_write_char_descr( gattc_if,
-                                                                    app_profile->conn_id,
-                                                                    descr_elem[0].handle,
-                                                                    sizeof(notify_en),
-                                                                    (uint8_t *)&notify_en,
-                                                                    ESP_GATT_WRITE_TYPE_RSP,
-                                                                    ESP_GATT_AUTH_REQ_NONE);
-                    }
+            /* CCCD handles come from the entry, discovered or cached: the writes of all subscriptions go back to back */
+            const ble_gatt_cache_sub_t *entry_sub = &cold->cache[app_id].subs[sub];
+            uint16_t notify_en = (entry_sub->char_props & ESP_GATT_CHAR_PROP_BIT_NOTIFY) ? 0x0001 : 0x0002;
+            esp_err_t ret = esp_ble_gattc_write_char_descr(gattc_if, hot->conn_id[app_id], entry_sub->cccd_handle,
+                                                           sizeof(notify_en), (uint8_t *)&notify_en, ESP_GATT_WRITE_TYPE_RSP,
+                                                           ESP_GATT_AUTH_REQ_NONE);
+            if (ret) {
+                BLE_LOGE(TAG, "esp_ble_gattc_write_char_descr error");
+                cold->sub_mask[app_id] &= ~(1U << sub);
+            }
+            cold->sub_written[app_id] |= (1U << sub);
+            ble_peer_sub_progress(app_id, gattc_if);
+            break;
+        }
 
-                    if (ret_status != ESP_GATT_OK){
-                        ESP_LOGE(TAG, "esp_ble_gattc_write_char_descr error");
-                    }
+        case ESP_GATTC_NOTIFY_EVT: {
+            /* Inter-arrival as the stack saw it, without the time the event waited in the queue */
+            int64_t now = ble_client.evt_us;
+            if (cold->notify_us[app_id]) {
+                ble_lat_record(app_id, BLE_LAT_NOTIFY, now - cold->notify_us[app_id]);
+            }
+            cold->notify_us[app_id] = now;
+            cold->stats[app_id].notifies++;
+            cold->link_pdus[app_id]  += ble_conn_pdus(p_data->notify.value_len, cold->ll_rx_octets[app_id]);
+            cold->link_bytes[app_id] += BLE_CONN_ATT_HDR + p_data->notify.value_len;
+            ble_data_push(app_id, p_data->notify.is_notify ? BLE_NOTIFY_REC_NOTIFY : BLE_NOTIFY_REC_INDICATE,
+                          p_data->notify.handle, p_data->notify.value, p_data->notify.value_len);
+            break;
+        }
 
-                    /* free descr_elem */
-                    free(descr_elem);
-                }
+        case ESP_GATTC_WRITE_DESCR_EVT: {
+            uint8_t sub = ble_peer_sub_find(app_id, p_data->write.handle, true);
+            if (sub == BLE_PEER_SUB_MAX) {
+                break;
             }
-            else{
-                ESP_LOGE(TAG, "decsr not found");
+            if (p_data->write.status != ESP_GATT_OK) {
+                BLE_LOGE(TAG, "write descr failed, error status = %x", p_data->write.status);
+                if (cold->cache_state[app_id] == BLE_CACHE_HIT) {
+                    /* Stale CCCD handle */
+                    ble_cache_invalidate(app_id, gattc_if);
+                    break;
+                }
+                /* The other subscriptions go on without this one */
+                cold->sub_mask[app_id] &= ~(1U << sub);
+            } else {
+                BLE_LOGI(TAG, "write descr success");
+                cold->sub_done[app_id] |= (1U << sub);
             }
+            ble_peer_sub_progress(app_id, gattc_if);
             break;
         }
 
-        case ESP_GATTC_NOTIFY_EVT:
-            if (p_data->notify.is_notify) {
-                ESP_LOGI(TAG, "ESP_GATTC_NOTIFY_EVT, Receive notify value:");
+        case ESP_GATTC_WRITE_CHAR_EVT:
+        case ESP_GATTC_PREP_WRITE_EVT:
+            if (p_data->write.status != ESP_GATT_OK && p_data->write.status != ESP_GATT_CONGESTED) {
+                BLE_LOGE(TAG, "write char failed, error status = %x", p_data->write.status);
             } else {
-                ESP_LOGI(TAG, "ESP_GATTC_NOTIFY_EVT, Receive indicate value:");
+                BLE_LOGD(TAG, "write char success");
+            }
+            if (ble_write_chunk_done(app_id, p_data->write.status)) {
+                ble_write_kick(app_id);
             }
-            esp_log_buffer_hex(TAG, p_data->notify.value, p_data->notify.value_len);
             break;
 
-        case ESP_GATTC_WRITE_DESCR_EVT:
-            if (p_data->write.status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "write descr failed, error status = %x", p_data->write.status);
-                break;
+        case ESP_GATTC_EXEC_EVT: {
+            ble_write_queue_t *q   = &ble_client.write_q[app_id];
+            ble_write_req_t   *req = &q->req[q->head];
+            if (p_data->exec_cmpl.status != ESP_GATT_OK) {
+                BLE_LOGE(TAG, "execute write failed, error status = %x", p_data->exec_cmpl.status);
             }
-            ESP_LOGI(TAG, "write descr success");
-            uint8_t write_char_data[35];
-            for (int i = 0; i < sizeof(write_char_data); ++i)
-            {
-                write_char_data[i] = i % 256;
+            portENTER_CRITICAL(&ble_peer_mux);
+            bool ours = q->count && req->mode == BLE_WRITE_LONG && req->exec_sent && !req->exec_done;
+            if (ours) {
+                req->exec_done = true;
+                if (p_data->exec_cmpl.status != ESP_GATT_OK) {
+                    req->status = ESP_FAIL;
+                }
+            }
+            portEXIT_CRITICAL(&ble_peer_mux);
+            if (ours) {
+                ble_write_kick(app_id);
             }
-            esp_ble_gattc_write_char( gattc_if,
-                                    app_profile->conn_id,
-                                    app_profile->char_handle,
-                                    sizeof(write_char_data),
-                                    write_char_data,
-                                    ESP_GATT_WRITE_TYPE_RSP,
-                                    ESP_GATT_AUTH_REQ_NONE);
             break;
+        }
 
-        case ESP_GATTC_WRITE_CHAR_EVT:
-            if (p_data->write.status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "write char failed, error status = %x", p_data->write.status);
-            } else {
-                ESP_LOGI(TAG, "write char success");
+        case ESP_GATTC_CONGEST_EVT:
+            /* L2CAP queue of the link over its threshold: hold write commands until it drains */
+            BLE_LOGD(TAG, "%s: congested %d", cold->remote_dev_name[app_id], p_data->congest.congested);
+            ble_client.write_q[app_id].congested = p_data->congest.congested;
+            if (!p_data->congest.congested) {
+                ble_write_kick(app_id);
             }
             break;
 
         case ESP_GATTC_SRVC_CHG_EVT: {
             esp_bd_addr_t bda;
             memcpy(bda, p_data->srvc_chg.remote_bda, sizeof(esp_bd_addr_t));
-            // ESP_LOGI(TAG, "ESP_GATTC_SRVC_CHG_EVT, bd_addr:%08x%04x",(bda[0] << 24) + (bda[1] << 16) + (bda[2] << 8) + bda[3],
-            //          (bda[4] << 8) + bda[5]);
-            ESP_LOGI(TAG, "ESP_GATTC_SRVC_CHG_EVT, bd_addr:");
-            esp_log_buffer_hex(TAG, bda, sizeof(esp_bd_addr_t));
+            BLE_LOGI(TAG, "ESP_GATTC_SRVC_CHG_EVT, bd_addr: %02x:%02x:%02x:%02x:%02x:%02x", BLE_LOG_BDA(bda));
+            if (memcmp(bda, cold->remote_bda[app_id], sizeof(esp_bd_addr_t)) == 0 && *conn_state >= BLE_CONN_CONNECTED) {
+                /* Handles may have moved: drop the entry and discover again on this link */
+                ble_cache_invalidate(app_id, gattc_if);
+            }
             break;
         }
         
         case ESP_GATTC_DISCONNECT_EVT:
-            if (memcmp(p_data->disconnect.remote_bda, app_profile->remote_bda, 6) == 0){
-                ESP_LOGI(TAG, "Device a disconnect");
-                *conn_device = false;
-                *get_service = false;
+            /* Routed here through conn_to_peer by ble_gattc_evt_handler, this is our link */
+            BLE_LOGI(TAG, "Device %s disconnect", cold->remote_dev_name[app_id]);
+            hot->conn_to_peer[p_data->disconnect.conn_id] = INVALID_PEER;
+            portENTER_CRITICAL(&ble_peer_mux);
+            hot->poll_inflight &= ~(1U << app_id);
+            portEXIT_CRITICAL(&ble_peer_mux);
+            bool was_ready = (*conn_state == BLE_CONN_READY);
+            *conn_state  = BLE_CONN_IDLE;
+            *get_service = false;
+            cold->stage_us[app_id]  = 0;
+            cold->notify_us[app_id] = 0;
+            cold->conn_int[app_id]       = 0U;
+            cold->conn_pending[app_id]   = false;
+            ble_client.link_pdus_retired += cold->link_pdus[app_id];
+            cold->link_pdus[app_id]      = 0U;
+            cold->link_pdus_seen[app_id] = 0U;
+            cold->link_bytes[app_id]     = 0U;
+            cold->link_bytes_seen[app_id] = 0U;
+            cold->conn_link[app_id]      = (ble_conn_link_t) { 0 };
+            ble_client.ll_wait_mask     &= ~(1U << app_id);
+            disc->char_count  = 0U;
+            disc->descr_count = 0U;
+            cold->sub_mask[app_id]    = 0U;
+            cold->sub_written[app_id] = 0U;
+            cold->sub_done[app_id]    = 0U;
+            /* Chunks already sent cannot be resumed on the next link, the writers decide what to send again */
+            ble_write_abort(app_id);
+            BLE_LOGI(TAG, "ESP_GATTC_DISCONNECT_EVT, reason = %d", p_data->disconnect.reason);
+            if (ble_client.peer_mask & (1U << app_id)) {
+                /* Lost link: look for it again right away, then back off, see ble_conn_pipeline_kick. A link that
+                 * never got ready keeps its backoff, see ble_peer_setup_failed. */
+                cold->stats[app_id].disconnects++;
+                if (cold->lost_us[app_id] == 0) {
+                    cold->lost_us[app_id] = esp_timer_get_time();
+                }
+                if (was_ready) {
+                    cold->retries[app_id]     = 0U;
+                    cold->next_try_us[app_id] = 0;
+                }
+                ble_client.stop_scan_done = false;
+                if (ble_client.is_scanning && ble_client.scan_targeted) {
+                    /* The running scan filters on other addresses, restart it with this one */
+                    ble_gap_scan_stop();
+                }
             }
-            ESP_LOGI(TAG, "ESP_GATTC_DISCONNECT_EVT, reason = %d", p_data->disconnect.reason);
+            ble_conn_pipeline_kick(&ble_client);
             break;
 
         default:
@@ -539,85 +893,1292 @@ static void gattc_profile_evt_handler(esp_gattc_cb_event_t event, esp_gatt_if_t
     }
 }
 
-/* API Globals */
-void bt_setup(void) 
+static void ble_conn_pipeline_kick(ble_gatt_client_t *client)
 {
-    esp_err_t ret;
-    /* Initialize BT Controller */
-    esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
-    ret = esp_bt_controller_init(&bt_cfg);
-    if (ret) {
-        ESP_LOGE(TAG, "%s Initialize controller failed: %s\n", __func__, esp_err_to_name(ret));
+    /* The controller initiates one connection at a time and opening while scanning is unreliable, so
+     * matches collected during the scan window are opened back to back once scanning has stopped,
+     * lowest priority value first. Each new OPEN_EVT frees the initiator for the next device while
+     * the previous links carry on with their own MTU exchange and service discovery. */
+    if (client->is_scanning && client->scan_mode == BLE_SCAN_MODE_BACKGROUND && !client->stop_scan_done) {
+        /* A peer went missing: the background duty cycle would take long to find it, stop for a discovery mode */
+        ble_gap_scan_stop();
         return;
     }
-
-    /* Bluetooth Controller Enable */
-    ret = esp_bt_controller_enable(ESP_BT_MODE_BLE);
-    if (ret) {
-        ESP_LOGE(TAG, "%s Enable controller failed: %s\n", __func__, esp_err_to_name(ret));
+    if (client->is_connecting || client->is_scanning) {
         return;
     }
 
-    /* Initialize Bluedroid API Stack */
-    ret = esp_bluedroid_init();
-    if (ret) {
-        ESP_LOGE(TAG, "%s Init bluetooth failed: %s\n", __func__, esp_err_to_name(ret));
-        return;
-    }
+    for (;;) {
+        uint8_t next     = INVALID_PEER;
+        bool    missing  = false;
+        int64_t next_try = INT64_MAX;
+        portENTER_CRITICAL(&ble_peer_mux);
+        for (uint8_t i = 0; i < PROFILE_NUM; i++)
+        {
+            if (!(client->peer_mask & (1U << i))) {
+                continue;
+            }
+            if (client->hot.conn_state[i] == BLE_CONN_FOUND &&
+                (next == INVALID_PEER || client->cold.priority[i] < client->cold.priority[next])) {
+                next = i;
+            }
+            if (client->hot.conn_state[i] == BLE_CONN_IDLE) {
+                missing  = true;
+                next_try = (client->cold.next_try_us[i] < next_try) ? client->cold.next_try_us[i] : next_try;
+            }
+        }
+        if (next != INVALID_PEER) {
+            client->hot.conn_state[next] = BLE_CONN_OPENING;
+            client->is_connecting    = true;
+        }
+        portEXIT_CRITICAL(&ble_peer_mux);
+
+        if (next == INVALID_PEER) {
+            /* Found devices are all opened, look for the remaining ones once the earliest backoff is over */
+            if (!missing && client->stop_scan_done) {
+                /* Every peer ready: ble_start_scan drops to background scanning, or leaves the radio alone */
+                ble_start_scan(client, false);
+            } else if (missing) {
+                int64_t wait_us = next_try - esp_timer_get_time();
+                if (wait_us <= 0) {
+                    ble_start_scan(client, false);
+                } else {
+                    TickType_t ticks = pdMS_TO_TICKS((uint32_t)((wait_us + 999) / 1000));
+                    xTimerChangePeriod(client->retry_timer, ticks ? ticks : 1, 0);
+                }
+            }
+            return;
+        }
 
-    /* Enable Bluedroid API Stack */
-    ret = esp_bluedroid_enable();
-    if (ret) {
-        ESP_LOGE(TAG, "%s Enable bluetooth failed: %s\n", __func__, esp_err_to_name(ret));
-        return;
+        BLE_LOGW(TAG, "Attempting to connect to %s", client->cold.remote_dev_name[next]);
+        client->cold.stage_us[next] = esp_timer_get_time();
+        esp_err_t ret = ble_gap_open(client, next);
+        if (ret == ESP_OK) {
+            return;
+        }
+        BLE_LOGE(TAG, "Gattc open error, error code = %x", ret);
+        client->hot.conn_state[next] = BLE_CONN_IDLE;
+        client->is_connecting    = false;
     }
 }
 
-void ble_register_cbs(void) 
+static bool ble_peers_all(const ble_gatt_client_t *client, ble_conn_state_t state)
 {
-    esp_err_t ret;
-    /* Register the  callback function to the gap module */
-    ret = esp_ble_gap_register_callback(esp_gap_cb);
-    if (ret){
-        ESP_LOGE(TAG, "Gap register error, error code = %x", ret);
-        return;
+    /* True if every peer in the table got at least as far as state */
+    for (uint8_t i = 0; i < PROFILE_NUM; i++)
+    {
+        if ((client->peer_mask & (1U << i)) && client->hot.conn_state[i] < state) {
+            return false;
+        }
     }
+    return client->peer_mask != 0U;
+}
 
-    /* Register the callback function to the gattc module */
-    ret = esp_ble_gattc_register_callback(esp_gattc_cb);
-    if(ret){
-        ESP_LOGE(TAG, "gattc register error, error code = %x", ret);
-        return;
+static bool ble_uuid_equal(const esp_bt_uuid_t *a, const esp_bt_uuid_t *b)
+{
+    if (a->len != b->len) {
+        return false;
+    }
+    switch (a->len) {
+        case ESP_UUID_LEN_16:
+            return a->uuid.uuid16 == b->uuid.uuid16;
+        case ESP_UUID_LEN_32:
+            return a->uuid.uuid32 == b->uuid.uuid32;
+        case ESP_UUID_LEN_128:
+            return memcmp(a->uuid.uuid128, b->uuid.uuid128, ESP_UUID_LEN_128) == 0;
+        default:
+            return false;
     }
 }
 
-void ble_setup(void) 
+static void ble_data_push(uint8_t peer, uint8_t type, uint16_t handle, const uint8_t *value, uint16_t len)
 {
-    esp_err_t ret;
-    /* Initialize NVS Flash module - Non-Volatile Storage */
-    ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
+    /* Out of the event record into the consumer's ring, stamped with the callback time; never blocks. The
+     * subscription is looked up here, where the handles are not changing under the lookup. */
+    uint8_t sub = ble_peer_sub_find(peer, handle, false);
+    if (!ble_notify_ring_push(&ble_client.notify_ring[peer], type, peer, handle,
+                              (sub == BLE_PEER_SUB_MAX) ? BLE_NOTIFY_SUB_NONE : sub, value, len, ble_client.evt_us)) {
+        BLE_LOGD(TAG, "Ring of %s full, value dropped", ble_client.cold.remote_dev_name[peer]);
+    }
+    if (ble_client.data_consumer) {
+        xTaskNotifyGive(ble_client.data_consumer);
     }
-    ESP_ERROR_CHECK( ret );
-
-    /* Realease Memory for BT Controller */
-    ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
-
-    /* Call BT Controller & Bluedroid Stack API */
-    bt_setup();
-
-    /* Register BLE GAP & BLE GATT Client Callbacks */
-    ble_register_cbs();
-
 }
 
-void ble_register_app(void)
+static void ble_peer_ready(uint8_t peer, esp_gatt_if_t gattc_if)
 {
-    esp_err_t ret = ESP_FAIL;
-    /* Register number of profiles to be used in the app */
-    /* This will trigger ESP_GATTC_REG_EVT */
+    /* Handles are in cold.cache[peer], either discovered or loaded from NVS */
+    ble_peer_hot_t         *hot   = &ble_client.hot;
+    ble_peer_cold_t        *cold  = &ble_client.cold;
+    ble_gatt_cache_entry_t *entry = &cold->cache[peer];
+
+    hot->service_start_handle[peer] = entry->service_start_handle;
+    hot->service_end_handle[peer]   = entry->service_end_handle;
+    hot->char_handle[peer]          = entry->char_handle;
+    cold->service_found[peer] = true;
+    cold->sub_mask[peer]      = 0U;
+    cold->sub_written[peer]   = 0U;
+    cold->sub_done[peer]      = 0U;
+    /* Polling cycle: the characteristics the server has, in configuration order */
+    hot->poll_count[peer] = 0U;
+    hot->poll_pos[peer]   = 0U;
+    for (uint8_t i = 0; i < entry->read_count && i < BLE_PEER_READ_MAX; i++)
+    {
+        if (entry->read_handle[i] != INVALID_HANDLE) {
+            hot->poll_handle[peer][hot->poll_count[peer]] = entry->read_handle[i];
+            hot->poll_len[peer][hot->poll_count[peer]]    = cold->reads[peer][i].len;
+            hot->poll_count[peer]++;
+        }
+    }
+    for (uint8_t i = 0; i < entry->sub_count && i < BLE_PEER_SUB_MAX; i++)
+    {
+        if (entry->subs[i].cccd_handle != INVALID_HANDLE) {
+            cold->sub_mask[peer] |= (1U << i);
+        }
+    }
+    if (cold->sub_mask[peer]) {
+        /* Values pushed by the server land in the peer ring, see ESP_GATTC_NOTIFY_EVT. Every registration is
+         * in place before the first ESP_GATTC_REG_FOR_NOTIFY_EVT writes its CCCD. */
+        for (uint8_t i = 0; i < entry->sub_count; i++)
+        {
+            if (cold->sub_mask[peer] & (1U << i)) {
+                esp_ble_gattc_register_for_notify(gattc_if, cold->remote_bda[peer], entry->subs[i].char_handle);
+            }
+        }
+    } else {
+        ble_cache_fill(peer, gattc_if);
+        ble_peer_recovered(peer);
+    }
+
+    /* Finished getting the charactistic handle after successfull conecction. */
+    ble_trace(peer, BLE_LAT_DISCOVERY);
+    hot->conn_state[peer] = BLE_CONN_READY;
+    if (ble_peers_all(&ble_client, BLE_CONN_READY)) {
+        BLE_LOGW(TAG, "All devices are connected");
+        ble_client.stop_scan_done = true;
+        ble_conn_pipeline_kick(&ble_client);
+    }
+    ble_poll_kick(&ble_client);
+    ble_write_kick(peer);
+}
+
+static void ble_peer_search(uint8_t peer, esp_gatt_if_t gattc_if)
+{
+    /* Bluedroid discovers the whole database either way; the filter only saves SEARCH_RES events when every
+     * UUID of the peer is in one service */
+    ble_peer_cold_t  *cold = &ble_client.cold;
+    ble_disc_arena_t *disc = &cold->disc[peer];
+
+    memset(disc->sub_start, 0, sizeof(disc->sub_start));
+    memset(disc->sub_end, 0, sizeof(disc->sub_end));
+    memset(disc->read_start, 0, sizeof(disc->read_start));
+    memset(disc->read_end, 0, sizeof(disc->read_end));
+    esp_ble_gattc_search_service(gattc_if, ble_client.hot.conn_id[peer], cold->search_all[peer] ? NULL : &cold->service_uuid[peer]);
+}
+
+static bool ble_disc_char(uint8_t peer, esp_gatt_if_t gattc_if, uint16_t start, uint16_t end, esp_bt_uuid_t uuid,
+                          esp_gattc_char_elem_t *chr)
+{
+    /* First characteristic of that UUID in the service range, from the local copy of the database */
+    ble_peer_cold_t  *cold    = &ble_client.cold;
+    ble_disc_arena_t *disc    = &cold->disc[peer];
+    uint16_t          conn_id = ble_client.hot.conn_id[peer];
+    uint16_t          count   = 0;
+
+    esp_gatt_status_t status = esp_ble_gattc_get_attr_count(gattc_if, conn_id, ESP_GATT_DB_CHARACTERISTIC, start, end,
+                                                            INVALID_HANDLE, &count);
+    if (status != ESP_GATT_OK) {
+        BLE_LOGE(TAG, "esp_ble_gattc_get_attr_count error");
+    }
+    if (count == 0) {
+        BLE_LOGE(TAG, "No char found");
+        return false;
+    }
+    BLE_LOGI(TAG, "Char count %d", count);
+    if (count > disc->char_hwm) {
+        disc->char_hwm = count;
+    }
+    if (count > BLE_DISC_CHAR_MAX) {
+        BLE_LOGW(TAG, "%s: %d chars, keeping %d", cold->remote_dev_name[peer], count, BLE_DISC_CHAR_MAX);
+        disc->truncated++;
+        count = BLE_DISC_CHAR_MAX;
+    }
+    status = esp_ble_gattc_get_char_by_uuid(gattc_if, conn_id, start, end, uuid, disc->chars, &count);
+    if (status != ESP_GATT_OK) {
+        BLE_LOGE(TAG, "esp_ble_gattc_get_char_by_uuid error");
+        count = 0;
+    }
+    disc->char_count = count;
+    if (count == 0) {
+        return false;
+    }
+    *chr = disc->chars[0];
+    return true;
+}
+
+static uint16_t ble_disc_cccd(uint8_t peer, esp_gatt_if_t gattc_if, uint16_t start, uint16_t end, uint16_t char_handle)
+{
+    ble_peer_cold_t  *cold    = &ble_client.cold;
+    ble_disc_arena_t *disc    = &cold->disc[peer];
+    uint16_t          conn_id = ble_client.hot.conn_id[peer];
+    uint16_t          count   = 0;
+
+    esp_gatt_status_t status = esp_ble_gattc_get_attr_count(gattc_if, conn_id, ESP_GATT_DB_DESCRIPTOR, start, end,
+                                                            char_handle, &count);
+    if (status != ESP_GATT_OK) {
+        BLE_LOGE(TAG, "esp_ble_gattc_get_attr_count error");
+    }
+    if (count == 0) {
+        BLE_LOGE(TAG, "decsr not found");
+        return INVALID_HANDLE;
+    }
+    if (count > disc->descr_hwm) {
+        disc->descr_hwm = count;
+    }
+    if (count > BLE_DISC_DESCR_MAX) {
+        BLE_LOGW(TAG, "%s: %d descrs, keeping %d", cold->remote_dev_name[peer], count, BLE_DISC_DESCR_MAX);
+        disc->truncated++;
+        count = BLE_DISC_DESCR_MAX;
+    }
+    status = esp_ble_gattc_get_descr_by_char_handle(gattc_if, conn_id, char_handle, ble_client.notify_descr_uuid,
+                                                    disc->descrs, &count);
+    if (status != ESP_GATT_OK) {
+        BLE_LOGE(TAG, "esp_ble_gattc_get_descr_by_char_handle error");
+        count = 0;
+    }
+    disc->descr_count = count;
+
+    /* Looked up by the CCCD UUID, the first match is the one */
+    if (count > 0 && disc->descrs[0].uuid.len == ESP_UUID_LEN_16 && disc->descrs[0].uuid.uuid.uuid16 == ESP_GATT_UUID_CHAR_CLIENT_CONFIG) {
+        return disc->descrs[0].handle;
+    }
+    BLE_LOGE(TAG, "decsr not found");
+    return INVALID_HANDLE;
+}
+
+static void ble_disc_subs(uint8_t peer, esp_gatt_if_t gattc_if)
+{
+    /* Every subscription resolved from the one search, before any CCCD is written */
+    ble_peer_cold_t        *cold  = &ble_client.cold;
+    ble_disc_arena_t       *disc  = &cold->disc[peer];
+    ble_gatt_cache_entry_t *entry = &cold->cache[peer];
+
+    entry->sub_count = cold->sub_count[peer];
+    for (uint8_t i = 0; i < entry->sub_count; i++)
+    {
+        ble_gatt_cache_sub_t *sub = &entry->subs[i];
+        esp_gattc_char_elem_t chr;
+        if (disc->sub_end[i] == 0U ||
+            !ble_disc_char(peer, gattc_if, disc->sub_start[i], disc->sub_end[i], cold->subs[peer][i].charact_uuid, &chr)) {
+            BLE_LOGW(TAG, "%s: subscription %d not found", cold->remote_dev_name[peer], i);
+            continue;
+        }
+        if (!(chr.properties & (ESP_GATT_CHAR_PROP_BIT_NOTIFY | ESP_GATT_CHAR_PROP_BIT_INDICATE))) {
+            BLE_LOGI(TAG, "%s: subscription %d neither notifies nor indicates", cold->remote_dev_name[peer], i);
+            continue;
+        }
+        sub->char_handle = chr.char_handle;
+        sub->char_props  = chr.properties;
+        sub->cccd_handle = ble_disc_cccd(peer, gattc_if, disc->sub_start[i], disc->sub_end[i], chr.char_handle);
+    }
+}
+
+static void ble_disc_reads(uint8_t peer, esp_gatt_if_t gattc_if)
+{
+    /* Polled characteristics resolved from the same search; one missing or not readable is left out of the cycle */
+    ble_peer_cold_t        *cold  = &ble_client.cold;
+    ble_disc_arena_t       *disc  = &cold->disc[peer];
+    ble_gatt_cache_entry_t *entry = &cold->cache[peer];
+
+    entry->read_count = cold->read_count[peer];
+    for (uint8_t i = 0; i < entry->read_count; i++)
+    {
+        esp_gattc_char_elem_t chr;
+        entry->read_handle[i] = INVALID_HANDLE;
+        if (disc->read_end[i] == 0U ||
+            !ble_disc_char(peer, gattc_if, disc->read_start[i], disc->read_end[i], cold->reads[peer][i].charact_uuid, &chr)) {
+            BLE_LOGW(TAG, "%s: polled characteristic %d not found", cold->remote_dev_name[peer], i);
+            continue;
+        }
+        if (!(chr.properties & ESP_GATT_CHAR_PROP_BIT_READ)) {
+            BLE_LOGW(TAG, "%s: polled characteristic %d not readable", cold->remote_dev_name[peer], i);
+            continue;
+        }
+        entry->read_handle[i] = chr.char_handle;
+    }
+}
+
+static uint8_t ble_peer_sub_find(uint8_t peer, uint16_t handle, bool cccd)
+{
+    /* Subscription of a value or CCCD handle, BLE_PEER_SUB_MAX if none */
+    const ble_gatt_cache_entry_t *entry = &ble_client.cold.cache[peer];
+
+    for (uint8_t i = 0; handle != INVALID_HANDLE && i < entry->sub_count && i < BLE_PEER_SUB_MAX; i++)
+    {
+        if ((cccd ? entry->subs[i].cccd_handle : entry->subs[i].char_handle) == handle) {
+            return i;
+        }
+    }
+    return BLE_PEER_SUB_MAX;
+}
+
+static void ble_peer_sub_progress(uint8_t peer, esp_gatt_if_t gattc_if)
+{
+    /* The Database Hash read goes behind the last CCCD write on the bearer, so it holds up no subscription.
+     * The link is subscribed once every write is acknowledged; failed ones leave sub_mask. */
+    ble_peer_cold_t *cold = &ble_client.cold;
+    uint8_t          mask = cold->sub_mask[peer];
+
+    if ((cold->sub_written[peer] & mask) == mask) {
+        ble_cache_fill(peer, gattc_if);
+    }
+    if (mask == 0U || (cold->sub_done[peer] & mask) != mask) {
+        return;
+    }
+    ble_trace(peer, BLE_LAT_SUBSCRIBE);
+    cold->stage_us[peer] = 0;
+    /* Subscriptions back in place, the peer has recovered */
+    ble_peer_recovered(peer);
+    /* No round trip when the characteristic takes write commands */
+    ble_peer_write(peer, INVALID_HANDLE, ble_demo_write, sizeof(ble_demo_write),
+                   (cold->cache[peer].char_props & ESP_GATT_CHAR_PROP_BIT_WRITE_NR) ? BLE_WRITE_NO_RSP : BLE_WRITE_RSP,
+                   NULL, NULL);
+}
+
+static void ble_trace(uint8_t peer, ble_lat_stage_t stage)
+{
+    /* Closes the bring-up stage in progress and starts the next one, at the callback time of the event */
+    ble_peer_cold_t *cold = &ble_client.cold;
+    int64_t          now  = ble_client.evt_us;
+    if (cold->stage_us[peer]) {
+        ble_lat_record(peer, stage, now - cold->stage_us[peer]);
+        BLE_LOGD(TAG, "%s: %s %u us", cold->remote_dev_name[peer], ble_lat_stage_name(stage),
+                 (unsigned)(now - cold->stage_us[peer]));
+    }
+    cold->stage_us[peer] = now;
+}
+
+static void ble_poll_kick(ble_gatt_client_t *client)
+{
+    /* Every polled link that is ready and has no read outstanding gets its next one. Reads are issued
+     * round robin starting after the link served last, so no link is always first in the Bluedroid
+     * command queue. Runs on every read completion, so each link reads back to back at its own pace. */
+    ble_peer_hot_t *hot   = &client->hot;
+    uint32_t        claim = 0U;
+    uint8_t         start;
+
+    portENTER_CRITICAL(&ble_peer_mux);
+    start = hot->poll_next;
+    for (uint8_t i = 0; i < PROFILE_NUM; i++)
+    {
+        uint32_t bit = 1U << i;
+        if ((hot->poll_mask & client->peer_mask & bit) && !(hot->poll_inflight & bit) && hot->conn_state[i] == BLE_CONN_READY &&
+            hot->poll_count[i]) {
+            claim |= bit;
+        }
+    }
+    hot->poll_inflight |= claim;
+    portEXIT_CRITICAL(&ble_peer_mux);
+
+    for (uint8_t n = 0; claim && n < PROFILE_NUM; n++)
+    {
+        uint8_t i = (uint8_t)((start + n) % PROFILE_NUM);
+        if (!(claim & (1U << i))) {
+            continue;
+        }
+        claim &= ~(1U << i);
+        hot->poll_next = (uint8_t)((i + 1U) % PROFILE_NUM);
+        esp_err_t ret = ble_poll_issue(i);
+        if (ret) {
+            BLE_LOGE(TAG, "Poll read error, error code = %x", ret);
+            portENTER_CRITICAL(&ble_peer_mux);
+            hot->poll_inflight &= ~(1U << i);
+            portEXIT_CRITICAL(&ble_peer_mux);
+        }
+    }
+}
+
+static esp_err_t ble_poll_issue(uint8_t peer)
+{
+    /* Fixed-length values from poll_pos on go in one Read Multiple, as many as fit its MTU - 1 byte response;
+     * a value of varying length, or a link that refused Read Multiple, is read on its own */
+    ble_peer_hot_t    *hot   = &ble_client.hot;
+    ble_peer_cold_t   *cold  = &ble_client.cold;
+    uint8_t            pos   = hot->poll_pos[peer];
+    uint8_t            count = hot->poll_count[peer];
+    uint16_t           room  = (uint16_t)(cold->mtu[peer] - 1U);
+    esp_gattc_multi_t  multi = { 0 };
+
+    for (uint8_t n = 0; !(cold->link_refused[peer] & BLE_LINK_REFUSED_READ_MULTI) && n < count &&
+         multi.num_attr < ESP_GATTC_MULTI_MAX; n++)
+    {
+        uint8_t  i   = (uint8_t)((pos + n) % count);
+        uint16_t len = hot->poll_len[peer][i];
+        if (len == 0U || len > room) {
+            break;
+        }
+        multi.handles[multi.num_attr++] = hot->poll_handle[peer][i];
+        room = (uint16_t)(room - len);
+    }
+    cold->read_us[peer] = esp_timer_get_time();
+    if (multi.num_attr >= 2U) {
+        hot->poll_n[peer] = multi.num_attr;
+        return esp_ble_gattc_read_multiple(hot->gattc_if[peer], hot->conn_id[peer], &multi, ESP_GATT_AUTH_REQ_NONE);
+    }
+    hot->poll_n[peer] = 1U;
+    return esp_ble_gattc_read_char(hot->gattc_if[peer], hot->conn_id[peer], hot->poll_handle[peer][pos], ESP_GATT_AUTH_REQ_NONE);
+}
+
+static void ble_write_pump(uint8_t peer)
+{
+    /* Hands chunks to Bluedroid while the head buffers allow. Requests and long writes need the link to
+     * themselves; write commands go back to back, up to BLE_WRITE_CREDITS outstanding, paused while the link
+     * is congested. Chunks are picked under the lock and issued outside it; a task finding the pump busy
+     * leaves its work to the one inside, which goes round once more. */
+    ble_write_queue_t *q   = &ble_client.write_q[peer];
+    ble_peer_hot_t    *hot = &ble_client.hot;
+
+    portENTER_CRITICAL(&ble_peer_mux);
+    if (q->pumping) {
+        q->again = true;
+        portEXIT_CRITICAL(&ble_peer_mux);
+        return;
+    }
+    q->pumping = true;
+    for (;;) {
+        ble_write_req_t *req  = NULL;
+        uint16_t         off  = 0U;
+        uint16_t         n    = 0U;
+        bool             exec = false;
+        uint16_t         mtu  = ble_client.cold.mtu[peer];
+
+        q->again = false;
+        for (uint8_t k = 0; hot->conn_state[peer] == BLE_CONN_READY && k < q->count; k++)
+        {
+            ble_write_req_t *r = &q->req[(q->head + k) % BLE_WRITE_QUEUE_LEN];
+            if (r->mode == BLE_WRITE_NO_RSP) {
+                if (r->sent == r->len) {
+                    continue;
+                }
+                if (q->congested || q->inflight >= BLE_WRITE_CREDITS) {
+                    break;
+                }
+                n = (uint16_t)(mtu - 3U);
+            } else if (k != 0U || q->inflight) {
+                break;
+            } else if (r->mode == BLE_WRITE_RSP) {
+                if (r->sent == r->len) {
+                    break;
+                }
+                if (r->len > mtu - 3U) {
+                    /* Settled by ble_write_finish without going on air */
+                    r->status = ESP_ERR_INVALID_SIZE;
+                    r->sent   = r->len;
+                    break;
+                }
+                n = r->len;
+            } else if (r->sent < r->len) {
+                n = (uint16_t)(mtu - 5U);
+            } else if (!r->exec_sent) {
+                /* Prepared chunks applied on success, discarded by the server otherwise */
+                exec = true;
+            } else {
+                break;
+            }
+            req = r;
+            off = r->sent;
+            if (exec) {
+                r->exec_sent = true;
+            } else {
+                n = (n < r->len - r->sent) ? n : (uint16_t)(r->len - r->sent);
+                r->sent = (uint16_t)(r->sent + n);
+                r->chunks_out++;
+                q->inflight++;
+            }
+            break;
+        }
+        if (!req) {
+            if (q->again) {
+                continue;
+            }
+            break;
+        }
+        portEXIT_CRITICAL(&ble_peer_mux);
+
+        esp_gatt_if_t gattc_if = hot->gattc_if[peer];
+        uint16_t      conn_id  = hot->conn_id[peer];
+        uint16_t      handle   = req->handle ? req->handle : hot->char_handle[peer];
+        esp_err_t     ret;
+        if (exec) {
+            ret = esp_ble_gattc_execute_write(gattc_if, conn_id, req->status == ESP_OK);
+        } else if (req->mode == BLE_WRITE_LONG) {
+            ret = esp_ble_gattc_prepare_write(gattc_if, conn_id, handle, off, n, (uint8_t *)&req->data[off], ESP_GATT_AUTH_REQ_NONE);
+        } else {
+            ret = esp_ble_gattc_write_char(gattc_if, conn_id, handle, n, (uint8_t *)&req->data[off],
+                                           req->mode == BLE_WRITE_NO_RSP ? ESP_GATT_WRITE_TYPE_NO_RSP : ESP_GATT_WRITE_TYPE_RSP,
+                                           ESP_GATT_AUTH_REQ_NONE);
+        }
+
+        portENTER_CRITICAL(&ble_peer_mux);
+        if (ret) {
+            /* No event will come for this chunk, settle it here and send nothing more of the buffer */
+            BLE_LOGE(TAG, "Write error, error code = %x", ret);
+            if (exec) {
+                req->exec_done = true;
+            } else {
+                req->chunks_out--;
+                q->inflight--;
+            }
+            req->status = ESP_FAIL;
+            req->sent   = req->len;
+        }
+    }
+    q->pumping = false;
+    portEXIT_CRITICAL(&ble_peer_mux);
+}
+
+static bool ble_write_finish(uint8_t peer)
+{
+    /* Pops the head buffer if nothing of it is left on air and calls its callback */
+    ble_write_queue_t *q = &ble_client.write_q[peer];
+    ble_write_req_t    req;
+
+    portENTER_CRITICAL(&ble_peer_mux);
+    ble_write_req_t *head = &q->req[q->head];
+    if (q->count == 0U || head->sent != head->len || head->chunks_out ||
+        (head->mode == BLE_WRITE_LONG && !head->exec_done)) {
+        portEXIT_CRITICAL(&ble_peer_mux);
+        return false;
+    }
+    req     = *head;
+    q->head = (uint8_t)((q->head + 1U) % BLE_WRITE_QUEUE_LEN);
+    q->count--;
+    /* Counted under the lock, ble_peer_get_stats copies them from other tasks */
+    ble_peer_stats_t *stats = &ble_client.cold.stats[peer];
+    if (req.status == ESP_OK) {
+        stats->writes++;
+        stats->write_bytes += req.len;
+    } else {
+        stats->write_errors++;
+    }
+    portEXIT_CRITICAL(&ble_peer_mux);
+    if (req.cb) {
+        req.cb(peer, req.status, req.arg);
+    }
+    return true;
+}
+
+static void ble_write_kick(uint8_t peer)
+{
+    /* Completed buffers free credits and may unblock the next request */
+    do {
+        ble_write_pump(peer);
+    } while (ble_write_finish(peer));
+}
+
+static void ble_writes_queued(ble_gatt_client_t *client)
+{
+    /* One event may cover several ble_peer_write calls, and a lost one is made up by the next */
+    portENTER_CRITICAL(&ble_peer_mux);
+    uint32_t mask = client->write_mask;
+    client->write_mask = 0U;
+    portEXIT_CRITICAL(&ble_peer_mux);
+
+    for (uint8_t i = 0; i < PROFILE_NUM; i++)
+    {
+        if (mask & (1U << i)) {
+            ble_write_kick(i);
+        }
+    }
+}
+
+static bool ble_write_chunk_done(uint8_t peer, esp_gatt_status_t status)
+{
+    /* Bluedroid completes the chunks of a link in the order they were issued: the event belongs to the
+     * oldest buffer with chunks outstanding. False if none, the write was not issued by ble_peer_write. */
+    ble_write_queue_t *q     = &ble_client.write_q[peer];
+    bool               found = false;
+
+    portENTER_CRITICAL(&ble_peer_mux);
+    for (uint8_t k = 0; k < q->count; k++)
+    {
+        ble_write_req_t *r = &q->req[(q->head + k) % BLE_WRITE_QUEUE_LEN];
+        if (r->chunks_out == 0U) {
+            continue;
+        }
+        r->chunks_out--;
+        q->inflight--;
+        uint16_t chunk = (uint16_t)(ble_client.cold.mtu[peer] - (r->mode == BLE_WRITE_LONG ? 5U : 3U));
+        chunk = (r->len < chunk) ? r->len : chunk;
+        ble_client.cold.link_pdus[peer]  += ble_conn_pdus(chunk, ble_client.cold.ll_tx_octets[peer]) + (r->mode != BLE_WRITE_NO_RSP);
+        ble_client.cold.link_bytes[peer] += BLE_CONN_ATT_HDR * (1U + (r->mode != BLE_WRITE_NO_RSP)) + chunk;
+        if (status == ESP_GATT_CONGESTED) {
+            /* Sent, but the link queue is full until ESP_GATTC_CONGEST_EVT clears it */
+            q->congested = true;
+        } else if (status != ESP_GATT_OK) {
+            r->status = ESP_FAIL;
+            r->sent   = r->len;
+        }
+        found = true;
+        break;
+    }
+    portEXIT_CRITICAL(&ble_peer_mux);
+    return found;
+}
+
+static void ble_write_abort(uint8_t peer)
+{
+    /* Link gone or peer removed: every queued buffer completes with ESP_ERR_INVALID_STATE */
+    ble_write_queue_t *q = &ble_client.write_q[peer];
+
+    for (;;) {
+        ble_write_req_t req;
+        portENTER_CRITICAL(&ble_peer_mux);
+        if (q->count == 0U) {
+            q->inflight  = 0U;
+            q->congested = false;
+            portEXIT_CRITICAL(&ble_peer_mux);
+            return;
+        }
+        req     = q->req[q->head];
+        q->head = (uint8_t)((q->head + 1U) % BLE_WRITE_QUEUE_LEN);
+        q->count--;
+        portEXIT_CRITICAL(&ble_peer_mux);
+
+        ble_client.cold.stats[peer].write_errors++;
+        if (req.cb) {
+            req.cb(peer, ESP_ERR_INVALID_STATE, req.arg);
+        }
+    }
+}
+
+static void ble_cache_fill(uint8_t peer, esp_gatt_if_t gattc_if)
+{
+    /* After a fresh discovery, read the Database Hash to store with the handles */
+    if (ble_client.cold.cache_state[peer] != BLE_CACHE_NONE) {
+        return;
+    }
+    ble_client.cold.cache_state[peer] = BLE_CACHE_FILLING;
+    esp_err_t ret = esp_ble_gattc_read_by_type(gattc_if, ble_client.hot.conn_id[peer], 0x0001, 0xFFFF,
+                                               &ble_db_hash_uuid, ESP_GATT_AUTH_REQ_NONE);
+    if (ret) {
+        ble_client.cold.cache_state[peer] = BLE_CACHE_NONE;
+    }
+}
+
+static void ble_cache_db_hash_read(uint8_t peer, esp_gatt_if_t gattc_if, const struct gattc_read_char_evt_param *read)
+{
+    ble_peer_cold_t        *cold  = &ble_client.cold;
+    ble_gatt_cache_entry_t *entry = &cold->cache[peer];
+    bool                    valid = (read->status == ESP_GATT_OK && read->value_len == BLE_GATT_DB_HASH_LEN);
+
+    if (cold->cache_state[peer] == BLE_CACHE_VALIDATING) {
+        if (valid && memcmp(read->value, entry->db_hash, BLE_GATT_DB_HASH_LEN) == 0) {
+            BLE_LOGI(TAG, "%s: database unchanged, handles from cache", cold->remote_dev_name[peer]);
+            cold->cache_state[peer] = BLE_CACHE_HIT;
+            ble_peer_ready(peer, gattc_if);
+            return;
+        }
+        BLE_LOGI(TAG, "%s: database changed, discovering", cold->remote_dev_name[peer]);
+        ble_gatt_cache_forget(cold->remote_bda[peer]);
+        cold->cache_state[peer] = BLE_CACHE_NONE;
+        ble_peer_search(peer, gattc_if);
+        return;
+    }
+
+    /* Filling: servers without a Database Hash are stored too, trusted until a Service Changed */
+    if (valid) {
+        memcpy(entry->db_hash, read->value, BLE_GATT_DB_HASH_LEN);
+        entry->flags |= BLE_GATT_CACHE_F_DB_HASH;
+    }
+    cold->cache_state[peer] = (ble_gatt_cache_store(cold->remote_bda[peer], entry) == ESP_OK) ? BLE_CACHE_STORED : BLE_CACHE_NONE;
+}
+
+static void ble_cache_invalidate(uint8_t peer, esp_gatt_if_t gattc_if)
+{
+    ble_peer_cold_t *cold = &ble_client.cold;
+
+    BLE_LOGW(TAG, "%s: cached handles invalid, discovering", cold->remote_dev_name[peer]);
+    ble_gatt_cache_forget(cold->remote_bda[peer]);
+    cold->cache_state[peer]   = BLE_CACHE_NONE;
+    cold->service_found[peer] = false;
+    cold->sub_mask[peer]      = 0U;
+    cold->sub_written[peer]   = 0U;
+    cold->sub_done[peer]      = 0U;
+    if (ble_client.hot.conn_state[peer] >= BLE_CONN_CONNECTED) {
+        ble_client.hot.conn_state[peer] = BLE_CONN_CONNECTED;
+        ble_peer_search(peer, gattc_if);
+    }
+}
+
+static void ble_reconnect_backoff(uint8_t peer)
+{
+    /* Exponential backoff with jitter, see BLE_RECONNECT_BACKOFF_MIN_MS */
+    ble_peer_cold_t *cold  = &ble_client.cold;
+    uint32_t         shift = (cold->retries[peer] < 16U) ? cold->retries[peer] : 16U;
+    uint32_t      delay_ms = BLE_RECONNECT_BACKOFF_MIN_MS << shift;
+    if (delay_ms > BLE_RECONNECT_BACKOFF_MAX_MS) {
+        delay_ms = BLE_RECONNECT_BACKOFF_MAX_MS;
+    }
+    delay_ms = delay_ms - delay_ms / 4U + esp_random() % (delay_ms / 2U + 1U);
+
+    if (cold->retries[peer] < UINT8_MAX) {
+        cold->retries[peer]++;
+    }
+    if (cold->lost_us[peer]) {
+        cold->stats[peer].retries++;
+    }
+    cold->next_try_us[peer] = esp_timer_get_time() + (int64_t)delay_ms * 1000;
+    BLE_LOGD(TAG, "%s: retry %d in %u ms", cold->remote_dev_name[peer], cold->retries[peer], (unsigned)delay_ms);
+}
+
+static void ble_peer_setup_failed(uint8_t peer, esp_gatt_if_t gattc_if)
+{
+    /* The link is of no use: free its ACL slot and try again once the backoff is over, the ESP_GATTC_DISCONNECT_EVT
+     * of the close leaves the backoff in place */
+    ble_reconnect_backoff(peer);
+    if (esp_ble_gattc_close(gattc_if, ble_client.hot.conn_id[peer]) != ESP_OK) {
+        BLE_LOGE(TAG, "%s: close failed", ble_client.cold.remote_dev_name[peer]);
+    }
+}
+
+static void ble_peer_recovered(uint8_t peer)
+{
+    ble_peer_cold_t  *cold  = &ble_client.cold;
+    ble_peer_stats_t *stats = &cold->stats[peer];
+
+    cold->retries[peer] = 0U;
+    if (cold->lost_us[peer] == 0) {
+        return;
+    }
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - cold->lost_us[peer]) / 1000);
+    cold->lost_us[peer]     = 0;
+    portENTER_CRITICAL(&ble_peer_mux);
+    stats->reconnects++;
+    stats->recover_last_ms   = ms;
+    stats->recover_total_ms += ms;
+    stats->recover_max_ms    = (ms > stats->recover_max_ms) ? ms : stats->recover_max_ms;
+    portEXIT_CRITICAL(&ble_peer_mux);
+    BLE_LOGW(TAG, "%s recovered in %u ms", cold->remote_dev_name[peer], (unsigned)ms);
+}
+
+static ble_scan_mode_t ble_scan_target(ble_gatt_client_t *client)
+{
+    /* The mode follows what is missing and what is up, see ble_scan.h. When every missing peer was seen
+     * before, scan through the controller accept list so that the host is not woken by other advertisers.
+     * A peer never seen, or missed BLE_RECONNECT_WL_RETRIES times (it may have changed address), needs an
+     * open scan. */
+    uint32_t targets  = 0U;
+    bool     targeted = true;
+    uint8_t  missing  = 0U;
+    uint8_t  links    = 0U;
+    client->scan_peers = 0U;
+    portENTER_CRITICAL(&ble_peer_mux);
+    for (uint8_t i = 0; i < PROFILE_NUM; i++)
+    {
+        if (!(client->peer_mask & (1U << i))) {
+            continue;
+        }
+        if (client->hot.conn_state[i] >= BLE_CONN_CONNECTED) {
+            links++;
+        }
+        if (client->hot.conn_state[i] != BLE_CONN_IDLE) {
+            continue;
+        }
+        missing++;
+        client->scan_peers |= (1U << i);
+        if (client->cold.bda_known[i] && client->cold.retries[i] < BLE_RECONNECT_WL_RETRIES) {
+            targets |= (1U << i);
+        } else {
+            targeted = false;
+        }
+    }
+    portEXIT_CRITICAL(&ble_peer_mux);
+    /* Decoders listen to every advertiser, the accept list would hide them */
+    targeted = targeted && targets && !client->adv_decoder_count;
+    ble_scan_mode_t mode = ble_scan_mode_pick(missing, links, client->adv_decoder_count != 0U);
+    if (mode == BLE_SCAN_MODE_OFF) {
+        return mode;
+    }
+
+    /* The accept list cannot change while scanning, ble_start_scan only runs with the scan stopped */
+    if (targeted && targets != client->whitelist_mask) {
+        esp_ble_gap_clear_whitelist();
+        for (uint8_t i = 0; i < PROFILE_NUM; i++)
+        {
+            if (targets & (1U << i)) {
+                esp_ble_gap_update_whitelist(true, client->cold.remote_bda[i],
+                                             client->cold.remote_addr_type[i] == BLE_ADDR_TYPE_PUBLIC ? BLE_WL_ADDR_TYPE_PUBLIC : BLE_WL_ADDR_TYPE_RANDOM);
+            }
+        }
+        client->whitelist_mask = targets;
+    }
+    if (targeted != client->scan_targeted || mode != client->scan_mode) {
+        ble_scan_mode_params(mode, &ble_scan_params);
+        ble_scan_params.scan_filter_policy = targeted ? BLE_SCAN_FILTER_ALLOW_ONLY_WLST : BLE_SCAN_FILTER_ALLOW_ALL;
+        esp_err_t ret = ble_gap_scan_params_set();
+        if (ret) {
+            BLE_LOGE(TAG, "Set scan params error, error code = %x", ret);
+            return mode;
+        }
+        client->scan_targeted = targeted;
+        client->scan_mode     = mode;
+        BLE_LOGI(TAG, "Scan mode %s, %u missing, %u links", ble_scan_mode_name(mode), missing, links);
+    }
+    return mode;
+}
+
+static void ble_scan_account(ble_scan_mode_t mode)
+{
+    /* Link traffic as counted for the connection parameter policy, closed links included */
+    uint8_t  links = 0U;
+    uint32_t pdus  = ble_client.link_pdus_retired;
+    for (uint8_t i = 0; i < PROFILE_NUM; i++)
+    {
+        pdus += ble_client.cold.link_pdus[i];
+        if ((ble_client.peer_mask & (1U << i)) && ble_client.hot.conn_state[i] >= BLE_CONN_CONNECTED) {
+            links++;
+        }
+    }
+    ble_scan_stats_update(mode, esp_timer_get_time(), links, pdus);
+}
+
+static void ble_link_negotiate(uint8_t peer)
+{
+    /* Longer data PDUs and the faster PHY, asked for alongside the MTU exchange. A peer that turned one
+     * down keeps the default and is not asked again, the link runs either way. */
+    ble_peer_cold_t *cold = &ble_client.cold;
+    if (!(cold->link_refused[peer] & BLE_LINK_REFUSED_DLE)) {
+        ble_client.ll_wait_mask |= (1U << peer);
+        ble_link_dle_next();
+    }
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    /* A link opened on LE Coded stays there, the peer is likely out of reach of the uncoded PHYs */
+    if (!(cold->link_refused[peer] & BLE_LINK_REFUSED_2M) && cold->tx_phy[peer] == BLE_LINK_PHY_1M) {
+        esp_err_t ret = esp_ble_gap_set_prefered_phy(cold->remote_bda[peer], 0, ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                                     ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+        if (ret) {
+            BLE_LOGE(TAG, "Set preferred PHY error, error code = %x", ret);
+        }
+    }
+#endif
+}
+
+static void ble_link_dle_next(void)
+{
+    /* ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT carries no address, so one request is in flight at a time */
+    while (ble_client.ll_pending == INVALID_PEER && ble_client.ll_wait_mask) {
+        uint8_t peer = (uint8_t)__builtin_ctz(ble_client.ll_wait_mask);
+        ble_client.ll_wait_mask &= ~(1U << peer);
+        if (ble_client.hot.conn_state[peer] < BLE_CONN_CONNECTED) {
+            continue;
+        }
+        esp_err_t ret = esp_ble_gap_set_pkt_data_len(ble_client.cold.remote_bda[peer], BLE_LINK_TX_OCTETS);
+        if (ret) {
+            BLE_LOGE(TAG, "Set data length error, error code = %x", ret);
+            continue;
+        }
+        ble_client.ll_pending = peer;
+    }
+}
+
+static void ble_retry_timer_cb(TimerHandle_t timer)
+{
+    /* Timer task: the client state is only touched from the client task */
+    (void)timer;
+    ble_evt_post_local(BLE_LOCAL_RETRY);
+}
+
+static void ble_conn_timer_cb(TimerHandle_t timer)
+{
+    (void)timer;
+    ble_evt_post_local(BLE_LOCAL_CONN_POLICY);
+}
+
+static void ble_conn_policy_run(ble_gatt_client_t *client)
+{
+    /* What each link carried over the period decides the parameters it gets next, see ble_conn_params.h */
+    ble_peer_cold_t   *cold   = &client->cold;
+
+    for (uint8_t i = 0; i < PROFILE_NUM; i++)
+    {
+        ble_conn_link_t *link  = &cold->conn_link[i];
+        uint32_t         pdus  = cold->link_pdus[i];
+        uint32_t         bytes = cold->link_bytes[i];
+        link->active     = (client->peer_mask & (1U << i)) && client->hot.conn_state[i] >= BLE_CONN_CONNECTED && cold->conn_int[i];
+        link->fixed      = client->hot.conn_state[i] != BLE_CONN_READY || cold->conn_pending[i];
+        link->priority   = cold->priority[i];
+        link->backlog    = client->write_q[i].count != 0U || client->write_q[i].congested;
+        link->pdus_per_s = (uint32_t)((uint64_t)(pdus - cold->link_pdus_seen[i]) * 1000U / BLE_CONN_POLICY_MS);
+        link->step       = ble_conn_interval_step(cold->conn_int[i]);
+        link->latency    = cold->conn_latency[i];
+        link->octets     = (cold->ll_tx_octets[i] > cold->ll_rx_octets[i]) ? cold->ll_tx_octets[i] : cold->ll_rx_octets[i];
+        link->phy        = cold->tx_phy[i];
+        if (pdus != cold->link_pdus_seen[i]) {
+            /* Short values do not fill long PDUs, and take less air time */
+            uint32_t avg = (bytes - cold->link_bytes_seen[i]) / (pdus - cold->link_pdus_seen[i]);
+            link->octets = (avg < link->octets) ? (uint16_t)avg : link->octets;
+        }
+        cold->link_pdus_seen[i]  = pdus;
+        cold->link_bytes_seen[i] = bytes;
+    }
+    ble_conn_policy(cold->conn_link, PROFILE_NUM);
+    /* Same period for the scan accounting, so that long background scans are sampled too */
+    ble_scan_sample();
+
+    for (uint8_t i = 0; i < PROFILE_NUM; i++)
+    {
+        const ble_conn_link_t *link = &cold->conn_link[i];
+        uint16_t               itvl = ble_conn_step_interval(link->step);
+        if (!link->active || link->fixed || (itvl == cold->conn_int[i] && link->latency == cold->conn_latency[i])) {
+            continue;
+        }
+        esp_ble_conn_update_params_t params = {
+            .min_int = itvl,
+            .max_int = itvl,
+            .latency = link->latency,
+            .timeout = BLE_CONN_SUP_TIMEOUT,
+        };
+        memcpy(params.bda, cold->remote_bda[i], sizeof(esp_bd_addr_t));
+        BLE_LOGI(TAG, "%s: %u PDUs/s, interval %u -> %u, latency %u", cold->remote_dev_name[i],
+                 (unsigned)link->pdus_per_s, cold->conn_int[i], itvl, link->latency);
+        cold->conn_pending[i] = true;
+        esp_err_t ret = esp_ble_gap_update_conn_params(&params);
+        if (ret) {
+            BLE_LOGE(TAG, "Update conn params error, error code = %x", ret);
+            cold->conn_pending[i] = false;
+        }
+    }
+}
+
+static void ble_collect_timer_cb(TimerHandle_t timer)
+{
+    (void)timer;
+    ble_evt_post_local(BLE_LOCAL_COLLECT);
+}
+
+static void ble_peers_changed(ble_gatt_client_t *client)
+{
+    /* Links of removed peers are closed here, an open in flight is closed on its OPEN_EVT. The slot is free for
+     * ble_peer_add once its bit is cleared and the link is down. */
+    portENTER_CRITICAL(&ble_peer_mux);
+    uint32_t removed = client->remove_mask;
+    portEXIT_CRITICAL(&ble_peer_mux);
+    for (uint8_t i = 0; removed && i < PROFILE_NUM; i++)
+    {
+        if (!(removed & (1U << i))) {
+            continue;
+        }
+        ble_conn_state_t state = client->hot.conn_state[i];
+        if (state == BLE_CONN_CONNECTED || state == BLE_CONN_READY) {
+            esp_ble_gattc_close(client->hot.gattc_if[i], client->hot.conn_id[i]);
+        }
+        ble_write_abort(i);
+        portENTER_CRITICAL(&ble_peer_mux);
+        client->remove_mask &= ~(1U << i);
+        portEXIT_CRITICAL(&ble_peer_mux);
+    }
+    if (ble_peers_all(client, BLE_CONN_READY)) {
+        client->stop_scan_done = true;
+    }
+    /* Only this task matches reports, so the rejects need no lock; an added peer's name is already in the filter */
+    ble_adv_filter_clear_rejects(&client->adv_filter);
+    /* Added peers are scanned for once the pipeline is idle */
+    if (client->is_started) {
+        ble_conn_pipeline_kick(client);
+    }
+}
+
+static void ble_collect_elapsed(ble_gatt_client_t *client)
+{
+    if (client->is_scanning) {
+        BLE_LOGI(TAG, "Collect time elapsed, stopping scan");
+        ble_gap_scan_stop();
+    }
+}
+
+static void ble_scan_report(const esp_bd_addr_t bda, esp_ble_addr_type_t addr_type, int8_t rssi, const uint8_t *adv, uint16_t len,
+                            uint8_t phy)
+{
+    ble_peer_cold_t      *cold          = &ble_client.cold;
+    ble_conn_state_t     *conn_state    = ble_client.hot.conn_state;
+
+    /* Runs for every report: reject non-matching devices before any logging */
+    ble_scan_stats_report();
+    int match;
+    if (ble_client.adv_decoder_count) {
+        /* Sensors are heard from whatever address they use: one walk for the decoders and the peer name */
+        ble_adv_fields_t fields;
+        ble_adv_parse(adv, len, &fields);
+        ble_adv_decode(bda, rssi, &fields);
+        portENTER_CRITICAL(&ble_peer_mux);
+        match = ble_adv_filter_match_name(&ble_client.adv_filter, bda, fields.name_complete ? fields.name : NULL,
+                                          fields.name_len);
+    } else {
+        /* Only peers are looked for: known and rejected addresses skip the advertising data */
+        portENTER_CRITICAL(&ble_peer_mux);
+        match = ble_adv_filter_match_len(&ble_client.adv_filter, bda, adv, len);
+    }
+    if (match == BLE_ADV_FILTER_NO_MATCH || conn_state[match] != BLE_CONN_IDLE) {
+        portEXIT_CRITICAL(&ble_peer_mux);
+        return;
+    }
+
+    /* Matches are only recorded here; opening is deferred until the scan stops so that every
+     * advertiser seen in this window is collected, see ble_conn_pipeline_kick. */
+    conn_state[match] = BLE_CONN_FOUND;
+    memcpy(cold->remote_bda[match], bda, sizeof(esp_bd_addr_t));
+    cold->remote_addr_type[match] = addr_type;
+    cold->bda_known[match]        = true;
+    cold->adv_phy[match]          = phy;
+    ble_adv_filter_allow(&ble_client.adv_filter, bda, (uint8_t)match);
+    bool all_found = ble_peers_all(&ble_client, BLE_CONN_FOUND);
+    portEXIT_CRITICAL(&ble_peer_mux);
+
+    cold->stage_us[match] = ble_client.scan_start_us;
+    ble_scan_stats_found(ble_client.evt_us - ble_client.scan_start_us);
+    ble_trace((uint8_t)match, BLE_LAT_SCAN);
+
+    BLE_LOGW(TAG, "Searched device %s", ble_client.cold.remote_dev_name[match]);
+    BLE_LOGI(TAG, "BDA: %02x:%02x:%02x:%02x:%02x:%02x", BLE_LOG_BDA(bda));
+
+    if (all_found && ble_client.is_scanning) {
+        /* Nothing left to look for, end the scan window early */
+        BLE_LOGW(TAG, "All devices found, stopping scan");
+        xTimerStop(ble_client.collect_timer, 0);
+        ble_gap_scan_stop();
+    } else if (!xTimerIsTimerActive(ble_client.collect_timer)) {
+        /* Do not hold found devices for the whole window if some others are absent */
+        xTimerStart(ble_client.collect_timer, 0);
+    }
+}
+
+static void ble_adv_decode(const esp_bd_addr_t bda, int8_t rssi, const ble_adv_fields_t *fields)
+{
+    /* Readings go to the consumer the way notifications do: one copy into a ring, then a task notification */
+    uint8_t buf[sizeof(ble_adv_reading_t) + BLE_ADV_READING_MAX];
+    ble_adv_reading_t *reading = (ble_adv_reading_t *)buf;
+    bool pushed = false;
+    for (uint8_t d = 0; d < ble_client.adv_decoder_count; d++)
+    {
+        const ble_adv_decoder_cfg_t *dec = &ble_client.adv_decoders[d];
+        const ble_adv_field_t *field = (dec->src == BLE_ADV_SRC_MFR) ? fields->mfr : fields->svc;
+        uint8_t count = (dec->src == BLE_ADV_SRC_MFR) ? fields->mfr_count : fields->svc_count;
+        for (uint8_t f = 0; f < count; f++)
+        {
+            if (field[f].id != dec->id || (dec->src == BLE_ADV_SRC_SVC_DATA && field[f].uuid_len != ESP_UUID_LEN_16)) {
+                continue;
+            }
+            uint16_t len = dec->decode(bda, &field[f], reading->data, BLE_ADV_READING_MAX, dec->arg);
+            if (len == 0U || len > BLE_ADV_READING_MAX) {
+                continue;
+            }
+            memcpy(reading->bda, bda, sizeof(esp_bd_addr_t));
+            reading->rssi = rssi;
+            reading->src  = (uint8_t)dec->src;
+            if (!ble_notify_ring_push(&ble_client.adv_ring, BLE_NOTIFY_REC_ADV, d, dec->id, BLE_NOTIFY_SUB_NONE, buf,
+                                      (uint16_t)(sizeof(ble_adv_reading_t) + len), ble_client.evt_us)) {
+                BLE_LOGD(TAG, "Advertising ring full, reading dropped");
+            }
+            pushed = true;
+        }
+    }
+    if (pushed && ble_client.data_consumer) {
+        xTaskNotifyGive(ble_client.data_consumer);
+    }
+}
+
+static uint16_t ble_demo_sensor_decode(const esp_bd_addr_t bda, const ble_adv_field_t *field, uint8_t *out,
+                                       uint16_t out_max, void *arg)
+{
+    /* The demo sensors send their reading as is, only its size is checked */
+    (void)bda;
+    (void)arg;
+    if (field->len != DEMO_SENSOR_DATA_LEN || out_max < DEMO_SENSOR_DATA_LEN) {
+        return 0U;
+    }
+    memcpy(out, field->data, DEMO_SENSOR_DATA_LEN);
+    return DEMO_SENSOR_DATA_LEN;
+}
+
+static void ble_demo_agg_emit(void)
+{
+    /* One frame per slot, peers added but silent in it marked missing */
+    static ble_agg_frame_t frame;
+    ble_agg_expect(&ble_client.agg, ble_client.peer_mask);
+    while (ble_agg_poll(&ble_client.agg, esp_timer_get_time(), &frame)) {
+        ESP_LOGD(TAG, "slot %lld ms: peers %03x, missing %03x", (long long)(frame.start_us / 1000),
+                 (unsigned)frame.present, (unsigned)frame.missing);
+    }
+}
+
+static void ble_scan_started(esp_bt_status_t status)
+{
+    if (status == ESP_BT_STATUS_SUCCESS) {
+        BLE_LOGI(TAG, "Scan start success");
+        ble_client.scan_start_us = esp_timer_get_time();
+        ble_scan_account(ble_client.scan_mode);
+    } else {
+        BLE_LOGE(TAG, "Scan start failed");
+        ble_client.is_scanning = false;
+    }
+}
+
+static void ble_scan_ended(bool elapsed)
+{
+    /* Stopped, or the window elapsed: open whatever was found, or scan again */
+    ble_client.is_scanning = false;
+    ble_scan_account(BLE_SCAN_MODE_OFF);
+    if (elapsed) {
+        xTimerStop(ble_client.collect_timer, 0);
+        /* Peers this window was looking for and did not see wait longer before the next one */
+        for (uint8_t i = 0; i < PROFILE_NUM; i++)
+        {
+            if ((ble_client.scan_peers & ble_client.peer_mask & (1U << i)) && ble_client.hot.conn_state[i] == BLE_CONN_IDLE) {
+                ble_reconnect_backoff(i);
+            }
+        }
+    }
+    ble_conn_pipeline_kick(&ble_client);
+}
+
+/* The controller takes either the legacy or the extended HCI commands, never both: with the BLE 5.0 API
+ * built in, every scan and connection goes through the extended ones */
+static esp_err_t ble_gap_scan_params_set(void)
+{
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    esp_ble_ext_scan_params_t ext;
+    ble_scan_ext_params(&ble_scan_params, &ext);
+    return esp_ble_gap_set_ext_scan_params(&ext);
+#else
+    return esp_ble_gap_set_scan_params(&ble_scan_params);
+#endif
+}
+
+static esp_err_t ble_gap_scan_start(uint32_t duration)
+{
+    /* Duration in seconds, 0 scans until stopped */
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    return esp_ble_gap_start_ext_scan(duration * 100U, 0);
+#else
+    return esp_ble_gap_start_scanning(duration);
+#endif
+}
+
+static esp_err_t ble_gap_scan_stop(void)
+{
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    return esp_ble_gap_stop_ext_scan();
+#else
+    return esp_ble_gap_stop_scanning();
+#endif
+}
+
+static esp_err_t ble_gap_open(ble_gatt_client_t *client, uint8_t peer)
+{
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    /* Initiate on the primary PHY the peer advertised on: a long range peer is only heard on LE Coded */
+    esp_ble_gap_phy_mask_t mask = (client->cold.adv_phy[peer] == BLE_LINK_PHY_CODED) ?
+                                  ESP_BLE_GAP_PHY_CODED_PREF_MASK : ESP_BLE_GAP_PHY_1M_PREF_MASK;
+    esp_err_t ret = esp_ble_gap_prefer_ext_connect_params_set(client->cold.remote_bda[peer], mask,
+                                                              &ble_ext_conn_params, &ble_ext_conn_params, &ble_ext_conn_params);
+    if (ret) {
+        return ret;
+    }
+    return esp_ble_gattc_aux_open(client->hot.gattc_if[peer], client->cold.remote_bda[peer], client->cold.remote_addr_type[peer], true);
+#else
+    return esp_ble_gattc_open(client->hot.gattc_if[peer], client->cold.remote_bda[peer], client->cold.remote_addr_type[peer], true);
+#endif
+}
+
+/* API Globals */
+void bt_setup(void) 
+{
+    esp_err_t ret;
+    /* Initialize BT Controller */
+    esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
+    ret = esp_bt_controller_init(&bt_cfg);
+    if (ret) {
+        ESP_LOGE(TAG, "%s Initialize controller failed: %s\n", __func__, esp_err_to_name(ret));
+        return;
+    }
+
+    /* Bluetooth Controller Enable */
+    ret = esp_bt_controller_enable(ESP_BT_MODE_BLE);
+    if (ret) {
+        ESP_LOGE(TAG, "%s Enable controller failed: %s\n", __func__, esp_err_to_name(ret));
+        return;
+    }
+
+    /* Initialize Bluedroid API Stack */
+    ret = esp_bluedroid_init();
+    if (ret) {
+        ESP_LOGE(TAG, "%s Init bluetooth failed: %s\n", __func__, esp_err_to_name(ret));
+        return;
+    }
+
+    /* Enable Bluedroid API Stack */
+    ret = esp_bluedroid_enable();
+    if (ret) {
+        ESP_LOGE(TAG, "%s Enable bluetooth failed: %s\n", __func__, esp_err_to_name(ret));
+        return;
+    }
+}
+
+void ble_register_cbs(void) 
+{
+    esp_err_t ret;
+    /* Register the  callback function to the gap module */
+    ret = esp_ble_gap_register_callback(esp_gap_cb);
+    if (ret){
+        ESP_LOGE(TAG, "Gap register error, error code = %x", ret);
+        return;
+    }
+
+    /* Register the callback function to the gattc module */
+    ret = esp_ble_gattc_register_callback(esp_gattc_cb);
+    if(ret){
+        ESP_LOGE(TAG, "gattc register error, error code = %x", ret);
+        return;
+    }
+}
+
+void ble_setup(void) 
+{
+    esp_err_t ret;
+    /* Initialize NVS Flash module - Non-Volatile Storage */
+    ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK( ret );
+
+    /* GATT handles of known peers, lets reconnects skip service discovery */
+    ble_gatt_cache_init();
+
+    /* Callbacks log through the deferred ring, start its drain task before they run */
+    ble_log_init();
+
+    /* The callbacks only queue events, the client task runs them; it must exist before they are registered */
+    ESP_ERROR_CHECK(ble_evt_init(ble_evt_dispatch));
+
+    /* Realease Memory for BT Controller */
+    ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
+
+    /* Call BT Controller & Bluedroid Stack API */
+    bt_setup();
+
+    /* Register BLE GAP & BLE GATT Client Callbacks */
+    ble_register_cbs();
+
+}
+
+void ble_register_app(void)
+{
+    esp_err_t ret = ESP_FAIL;
+    /* Register every profile of the pool up front, ble_peer_add only fills them */
+    /* This will trigger ESP_GATTC_REG_EVT */
     for (uint8_t i = 0; i < PROFILE_NUM; i++)
     {
         profiles_app_id_t app_id = (profiles_app_id_t)i;
@@ -651,28 +2212,515 @@ void ble_start_scan(ble_gatt_client_t *client, bool reset)
     if (reset)
     {
         client->stop_scan_done = false;
-        /* Close all connections */
-        /* Reset all conn values from client struct */
+        /* Start over: close every link, they come back through the reconnect path, and forget the backoff */
+        for (uint8_t i = 0; i < PROFILE_NUM; i++)
+        {
+            client->cold.retries[i]     = 0U;
+            client->cold.next_try_us[i] = 0;
+            if (client->hot.conn_state[i] == BLE_CONN_FOUND) {
+                client->hot.conn_state[i] = BLE_CONN_IDLE;
+            } else if (client->hot.conn_state[i] >= BLE_CONN_CONNECTED) {
+                esp_ble_gattc_close(client->hot.gattc_if[i], client->hot.conn_id[i]);
+            }
+        }
+    }
+    /* Rejected devices get one more look per scan window, in case they were renamed */
+    ble_adv_filter_clear_rejects(&client->adv_filter);
+    if (client->collect_timer == NULL) {
+        client->collect_timer = xTimerCreate("ble_collect", pdMS_TO_TICKS(BLE_SCAN_COLLECT_MS), pdFALSE, client, ble_collect_timer_cb);
+    }
+    if (client->retry_timer == NULL) {
+        client->retry_timer = xTimerCreate("ble_retry", pdMS_TO_TICKS(BLE_RECONNECT_BACKOFF_MIN_MS), pdFALSE, client, ble_retry_timer_cb);
+    }
+    if (client->conn_timer == NULL) {
+        client->conn_timer = xTimerCreate("ble_conn", pdMS_TO_TICKS(BLE_CONN_POLICY_MS), pdTRUE, client, ble_conn_timer_cb);
+        xTimerStart(client->conn_timer, 0);
+    }
+    ble_scan_mode_t mode = ble_scan_target(client);
+    if (mode == BLE_SCAN_MODE_OFF) {
+        return;
     }
-    client->is_connecting  = false;
-    esp_ble_gap_start_scanning(BLE_SCAN_TIME); // Duration in seconds;
+    /* Discovery windows last BLE_SCAN_TIME seconds, the background scan runs until a peer goes missing */
+    esp_err_t ret = ble_gap_scan_start(mode == BLE_SCAN_MODE_BACKGROUND ? 0U : BLE_SCAN_TIME);
+    if (ret) {
+        ESP_LOGE(TAG, "Start scanning error, error code = %x", ret);
+        return;
+    }
+    client->is_scanning = true;
 
     /* This will trigger ESP_GAP_BLE_SCAN_START_COMPLETE_EVT and ESP_GAP_BLE_SCAN_RESULT_EVT after.
-    *   ESP_GAP_BLE_SCAN_RESULT_EVT will then try to connect to device.
-    *   esp_ble_gap_stop_scanning will be called if names mathced -> ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT
-    *   esp_ble_gattc_open will be called next to connect device -> ESP_GATTC_CONNECT_EVT and then ESP_GATTC_OPEN_EVT
-    *   ESP_GATTC_OPEN_EVT after a succesfull connection, will send MTU request with esp_ble_gattc_send_mtu_req, 
+    *   ESP_GAP_BLE_SCAN_RESULT_EVT marks every matching device as found during the scan window.
+    *   esp_ble_gap_stop_scanning is called once all devices are found or BLE_SCAN_COLLECT_MS after the first
+    *   match -> ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT, otherwise the window ends with ESP_GAP_SEARCH_INQ_CMPL_EVT. Either one runs ble_conn_pipeline_kick.
+    *   esp_ble_gattc_open is then called for each found device in turn -> ESP_GATTC_CONNECT_EVT and then ESP_GATTC_OPEN_EVT
+    *   ESP_GATTC_OPEN_EVT opens the next found device, and after a succesfull connection, will send MTU request with esp_ble_gattc_send_mtu_req, 
     *   triggering ESP_GATTC_CFG_MTU_EVT after: - Updating connection params -> ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT.
     *                                           - Call esp_ble_gattc_search_service -> ESP_GATTC_DIS_SRVC_CMPL_EVT and ESP_GATTC_SEARCH_RES_EVT
     *   ESP_GATTC_SEARCH_RES_EVT will get start and end handle for the service -> ESP_GATTC_SEARCH_CMPL_EVT
     *   ESP_GATTC_SEARCH_CMPL_EVT: If there's a service, get the attribute characteristics count.
     *                               If theres more than one characteristic, get it by UUID
-    *                               Save characteristic handle and start scan again to keep connecting other devices.
+    *                               Save characteristic handle, stop_scan_done is set once every device got there.
+    *   Once every found device is opened, scanning restarts if some devices are still missing.
+    *   Lost links (ESP_GATTC_DISCONNECT_EVT) are scanned for again right away; a peer missed by a whole scan
+    *   window or failing to open backs off exponentially, and known BDAs are scanned through the accept list.
+    *   Once every peer is READY a passive background scan runs until one goes missing, see ble_scan.h.
     * */
 }
 
+esp_err_t ble_client_start(void)
+{
+    if (ble_client.is_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* Set first: API calls from here on are queued behind the start, never run beside it */
+    ble_client.is_started = true;
+    esp_err_t ret = ble_evt_post_local(BLE_LOCAL_START);
+    if (ret) {
+        ble_client.is_started = false;
+    }
+    return ret;
+}
+
+esp_err_t ble_peer_add(const ble_peer_cfg_t *cfg, uint8_t *peer_id)
+{
+    ble_gatt_client_t *client = &ble_client;
+    if (cfg == NULL || cfg->name == NULL || strlen(cfg->name) > BLE_PEER_NAME_LEN_MAX ||
+        cfg->sub_count > BLE_PEER_SUB_MAX || (cfg->sub_count && cfg->subs == NULL) ||
+        cfg->read_count > BLE_PEER_READ_MAX || (cfg->read_count && cfg->reads == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* A removed peer keeps its profile until its link is down. The slot is reserved, filled without the lock
+     * (nothing reads a profile outside peer_mask) and published with its filter entry at the end. */
+    portENTER_CRITICAL(&ble_peer_mux);
+    uint8_t id = INVALID_PEER;
+    for (uint8_t i = 0; i < PROFILE_NUM; i++)
+    {
+        if (!((client->peer_mask | client->remove_mask | client->add_mask) & (1U << i)) &&
+            client->hot.conn_state[i] == BLE_CONN_IDLE) {
+            id = i;
+            break;
+        }
+    }
+    if (id != INVALID_PEER) {
+        client->add_mask |= (1U << id);
+    }
+    portEXIT_CRITICAL(&ble_peer_mux);
+    if (id == INVALID_PEER) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    strcpy(client->cold.remote_dev_name[id], cfg->name);
+    client->cold.service_uuid[id]  = cfg->service_uuid;
+    client->cold.charact_uuid[id]  = cfg->charact_uuid;
+    if (cfg->subs) {
+        memcpy(client->cold.subs[id], cfg->subs, cfg->sub_count * sizeof(ble_peer_sub_t));
+        client->cold.sub_count[id] = cfg->sub_count;
+    } else {
+        memset(&client->cold.subs[id][0], 0, sizeof(ble_peer_sub_t));
+        client->cold.subs[id][0].service_uuid = cfg->service_uuid;
+        client->cold.subs[id][0].charact_uuid = cfg->charact_uuid;
+        client->cold.sub_count[id] = 1U;
+    }
+    for (uint8_t i = 0; i < client->cold.sub_count[id]; i++)
+    {
+        /* The caller's format may go away, the peer keeps its own copy */
+        if (client->cold.subs[id][i].fmt) {
+            client->cold.sub_fmt[id][i]  = *client->cold.subs[id][i].fmt;
+            client->cold.subs[id][i].fmt = &client->cold.sub_fmt[id][i];
+        }
+    }
+    if (cfg->reads) {
+        memcpy(client->cold.reads[id], cfg->reads, cfg->read_count * sizeof(ble_peer_read_t));
+        client->cold.read_count[id] = cfg->read_count;
+    } else {
+        memset(&client->cold.reads[id][0], 0, sizeof(ble_peer_read_t));
+        client->cold.reads[id][0].service_uuid = cfg->service_uuid;
+        client->cold.reads[id][0].charact_uuid = cfg->charact_uuid;
+        client->cold.read_count[id] = 1U;
+    }
+    /* Cached handles only hold for the same UUIDs in the same order */
+    esp_bt_uuid_t uuids[2U + 2U * BLE_PEER_SUB_MAX + 2U * BLE_PEER_READ_MAX] = { cfg->service_uuid, cfg->charact_uuid };
+    uint8_t       n_uuids = 2U;
+    client->cold.search_all[id] = false;
+    for (uint8_t i = 0; i < client->cold.sub_count[id]; i++)
+    {
+        uuids[n_uuids++] = client->cold.subs[id][i].service_uuid;
+        uuids[n_uuids++] = client->cold.subs[id][i].charact_uuid;
+        if (!ble_uuid_equal(&client->cold.subs[id][i].service_uuid, &cfg->service_uuid)) {
+            client->cold.search_all[id] = true;
+        }
+    }
+    for (uint8_t i = 0; i < client->cold.read_count[id]; i++)
+    {
+        uuids[n_uuids++] = client->cold.reads[id][i].service_uuid;
+        uuids[n_uuids++] = client->cold.reads[id][i].charact_uuid;
+        if (!ble_uuid_equal(&client->cold.reads[id][i].service_uuid, &cfg->service_uuid)) {
+            client->cold.search_all[id] = true;
+        }
+    }
+    client->cold.peer_key[id]      = ble_gatt_cache_peer_key(uuids, n_uuids);
+    client->cold.sub_mask[id]      = 0U;
+    client->cold.sub_written[id]   = 0U;
+    client->cold.sub_done[id]      = 0U;
+    client->cold.priority[id]      = cfg->priority;
+    client->cold.service_found[id] = false;
+    client->cold.cache_state[id]   = BLE_CACHE_NONE;
+    client->cold.bda_known[id]     = false;
+    client->cold.retries[id]       = 0U;
+    client->cold.link_refused[id]  = 0U;
+    client->cold.adv_phy[id]       = BLE_LINK_PHY_1M;
+    client->cold.next_try_us[id]   = 0;
+    client->cold.lost_us[id]       = 0;
+    memset(&client->cold.stats[id], 0, sizeof(client->cold.stats[id]));
+    memset(&client->cold.disc[id], 0, sizeof(client->cold.disc[id]));
+    client->cold.stage_us[id]      = 0;
+    client->cold.notify_us[id]     = 0;
+    ble_adv_name_entry_t name_entry;
+    esp_err_t ret = ble_adv_filter_name_entry(client->cold.remote_dev_name[id], id, &name_entry);
+
+    portENTER_CRITICAL(&ble_peer_mux);
+    if (ret == ESP_OK) {
+        ret = ble_adv_filter_insert(&client->adv_filter, &name_entry);
+    }
+    if (ret == ESP_OK) {
+        client->peer_mask     |= (1U << id);
+        client->stop_scan_done = false;
+    }
+    client->add_mask &= ~(1U << id);
+    portEXIT_CRITICAL(&ble_peer_mux);
+    if (ret) {
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Peer %s added as profile %d, priority %d", client->cold.remote_dev_name[id], id, cfg->priority);
+    if (peer_id) {
+        *peer_id = id;
+    }
+    /* Already running: the client task forgets the cached rejects, which may hold the new peer, and scans for it
+     * once the pipeline is idle; before the start ble_start_scan clears them */
+    if (client->is_started) {
+        ble_evt_post_local(BLE_LOCAL_PEERS);
+    }
+    return ESP_OK;
+}
+
+esp_err_t ble_peer_remove(uint8_t peer_id)
+{
+    ble_gatt_client_t *client = &ble_client;
+    if (peer_id >= PROFILE_NUM) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&ble_peer_mux);
+    if (!(client->peer_mask & (1U << peer_id))) {
+        portEXIT_CRITICAL(&ble_peer_mux);
+        return ESP_ERR_NOT_FOUND;
+    }
+    client->peer_mask   &= ~(1U << peer_id);
+    client->remove_mask |= (1U << peer_id);
+    ble_adv_filter_remove(&client->adv_filter, peer_id);
+    if (client->hot.conn_state[peer_id] == BLE_CONN_FOUND) {
+        client->hot.conn_state[peer_id] = BLE_CONN_IDLE;
+    }
+    portEXIT_CRITICAL(&ble_peer_mux);
+
+    ESP_LOGI(TAG, "Peer %s removed", client->cold.remote_dev_name[peer_id]);
+    /* The link and the write queue belong to the client task; before the start there is neither a link nor the
+     * task's queue */
+    if (client->is_started) {
+        ble_evt_post_local(BLE_LOCAL_PEERS);
+    } else {
+        ble_peers_changed(client);
+    }
+    return ESP_OK;
+}
+
+ble_notify_ring_t *ble_peer_ring(uint8_t peer_id)
+{
+    return (peer_id < PROFILE_NUM) ? &ble_client.notify_ring[peer_id] : NULL;
+}
+
+esp_err_t ble_adv_decoder_add(const ble_adv_decoder_cfg_t *cfg, uint8_t *decoder_id)
+{
+    ble_gatt_client_t *client = &ble_client;
+    if (cfg == NULL || cfg->decode == NULL || cfg->src > BLE_ADV_SRC_SVC_DATA) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (client->is_started) {
+        /* The scan result path reads the table without locking */
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (client->adv_decoder_count == BLE_ADV_DECODER_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    client->adv_decoders[client->adv_decoder_count] = *cfg;
+    if (decoder_id) {
+        *decoder_id = client->adv_decoder_count;
+    }
+    client->adv_decoder_count++;
+    return ESP_OK;
+}
+
+ble_notify_ring_t *ble_adv_ring(void)
+{
+    return &ble_client.adv_ring;
+}
+
+void ble_peer_set_consumer(TaskHandle_t task)
+{
+    ble_client.data_consumer = task;
+}
+
+esp_err_t ble_peer_poll(uint8_t peer_id, bool enable)
+{
+    if (peer_id >= PROFILE_NUM) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&ble_peer_mux);
+    if (enable) {
+        ble_client.hot.poll_mask |= (1U << peer_id);
+    } else {
+        ble_client.hot.poll_mask &= ~(1U << peer_id);
+    }
+    portEXIT_CRITICAL(&ble_peer_mux);
+    /* The client task starts it right away if the link is already ready, otherwise it starts once it is */
+    if (enable && ble_client.is_started) {
+        ble_evt_post_local(BLE_LOCAL_POLL);
+    }
+    return ESP_OK;
+}
+
+esp_err_t ble_peer_write(uint8_t peer_id, uint16_t handle, const uint8_t *data, uint16_t len, ble_write_mode_t mode,
+                         ble_write_done_cb_t cb, void *arg)
+{
+    if (peer_id >= PROFILE_NUM || data == NULL || len == 0U || mode > BLE_WRITE_LONG) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (mode == BLE_WRITE_LONG && len > BLE_WRITE_LONG_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ble_write_queue_t *q = &ble_client.write_q[peer_id];
+
+    portENTER_CRITICAL(&ble_peer_mux);
+    if (!(ble_client.peer_mask & (1U << peer_id))) {
+        portEXIT_CRITICAL(&ble_peer_mux);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (q->count == BLE_WRITE_QUEUE_LEN) {
+        portEXIT_CRITICAL(&ble_peer_mux);
+        return ESP_ERR_NO_MEM;
+    }
+    ble_write_req_t *req = &q->req[(q->head + q->count) % BLE_WRITE_QUEUE_LEN];
+    *req = (ble_write_req_t) {
+        .data   = data,
+        .len    = len,
+        .handle = handle,
+        .mode   = mode,
+        .cb     = cb,
+        .arg    = arg,
+        .status = ESP_OK,
+    };
+    q->count++;
+    ble_client.write_mask |= (1U << peer_id);
+    portEXIT_CRITICAL(&ble_peer_mux);
+
+    /* The client task puts it on air right away if the link is ready, otherwise from ble_peer_ready; before the
+     * start there is no link to kick */
+    if (ble_client.is_started) {
+        ble_evt_post_local(BLE_LOCAL_WRITE);
+    }
+    return ESP_OK;
+}
+
+void ble_poll_log_rates(void)
+{
+    static int64_t  last_us;
+    static uint32_t last_reads[PROFILE_NUM];
+    static uint32_t last_requests[PROFILE_NUM];
+    int64_t now = esp_timer_get_time();
+    int64_t elapsed_us = now - last_us;
+
+    for (uint8_t i = 0; i < PROFILE_NUM; i++)
+    {
+        uint32_t reads    = ble_client.cold.stats[i].reads;
+        uint32_t requests = ble_client.cold.stats[i].read_requests;
+        if ((ble_client.hot.poll_mask & ble_client.peer_mask & (1U << i)) && last_us && elapsed_us > 0) {
+            ESP_LOGI(TAG, "%s: %u reads/s in %u requests/s, %u errors", ble_client.cold.remote_dev_name[i],
+                     (unsigned)((uint64_t)(reads - last_reads[i]) * 1000000ULL / (uint64_t)elapsed_us),
+                     (unsigned)((uint64_t)(requests - last_requests[i]) * 1000000ULL / (uint64_t)elapsed_us),
+                     (unsigned)ble_client.cold.stats[i].read_errors);
+        }
+        last_reads[i]    = reads;
+        last_requests[i] = requests;
+    }
+    last_us = now;
+}
+
+void ble_conn_log_params(void)
+{
+    for (uint8_t i = 0; i < PROFILE_NUM; i++)
+    {
+        const ble_peer_cold_t *cold = &ble_client.cold;
+        if ((ble_client.peer_mask & (1U << i)) && cold->conn_int[i]) {
+            ESP_LOGI(TAG, "%s: interval %u.%02u ms, latency %u, %u PDUs/s, %u updates, LE %uM, PDUs %u/%u bytes",
+                     cold->remote_dev_name[i], cold->conn_int[i] * 125U / 100U, cold->conn_int[i] * 125U % 100U,
+                     cold->conn_latency[i], (unsigned)cold->conn_link[i].pdus_per_s, (unsigned)cold->stats[i].conn_updates,
+                     cold->tx_phy[i], cold->ll_tx_octets[i], cold->ll_rx_octets[i]);
+        }
+    }
+}
+
+void ble_scan_sample(void)
+{
+    ble_scan_account(ble_scan_mode_get());
+}
+
+void ble_disc_log_usage(void)
+{
+    for (uint8_t i = 0; i < PROFILE_NUM; i++)
+    {
+        const ble_disc_arena_t *disc = &ble_client.cold.disc[i];
+        if (ble_client.peer_mask & (1U << i)) {
+            ESP_LOGI(TAG, "%s: discovery arena chars %u/%u, descrs %u/%u, %u truncated", ble_client.cold.remote_dev_name[i],
+                     disc->char_hwm, BLE_DISC_CHAR_MAX, disc->descr_hwm, BLE_DISC_DESCR_MAX, (unsigned)disc->truncated);
+        }
+    }
+}
+
+esp_err_t ble_peer_get_stats(uint8_t peer_id, ble_peer_stats_t *stats)
+{
+    if (peer_id >= PROFILE_NUM || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&ble_peer_mux);
+    *stats = ble_client.cold.stats[peer_id];
+    portEXIT_CRITICAL(&ble_peer_mux);
+    return ESP_OK;
+}
+
+esp_err_t ble_peer_get_link(uint8_t peer_id, ble_peer_link_t *link)
+{
+    if (peer_id >= PROFILE_NUM || link == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const ble_peer_cold_t *cold = &ble_client.cold;
+    link->mtu          = cold->mtu[peer_id];
+    link->conn_int     = cold->conn_int[peer_id];
+    link->conn_latency = cold->conn_latency[peer_id];
+    link->tx_phy       = cold->tx_phy[peer_id];
+    link->rx_phy       = cold->rx_phy[peer_id];
+    link->tx_octets    = cold->ll_tx_octets[peer_id];
+    link->rx_octets    = cold->ll_rx_octets[peer_id];
+    link->refused      = cold->link_refused[peer_id];
+    link->subscribed   = (ble_client.hot.conn_state[peer_id] == BLE_CONN_READY) ? cold->sub_done[peer_id] : 0U;
+    return ESP_OK;
+}
+
+esp_err_t ble_peer_sub_index(uint8_t peer_id, uint16_t handle, uint8_t *sub)
+{
+    if (peer_id >= PROFILE_NUM || sub == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t i = ble_peer_sub_find(peer_id, handle, false);
+    if (i == BLE_PEER_SUB_MAX) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *sub = i;
+    return ESP_OK;
+}
+
+esp_err_t ble_peer_samples(const ble_notify_rec_t *rec, int32_t *out, uint16_t max, uint16_t *count)
+{
+    if (rec == NULL || rec->peer >= PROFILE_NUM || out == NULL || count == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    /* The record carries its subscription: the handle cache is the client task's, rewritten on discovery */
+    if (rec->sub >= BLE_PEER_SUB_MAX || ble_client.cold.subs[rec->peer][rec->sub].fmt == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *count = ble_sample_decode(ble_client.cold.subs[rec->peer][rec->sub].fmt, rec->data, rec->len, out, max);
+    return ESP_OK;
+}
+
 void app_main(void)
 {
+    static const char *peer_names[] = {
+        // "ESP_GATTS_DEMO"
+        "ESP_GATTS_DEMO_a", "ESP_GATTS_DEMO_b", "ESP_GATTS_DEMO_c"
+    };
+    /* Notified values are int16 samples in 0.01 units, handed on in 0.001 */
+    static const ble_sample_fmt_t sample_fmt = {
+        .mul = 10,
+    };
+    /* Both profiles of the ESP_GATTS_DEMO servers notify, one link carries the two streams */
+    static const ble_peer_sub_t peer_subs[] = {
+        {
+            .service_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_SERVICE_UUID,}, },
+            .charact_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_NOTIFY_CHAR_UUID,}, },
+            .fmt          = &sample_fmt,
+        },
+        {
+            .service_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_SERVICE_B_UUID,}, },
+            .charact_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_NOTIFY_CHAR_B_UUID,}, },
+            .fmt          = &sample_fmt,
+        },
+    };
+
+    /* Both values polled in one Read Multiple per cycle */
+    static const ble_peer_read_t peer_reads[] = {
+        {
+            .service_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_SERVICE_UUID,}, },
+            .charact_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_NOTIFY_CHAR_UUID,}, },
+            .len          = REMOTE_READ_LEN,
+        },
+        {
+            .service_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_SERVICE_B_UUID,}, },
+            .charact_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_NOTIFY_CHAR_B_UUID,}, },
+            .len          = REMOTE_READ_LEN,
+        },
+    };
+
+    /* Peers to connect to, all ESP_GATTS_DEMO servers, each read as fast as its link allows */
+    for (uint8_t i = 0; i < sizeof(peer_names) / sizeof(peer_names[0]); i++)
+    {
+        ble_peer_cfg_t peer = {
+            .name         = peer_names[i],
+            .service_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_SERVICE_UUID,}, },
+            .charact_uuid = { .len = ESP_UUID_LEN_16, .uuid = {.uuid16 = REMOTE_NOTIFY_CHAR_UUID,}, },
+            .subs         = peer_subs,
+            .sub_count    = sizeof(peer_subs) / sizeof(peer_subs[0]),
+            .reads        = peer_reads,
+            .read_count   = sizeof(peer_reads) / sizeof(peer_reads[0]),
+            .priority     = i,
+        };
+        uint8_t peer_id;
+        if (ble_peer_add(&peer, &peer_id) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to add peer %s", peer_names[i]);
+            continue;
+        }
+#ifndef CONFIG_BLE_CLIENT_LOW_POWER
+        ble_peer_poll(peer_id, true);
+#else
+        /* Not polled: the notifications carry the samples, back-to-back reads would keep the radio and CPU up */
+#endif
+    }
+
+    /* Advertise-only sensors, read from their manufacturer data without a connection */
+    ble_adv_decoder_cfg_t sensor = {
+        .src    = BLE_ADV_SRC_MFR,
+        .id     = DEMO_SENSOR_COMPANY_ID,
+        .decode = ble_demo_sensor_decode,
+    };
+    if (ble_adv_decoder_add(&sensor, NULL) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add the sensor decoder");
+    }
+
+    /* Light sleep between connection events in low-power builds, and the awake time measurement */
+    if (ble_power_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Running without light sleep");
+    }
+
     /* Run complete BLE setup */
     ble_setup();
 
@@ -682,34 +2730,68 @@ void app_main(void)
     /* Setup MTU size */
     ble_set_local_mtu(500);
 
-    /* Start BLE scan */
-    ble_start_scan(&ble_client, true);
-
-    /* Wait till stop_scan_done is set. */
-    while (!ble_client.stop_scan_done) {
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-    }
-
-    /* TEST */
-    esp_ble_gattc_read_char(ble_client.app_profiles[PROFILE_A_APP_ID].gattc_if, ble_client.app_profiles[PROFILE_A_APP_ID].conn_id, 
-                                ble_client.app_profiles[PROFILE_A_APP_ID].char_handle, ESP_GATT_AUTH_REQ_NONE);
-    esp_ble_gattc_read_char(ble_client.app_profiles[PROFILE_B_APP_ID].gattc_if, ble_client.app_profiles[PROFILE_B_APP_ID].conn_id, 
-                                ble_client.app_profiles[PROFILE_B_APP_ID].char_handle, ESP_GATT_AUTH_REQ_NONE);
-    vTaskDelay(2 / portTICK_PERIOD_MS);
-    esp_ble_gattc_read_char(ble_client.app_profiles[PROFILE_A_APP_ID].gattc_if, ble_client.app_profiles[PROFILE_A_APP_ID].conn_id, 
-                                ble_client.app_profiles[PROFILE_A_APP_ID].char_handle, ESP_GATT_AUTH_REQ_NONE);
-    esp_ble_gattc_read_char(ble_client.app_profiles[PROFILE_B_APP_ID].gattc_if, ble_client.app_profiles[PROFILE_B_APP_ID].conn_id, 
-                                ble_client.app_profiles[PROFILE_B_APP_ID].char_handle, ESP_GATT_AUTH_REQ_NONE);
-    vTaskDelay(2 / portTICK_PERIOD_MS);
-    esp_ble_gattc_read_char(ble_client.app_profiles[PROFILE_A_APP_ID].gattc_if, ble_client.app_profiles[PROFILE_A_APP_ID].conn_id, 
-                                ble_client.app_profiles[PROFILE_A_APP_ID].char_handle, ESP_GATT_AUTH_REQ_NONE);
-    esp_ble_gattc_read_char(ble_client.app_profiles[PROFILE_B_APP_ID].gattc_if, ble_client.app_profiles[PROFILE_B_APP_ID].conn_id, 
-                                ble_client.app_profiles[PROFILE_B_APP_ID].char_handle, ESP_GATT_AUTH_REQ_NONE);
-    vTaskDelay(2 / portTICK_PERIOD_MS);
-    esp_ble_gattc_read_char(ble_client.app_profiles[PROFILE_A_APP_ID].gattc_if, ble_client.app_profiles[PROFILE_A_APP_ID].conn_id, 
-                                ble_client.app_profiles[PROFILE_A_APP_ID].char_handle, ESP_GATT_AUTH_REQ_NONE);
-    esp_ble_gattc_read_char(ble_client.app_profiles[PROFILE_B_APP_ID].gattc_if, ble_client.app_profiles[PROFILE_B_APP_ID].conn_id, 
-                                ble_client.app_profiles[PROFILE_B_APP_ID].char_handle, ESP_GATT_AUTH_REQ_NONE);
-    vTaskDelay(2 / portTICK_PERIOD_MS);
+    /* Received values are drained below */
+    ble_peer_set_consumer(xTaskGetCurrentTaskHandle());
+
+    /* Start BLE scan in the client task; reads start on each link as soon as its handles are known, see ble_poll_kick */
+    ESP_ERROR_CHECK(ble_client_start());
+
+    /* Consume read and notified values as they arrive, samples decoded a value at a time and aggregated across
+     * the peers in time slots */
+    static int32_t samples[BLE_SAMPLE_MAX];
+    ble_agg_init(&ble_client.agg, BLE_AGG_WINDOW_MS * 1000U, BLE_AGG_GRACE_MS * 1000U);
+    int64_t last_report = esp_timer_get_time();
+    while (1) {
+        /* Woken by every ring push, when a slot holding samples is due, or for the report; slots nobody sent to
+         * are emitted on the next wake. At least a tick, so it never spins. */
+        int64_t now     = esp_timer_get_time();
+        int64_t wait_us = last_report + (int64_t)BLE_POLL_REPORT_MS * 1000 - now;
+        if (ble_agg_open(&ble_client.agg) && ble_agg_due_us(&ble_client.agg, now) < wait_us) {
+            wait_us = ble_agg_due_us(&ble_client.agg, now);
+        }
+        TickType_t wait = wait_us > 0 ? pdMS_TO_TICKS(wait_us / 1000) : 0;
+        ble_power_idle();
+        ulTaskNotifyTake(pdTRUE, wait ? wait : 1);
+        ble_power_wake();
+        /* Slots that fell due while asleep first, so the new records are not taken for too far ahead */
+        ble_demo_agg_emit();
+        for (uint8_t i = 0; i < PROFILE_NUM; i++)
+        {
+            const ble_notify_rec_t *rec;
+            while ((rec = ble_notify_ring_claim(&ble_client.notify_ring[i])) != NULL) {
+                uint16_t count = 0;
+                if (rec->type != BLE_NOTIFY_REC_READ && ble_peer_samples(rec, samples, BLE_SAMPLE_MAX, &count) == ESP_OK && count) {
+                    ESP_LOGD(TAG, "%s: handle %d, %d samples, first %d", ble_client.cold.remote_dev_name[i], rec->handle,
+                             count, (int)samples[0]);
+                    ble_agg_add(&ble_client.agg, i, rec->time_us, samples, count);
+                } else {
+                    ESP_LOGD(TAG, "%s: %s handle %d, %d bytes", ble_client.cold.remote_dev_name[i],
+                             rec->type == BLE_NOTIFY_REC_READ ? "read" : "notify", rec->handle, rec->len);
+                }
+                ble_notify_ring_release(&ble_client.notify_ring[i], rec);
+            }
+        }
+        const ble_notify_rec_t *rec;
+        while ((rec = ble_notify_ring_claim(&ble_client.adv_ring)) != NULL) {
+            const ble_adv_reading_t *reading = (const ble_adv_reading_t *)rec->data;
+            ESP_LOGD(TAG, "%02x:%02x:%02x:%02x:%02x:%02x: decoder %d, %d dBm, %d bytes", BLE_LOG_BDA(reading->bda),
+                     rec->peer, reading->rssi, (int)(rec->len - sizeof(ble_adv_reading_t)));
+            ble_notify_ring_release(&ble_client.adv_ring, rec);
+        }
+        ble_demo_agg_emit();
+        if (esp_timer_get_time() - last_report >= (int64_t)BLE_POLL_REPORT_MS * 1000) {
+            last_report = esp_timer_get_time();
+            ble_poll_log_rates();
+            ble_conn_log_params();
+            /* Accounted by the connection policy in the client task, at most a second old */
+            ble_scan_log();
+            ble_disc_log_usage();
+            ble_lat_log();
+            ble_evt_log();
+            ble_power_log();
+            ESP_LOGI(TAG, "slots: %u, %u complete, %u late samples", (unsigned)ble_client.agg.frames,
+                     (unsigned)ble_client.agg.complete, (unsigned)ble_client.agg.late);
+        }
+    }
 
 }
\ No newline at end of file
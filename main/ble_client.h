@@ -38,24 +38,94 @@
 #include "esp_bt_main.h"
 #include "esp_gatt_common_api.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
 /* Vanilla FreeRTOS */
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
+/* Project */
+#include "ble_adv_data.h"
+#include "ble_adv_filter.h"
+#include "ble_notify_ring.h"
+#include "ble_gatt_cache.h"
+#include "ble_log.h"
+#include "ble_latency.h"
+#include "ble_conn_params.h"
+#include "ble_scan.h"
+#include "ble_evt.h"
+#include "ble_sample.h"
+#include "ble_agg.h"
+#include "ble_power.h"
 
 /* * * * * * * * * * * * * * * *
  * * * * * * DEFINES * * * * * *
  * * * * * * * * * * * * * * * */
 
-#define REMOTE_SERVICE_UUID     0x00FF              /* Single Remote Filter Service UUID for all servers */
-#define REMOTE_NOTIFY_CHAR_UUID 0xFF01              /* Single Remote Filter Characteristc UUID for all servers */
+#define REMOTE_SERVICE_UUID     0x00FF              /* Remote Filter Service UUID of the ESP_GATTS_DEMO servers */
+#define REMOTE_NOTIFY_CHAR_UUID 0xFF01              /* Remote Filter Characteristc UUID of the ESP_GATTS_DEMO servers */
+#define REMOTE_SERVICE_B_UUID   0x00EE              /* Second profile of the ESP_GATTS_DEMO servers, notifies too */
+#define REMOTE_NOTIFY_CHAR_B_UUID 0xEE01
+#define REMOTE_READ_LEN         4U                  /* The ESP_GATTS_DEMO servers answer reads with 4 bytes */
+#define DEMO_SENSOR_COMPANY_ID  0x02E5              /* Espressif, manufacturer data of the advertise-only demo sensors */
+#define DEMO_SENSOR_DATA_LEN    4U                  /* uint16 sequence number, int16 temperature in 0.01 degC */
 
 
-#define PROFILE_NUM     3U   /* Register three profiles, each profile corresponds to one connection which makes it easy to handle each connection event */
-#define PROFILE_NUM_MAX 8U
+/* Peer pool size: one profile per connection, bounded by the controller links and by the Bluedroid ACL link
+ * limit. The C3/S3 controller counts activities, one of them left to the scan; the ESP32 one counts links. */
+#ifdef CONFIG_BT_CTRL_BLE_MAX_ACT
+#define BLE_CTRL_LINKS  (CONFIG_BT_CTRL_BLE_MAX_ACT - 1)
+#else
+#define BLE_CTRL_LINKS  CONFIG_BTDM_CTRL_BLE_MAX_CONN
+#endif
+#ifdef CONFIG_BT_ACL_CONNECTIONS
+#define BLE_ACL_LINKS   CONFIG_BT_ACL_CONNECTIONS
+#else
+#define BLE_ACL_LINKS   CONFIG_BTDM_CTRL_BLE_MAX_CONN
+#endif
+#define BLE_MAX_LINKS   (BLE_CTRL_LINKS < BLE_ACL_LINKS ? BLE_CTRL_LINKS : BLE_ACL_LINKS)
+#define PROFILE_NUM     (BLE_MAX_LINKS < PROFILE_MAX_APP_ID ? BLE_MAX_LINKS : PROFILE_MAX_APP_ID)
 #define INVALID_HANDLE  0U
+#define INVALID_PEER    0xFFU
+#define BLE_GATTC_IF_NUM    256U                        /* Every esp_gatt_if_t value, for direct-mapped dispatch */
+#define BLE_CONN_ID_NUM     BLE_ACL_LINKS               /* Bluedroid hands out conn_id as the link index */
+
+#define BLE_PEER_NAME_LEN_MAX   29U     /* Complete local name fitting a legacy advertising packet */
+#define BLE_PEER_SUB_MAX        BLE_GATT_CACHE_SUB_MAX  /* Characteristics one link subscribes to */
+#define BLE_PEER_READ_MAX       BLE_GATT_CACHE_READ_MAX /* Characteristics one link polls */
 
 #define BLE_SCAN_TIME   1U   // Seconds
+#define BLE_SCAN_COLLECT_MS 300U    /* Keep scanning this long after the first match to collect the other devices */
+
+/* Reconnect backoff: a peer missed by a scan window or failing to open waits MIN << (retries - 1) ms, capped
+ * at MAX, +-25% jitter so that peers lost together do not retry in lockstep */
+#define BLE_RECONNECT_BACKOFF_MIN_MS    250U
+#define BLE_RECONNECT_BACKOFF_MAX_MS    30000U
+#define BLE_RECONNECT_WL_RETRIES        3U      /* Scan for a known BDA through the controller accept list this many times */
+
+#define BLE_POLL_REPORT_MS  5000U   /* Period of the reads/second log in app_main */
+#define BLE_AGG_WINDOW_MS   100U    /* Time slot app_main aggregates the peers' samples in */
+#define BLE_AGG_GRACE_MS    50U     /* Wait for late records after a slot ends, e.g. a busy client task */
+
+#define BLE_DISC_CHAR_MAX   8U      /* Characteristics of the peer service kept per link, extra ones are dropped */
+#define BLE_DISC_DESCR_MAX  4U      /* Descriptors of a subscribed characteristic kept per lookup */
+
+#define BLE_WRITE_QUEUE_LEN 8U      /* Buffers queued per peer for ble_peer_write */
+#define BLE_WRITE_CREDITS   4U      /* Write commands handed to Bluedroid per link before one completes */
+#define BLE_WRITE_LONG_MAX  512U    /* Longest attribute value, bounds BLE_WRITE_LONG buffers */
+
+/* Link layer negotiated after the MTU request: data PDU payload, and LE 2M where the BLE 5.0 API is built in */
+#define BLE_LINK_TX_OCTETS      BLE_CONN_LL_PAYLOAD_MAX
+#define BLE_LINK_PHY_1M         BLE_CONN_PHY_1M
+#define BLE_LINK_PHY_2M         BLE_CONN_PHY_2M
+#define BLE_LINK_PHY_CODED      BLE_CONN_PHY_CODED
+#define BLE_LINK_EXT_CONN_ITVL  24U     /* 30 ms, interval asked for by extended connections until the policy runs */
+#define BLE_LINK_REFUSED_DLE    (1U << 0)
+#define BLE_LINK_REFUSED_2M     (1U << 1)
+#define BLE_LINK_REFUSED_READ_MULTI (1U << 2)   /* Read Multiple failed or did not split, polls read one by one */
+
+#define BLE_ADV_DECODER_MAX     8U      /* Advertising data decoders, see ble_adv_decoder_add */
+#define BLE_ADV_READING_MAX     32U     /* Longest reading a decoder may produce */
 
 /* * * * * * * * * * * * * * * *
  * * * * * FN TYPEDEFS * * * *
@@ -64,6 +134,16 @@
 /* Callback function when event is triggered; substituting  "esp_gattc_cb_t" typedef*/
 typedef void (* esp_gattc_cbk_t)(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param, uint8_t idx);
 
+/* Completion of a ble_peer_write buffer, from the client task; the buffer may be reused from here on.
+ * status: ESP_OK, ESP_FAIL on a GATT error, ESP_ERR_INVALID_SIZE if the buffer does not fit the link MTU,
+ * ESP_ERR_INVALID_STATE if the link dropped or the peer was removed first. */
+typedef void (* ble_write_done_cb_t)(uint8_t peer_id, esp_err_t status, void *arg);
+
+/* Turns one advertising data field of the sender bda into a reading of at most out_max bytes at out, from the
+ * client task for every report carrying the field. Returns the reading length, 0 to drop it. */
+typedef uint16_t (* ble_adv_decode_fn_t)(const esp_bd_addr_t bda, const ble_adv_field_t *field, uint8_t *out,
+                                         uint16_t out_max, void *arg);
+
 /* * * * * * * * * * * * * * * *
  * * * * * * ENUMS * * * * * * *
  * * * * * * * * * * * * * * * */
@@ -81,35 +161,274 @@ typedef enum {
     PROFILE_MAX_APP_ID
 } profiles_app_id_t;
 
+/* Connection pipeline state of each profile, ordered by progress */
+typedef enum {
+    BLE_CONN_IDLE = 0,      /* Not found yet, scanning for it */
+    BLE_CONN_FOUND,         /* Advertiser matched during the scan window, waiting for its turn to open */
+    BLE_CONN_OPENING,       /* esp_ble_gattc_open in flight, only one at a time */
+    BLE_CONN_CONNECTED,     /* Link up, MTU exchange and service discovery running */
+    BLE_CONN_READY          /* Characteristic handle resolved */
+} ble_conn_state_t;
+
+/* Where the handles of a connected peer come from, see ble_gatt_cache.h */
+typedef enum {
+    BLE_CACHE_NONE = 0,     /* No usable entry, discovering */
+    BLE_CACHE_LOADED,       /* Entry found on open, used after the MTU exchange */
+    BLE_CACHE_VALIDATING,   /* Database Hash read in flight, compared against the entry */
+    BLE_CACHE_HIT,          /* Handles taken from the entry, discovery skipped */
+    BLE_CACHE_FILLING,      /* Discovered, Database Hash read in flight before storing */
+    BLE_CACHE_STORED        /* Discovered and written to NVS */
+} ble_cache_state_t;
+
+/* Advertising data field a decoder is fed from */
+typedef enum {
+    BLE_ADV_SRC_MFR = 0,    /* Manufacturer specific data of a company identifier */
+    BLE_ADV_SRC_SVC_DATA    /* Service data of a 16-bit service UUID */
+} ble_adv_src_t;
+
+/* Timer expiries and API requests, run in the client task as BLE_EVT_SRC_LOCAL events */
+typedef enum {
+    BLE_LOCAL_COLLECT = 0,  /* Scan collection window elapsed */
+    BLE_LOCAL_RETRY,        /* Earliest reconnect backoff expired */
+    BLE_LOCAL_CONN_POLICY,  /* Connection parameter policy period */
+    BLE_LOCAL_PEERS,        /* Peers added or removed through the API */
+    BLE_LOCAL_POLL,         /* Polling enabled through the API */
+    BLE_LOCAL_START,        /* First scan, requested from app_main */
+    BLE_LOCAL_WRITE         /* Buffers queued through the API */
+} ble_local_evt_t;
+
+/* How ble_peer_write puts a buffer on air */
+typedef enum {
+    BLE_WRITE_RSP = 0,      /* One write request, at most MTU - 3 bytes, one round trip */
+    BLE_WRITE_NO_RSP,       /* Write commands of MTU - 3 bytes, several per connection event, not acknowledged */
+    BLE_WRITE_LONG          /* Prepare writes of MTU - 5 bytes then an execute, applied at once by the server */
+} ble_write_mode_t;
+
 /* * * * * * * * * * * * * * * *
  * * * * * * STRUCTS * * * * * *
  * * * * * * * * * * * * * * * */
 
-typedef struct gattc_profile_inst {
-    esp_gattc_cbk_t gattc_cb;
-    uint16_t        gattc_if;
-    uint16_t        app_id;
-    uint16_t        conn_id;
-    uint16_t        service_start_handle;
-    uint16_t        service_end_handle;
-    uint16_t        char_handle;
-    esp_bd_addr_t   remote_bda;
-} gattc_profile_inst_t;
+/* A characteristic to subscribe to, 16- or 128-bit UUIDs. Notified if it can be, indicated otherwise. */
+typedef struct ble_peer_sub {
+    esp_bt_uuid_t   service_uuid;
+    esp_bt_uuid_t   charact_uuid;
+    const ble_sample_fmt_t *fmt;        /* Packed int16 samples, decoded by ble_peer_samples; NULL: raw bytes. Copied
+                                         * by ble_peer_add. */
+} ble_peer_sub_t;
+
+/* A characteristic read on every polling cycle. Values of a fixed length are read several at a time with Read
+ * Multiple, whose response concatenates them without lengths. */
+typedef struct ble_peer_read {
+    esp_bt_uuid_t   service_uuid;
+    esp_bt_uuid_t   charact_uuid;
+    uint16_t        len;                /* Value length, 0 if it varies: always read on its own */
+} ble_peer_read_t;
+
+/* Peer description for ble_peer_add, copied into the pool */
+typedef struct ble_peer_cfg {
+    const char     *name;               /* Complete local name to match in advertising reports */
+    esp_bt_uuid_t   service_uuid;       /* Primary service to discover */
+    esp_bt_uuid_t   charact_uuid;       /* Characteristic read and written in that service */
+    const ble_peer_sub_t *subs;         /* Characteristics to subscribe to on one link, in any services; NULL:
+                                         * charact_uuid, if it notifies */
+    uint8_t         sub_count;          /* Entries of subs, at most BLE_PEER_SUB_MAX */
+    const ble_peer_read_t *reads;       /* Characteristics ble_peer_poll reads each cycle, in any services; NULL:
+                                         * charact_uuid */
+    uint8_t         read_count;         /* Entries of reads, at most BLE_PEER_READ_MAX */
+    uint8_t         priority;           /* Lower values are connected first */
+} ble_peer_cfg_t;
+
+/* Decoder description for ble_adv_decoder_add */
+typedef struct ble_adv_decoder_cfg {
+    ble_adv_src_t           src;
+    uint16_t                id;                 /* Company identifier or service UUID to decode */
+    ble_adv_decode_fn_t     decode;
+    void                   *arg;
+} ble_adv_decoder_cfg_t;
+
+/* Payload of a BLE_NOTIFY_REC_ADV record: the sender, then the reading. The record handle holds the field id. */
+typedef struct ble_adv_reading {
+    esp_bd_addr_t           bda;
+    int8_t                  rssi;
+    uint8_t                 src;                /* ble_adv_src_t */
+    uint8_t                 data[];
+} ble_adv_reading_t;
+
+/* Link counters of a peer, MTTR = recover_total_ms / reconnects */
+typedef struct ble_peer_stats {
+    uint32_t                reads;                          /* Values read by polling */
+    uint32_t                read_requests;                  /* ATT requests they took, fewer with Read Multiple */
+    uint32_t                read_errors;
+    uint32_t                writes;                         /* Buffers completed by ble_peer_write */
+    uint32_t                write_errors;
+    uint64_t                write_bytes;
+    uint32_t                conn_updates;                   /* Connection parameter updates requested and applied */
+    uint32_t                disconnects;
+    uint32_t                reconnects;                     /* Lost links brought back up and subscribed again */
+    uint32_t                notifies;                       /* Notifications and indications, every subscription */
+    uint32_t                retries;                        /* Missed scan windows and failed opens while lost */
+    uint32_t                recover_last_ms;
+    uint32_t                recover_max_ms;
+    uint64_t                recover_total_ms;
+} ble_peer_stats_t;
+
+/* What a peer link runs with, see ble_peer_get_link */
+typedef struct ble_peer_link {
+    uint16_t                mtu;
+    uint16_t                conn_int;                       /* 1.25 ms units, 0 if not connected */
+    uint16_t                conn_latency;
+    uint8_t                 tx_phy;                         /* BLE_LINK_PHY_* */
+    uint8_t                 rx_phy;
+    uint16_t                tx_octets;                      /* Data PDU payload each way, BLE_CONN_LL_PAYLOAD without DLE */
+    uint16_t                rx_octets;
+    uint8_t                 refused;                        /* BLE_LINK_REFUSED_* the peer turned down */
+    uint8_t                 subscribed;                     /* Bit n set once subs[n] of ble_peer_cfg_t is subscribed */
+} ble_peer_link_t;
+
+/* Per-peer state touched on every GATTC event, parallel arrays indexed by peer id */
+typedef struct ble_peer_hot {
+    ble_conn_state_t        conn_state[PROFILE_NUM];
+    uint16_t                conn_id[PROFILE_NUM];
+    uint16_t                char_handle[PROFILE_NUM];
+    uint16_t                service_start_handle[PROFILE_NUM];
+    uint16_t                service_end_handle[PROFILE_NUM];
+    esp_gatt_if_t           gattc_if[PROFILE_NUM];
+    uint8_t                 if_to_peer[BLE_GATTC_IF_NUM];   /* gattc_if -> peer id, INVALID_PEER if not ours */
+    uint8_t                 conn_to_peer[BLE_CONN_ID_NUM];  /* conn_id -> peer id owning the link, INVALID_PEER if none */
+    uint32_t                poll_mask;                      /* Bit n set if peer n is polled */
+    uint32_t                poll_inflight;                  /* Bit n set while peer n has a polling read outstanding */
+    uint8_t                 poll_next;                      /* Round-robin start of the next ble_poll_kick pass */
+    uint16_t                poll_handle[PROFILE_NUM][BLE_PEER_READ_MAX];    /* Handles read each polling cycle */
+    uint16_t                poll_len[PROFILE_NUM][BLE_PEER_READ_MAX];       /* ble_peer_read_t len of each handle */
+    uint8_t                 poll_count[PROFILE_NUM];
+    uint8_t                 poll_pos[PROFILE_NUM];          /* First handle of the request in flight or next */
+    uint8_t                 poll_n[PROFILE_NUM];            /* Handles the request in flight reads */
+} ble_peer_hot_t;
+
+/* Per-peer data only used while connecting and discovering */
+/* Discovery results of one link, valid from discovery until the link drops. Fixed size so that
+ * reconnect storms do not churn the heap; the high-water marks tell whether the sizes fit the servers. */
+typedef struct ble_disc_arena {
+    esp_gattc_char_elem_t   chars[BLE_DISC_CHAR_MAX];
+    esp_gattc_descr_elem_t  descrs[BLE_DISC_DESCR_MAX];
+    uint16_t                char_count;                     /* Valid entries of chars */
+    uint16_t                descr_count;
+    uint16_t                sub_start[BLE_PEER_SUB_MAX];    /* Service range of each subscription, 0 until searched out */
+    uint16_t                sub_end[BLE_PEER_SUB_MAX];
+    uint16_t                read_start[BLE_PEER_READ_MAX];  /* and of each polled characteristic */
+    uint16_t                read_end[BLE_PEER_READ_MAX];
+    uint16_t                char_hwm;                       /* Most characteristics a server reported, may exceed BLE_DISC_CHAR_MAX */
+    uint16_t                descr_hwm;
+    uint32_t                truncated;                      /* Lookups that reported more entries than fit */
+} ble_disc_arena_t;
+
+typedef struct ble_peer_cold {
+    char                    remote_dev_name[PROFILE_NUM][BLE_PEER_NAME_LEN_MAX + 1];
+    esp_bt_uuid_t           service_uuid[PROFILE_NUM];      /* Remote filter service UUID of each peer */
+    esp_bt_uuid_t           charact_uuid[PROFILE_NUM];      /* Characteristic UUID within that service */
+    ble_peer_sub_t          subs[PROFILE_NUM][BLE_PEER_SUB_MAX];    /* Subscriptions of each peer, fmt points to sub_fmt */
+    ble_sample_fmt_t        sub_fmt[PROFILE_NUM][BLE_PEER_SUB_MAX];
+    uint8_t                 sub_count[PROFILE_NUM];
+    ble_peer_read_t         reads[PROFILE_NUM][BLE_PEER_READ_MAX];  /* Polling cycle of each peer */
+    uint8_t                 read_count[PROFILE_NUM];
+    bool                    search_all[PROFILE_NUM];        /* UUIDs in several services, searched in one unfiltered pass */
+    uint32_t                peer_key[PROFILE_NUM];          /* ble_gatt_cache_peer_key of all the UUIDs above */
+    uint8_t                 sub_mask[PROFILE_NUM];          /* Bit n set if subs[n] has a CCCD on the current link */
+    uint8_t                 sub_written[PROFILE_NUM];       /* CCCD writes issued */
+    uint8_t                 sub_done[PROFILE_NUM];          /* CCCD writes acknowledged */
+    esp_bd_addr_t           remote_bda[PROFILE_NUM];
+    esp_ble_addr_type_t     remote_addr_type[PROFILE_NUM];
+    uint8_t                 priority[PROFILE_NUM];
+    bool                    service_found[PROFILE_NUM];
+    ble_cache_state_t       cache_state[PROFILE_NUM];
+    ble_gatt_cache_entry_t  cache[PROFILE_NUM];             /* Resolved handles of the current link, as stored in NVS */
+    bool                    bda_known[PROFILE_NUM];         /* remote_bda was seen, reconnect scans can filter on it */
+    uint8_t                 retries[PROFILE_NUM];           /* Consecutive failed attempts, drives the backoff */
+    int64_t                 next_try_us[PROFILE_NUM];       /* Earliest scan for this peer, esp_timer time */
+    int64_t                 lost_us[PROFILE_NUM];           /* When the link dropped, 0 if not recovering */
+    ble_peer_stats_t        stats[PROFILE_NUM];
+    ble_disc_arena_t        disc[PROFILE_NUM];
+    int64_t                 stage_us[PROFILE_NUM];          /* Start of the bring-up stage in progress, 0 if none */
+    int64_t                 read_us[PROFILE_NUM];           /* When the outstanding polling read was issued */
+    int64_t                 notify_us[PROFILE_NUM];         /* Last notification, 0 if none on this link */
+    uint16_t                mtu[PROFILE_NUM];               /* ATT MTU of the link, sizes write chunks */
+    uint16_t                conn_int[PROFILE_NUM];          /* Negotiated connection parameters, 0 if not connected */
+    uint16_t                conn_latency[PROFILE_NUM];
+    uint16_t                conn_timeout[PROFILE_NUM];
+    bool                    conn_pending[PROFILE_NUM];      /* Update requested, waiting for ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT */
+    uint32_t                link_pdus[PROFILE_NUM];         /* Data PDUs carried on the link, estimated from the ATT traffic */
+    uint32_t                link_pdus_seen[PROFILE_NUM];    /* link_pdus at the last policy run */
+    uint32_t                link_bytes[PROFILE_NUM];        /* Payload of those PDUs, for their average size */
+    uint32_t                link_bytes_seen[PROFILE_NUM];
+    ble_conn_link_t         conn_link[PROFILE_NUM];         /* Policy view of each link, see ble_conn_params.h */
+    uint16_t                ll_tx_octets[PROFILE_NUM];      /* Data PDU payload of the link each way */
+    uint16_t                ll_rx_octets[PROFILE_NUM];
+    uint8_t                 tx_phy[PROFILE_NUM];            /* BLE_LINK_PHY_* of the link each way */
+    uint8_t                 rx_phy[PROFILE_NUM];
+    uint8_t                 link_refused[PROFILE_NUM];      /* BLE_LINK_REFUSED_*, not asked again until ble_peer_add */
+    uint8_t                 adv_phy[PROFILE_NUM];           /* Primary PHY the peer was last seen advertising on, it is opened on it */
+} ble_peer_cold_t;
+
+/* A buffer queued by ble_peer_write, referenced and not copied until its callback */
+typedef struct ble_write_req {
+    const uint8_t          *data;
+    uint16_t                len;
+    uint16_t                handle;
+    ble_write_mode_t        mode;
+    ble_write_done_cb_t     cb;
+    void                   *arg;
+    uint16_t                sent;                           /* Bytes handed to Bluedroid, len once nothing more is to go */
+    uint8_t                 chunks_out;                     /* Chunks handed to Bluedroid and not completed */
+    bool                    exec_sent;                      /* BLE_WRITE_LONG: execute write issued */
+    bool                    exec_done;
+    esp_err_t               status;
+} ble_write_req_t;
+
+/* Write pipeline of one peer. Only the head buffer is on air, except that buffers written with commands
+ * follow each other without a gap as long as credits last and the link is not congested. */
+typedef struct ble_write_queue {
+    ble_write_req_t         req[BLE_WRITE_QUEUE_LEN];
+    uint8_t                 head;
+    uint8_t                 count;
+    uint8_t                 inflight;                       /* Chunks outstanding over every buffer */
+    bool                    congested;                      /* ESP_GATTC_CONGEST_EVT, commands paused until cleared */
+    bool                    pumping;                        /* A task is issuing chunks, others leave it to it */
+    bool                    again;                          /* Set while pumping, the pump goes round once more */
+} ble_write_queue_t;
 
 typedef struct ble_gatt_client
 {
-    gattc_profile_inst_t    app_profiles[PROFILE_NUM];
-    const char              *remote_dev_name[PROFILE_NUM];
-    esp_bt_uuid_t           service_uuid;                   /* Single Remote Filter Service UUID for all servers */
-    esp_bt_uuid_t           charact_uuid;                   /* Same characteristic UUID for all services */
+    ble_peer_hot_t          hot;
+    uint32_t                peer_mask;                      /* Bit n set if peer id n holds a peer */
+    uint32_t                remove_mask;                    /* Removed peers whose link and writes the client task still has to end */
+    uint32_t                add_mask;                       /* Profiles ble_peer_add is filling, not yet in peer_mask */
+    uint32_t                write_mask;                     /* Peers with buffers queued by ble_peer_write, not yet pumped */
+    bool                    stop_scan_done;                 /* Set once every profile is READY */
+    bool                    is_connecting;                  /* An esp_ble_gattc_open is in flight */
+    bool                    is_scanning;
+    bool                    is_started;                     /* ble_client_start ran, the client task owns links and scans */
+    TaskHandle_t            data_consumer;                  /* Notified on every ring push, may be NULL */
+    ble_peer_cold_t         cold;
     esp_bt_uuid_t           notify_descr_uuid;              /* Same description notify UUID for all services */
-    esp_gattc_char_elem_t  *char_elem_result[PROFILE_NUM];
-    esp_gattc_descr_elem_t *descr_elem_result[PROFILE_NUM];
-    uint16_t                charact_count[PROFILE_NUM];
-    bool                    connections[PROFILE_NUM];
-    bool                    service_found[PROFILE_NUM];
-    bool                    stop_scan_done;
-    bool                    is_connecting;
+    ble_adv_filter_t        adv_filter;                     /* Maps scan reports to peer ids */
+    TimerHandle_t           collect_timer;                  /* Ends the scan window BLE_SCAN_COLLECT_MS after the first match */
+    TimerHandle_t           retry_timer;                    /* Restarts the scan when the earliest backoff expires */
+    TimerHandle_t           conn_timer;                     /* Runs the connection parameter policy */
+    uint32_t                scan_peers;                     /* Peers the running scan window looks for */
+    uint32_t                whitelist_mask;                 /* Peers whose BDA is in the controller accept list */
+    bool                    scan_targeted;                  /* Scan parameters use the accept list */
+    ble_scan_mode_t         scan_mode;                      /* Mode the scan parameters were last set for, see ble_scan.h */
+    uint32_t                link_pdus_retired;              /* link_pdus of closed links, for the per-mode scan accounting */
+    uint8_t                 ll_pending;                     /* Peer of the data length request in flight, its event has no address */
+    uint32_t                ll_wait_mask;                   /* Peers waiting to send their data length request */
+    int64_t                 scan_start_us;                  /* Last successful scan start, for BLE_LAT_SCAN */
+    int64_t                 evt_us;                         /* Callback time of the event being handled, see ble_evt.h */
+    ble_notify_ring_t       notify_ring[PROFILE_NUM];       /* Notified and read values, drained by the data consumer */
+    ble_adv_decoder_cfg_t   adv_decoders[BLE_ADV_DECODER_MAX];
+    uint8_t                 adv_decoder_count;              /* Fixed once scanning started, read without locking */
+    ble_notify_ring_t       adv_ring;                       /* Readings of every decoder, drained by the data consumer */
+    ble_agg_t               agg;                            /* Sample windows of the app_main consumer */
+    ble_write_queue_t       write_q[PROFILE_NUM];
 } ble_gatt_client_t;
 
 extern ble_gatt_client_t ble_client;
@@ -125,4 +444,65 @@ void start_scan(void);
 
 void ble_register_app(void);
 
+/* Client task only, other tasks use ble_client_start */
 void ble_start_scan(ble_gatt_client_t *client, bool reset);
+
+/* Once, from any task after ble_register_app: the first scan runs in the client task, and the peer table calls
+ * hand their work to it from then on */
+esp_err_t ble_client_start(void);
+
+void ble_set_local_mtu(uint16_t mtu);
+
+/* Peer table, usable before and after ble_client_start; no heap is used */
+esp_err_t ble_peer_add(const ble_peer_cfg_t *cfg, uint8_t *peer_id);
+
+esp_err_t ble_peer_remove(uint8_t peer_id);
+
+/* Received values of a peer, consumed with ble_notify_ring_claim/release from a single task */
+ble_notify_ring_t *ble_peer_ring(uint8_t peer_id);
+
+/* Connectionless sensors: decode a field of every advertising report into readings. Only before ble_client_start;
+ * scanning then keeps a background scan open to all advertisers even without peers. */
+esp_err_t ble_adv_decoder_add(const ble_adv_decoder_cfg_t *cfg, uint8_t *decoder_id);
+
+/* Readings of the decoders as BLE_NOTIFY_REC_ADV records, consumed like ble_peer_ring from the same task */
+ble_notify_ring_t *ble_adv_ring(void);
+
+/* Task to wake with xTaskNotifyGive whenever a value lands in any ring */
+void ble_peer_set_consumer(TaskHandle_t task);
+
+esp_err_t ble_peer_get_stats(uint8_t peer_id, ble_peer_stats_t *stats);
+
+/* Read the peer characteristics continuously while the link is ready, one request in flight per link: fixed-length
+ * values together with Read Multiple where the server takes it, the others one by one */
+esp_err_t ble_peer_poll(uint8_t peer_id, bool enable);
+
+/* Queue len bytes of data for the peer attribute handle (INVALID_HANDLE: the peer characteristic). The buffer
+ * is not copied and must stay untouched until cb (may be NULL) runs. Buffers of a peer go on air in order,
+ * starting once its link is ready. */
+esp_err_t ble_peer_write(uint8_t peer_id, uint16_t handle, const uint8_t *data, uint16_t len, ble_write_mode_t mode,
+                         ble_write_done_cb_t cb, void *arg);
+
+/* Log the reads/second of every polled peer since the previous call */
+void ble_poll_log_rates(void);
+
+/* Log the negotiated connection parameters and the measured demand of every connected peer */
+void ble_conn_log_params(void);
+
+/* Link parameters of a peer: MTU, connection interval, PHY and data PDU sizes, subscriptions in place */
+esp_err_t ble_peer_get_link(uint8_t peer_id, ble_peer_link_t *link);
+
+/* Subscription of a handle: the index into ble_peer_cfg_t subs of it on the current link. From the client task; a
+ * consumer reads the sub of its ring record instead. */
+esp_err_t ble_peer_sub_index(uint8_t peer_id, uint16_t handle, uint8_t *sub);
+
+/* Samples of a peer ring record, decoded with the format of its subscription (the record's sub) into out, at most
+ * max of them. ESP_ERR_NOT_FOUND if the record's subscription has no format. Called from the consumer task. */
+esp_err_t ble_peer_samples(const ble_notify_rec_t *rec, int32_t *out, uint16_t max, uint16_t *count);
+
+/* Brings the per-mode scan accounting of ble_scan.h up to now, before reading it. Reads the link traffic counters
+ * unlocked, so only from the client task or with the client stopped; the connection policy runs it once a second. */
+void ble_scan_sample(void);
+
+/* Log the discovery arena high-water marks of every peer against BLE_DISC_CHAR_MAX / BLE_DISC_DESCR_MAX */
+void ble_disc_log_usage(void);
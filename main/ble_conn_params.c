@@ -0,0 +1,179 @@
+/**
+ * @file ble_conn_params.c
+ *
+ *
+ * @brief Connection parameter policy, see ble_conn_params.h.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stddef.h>
+/* API */
+#include "ble_conn_params.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define LAST_STEP       (BLE_CONN_STEPS - 1U)
+#define IFS_US          150U
+#define CODED_FIXED_US  400U
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static const uint16_t conn_ladder[BLE_CONN_STEPS] = BLE_CONN_ITVL_LADDER;
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Locals */
+static uint32_t conn_pair_us(const ble_conn_link_t *link)
+{
+    return ble_conn_pdu_pair_us(link->octets ? link->octets : BLE_CONN_LL_PAYLOAD, link->phy);
+}
+
+static uint32_t conn_ce_pdus(const ble_conn_link_t *link)
+{
+    /* The event keeps its length in time: fewer long PDUs, more short or fast ones */
+    uint32_t pdus = BLE_CONN_CE_PDUS * BLE_CONN_PDU_PAIR_US / conn_pair_us(link);
+    return pdus ? pdus : 1U;
+}
+
+static uint8_t conn_demand_step(const ble_conn_link_t *link)
+{
+    /* Longest interval whose events carry the demand with headroom */
+    if (link->pdus_per_s == 0U) {
+        return LAST_STEP;
+    }
+    uint32_t ce_pdus = conn_ce_pdus(link);
+    uint64_t events  = ((uint64_t)link->pdus_per_s * BLE_CONN_HEADROOM + ce_pdus - 1U) / ce_pdus;
+    for (uint8_t s = LAST_STEP; s > 0U; s--)
+    {
+        if ((uint64_t)conn_ladder[s] * 1250U * events <= 1000000U) {
+            return s;
+        }
+    }
+    return 0U;
+}
+
+/* API */
+uint16_t ble_conn_step_interval(uint8_t step)
+{
+    return conn_ladder[(step < BLE_CONN_STEPS) ? step : LAST_STEP];
+}
+
+uint8_t ble_conn_interval_step(uint16_t interval)
+{
+    for (uint8_t s = 0; s < BLE_CONN_STEPS; s++)
+    {
+        if (conn_ladder[s] >= interval) {
+            return s;
+        }
+    }
+    return LAST_STEP;
+}
+
+uint32_t ble_conn_pdus(uint16_t len, uint16_t octets)
+{
+    octets = octets ? octets : BLE_CONN_LL_PAYLOAD;
+    return (len + BLE_CONN_ATT_HDR + octets - 1U) / octets;
+}
+
+uint32_t ble_conn_pdu_pair_us(uint16_t octets, uint8_t phy)
+{
+    /* Preamble, access address, header, payload and CRC: 10 bytes around the payload at 1 us per bit, 11 at
+     * 0.5 us per bit on 2M for the longer preamble. Coded S=8 sends 400 us of preamble, access address and
+     * coding fields, then header, payload and CRC at 64 us per byte. The empty ack is the same without payload. */
+    if (phy == BLE_CONN_PHY_2M) {
+        return (octets + 11U) * 4U + IFS_US + 11U * 4U + IFS_US;
+    }
+    if (phy == BLE_CONN_PHY_CODED) {
+        return CODED_FIXED_US + (octets + 5U) * 64U + IFS_US + CODED_FIXED_US + 5U * 64U + IFS_US;
+    }
+    return (octets + 10U) * 8U + IFS_US + 10U * 8U + IFS_US;
+}
+
+uint32_t ble_conn_airtime_us(const ble_conn_link_t *link, uint8_t step)
+{
+    /* Every event costs its overhead; data beyond what the events can carry is not sent, so not counted */
+    uint64_t events = 1000000U / ((uint32_t)ble_conn_step_interval(step) * 1250U);
+    uint64_t pdus   = events * conn_ce_pdus(link);
+    pdus = (link->pdus_per_s < pdus) ? link->pdus_per_s : pdus;
+    return (uint32_t)(events * BLE_CONN_EVENT_US + pdus * conn_pair_us(link));
+}
+
+void ble_conn_policy(ble_conn_link_t *links, uint8_t n)
+{
+    /* Each link on its own: faster at once when the demand or a backlog asks for it, slower only after
+     * BLE_CONN_SLOW_PERIODS periods in a row, so that bursts do not make the parameters flap */
+    for (uint8_t i = 0; i < n; i++)
+    {
+        ble_conn_link_t *link = &links[i];
+        if (!link->active || link->fixed) {
+            continue;
+        }
+        uint8_t want = conn_demand_step(link);
+        if (link->backlog && link->step > 0U && want >= link->step) {
+            want = link->step - 1U;
+        }
+        if (want < link->step) {
+            link->step       = want;
+            link->slow_votes = 0U;
+        } else if (want > link->step) {
+            if (++link->slow_votes >= BLE_CONN_SLOW_PERIODS) {
+                link->step       = want;
+                link->slow_votes = 0U;
+            }
+        } else {
+            link->slow_votes = 0U;
+        }
+    }
+
+    /* Then the budget over all links: slow the least important one still adjustable, the fastest first
+     * among equals, one step at a time */
+    uint64_t total = 0U;
+    for (uint8_t i = 0; i < n; i++)
+    {
+        if (links[i].active) {
+            total += ble_conn_airtime_us(&links[i], links[i].step);
+        }
+    }
+    while (total > (uint64_t)BLE_CONN_AIRTIME_PCT * 10000U) {
+        ble_conn_link_t *victim = NULL;
+        for (uint8_t i = 0; i < n; i++)
+        {
+            ble_conn_link_t *link = &links[i];
+            if (!link->active || link->fixed || link->step == LAST_STEP) {
+                continue;
+            }
+            if (!victim || link->priority > victim->priority ||
+                (link->priority == victim->priority && link->step < victim->step)) {
+                victim = link;
+            }
+        }
+        if (!victim) {
+            break;
+        }
+        total -= ble_conn_airtime_us(victim, victim->step);
+        victim->step++;
+        victim->slow_votes = 0U;
+        total += ble_conn_airtime_us(victim, victim->step);
+    }
+
+    /* Peripheral latency only where nothing moves: it delays the first request after a quiet spell */
+    for (uint8_t i = 0; i < n; i++)
+    {
+        ble_conn_link_t *link = &links[i];
+        if (link->active && !link->fixed) {
+            link->latency = (link->step == LAST_STEP && link->pdus_per_s == 0U && !link->backlog) ? BLE_CONN_IDLE_LATENCY : 0U;
+        }
+    }
+}
@@ -0,0 +1,88 @@
+/**
+ * @file ble_conn_params.h
+ *
+ *
+ * @brief Connection parameter policy. Every BLE_CONN_POLICY_MS the client
+ *          reports what each link carried; ble_conn_policy picks an interval
+ *          from a fixed ladder so that the link could carry twice that, gives
+ *          links without traffic the longest interval plus peripheral latency,
+ *          and keeps the radio time of all links within BLE_CONN_AIRTIME_PCT,
+ *          slowing the lowest priority links first. Pure computation: the
+ *          client issues the updates and tracks what was negotiated.
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BLE_CONN_POLICY_MS      1000U   /* Period of the policy, and of the demand measurement */
+#define BLE_CONN_STEPS          5U      /* Ladder of 7.5, 15, 30, 60 and 100 ms, in 1.25 ms units below */
+#define BLE_CONN_ITVL_LADDER    { 6U, 12U, 24U, 48U, 80U }
+#define BLE_CONN_IDLE_LATENCY   4U      /* Idle links at the last step let the server skip 4 events, 500 ms */
+#define BLE_CONN_SUP_TIMEOUT    400U    /* 4 s, 10 ms units, above 2 * (1 + latency) * interval on every step */
+#define BLE_CONN_SLOW_PERIODS   3U      /* Periods a link must want a longer interval before it gets one */
+
+/* Radio time model, figures for LE 1M without Data Length Extension; other links scale by ble_conn_pdu_pair_us */
+#define BLE_CONN_AIRTIME_PCT    60U     /* Share of the radio for connections, the rest is left to scanning */
+#define BLE_CONN_EVENT_US       400U    /* Empty PDU pair plus scheduling margin, paid by every event */
+#define BLE_CONN_PDU_PAIR_US    676U    /* Full 27-byte data PDU, IFS, ack, IFS */
+#define BLE_CONN_CE_PDUS        6U      /* Data PDUs the controller fits in one event, so 4 ms of PDU pairs */
+#define BLE_CONN_LL_PAYLOAD     27U     /* Data PDU payload until the link negotiates a longer one */
+#define BLE_CONN_LL_PAYLOAD_MAX 251U
+#define BLE_CONN_ATT_HDR        7U      /* L2CAP header (4) + ATT opcode and handle (3) */
+#define BLE_CONN_PHY_1M         1U      /* HCI PHY values */
+#define BLE_CONN_PHY_2M         2U
+#define BLE_CONN_PHY_CODED      3U      /* S=8 coding, 125 kbit/s */
+#define BLE_CONN_HEADROOM       2U      /* A link is sized for this multiple of its measured demand */
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* One link as seen by the policy. Kept by the caller between runs: step and slow_votes carry over. */
+typedef struct ble_conn_link {
+    bool        active;                 /* In: connected, its radio time counts against the budget */
+    bool        fixed;                  /* In: counted but left alone, e.g. still discovering or an update pending */
+    uint8_t     priority;               /* In: lower values are slowed last */
+    bool        backlog;                /* In: data was waiting at the end of the period */
+    uint32_t    pdus_per_s;             /* In: data PDUs carried per second, both directions */
+    uint16_t    octets;                 /* In: average data PDU payload carried, at most what the link negotiated */
+    uint8_t     phy;                    /* In: BLE_CONN_PHY_* the link runs on, 0 for 1M */
+    uint8_t     step;                   /* In: current ladder step, out: the one to request */
+    uint16_t    latency;                /* Out: peripheral latency to request */
+    uint8_t     slow_votes;             /* Consecutive periods that wanted a longer interval */
+} ble_conn_link_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Connection interval of a ladder step, 1.25 ms units */
+uint16_t ble_conn_step_interval(uint8_t step);
+
+/* Shortest ladder step at or above an interval in 1.25 ms units, the last one if none */
+uint8_t ble_conn_interval_step(uint16_t interval);
+
+/* Data PDUs an ATT PDU carrying len bytes of value takes on a link with octets of data PDU payload */
+uint32_t ble_conn_pdus(uint16_t len, uint16_t octets);
+
+/* Air time of a full data PDU of octets payload, its ack and both inter frame spaces on a BLE_CONN_PHY_*, in us */
+uint32_t ble_conn_pdu_pair_us(uint16_t octets, uint8_t phy);
+
+/* Radio time a link takes per second at a ladder step, in us */
+uint32_t ble_conn_airtime_us(const ble_conn_link_t *link, uint8_t step);
+
+/* Choose step and latency of every active link, see the file comment */
+void ble_conn_policy(ble_conn_link_t *links, uint8_t n);
@@ -0,0 +1,354 @@
+/**
+ * @file ble_evt.c
+ *
+ *
+ * @brief Client event queue, see ble_evt.h.
+ *
+ *          The queue has several producers (BTC task, timer task, callers of
+ *          ble_evt_post_local) and the client task as its only consumer. Only
+ *          the BTC callbacks spill payloads, so the spill ring keeps a single
+ *          producer. Room in the queue is checked before spilling; should
+ *          another poster take the last slot meanwhile, the payload is left
+ *          an orphan in the ring, skipped by its sequence number.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <string.h>
+/* FreeRTOS */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+/* ESP32 API */
+#include "esp_log.h"
+#include "esp_timer.h"
+/* API */
+#include "ble_evt.h"
+#include "ble_notify_ring.h"
+#include "ble_log.h"
+#include "ble_power.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define TAG     "BLE_EVT"
+
+_Static_assert(BLE_EVT_REPORT_RESERVE < BLE_EVT_QUEUE_LEN, "Reports need some of the queue");
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static portMUX_TYPE         evt_mux = portMUX_INITIALIZER_UNLOCKED;
+static QueueHandle_t        evt_queue;
+static TaskHandle_t         evt_task;
+static ble_evt_handler_t    evt_handler;
+static ble_notify_ring_t    evt_spill;          /* Payloads over BLE_EVT_INLINE_MAX, BTC task to client task */
+static uint16_t             evt_spill_seq;      /* BTC task only */
+static ble_evt_stats_t      evt_stats;
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Locals */
+static bool ble_evt_payload(ble_evt_t *evt, uint8_t type, const uint8_t *data, uint16_t len, bool lossy)
+{
+    /* One copy out of the Bluedroid buffer, into the record or the spill ring */
+    evt->len = len;
+    if (len <= BLE_EVT_INLINE_MAX) {
+        evt->spill = BLE_EVT_INLINE;
+        if (len) {
+            memcpy(evt->data, data, len);
+        }
+        return true;
+    }
+    /* No spill for a record the queue is about to refuse */
+    if (uxQueueSpacesAvailable(evt_queue) <= (lossy ? BLE_EVT_REPORT_RESERVE : 0U) ||
+        !ble_notify_ring_push(&evt_spill, type, 0U, evt_spill_seq, BLE_NOTIFY_SUB_NONE, data, len, 0)) {
+        evt->len = 0U;
+        return false;
+    }
+    /* The sequence skips BLE_EVT_INLINE, which would pass the record off as inline once it wraps */
+    evt->spill    = evt_spill_seq;
+    evt_spill_seq = (evt_spill_seq + 1U == BLE_EVT_INLINE) ? 0U : (uint16_t)(evt_spill_seq + 1U);
+    portENTER_CRITICAL(&evt_mux);
+    evt_stats.spilled++;
+    portEXIT_CRITICAL(&evt_mux);
+    return true;
+}
+
+static void ble_evt_drop(void)
+{
+    portENTER_CRITICAL(&evt_mux);
+    evt_stats.dropped++;
+    portEXIT_CRITICAL(&evt_mux);
+}
+
+static bool ble_evt_send(ble_evt_t *evt, bool lossy)
+{
+    /* Never blocks: lossy events keep clear of the reserve, the others take any slot left */
+    evt->time_us = esp_timer_get_time();
+    UBaseType_t spaces = uxQueueSpacesAvailable(evt_queue);
+    bool        ok     = (spaces > (lossy ? BLE_EVT_REPORT_RESERVE : 0U)) && xQueueSend(evt_queue, evt, 0) == pdTRUE;
+
+    portENTER_CRITICAL(&evt_mux);
+    if (ok) {
+        uint32_t used = BLE_EVT_QUEUE_LEN - spaces + 1U;
+        evt_stats.posted++;
+        evt_stats.queue_hwm = (used > evt_stats.queue_hwm) ? used : evt_stats.queue_hwm;
+    } else if (lossy) {
+        evt_stats.dropped++;
+    } else {
+        evt_stats.lost++;
+    }
+    portEXIT_CRITICAL(&evt_mux);
+    if (!ok && !lossy) {
+        BLE_LOGE(TAG, "Queue full, event %d of source %d lost", evt->event, evt->src);
+    }
+    return ok;
+}
+
+static void ble_evt_post_report(ble_evt_t *evt, const uint8_t *data, uint16_t len)
+{
+    if (!ble_evt_payload(evt, BLE_NOTIFY_REC_ADV, data, len, true)) {
+        ble_evt_drop();
+        return;
+    }
+    ble_evt_send(evt, true);
+}
+
+static const ble_notify_rec_t *ble_evt_unspill(uint16_t seq)
+{
+    /* Orphans of records that were never queued come first, and are older */
+    const ble_notify_rec_t *rec;
+    while ((rec = ble_notify_ring_claim(&evt_spill)) != NULL && rec->handle != seq) {
+        ble_notify_ring_release(&evt_spill, rec);
+    }
+    return rec;
+}
+
+static void ble_evt_task(void *arg)
+{
+    (void)arg;
+    ble_evt_t evt;
+
+    ble_power_wake();
+    while (1) {
+        ble_power_idle();
+        BaseType_t got = xQueueReceive(evt_queue, &evt, portMAX_DELAY);
+        ble_power_wake();
+        if (got != pdTRUE) {
+            continue;
+        }
+        int64_t                 start   = esp_timer_get_time();
+        const ble_notify_rec_t *rec     = NULL;
+        const uint8_t          *payload = evt.data;
+        if (evt.spill != BLE_EVT_INLINE) {
+            rec     = ble_evt_unspill(evt.spill);
+            payload = rec ? rec->data : NULL;
+            evt.len = rec ? evt.len : 0U;
+        }
+        if (evt.src == BLE_EVT_SRC_GATTC) {
+            switch (evt.event) {
+                case ESP_GATTC_READ_CHAR_EVT:
+                case ESP_GATTC_READ_DESCR_EVT:
+                case ESP_GATTC_READ_MULTIPLE_EVT:
+                    evt.p.gattc.read.value     = (uint8_t *)payload;
+                    evt.p.gattc.read.value_len = evt.len;
+                    break;
+                case ESP_GATTC_NOTIFY_EVT:
+                    evt.p.gattc.notify.value     = (uint8_t *)payload;
+                    evt.p.gattc.notify.value_len = evt.len;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        evt_handler(&evt, payload);
+
+        if (rec) {
+            ble_notify_ring_release(&evt_spill, rec);
+        }
+        int64_t  end  = esp_timer_get_time();
+        uint32_t wait = (uint32_t)(start - evt.time_us);
+        uint32_t run  = (uint32_t)(end - start);
+        portENTER_CRITICAL(&evt_mux);
+        evt_stats.handled++;
+        evt_stats.wait_us_max   = (wait > evt_stats.wait_us_max) ? wait : evt_stats.wait_us_max;
+        evt_stats.handle_us_max = (run > evt_stats.handle_us_max) ? run : evt_stats.handle_us_max;
+        portEXIT_CRITICAL(&evt_mux);
+    }
+}
+
+/* API */
+esp_err_t ble_evt_init(ble_evt_handler_t handler)
+{
+    if (evt_task) {
+        return ESP_OK;
+    }
+    if (handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    evt_handler = handler;
+    evt_queue   = xQueueCreate(BLE_EVT_QUEUE_LEN, sizeof(ble_evt_t));
+    if (evt_queue == NULL) {
+        ESP_LOGE(TAG, "Queue create failed");
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(ble_evt_task, "ble_client", BLE_EVT_TASK_STACK, NULL, BLE_EVT_TASK_PRIO, &evt_task) != pdPASS) {
+        ESP_LOGE(TAG, "Client task create failed");
+        vQueueDelete(evt_queue);
+        evt_queue = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void ble_evt_post_gap(esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t *param)
+{
+    ble_evt_t evt;
+    evt.src      = BLE_EVT_SRC_GAP;
+    evt.gattc_if = ESP_GATT_IF_NONE;
+    evt.event    = (uint16_t)event;
+    evt.len      = 0U;
+    evt.spill    = BLE_EVT_INLINE;
+
+    switch (event) {
+        case ESP_GAP_BLE_SCAN_RESULT_EVT: {
+            const struct ble_scan_result_evt_param *rst = &param->scan_rst;
+            evt.p.report = (ble_evt_report_t) {
+                .addr_type  = (uint8_t)rst->ble_addr_type,
+                .rssi       = (int8_t)rst->rssi,
+                .search_evt = (uint8_t)rst->search_evt,
+                .coded      = false,
+            };
+            memcpy(evt.p.report.bda, rst->bda, sizeof(esp_bd_addr_t));
+            if (rst->search_evt == ESP_GAP_SEARCH_INQ_RES_EVT) {
+                ble_evt_post_report(&evt, rst->ble_adv, (uint16_t)(rst->adv_data_len + rst->scan_rsp_len));
+                return;
+            }
+            /* The end of the scan window is not a report, and not to be dropped */
+            break;
+        }
+        case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT:
+        case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT:
+        case ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT:
+        case ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT:
+            /* Every completion parameter starts with its status */
+            evt.p.status = param->scan_start_cmpl.status;
+            break;
+        case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+            evt.p.update_conn_params = param->update_conn_params;
+            break;
+        case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+            evt.p.pkt_data_lenth_cmpl = param->pkt_data_lenth_cmpl;
+            break;
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+        case ESP_GAP_BLE_SET_PREFERED_PHY_COMPLETE_EVT:
+        case ESP_GAP_BLE_SET_EXT_SCAN_PARAMS_COMPLETE_EVT:
+        case ESP_GAP_BLE_EXT_SCAN_START_COMPLETE_EVT:
+        case ESP_GAP_BLE_EXT_SCAN_STOP_COMPLETE_EVT:
+        case ESP_GAP_BLE_PREFER_EXT_CONN_PARAMS_SET_COMPLETE_EVT:
+            evt.p.status = param->set_perf_phy.status;
+            break;
+        case ESP_GAP_BLE_SCAN_TIMEOUT_EVT:
+            break;
+        case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+            evt.p.phy_update = param->phy_update;
+            break;
+        case ESP_GAP_BLE_EXT_ADV_REPORT_EVT: {
+            const esp_ble_gap_ext_adv_reprot_t *rpt = &param->ext_adv_report.params;
+            evt.p.report = (ble_evt_report_t) {
+                .addr_type  = (uint8_t)rpt->addr_type,
+                .rssi       = rpt->rssi,
+                .search_evt = ESP_GAP_SEARCH_INQ_RES_EVT,
+                .coded      = rpt->primary_phy == ESP_BLE_GAP_PRI_PHY_CODED,
+            };
+            memcpy(evt.p.report.bda, rpt->addr, sizeof(esp_bd_addr_t));
+            ble_evt_post_report(&evt, rpt->adv_data, rpt->adv_data_len);
+            return;
+        }
+#endif
+        default:
+            return;
+    }
+    ble_evt_send(&evt, false);
+}
+
+void ble_evt_post_gattc(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, const esp_ble_gattc_cb_param_t *param)
+{
+    ble_evt_t evt;
+    evt.src      = BLE_EVT_SRC_GATTC;
+    evt.gattc_if = gattc_if;
+    evt.event    = (uint16_t)event;
+    evt.len      = 0U;
+    evt.spill    = BLE_EVT_INLINE;
+    evt.p.gattc  = *param;
+
+    switch (event) {
+        case ESP_GATTC_NOTIFY_EVT: {
+            /* Indications are confirmed by the stack once the callback returns: the server will not send them again,
+             * so they take the reserve like state events */
+            bool lossy = param->notify.is_notify;
+            if (!ble_evt_payload(&evt, lossy ? BLE_NOTIFY_REC_NOTIFY : BLE_NOTIFY_REC_INDICATE,
+                                 param->notify.value, param->notify.value_len, lossy)) {
+                ble_evt_drop();
+                if (lossy) {
+                    return;
+                }
+                /* Spill ring full: queued without its value, counted and logged rather than lost unseen */
+                BLE_LOGE(TAG, "Spill ring full, indication of handle %d queued without its %d bytes",
+                         param->notify.handle, param->notify.value_len);
+            }
+            ble_evt_send(&evt, lossy);
+            return;
+        }
+        case ESP_GATTC_READ_CHAR_EVT:
+        case ESP_GATTC_READ_DESCR_EVT:
+        case ESP_GATTC_READ_MULTIPLE_EVT:
+            /* The read still completes, as failed, so its caller is not left waiting */
+            if (param->read.status == ESP_GATT_OK &&
+                !ble_evt_payload(&evt, BLE_NOTIFY_REC_READ, param->read.value, param->read.value_len, false)) {
+                evt.p.gattc.read.status = ESP_GATT_NO_RESOURCES;
+            }
+            break;
+        default:
+            break;
+    }
+    ble_evt_send(&evt, false);
+}
+
+esp_err_t ble_evt_post_local(uint16_t event)
+{
+    ble_evt_t evt;
+    evt.src      = BLE_EVT_SRC_LOCAL;
+    evt.gattc_if = ESP_GATT_IF_NONE;
+    evt.event    = event;
+    evt.len      = 0U;
+    evt.spill    = BLE_EVT_INLINE;
+    return ble_evt_send(&evt, false) ? ESP_OK : ESP_FAIL;
+}
+
+void ble_evt_get_stats(ble_evt_stats_t *stats)
+{
+    portENTER_CRITICAL(&evt_mux);
+    *stats = evt_stats;
+    portEXIT_CRITICAL(&evt_mux);
+}
+
+void ble_evt_log(void)
+{
+    ble_evt_stats_t st;
+    ble_evt_get_stats(&st);
+    ESP_LOGI(TAG, "%u events, %u waiting at most of %u, %u dropped, %u lost, %u spilled, wait max %u us, handler max %u us",
+             (unsigned)st.handled, (unsigned)st.queue_hwm, (unsigned)BLE_EVT_QUEUE_LEN, (unsigned)st.dropped,
+             (unsigned)st.lost, (unsigned)st.spilled, (unsigned)st.wait_us_max, (unsigned)st.handle_us_max);
+}
@@ -0,0 +1,134 @@
+/**
+ * @file ble_evt.h
+ *
+ *
+ * @brief Client event queue. The GAP and GATTC callbacks run in the Bluedroid
+ *          BTC task and only copy their event into a fixed-size record and
+ *          queue it; a dedicated client task takes the records in order and
+ *          runs the handlers, so lookups, NVS access, scans and writes never
+ *          hold up the stack. Timers post local events to the same queue, so
+ *          all of the client state machine runs in that one task.
+ *
+ *          A record carries the GATTC parameter union, or a compact form of
+ *          the GAP parameters the client uses, and up to BLE_EVT_INLINE_MAX
+ *          payload bytes (values, advertising data). Longer payloads go to a
+ *          spill ring and are found again by sequence number. The handler
+ *          gets read and notification value pointers already redirected to
+ *          the payload, valid until it returns.
+ *
+ *          Advertising reports and notifications may be dropped when the
+ *          queue or the spill ring is short of room, and leave the last
+ *          BLE_EVT_REPORT_RESERVE slots to the events driving the connection
+ *          state, which are only lost on a completely full queue. Indications,
+ *          already confirmed to the server, are queued like the latter.
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdbool.h>
+#include <stdint.h>
+/* FreeRTOS */
+#include "freertos/FreeRTOS.h"
+/* ESP32 API */
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_gap_ble_api.h"
+#include "esp_gattc_api.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BLE_EVT_QUEUE_LEN       32U     /* Records */
+#define BLE_EVT_REPORT_RESERVE  8U      /* Slots reports and notifications leave free */
+#define BLE_EVT_INLINE_MAX      64U     /* Payload bytes within a record: a whole legacy report and scan response */
+#define BLE_EVT_TASK_PRIO       (configMAX_PRIORITIES - 7)  /* One below the BTC task, above the application */
+#define BLE_EVT_TASK_STACK      4096U
+#define BLE_EVT_INLINE          0xFFFFU /* spill of a record whose payload is inline */
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * ENUMS * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef enum {
+    BLE_EVT_SRC_GAP = 0,            /* event is an esp_gap_ble_cb_event_t */
+    BLE_EVT_SRC_GATTC,              /* event is an esp_gattc_cb_event_t */
+    BLE_EVT_SRC_LOCAL               /* event is defined by the poster, see ble_evt_post_local */
+} ble_evt_src_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* ESP_GAP_BLE_SCAN_RESULT_EVT and ESP_GAP_BLE_EXT_ADV_REPORT_EVT, advertising data in the payload */
+typedef struct ble_evt_report {
+    esp_bd_addr_t           bda;
+    uint8_t                 addr_type;      /* esp_ble_addr_type_t */
+    int8_t                  rssi;
+    uint8_t                 search_evt;     /* esp_gap_search_evt_t, ESP_GAP_SEARCH_INQ_RES_EVT for extended reports */
+    bool                    coded;          /* Heard on the LE Coded primary PHY */
+} ble_evt_report_t;
+
+typedef struct ble_evt {
+    int64_t                 time_us;        /* esp_timer_get_time() when posted */
+    uint8_t                 src;            /* ble_evt_src_t */
+    esp_gatt_if_t           gattc_if;
+    uint16_t                event;
+    uint16_t                len;            /* Payload bytes */
+    uint16_t                spill;          /* Spill record holding the payload, BLE_EVT_INLINE if in data */
+    union {
+        esp_ble_gattc_cb_param_t                    gattc;
+        ble_evt_report_t                            report;
+        esp_bt_status_t                             status;             /* GAP completions */
+        struct ble_update_conn_params_evt_param     update_conn_params;
+        struct ble_pkt_data_length_cmpl_evt_param   pkt_data_lenth_cmpl;
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+        struct ble_phy_update_cmpl_param            phy_update;
+#endif
+    } p;
+    uint8_t                 data[BLE_EVT_INLINE_MAX];
+} ble_evt_t;
+
+typedef struct ble_evt_stats {
+    uint32_t                posted;
+    uint32_t                handled;
+    uint32_t                dropped;        /* Reports and notifications refused, queue or spill ring short of room,
+                                             * and indications queued without their value */
+    uint32_t                lost;           /* Other events refused on a full queue */
+    uint32_t                spilled;        /* Payloads over BLE_EVT_INLINE_MAX */
+    uint32_t                queue_hwm;      /* Most records waiting at once */
+    uint32_t                wait_us_max;    /* Longest a record waited for the client task */
+    uint32_t                handle_us_max;  /* Longest handler run */
+} ble_evt_stats_t;
+
+/* Runs in the client task for every record in posting order. payload points at evt->len bytes, valid until it
+ * returns; evt is the task's own copy and may be modified. */
+typedef void (* ble_evt_handler_t)(ble_evt_t *evt, const uint8_t *payload);
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Creates the queue and the client task, before the callbacks are registered */
+esp_err_t ble_evt_init(ble_evt_handler_t handler);
+
+/* From the GAP callback: queues the events the client handles, ignores the others */
+void ble_evt_post_gap(esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t *param);
+
+/* From the GATTC callback: queues every event, with the read or notified value */
+void ble_evt_post_gattc(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, const esp_ble_gattc_cb_param_t *param);
+
+/* From any task or timer callback, never blocks: an event of the poster's own numbering */
+esp_err_t ble_evt_post_local(uint16_t event);
+
+void ble_evt_get_stats(ble_evt_stats_t *stats);
+
+/* One line with the stats above */
+void ble_evt_log(void);
@@ -0,0 +1,130 @@
+/**
+ * @file ble_gatt_cache.c
+ *
+ *
+ * @brief Persistent GATT handle cache, see ble_gatt_cache.h.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdio.h>
+#include <string.h>
+/* Non-Volatile Mem Includes */
+#include "nvs.h"
+/* ESP32 API */
+#include "esp_log.h"
+/* API */
+#include "ble_gatt_cache.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define TAG             "BLE_GATT_CACHE"
+#define FNV1A_OFFSET    2166136261U
+#define FNV1A_PRIME     16777619U
+#define BDA_KEY_LEN     13U     /* 12 hex digits, within NVS_KEY_NAME_MAX_SIZE */
+
+_Static_assert(sizeof(ble_gatt_cache_entry_t) == 64U, "ble_gatt_cache_entry_t must not have padding");
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static nvs_handle_t cache_nvs;
+static bool         cache_ready;
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Locals */
+static void bda_key(const esp_bd_addr_t bda, char key[BDA_KEY_LEN])
+{
+    snprintf(key, BDA_KEY_LEN, "%02x%02x%02x%02x%02x%02x", bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+}
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ data[i]) * FNV1A_PRIME;
+    }
+    return hash;
+}
+
+/* API */
+esp_err_t ble_gatt_cache_init(void)
+{
+    esp_err_t ret = nvs_open(BLE_GATT_CACHE_NAMESPACE, NVS_READWRITE, &cache_nvs);
+    if (ret) {
+        ESP_LOGE(TAG, "NVS open failed, error code = %x", ret);
+        return ret;
+    }
+    cache_ready = true;
+    return ESP_OK;
+}
+
+uint32_t ble_gatt_cache_peer_key(const esp_bt_uuid_t *uuids, uint8_t count)
+{
+    /* Only the used part of the UUIDs, the union tail is not initialised for 16-bit UUIDs */
+    uint32_t hash = FNV1A_OFFSET;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        hash = fnv1a(hash, (const uint8_t *)&uuids[i].len, sizeof(uuids[i].len));
+        hash = fnv1a(hash, (const uint8_t *)&uuids[i].uuid, uuids[i].len);
+    }
+    return hash;
+}
+
+bool ble_gatt_cache_load(const esp_bd_addr_t bda, uint32_t peer_key, ble_gatt_cache_entry_t *entry)
+{
+    char   key[BDA_KEY_LEN];
+    size_t len = sizeof(*entry);
+    if (!cache_ready) {
+        return false;
+    }
+    bda_key(bda, key);
+    if (nvs_get_blob(cache_nvs, key, entry, &len) != ESP_OK || len != sizeof(*entry)) {
+        return false;
+    }
+    return entry->version == BLE_GATT_CACHE_VERSION && entry->peer_key == peer_key;
+}
+
+esp_err_t ble_gatt_cache_store(const esp_bd_addr_t bda, const ble_gatt_cache_entry_t *entry)
+{
+    char key[BDA_KEY_LEN];
+    if (!cache_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bda_key(bda, key);
+    esp_err_t ret = nvs_set_blob(cache_nvs, key, entry, sizeof(*entry));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(cache_nvs);
+    }
+    if (ret) {
+        ESP_LOGE(TAG, "Store %s failed, error code = %x", key, ret);
+    }
+    return ret;
+}
+
+esp_err_t ble_gatt_cache_forget(const esp_bd_addr_t bda)
+{
+    char key[BDA_KEY_LEN];
+    if (!cache_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bda_key(bda, key);
+    esp_err_t ret = nvs_erase_key(cache_nvs, key);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(cache_nvs);
+    }
+    return ret;
+}
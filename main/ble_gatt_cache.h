@@ -0,0 +1,86 @@
+/**
+ * @file ble_gatt_cache.h
+ *
+ *
+ * @brief Persistent GATT handle cache, one NVS blob per peer BDA.
+ *          Holds what service discovery resolves for a peer (service range,
+ *          characteristic handle and properties, handles of the subscribed
+ *          characteristics and their CCCDs, handles of the polled ones)
+ *          together with
+ *          the server's Database Hash (0x2B2A) when it exposes one, so that a
+ *          reconnect only reads the hash instead of rediscovering.
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdint.h>
+#include <stdbool.h>
+/* ESP32 API */
+#include "esp_err.h"
+#include "esp_bt_defs.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BLE_GATT_CACHE_NAMESPACE    "ble_gatt_cache"
+#define BLE_GATT_CACHE_VERSION      3U      /* Bump when ble_gatt_cache_entry_t changes, older blobs are ignored */
+#define BLE_GATT_DB_HASH_UUID       0x2B2A  /* Database Hash characteristic of the GATT service */
+#define BLE_GATT_DB_HASH_LEN        16U
+#define BLE_GATT_CACHE_SUB_MAX      4U      /* Subscribed characteristics kept per peer */
+#define BLE_GATT_CACHE_READ_MAX     4U      /* Polled characteristics kept per peer */
+
+#define BLE_GATT_CACHE_F_DB_HASH    (1U << 0)   /* db_hash holds the server's Database Hash */
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* A subscribed characteristic, 0 handles if the server lacks it */
+typedef struct ble_gatt_cache_sub {
+    uint16_t    char_handle;
+    uint16_t    cccd_handle;
+    uint8_t     char_props;
+    uint8_t     reserved;
+} ble_gatt_cache_sub_t;
+
+/* Stored as is, keep it free of padding */
+typedef struct ble_gatt_cache_entry {
+    uint8_t     version;
+    uint8_t     flags;
+    uint8_t     char_props;
+    uint8_t     sub_count;                      /* Valid entries of subs */
+    uint32_t    peer_key;                       /* ble_gatt_cache_peer_key of the UUIDs the handles belong to */
+    uint16_t    service_start_handle;
+    uint16_t    service_end_handle;
+    uint16_t    char_handle;
+    uint8_t     read_count;                     /* Valid entries of read_handle */
+    uint8_t     reserved;
+    uint8_t     db_hash[BLE_GATT_DB_HASH_LEN];
+    ble_gatt_cache_sub_t subs[BLE_GATT_CACHE_SUB_MAX];
+    uint16_t    read_handle[BLE_GATT_CACHE_READ_MAX];   /* 0 if the server lacks the characteristic */
+} ble_gatt_cache_entry_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Opens the NVS namespace, nvs_flash_init must have run */
+esp_err_t ble_gatt_cache_init(void);
+
+/* Hash of the count UUIDs a peer is configured with, in the order given */
+uint32_t ble_gatt_cache_peer_key(const esp_bt_uuid_t *uuids, uint8_t count);
+
+/* False if there is no entry for bda, or it was stored for another version or peer_key */
+bool ble_gatt_cache_load(const esp_bd_addr_t bda, uint32_t peer_key, ble_gatt_cache_entry_t *entry);
+
+esp_err_t ble_gatt_cache_store(const esp_bd_addr_t bda, const ble_gatt_cache_entry_t *entry);
+
+esp_err_t ble_gatt_cache_forget(const esp_bd_addr_t bda);
@@ -0,0 +1,150 @@
+/**
+ * @file ble_latency.c
+ *
+ *
+ * @brief Connection lifecycle latency histograms, see ble_latency.h.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <string.h>
+/* FreeRTOS */
+#include "freertos/FreeRTOS.h"
+/* ESP32 API */
+#include "esp_log.h"
+/* API */
+#include "ble_latency.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define TAG     "BLE_LATENCY"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static portMUX_TYPE     lat_mux = portMUX_INITIALIZER_UNLOCKED;
+static ble_lat_hist_t   lat_hist[BLE_LAT_STAGE_NUM];
+static uint32_t         lat_last[BLE_LAT_PEERS_MAX][BLE_LAT_STAGE_NUM];
+
+static const char *const lat_names[BLE_LAT_STAGE_NUM] = {
+    [BLE_LAT_SCAN]      = "scan",
+    [BLE_LAT_CONNECT]   = "connect",
+    [BLE_LAT_MTU]       = "mtu",
+    [BLE_LAT_DISCOVERY] = "discovery",
+    [BLE_LAT_SUBSCRIBE] = "subscribe",
+    [BLE_LAT_READ]      = "read",
+    [BLE_LAT_NOTIFY]    = "notify",
+};
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Locals */
+static inline uint32_t lat_bucket(uint32_t us)
+{
+    uint32_t scaled = us >> BLE_LAT_BUCKET_SHIFT;
+    if (scaled <= 1U) {
+        return 0U;
+    }
+    uint32_t b = 31U - (uint32_t)__builtin_clz(scaled);
+    return (b < BLE_LAT_BUCKETS) ? b : BLE_LAT_BUCKETS - 1U;
+}
+
+/* API */
+void ble_lat_record(uint8_t peer, ble_lat_stage_t stage, int64_t us)
+{
+    if (stage >= BLE_LAT_STAGE_NUM || us < 0) {
+        return;
+    }
+    uint32_t        v = (us > (int64_t)UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+    ble_lat_hist_t *h = &lat_hist[stage];
+
+    portENTER_CRITICAL(&lat_mux);
+    if (h->count == 0U || v < h->min_us) {
+        h->min_us = v;
+    }
+    if (v > h->max_us) {
+        h->max_us = v;
+    }
+    h->count++;
+    h->sum_us += v;
+    h->buckets[lat_bucket(v)]++;
+    if (peer < BLE_LAT_PEERS_MAX) {
+        lat_last[peer][stage] = v;
+    }
+    portEXIT_CRITICAL(&lat_mux);
+}
+
+esp_err_t ble_lat_get(ble_lat_stage_t stage, ble_lat_hist_t *hist)
+{
+    if (stage >= BLE_LAT_STAGE_NUM || !hist) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&lat_mux);
+    *hist = lat_hist[stage];
+    portEXIT_CRITICAL(&lat_mux);
+    return ESP_OK;
+}
+
+uint32_t ble_lat_get_last(uint8_t peer, ble_lat_stage_t stage)
+{
+    if (peer >= BLE_LAT_PEERS_MAX || stage >= BLE_LAT_STAGE_NUM) {
+        return 0U;
+    }
+    return lat_last[peer][stage];
+}
+
+uint32_t ble_lat_percentile(const ble_lat_hist_t *hist, uint8_t percent)
+{
+    if (hist->count == 0U) {
+        return 0U;
+    }
+    /* Rank of the sample, rounded up so that p100 is the last one */
+    uint64_t rank = ((uint64_t)hist->count * percent + 99U) / 100U;
+    uint64_t seen = 0U;
+    for (uint32_t b = 0; b < BLE_LAT_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen >= rank && seen > 0U) {
+            uint64_t upper = 1ULL << (b + BLE_LAT_BUCKET_SHIFT + 1U);
+            return (upper < hist->max_us) ? (uint32_t)upper : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+const char *ble_lat_stage_name(ble_lat_stage_t stage)
+{
+    return (stage < BLE_LAT_STAGE_NUM) ? lat_names[stage] : "?";
+}
+
+void ble_lat_reset(void)
+{
+    portENTER_CRITICAL(&lat_mux);
+    memset(lat_hist, 0, sizeof(lat_hist));
+    memset(lat_last, 0, sizeof(lat_last));
+    portEXIT_CRITICAL(&lat_mux);
+}
+
+void ble_lat_log(void)
+{
+    for (uint32_t s = 0; s < BLE_LAT_STAGE_NUM; s++)
+    {
+        ble_lat_hist_t h;
+        ble_lat_get((ble_lat_stage_t)s, &h);
+        if (h.count == 0U) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%-9s n %u, min %u, p50 %u, p90 %u, p99 %u, max %u us", lat_names[s], (unsigned)h.count,
+                 (unsigned)h.min_us, (unsigned)ble_lat_percentile(&h, 50), (unsigned)ble_lat_percentile(&h, 90),
+                 (unsigned)ble_lat_percentile(&h, 99), (unsigned)h.max_us);
+    }
+}
@@ -0,0 +1,80 @@
+/**
+ * @file ble_latency.h
+ *
+ *
+ * @brief Connection lifecycle latency histograms. The client times each
+ *          bring-up stage of every peer from its callbacks and records the
+ *          duration here; each stage keeps a fixed log2 histogram over all
+ *          peers plus the last duration per peer. Recording is a clz and a
+ *          few increments, cheap enough to stay on in production.
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdint.h>
+/* ESP32 API */
+#include "esp_err.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BLE_LAT_PEERS_MAX       8U
+#define BLE_LAT_BUCKETS         20U     /* Bucket b holds [2^(b+7), 2^(b+8)) us, the first and last also everything beyond */
+#define BLE_LAT_BUCKET_SHIFT    7U
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * ENUMS * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef enum {
+    BLE_LAT_SCAN = 0,       /* Scan started -> peer's advertisement matched */
+    BLE_LAT_CONNECT,        /* esp_ble_gattc_open -> ESP_GATTC_OPEN_EVT */
+    BLE_LAT_MTU,            /* ESP_GATTC_OPEN_EVT -> ESP_GATTC_CFG_MTU_EVT */
+    BLE_LAT_DISCOVERY,      /* ESP_GATTC_CFG_MTU_EVT -> handles known, from search or cache */
+    BLE_LAT_SUBSCRIBE,      /* Handles known -> ESP_GATTC_WRITE_DESCR_EVT */
+    BLE_LAT_READ,           /* esp_ble_gattc_read_char -> ESP_GATTC_READ_CHAR_EVT */
+    BLE_LAT_NOTIFY,         /* Between two notifications of a peer */
+    BLE_LAT_STAGE_NUM
+} ble_lat_stage_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct ble_lat_hist {
+    uint32_t    count;
+    uint32_t    min_us;
+    uint32_t    max_us;
+    uint64_t    sum_us;
+    uint32_t    buckets[BLE_LAT_BUCKETS];
+} ble_lat_hist_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+void ble_lat_record(uint8_t peer, ble_lat_stage_t stage, int64_t us);
+
+/* Copy of a stage histogram, consistent with concurrent records */
+esp_err_t ble_lat_get(ble_lat_stage_t stage, ble_lat_hist_t *hist);
+
+/* Last duration of a stage for a peer, 0 if never recorded */
+uint32_t ble_lat_get_last(uint8_t peer, ble_lat_stage_t stage);
+
+/* Upper bound of the bucket holding the given percentile (0-100), capped at max_us */
+uint32_t ble_lat_percentile(const ble_lat_hist_t *hist, uint8_t percent);
+
+const char *ble_lat_stage_name(ble_lat_stage_t stage);
+
+void ble_lat_reset(void);
+
+/* Log count, min, p50, p90, p99 and max of every stage with samples */
+void ble_lat_log(void);
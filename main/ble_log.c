@@ -0,0 +1,203 @@
+/**
+ * @file ble_log.c
+ *
+ *
+ * @brief Deferred logging, see ble_log.h.
+ *
+ *          Handlers run in the client task, the Bluedroid callbacks in the BTC
+ *          task and application calls in theirs, so the ring has several
+ *          producers; a record is copied in a short critical section. The
+ *          drain task is the only consumer and formats outside of it.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdio.h>
+/* FreeRTOS */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+/* ESP32 API */
+#include "esp_timer.h"
+/* API */
+#include "ble_log.h"
+#include "ble_power.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define TAG             "BLE_LOG"
+#define RING_MASK       (BLE_LOG_RING_LEN - 1U)
+#define LINE_LEN_MAX    160U
+
+_Static_assert((BLE_LOG_RING_LEN & RING_MASK) == 0, "BLE_LOG_RING_LEN must be a power of two");
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct ble_log_rec {
+    int64_t             time_us;
+    const char         *tag;
+    const char         *format;
+    uintptr_t           args[BLE_LOG_ARGS_MAX];
+    esp_log_level_t     level;
+} ble_log_rec_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static portMUX_TYPE     log_mux = portMUX_INITIALIZER_UNLOCKED;
+static ble_log_rec_t    log_ring[BLE_LOG_RING_LEN];
+static uint32_t         log_head;
+static uint32_t         log_tail;
+static ble_log_stats_t  log_stats;
+static TaskHandle_t     log_task;
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Locals */
+static bool ble_log_pop(ble_log_rec_t *rec)
+{
+    bool ok = false;
+    portENTER_CRITICAL(&log_mux);
+    if (log_tail != log_head) {
+        *rec = log_ring[log_tail & RING_MASK];
+        log_tail++;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&log_mux);
+    return ok;
+}
+
+static void ble_log_print(const ble_log_rec_t *rec)
+{
+    char line[LINE_LEN_MAX];
+    snprintf(line, sizeof(line), rec->format, rec->args[0], rec->args[1], rec->args[2],
+             rec->args[3], rec->args[4], rec->args[5]);
+    ESP_LOG_LEVEL(rec->level, rec->tag, "%s (at %u ms)", line, (unsigned)(rec->time_us / 1000));
+    log_stats.printed++;
+}
+
+static void ble_log_task(void *arg)
+{
+    (void)arg;
+    uint32_t   tokens = BLE_LOG_BURST;
+    uint32_t   suppressed_shown = 0U;
+    TickType_t last = xTaskGetTickCount();
+
+    ble_power_wake();
+    while (1) {
+        /* A ring left empty is checked less often; ble_log_put wakes the task early once it fills up */
+        portENTER_CRITICAL(&log_mux);
+        bool idle = (log_tail == log_head) && (log_stats.suppressed == suppressed_shown);
+        portEXIT_CRITICAL(&log_mux);
+        ble_power_idle();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(idle ? BLE_LOG_IDLE_MS : BLE_LOG_DRAIN_MS));
+        ble_power_wake();
+
+        /* Token bucket: BLE_LOG_RATE_PER_S lines per second, up to BLE_LOG_BURST at once */
+        TickType_t now   = xTaskGetTickCount();
+        uint32_t   added = (uint32_t)(((uint64_t)(now - last) * BLE_LOG_RATE_PER_S) / configTICK_RATE_HZ);
+        if (added > 0U) {
+            /* Advance by what was credited only, the remainder counts towards the next token */
+            last  += (TickType_t)(((uint64_t)added * configTICK_RATE_HZ) / BLE_LOG_RATE_PER_S);
+            tokens += added;
+        }
+        if (tokens >= BLE_LOG_BURST) {
+            tokens = BLE_LOG_BURST;
+            last   = now;
+        }
+
+        ble_log_rec_t rec;
+        while (ble_log_pop(&rec)) {
+            /* Errors always go out, the rest competes for tokens */
+            if (rec.level == ESP_LOG_ERROR || tokens > 0U) {
+                tokens -= (tokens > 0U);
+                ble_log_print(&rec);
+            } else {
+                log_stats.suppressed++;
+            }
+        }
+        if (log_stats.suppressed != suppressed_shown && tokens > 0U) {
+            tokens--;
+            ESP_LOGW(TAG, "%u records over the rate limit, %u dropped on a full ring",
+                     (unsigned)(log_stats.suppressed - suppressed_shown), (unsigned)log_stats.dropped);
+            suppressed_shown = log_stats.suppressed;
+        }
+    }
+}
+
+/* API */
+esp_err_t ble_log_init(void)
+{
+    if (log_task) {
+        return ESP_OK;
+    }
+    if (xTaskCreate(ble_log_task, "ble_log", BLE_LOG_TASK_STACK, NULL, BLE_LOG_TASK_PRIO, &log_task) != pdPASS) {
+        ESP_LOGE(TAG, "Drain task create failed");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void ble_log_put(esp_log_level_t level, const char *tag, const char *format,
+                 uintptr_t a0, uintptr_t a1, uintptr_t a2, uintptr_t a3, uintptr_t a4, uintptr_t a5)
+{
+    int64_t  now = esp_timer_get_time();
+    uint32_t used;
+
+    portENTER_CRITICAL(&log_mux);
+    used = log_head - log_tail;
+    if (used >= BLE_LOG_RING_LEN) {
+        log_stats.dropped++;
+        portEXIT_CRITICAL(&log_mux);
+        return;
+    }
+    ble_log_rec_t *rec = &log_ring[log_head & RING_MASK];
+    rec->time_us = now;
+    rec->tag     = tag;
+    rec->format  = format;
+    rec->args[0] = a0;
+    rec->args[1] = a1;
+    rec->args[2] = a2;
+    rec->args[3] = a3;
+    rec->args[4] = a4;
+    rec->args[5] = a5;
+    rec->level   = level;
+    log_head++;
+    log_stats.queued++;
+    used++;
+    if (used > log_stats.ring_hwm) {
+        log_stats.ring_hwm = used;
+    }
+    portEXIT_CRITICAL(&log_mux);
+
+    /* Wake the drain task early before the ring fills up */
+    if (used == BLE_LOG_RING_LEN / 2U && log_task) {
+        xTaskNotifyGive(log_task);
+    }
+}
+
+void ble_log_flush(void)
+{
+    ble_log_rec_t rec;
+    while (ble_log_pop(&rec)) {
+        ble_log_print(&rec);
+    }
+}
+
+void ble_log_get_stats(ble_log_stats_t *stats)
+{
+    portENTER_CRITICAL(&log_mux);
+    *stats = log_stats;
+    portEXIT_CRITICAL(&log_mux);
+}
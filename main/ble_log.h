@@ -0,0 +1,128 @@
+/**
+ * @file ble_log.h
+ *
+ *
+ * @brief Deferred logging for the Bluedroid callback path. BLE_LOGx appends
+ *          a fixed-size record (timestamp, format pointer, raw arguments) to
+ *          a ring in constant time; a low-priority task formats the records
+ *          later and rate-limits what reaches the UART.
+ *
+ *          The format string and every %s argument must outlive the record:
+ *          string literals and the peer table names are fine, stack buffers
+ *          are not. Arguments are stored as uintptr_t, so 64-bit and floating
+ *          point arguments are not supported. At most BLE_LOG_ARGS_MAX of them.
+ *
+ *          Levels above CONFIG_BLE_CLIENT_HOT_LOG_LEVEL compile to nothing.
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdint.h>
+/* ESP32 API */
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#ifdef CONFIG_BLE_CLIENT_HOT_LOG_LEVEL
+#define BLE_LOG_LEVEL       CONFIG_BLE_CLIENT_HOT_LOG_LEVEL
+#else
+#define BLE_LOG_LEVEL       ESP_LOG_INFO
+#endif
+
+#define BLE_LOG_RING_LEN    128U    /* Records, power of two */
+#define BLE_LOG_ARGS_MAX    6U
+#define BLE_LOG_DRAIN_MS    50U     /* Drain task period */
+#ifdef CONFIG_BLE_CLIENT_LOW_POWER
+#define BLE_LOG_IDLE_MS     1000U   /* Drain task period while nothing is queued */
+#else
+#define BLE_LOG_IDLE_MS     BLE_LOG_DRAIN_MS
+#endif
+#define BLE_LOG_RATE_PER_S  50U     /* Lines per second printed once the burst is spent */
+#define BLE_LOG_BURST       32U
+#define BLE_LOG_TASK_PRIO   1U
+#define BLE_LOG_TASK_STACK  3072U
+
+/* Records the call with the argument count spelled out, (uintptr_t) casts keep pointers and integers alike */
+#define BLE_LOG_CAT_(a, b)  a##b
+#define BLE_LOG_CAT(a, b)   BLE_LOG_CAT_(a, b)
+#define BLE_LOG_NARG(...)   BLE_LOG_NARG_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define BLE_LOG_NARG_(_0, _1, _2, _3, _4, _5, _6, n, ...)   n
+#define BLE_LOG_A0()                    0, 0, 0, 0, 0, 0
+#define BLE_LOG_A1(a)                   (uintptr_t)(a), 0, 0, 0, 0, 0
+#define BLE_LOG_A2(a, b)                (uintptr_t)(a), (uintptr_t)(b), 0, 0, 0, 0
+#define BLE_LOG_A3(a, b, c)             (uintptr_t)(a), (uintptr_t)(b), (uintptr_t)(c), 0, 0, 0
+#define BLE_LOG_A4(a, b, c, d)          (uintptr_t)(a), (uintptr_t)(b), (uintptr_t)(c), (uintptr_t)(d), 0, 0
+#define BLE_LOG_A5(a, b, c, d, e)       (uintptr_t)(a), (uintptr_t)(b), (uintptr_t)(c), (uintptr_t)(d), (uintptr_t)(e), 0
+#define BLE_LOG_A6(a, b, c, d, e, f)    (uintptr_t)(a), (uintptr_t)(b), (uintptr_t)(c), (uintptr_t)(d), (uintptr_t)(e), (uintptr_t)(f)
+
+/* The dead esp_log_write call only lets the compiler check the format against the arguments */
+#define BLE_LOG_PUT(level, tag, format, ...) do {                                                       \
+        if (0) {                                                                                        \
+            esp_log_write((level), (tag), format, ##__VA_ARGS__);                                       \
+        }                                                                                               \
+        ble_log_put((level), (tag), format,                                                             \
+                    BLE_LOG_CAT(BLE_LOG_A, BLE_LOG_NARG(__VA_ARGS__))(__VA_ARGS__));                    \
+    } while (0)
+
+#if BLE_LOG_LEVEL >= 1
+#define BLE_LOGE(tag, format, ...)  BLE_LOG_PUT(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#else
+#define BLE_LOGE(tag, format, ...)  do { } while (0)
+#endif
+#if BLE_LOG_LEVEL >= 2
+#define BLE_LOGW(tag, format, ...)  BLE_LOG_PUT(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#else
+#define BLE_LOGW(tag, format, ...)  do { } while (0)
+#endif
+#if BLE_LOG_LEVEL >= 3
+#define BLE_LOGI(tag, format, ...)  BLE_LOG_PUT(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#else
+#define BLE_LOGI(tag, format, ...)  do { } while (0)
+#endif
+#if BLE_LOG_LEVEL >= 4
+#define BLE_LOGD(tag, format, ...)  BLE_LOG_PUT(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#else
+#define BLE_LOGD(tag, format, ...)  do { } while (0)
+#endif
+
+/* BDA as six BLE_LOGx arguments for a "%02x:%02x:%02x:%02x:%02x:%02x" format */
+#define BLE_LOG_BDA(bda)    (bda)[0], (bda)[1], (bda)[2], (bda)[3], (bda)[4], (bda)[5]
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct ble_log_stats {
+    uint32_t    queued;
+    uint32_t    printed;
+    uint32_t    dropped;        /* Ring full when the record was put */
+    uint32_t    suppressed;     /* Over the print rate, discarded by the drain task */
+    uint32_t    ring_hwm;       /* Most records waiting at once */
+} ble_log_stats_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Starts the drain task, records put before are kept */
+esp_err_t ble_log_init(void);
+
+/* Use BLE_LOGx instead, it checks the format and drops compiled-out levels */
+void ble_log_put(esp_log_level_t level, const char *tag, const char *format,
+                 uintptr_t a0, uintptr_t a1, uintptr_t a2, uintptr_t a3, uintptr_t a4, uintptr_t a5);
+
+/* Prints every waiting record now, ignoring the rate limit */
+void ble_log_flush(void);
+
+void ble_log_get_stats(ble_log_stats_t *stats);
@@ -0,0 +1,126 @@
+/**
+ * @file ble_notify_ring.c
+ *
+ *
+ * @brief SPSC notification ring, see ble_notify_ring.h.
+ *
+ *          Records never straddle the end of the buffer. When the space left
+ *          before the end cannot hold a header, both sides skip to the start;
+ *          when it holds a header but not the record, the producer writes a
+ *          PAD record over it.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <string.h>
+/* API */
+#include "ble_notify_ring.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define RING_MASK           (BLE_NOTIFY_RING_SIZE - 1U)
+#define REC_HDR_SIZE        ((uint32_t)sizeof(ble_notify_rec_t))
+#define REC_SIZE(len)       ((REC_HDR_SIZE + (uint32_t)(len) + BLE_NOTIFY_REC_ALIGN - 1U) & ~(BLE_NOTIFY_REC_ALIGN - 1U))
+
+_Static_assert((BLE_NOTIFY_RING_SIZE & RING_MASK) == 0, "BLE_NOTIFY_RING_SIZE must be a power of two");
+_Static_assert((sizeof(ble_notify_rec_t) % BLE_NOTIFY_REC_ALIGN) == 0, "Record header must keep records aligned");
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Locals */
+static inline uint32_t to_end(uint32_t pos)
+{
+    return BLE_NOTIFY_RING_SIZE - (pos & RING_MASK);
+}
+
+/* API */
+void ble_notify_ring_reset(ble_notify_ring_t *ring)
+{
+    atomic_store_explicit(&ring->head, 0U, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, 0U, memory_order_relaxed);
+    ring->dropped = 0U;
+    ring->pushed  = 0U;
+}
+
+bool ble_notify_ring_push(ble_notify_ring_t *ring, uint8_t type, uint8_t peer, uint16_t handle, uint8_t sub,
+                          const uint8_t *data, uint16_t len, int64_t time_us)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t need = REC_SIZE(len);
+    uint32_t skip = 0U;
+
+    if (to_end(head) < need) {
+        skip = to_end(head);
+    }
+    if (need > BLE_NOTIFY_RING_SIZE || (head - tail) + skip + need > BLE_NOTIFY_RING_SIZE) {
+        ring->dropped++;
+        return false;
+    }
+
+    if (skip >= REC_HDR_SIZE) {
+        ble_notify_rec_t *pad = (ble_notify_rec_t *)&ring->buf[head & RING_MASK];
+        pad->type = BLE_NOTIFY_REC_PAD;
+    }
+    head += skip;
+
+    ble_notify_rec_t *rec = (ble_notify_rec_t *)&ring->buf[head & RING_MASK];
+    rec->time_us  = time_us;
+    rec->len      = len;
+    rec->handle   = handle;
+    rec->type     = type;
+    rec->peer     = peer;
+    rec->sub      = sub;
+    rec->reserved = 0U;
+    memcpy(rec->data, data, len);
+
+    /* Publish the record only once it is complete */
+    atomic_store_explicit(&ring->head, head + need, memory_order_release);
+    ring->pushed++;
+    return true;
+}
+
+const ble_notify_rec_t *ble_notify_ring_claim(ble_notify_ring_t *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    while (tail != head) {
+        if (to_end(tail) < REC_HDR_SIZE) {
+            tail += to_end(tail);
+            continue;
+        }
+        const ble_notify_rec_t *rec = (const ble_notify_rec_t *)&ring->buf[tail & RING_MASK];
+        if (rec->type == BLE_NOTIFY_REC_PAD) {
+            tail += to_end(tail);
+            continue;
+        }
+        /* Padding skipped on the way is freed right away */
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        return rec;
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    return NULL;
+}
+
+void ble_notify_ring_release(ble_notify_ring_t *ring, const ble_notify_rec_t *rec)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + REC_SIZE(rec->len), memory_order_release);
+}
+
+uint32_t ble_notify_ring_used(ble_notify_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return head - tail;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file ble_notify_ring.h
+ *
+ *
+ * @brief Lock-free single-producer/single-consumer ring of variable length
+ *          records, used to hand notification and read payloads from the
+ *          BLE client task to an application task. The producer
+ *          copies each payload once into the ring; the consumer gets
+ *          pointers into the ring (claim) and frees them in order (release).
+ *
+ *          Only the producer writes head and only the consumer writes tail,
+ *          so plain acquire/release loads and stores are enough; no
+ *          read-modify-write atomics are needed on the RV32IMC core.
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BLE_NOTIFY_RING_SIZE    2048U   /* Bytes per ring, power of two */
+#define BLE_NOTIFY_REC_ALIGN    8U
+#define BLE_NOTIFY_SUB_NONE     0xFFU   /* sub of a record that belongs to no subscription */
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * ENUMS * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef enum {
+    BLE_NOTIFY_REC_PAD = 0,         /* Internal, fills the ring end before a wrap */
+    BLE_NOTIFY_REC_NOTIFY,
+    BLE_NOTIFY_REC_INDICATE,
+    BLE_NOTIFY_REC_READ,
+    BLE_NOTIFY_REC_ADV              /* Reading decoded from advertising data, peer holds the decoder id */
+} ble_notify_rec_type_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Record header, payload follows; records are BLE_NOTIFY_REC_ALIGN aligned */
+typedef struct ble_notify_rec {
+    int64_t     time_us;            /* esp_timer_get_time() when the callback ran */
+    uint16_t    len;
+    uint16_t    handle;             /* Attribute handle the value came from */
+    uint8_t     type;               /* ble_notify_rec_type_t */
+    uint8_t     peer;
+    uint8_t     sub;                /* Subscription of handle when the value arrived, BLE_NOTIFY_SUB_NONE if none */
+    uint8_t     reserved;
+    uint8_t     data[];
+} ble_notify_rec_t;
+
+typedef struct ble_notify_ring {
+    _Atomic uint32_t    head;       /* Producer position, free running */
+    _Atomic uint32_t    tail;       /* Consumer position, free running */
+    uint32_t            dropped;    /* Records refused because the ring was full, producer only */
+    uint32_t            pushed;
+    _Alignas(BLE_NOTIFY_REC_ALIGN) uint8_t buf[BLE_NOTIFY_RING_SIZE];
+} ble_notify_ring_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* A zeroed ring is empty; reset must not race with either side */
+void ble_notify_ring_reset(ble_notify_ring_t *ring);
+
+/* Producer: copy one payload in, false if it does not fit (counted in dropped) */
+bool ble_notify_ring_push(ble_notify_ring_t *ring, uint8_t type, uint8_t peer, uint16_t handle, uint8_t sub,
+                          const uint8_t *data, uint16_t len, int64_t time_us);
+
+/* Consumer: oldest record or NULL, stays valid until released */
+const ble_notify_rec_t *ble_notify_ring_claim(ble_notify_ring_t *ring);
+
+/* Consumer: free the record returned by the last claim */
+void ble_notify_ring_release(ble_notify_ring_t *ring, const ble_notify_rec_t *rec);
+
+uint32_t ble_notify_ring_used(ble_notify_ring_t *ring);
@@ -0,0 +1,136 @@
+/**
+ * @file ble_power.c
+ *
+ *
+ * @brief Power management and awake-time accounting, see ble_power.h.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdio.h>
+/* FreeRTOS */
+#include "freertos/FreeRTOS.h"
+/* ESP32 API */
+#include "esp_log.h"
+#include "esp_timer.h"
+#ifdef CONFIG_BLE_CLIENT_LOW_POWER
+#include "esp_pm.h"
+#ifndef CONFIG_IDF_TARGET_ESP32C3
+#error "CONFIG_BLE_CLIENT_LOW_POWER configures the ESP32-C3 power manager only"
+#endif
+#endif
+/* API */
+#include "ble_power.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define TAG     "BLE_POWER"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static portMUX_TYPE         power_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t             power_running;      /* Client tasks between ble_power_wake and ble_power_idle */
+static int64_t              power_woke_us;      /* When the first of them woke */
+static ble_power_stats_t    power_stats;
+static ble_power_stats_t    power_logged;       /* At the previous ble_power_log */
+static int64_t              power_logged_us;
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* API */
+esp_err_t ble_power_init(void)
+{
+    esp_err_t ret = ESP_OK;
+#ifdef CONFIG_BLE_CLIENT_LOW_POWER
+    /* Light sleep needs tickless idle; modem sleep is up to the controller once it is enabled */
+    esp_pm_config_esp32c3_t pm = {
+        .max_freq_mhz       = BLE_POWER_CPU_MAX_MHZ,
+        .min_freq_mhz       = BLE_POWER_CPU_MIN_MHZ,
+        .light_sleep_enable = true,
+    };
+    ret = esp_pm_configure(&pm);
+    if (ret != ESP_OK) {
+        /* The measurement still runs, the figures then show the client awake */
+        ESP_LOGE(TAG, "Power management config failed, %s", esp_err_to_name(ret));
+    } else {
+        ESP_LOGI(TAG, "Light sleep on, CPU %u-%u MHz", BLE_POWER_CPU_MIN_MHZ, BLE_POWER_CPU_MAX_MHZ);
+    }
+#endif
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&power_mux);
+    power_running         = 1U;
+    power_woke_us         = now;
+    power_stats.since_us  = now;
+    power_stats.awake_us  = 0;
+    power_stats.wakeups   = 0U;
+    power_logged          = power_stats;
+    power_logged_us       = now;
+    portEXIT_CRITICAL(&power_mux);
+    return ret;
+}
+
+void ble_power_wake(void)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&power_mux);
+    if (power_running++ == 0U) {
+        power_woke_us = now;
+        power_stats.wakeups++;
+    }
+    portEXIT_CRITICAL(&power_mux);
+}
+
+void ble_power_idle(void)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&power_mux);
+    if (power_running > 0U && --power_running == 0U) {
+        power_stats.awake_us += now - power_woke_us;
+    }
+    portEXIT_CRITICAL(&power_mux);
+}
+
+void ble_power_get(ble_power_stats_t *stats)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&power_mux);
+    *stats = power_stats;
+    if (power_running > 0U) {
+        /* The running stretch so far, e.g. the caller's own */
+        stats->awake_us += now - power_woke_us;
+    }
+    portEXIT_CRITICAL(&power_mux);
+}
+
+void ble_power_log(void)
+{
+    ble_power_stats_t st;
+    ble_power_get(&st);
+    int64_t  now     = esp_timer_get_time();
+    int64_t  span_us = now - power_logged_us;
+    int64_t  awake   = st.awake_us - power_logged.awake_us;
+    uint32_t wakeups = st.wakeups - power_logged.wakeups;
+    if (span_us > 0) {
+        /* Tenths of both, for figures well under one */
+        uint32_t awake_pm   = (uint32_t)(awake * 1000 / span_us);
+        uint32_t wakeups_ds = (uint32_t)((int64_t)wakeups * 10000000 / span_us);
+        ESP_LOGI(TAG, "awake %u.%u%%, %u.%u wakeups/s", (unsigned)(awake_pm / 10U), (unsigned)(awake_pm % 10U),
+                 (unsigned)(wakeups_ds / 10U), (unsigned)(wakeups_ds % 10U));
+    }
+    power_logged    = st;
+    power_logged_us = now;
+#if defined(CONFIG_BLE_CLIENT_LOW_POWER) && defined(CONFIG_PM_PROFILING)
+    esp_pm_dump_locks(stdout);
+#endif
+}
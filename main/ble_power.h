@@ -0,0 +1,67 @@
+/**
+ * @file ble_power.h
+ *
+ *
+ * @brief Power management of the client. With CONFIG_BLE_CLIENT_LOW_POWER,
+ *          ble_power_init lets the power manager scale the CPU down and enter
+ *          automatic light sleep whenever every task is blocked; the
+ *          controller keeps the links through modem sleep on its own 32 kHz
+ *          clock (sdkconfig.defaults.lowpower).
+ *
+ *          In every build, the client's tasks bracket their blocking waits
+ *          with ble_power_idle and ble_power_wake. From that the module
+ *          measures the share of time at least one of them runs and how
+ *          often the first one wakes, which bounds the CPU wakeups the
+ *          client causes. Bluedroid and controller tasks are not counted;
+ *          CONFIG_PM_PROFILING gives the power manager's own figures.
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdint.h>
+/* ESP32 API */
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BLE_POWER_CPU_MAX_MHZ   160U
+#define BLE_POWER_CPU_MIN_MHZ   40U     /* XTAL, the lowest frequency the radio tolerates */
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef struct ble_power_stats {
+    int64_t     since_us;               /* Start of the measurement, esp_timer time */
+    int64_t     awake_us;               /* Time at least one client task was running */
+    uint32_t    wakeups;                /* Times the first of them woke while none was running */
+} ble_power_stats_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Configures the power manager in low-power builds and starts the measurement, the caller counting as awake.
+ * The measurement starts even if the power manager refuses the configuration, whose error is returned. */
+esp_err_t ble_power_init(void);
+
+/* A client task returned from a blocking wait, or started */
+void ble_power_wake(void);
+
+/* A client task is about to block */
+void ble_power_idle(void);
+
+void ble_power_get(ble_power_stats_t *stats);
+
+/* Awake share and wakeups per second since the previous call */
+void ble_power_log(void);
@@ -0,0 +1,107 @@
+/**
+ * @file ble_sample.c
+ *
+ *
+ * @brief Fixed-point sample decoding, see ble_sample.h.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stddef.h>
+/* API */
+#include "ble_sample.h"
+
+/* BLE_SAMPLE_SCALAR keeps the host on the plain C loop, to measure what the C3 runs */
+#if defined(__SSE2__) && !defined(BLE_SAMPLE_SCALAR)
+#define BLE_SAMPLE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && !defined(BLE_SAMPLE_SCALAR)
+#define BLE_SAMPLE_NEON
+#include <arm_neon.h>
+#endif
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BLE_SAMPLE_LANES        8U      /* int16 samples per 128-bit vector */
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Locals */
+static void convert_tail(const uint8_t *src, uint16_t n, int16_t mul, int32_t add, uint8_t shift, int32_t *restrict out)
+{
+    /* Byte loads keep it independent of alignment and endianness; no branch in the body, so the compiler may
+     * unroll or vectorise it */
+    for (uint16_t i = 0; i < n; i++) {
+        int16_t raw = (int16_t)((uint16_t)src[2U * i] | ((uint16_t)src[2U * i + 1U] << 8));
+        out[i] = ((int32_t)raw * mul + add) >> shift;
+    }
+}
+
+static uint16_t convert_vec(const uint8_t *src, uint16_t n, int16_t mul, int32_t add, uint8_t shift, int32_t *out)
+{
+    /* Whole vectors of samples, the rest is left to convert_tail. Both host targets are little endian, so the
+     * bytes load as int16 lanes directly. */
+    uint16_t done = 0;
+#if defined(BLE_SAMPLE_SSE2)
+    /* No 32-bit multiply before SSE4.1: the low and high halves of the int16 products, interleaved */
+    __m128i m  = _mm_set1_epi16(mul);
+    __m128i a  = _mm_set1_epi32(add);
+    __m128i sh = _mm_cvtsi32_si128(shift);
+    for (; done + BLE_SAMPLE_LANES <= n; done += BLE_SAMPLE_LANES) {
+        __m128i x  = _mm_loadu_si128((const __m128i *)(const void *)&src[2U * done]);
+        __m128i lo = _mm_mullo_epi16(x, m);
+        __m128i hi = _mm_mulhi_epi16(x, m);
+        __m128i p0 = _mm_sra_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), a), sh);
+        __m128i p1 = _mm_sra_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), a), sh);
+        _mm_storeu_si128((__m128i *)(void *)&out[done], p0);
+        _mm_storeu_si128((__m128i *)(void *)&out[done + 4U], p1);
+    }
+#elif defined(BLE_SAMPLE_NEON)
+    int16x4_t m  = vdup_n_s16(mul);
+    int32x4_t a  = vdupq_n_s32(add);
+    int32x4_t sh = vdupq_n_s32(-(int32_t)shift);   /* vshlq by a negative count shifts right, arithmetic */
+    for (; done + BLE_SAMPLE_LANES <= n; done += BLE_SAMPLE_LANES) {
+        int16x8_t x  = vreinterpretq_s16_u8(vld1q_u8(&src[2U * done]));
+        int32x4_t p0 = vshlq_s32(vaddq_s32(vmull_s16(vget_low_s16(x), m), a), sh);
+        int32x4_t p1 = vshlq_s32(vaddq_s32(vmull_s16(vget_high_s16(x), m), a), sh);
+        vst1q_s32(&out[done], p0);
+        vst1q_s32(&out[done + 4U], p1);
+    }
+#else
+    (void)src;
+    (void)n;
+    (void)mul;
+    (void)add;
+    (void)shift;
+    (void)out;
+#endif
+    return done;
+}
+
+/* API */
+uint16_t ble_sample_decode(const ble_sample_fmt_t *fmt, const uint8_t *data, uint16_t len, int32_t *out, uint16_t max)
+{
+    if (fmt == NULL || data == NULL || out == NULL || len < fmt->offset || fmt->shift > 31U) {
+        return 0;
+    }
+    uint16_t n = (uint16_t)((len - fmt->offset) / 2U);
+    if (fmt->count && n > fmt->count) {
+        n = fmt->count;
+    }
+    if (n > max) {
+        n = max;
+    }
+    const uint8_t *src  = &data[fmt->offset];
+    uint16_t       done = convert_vec(src, n, fmt->mul, fmt->add, fmt->shift, out);
+    convert_tail(&src[2U * done], (uint16_t)(n - done), fmt->mul, fmt->add, fmt->shift, &out[done]);
+    return n;
+}
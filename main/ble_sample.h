@@ -0,0 +1,50 @@
+/**
+ * @file ble_sample.h
+ *
+ *
+ * @brief Fixed-point decoding of characteristic values that pack arrays of
+ *          little-endian int16 samples. A format descriptor per characteristic
+ *          gives where the samples start and how a raw sample maps to the
+ *          consumer's unit: value = (raw * mul + add) >> shift, in int32.
+ *          No floating point, the C3 has no FPU. A whole value is converted
+ *          in one batch: SSE2 or NEON on the host simulator, a plain C loop
+ *          otherwise (RV32IMC has no vector unit).
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdint.h>
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define BLE_SAMPLE_MAX          257U    /* Samples of the longest value, (ESP_GATT_MAX_MTU_SIZE - 3) / 2 */
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Layout of one characteristic's values. raw * mul + add must fit an int32 for every raw sample. */
+typedef struct ble_sample_fmt {
+    uint8_t         offset;             /* Header bytes before the first sample, e.g. a sequence number */
+    uint8_t         count;              /* Samples per value, 0: as many as the value holds */
+    uint8_t         shift;              /* Right shift after the scaling, 0-31 */
+    int16_t         mul;
+    int32_t         add;
+} ble_sample_fmt_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Converts the samples of len bytes of value into out, at most max of them; returns how many. A value shorter
+ * than the format's offset yields none, a trailing odd byte is ignored. */
+uint16_t ble_sample_decode(const ble_sample_fmt_t *fmt, const uint8_t *data, uint16_t len, int32_t *out, uint16_t max);
@@ -0,0 +1,194 @@
+/**
+ * @file ble_scan.c
+ *
+ *
+ * @brief Scan modes and their accounting, see ble_scan.h.
+ *
+ */
+
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <string.h>
+/* FreeRTOS */
+#include "freertos/FreeRTOS.h"
+/* ESP32 API */
+#include "esp_log.h"
+/* API */
+#include "ble_scan.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#define TAG     "BLE_SCAN"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * VARIABLES * * * * *
+ * * * * * * * * * * * * * * * */
+
+static portMUX_TYPE             scan_mux = portMUX_INITIALIZER_UNLOCKED;
+static ble_scan_mode_stats_t    scan_stats[BLE_SCAN_MODE_NUM];
+static ble_scan_mode_t          scan_mode;
+static int64_t                  scan_since_us;
+static uint8_t                  scan_links;
+static uint32_t                 scan_pdus;
+
+static const char *const scan_names[BLE_SCAN_MODE_NUM] = {
+    [BLE_SCAN_MODE_OFF]        = "off",
+    [BLE_SCAN_MODE_AGGRESSIVE] = "aggressive",
+    [BLE_SCAN_MODE_SHARED]     = "shared",
+    [BLE_SCAN_MODE_BACKGROUND] = "background",
+};
+
+/* Interval and window per mode, 0.625 ms units */
+static const uint16_t scan_itvl[BLE_SCAN_MODE_NUM] = {
+    [BLE_SCAN_MODE_AGGRESSIVE] = BLE_SCAN_FAST_ITVL,
+    [BLE_SCAN_MODE_SHARED]     = BLE_SCAN_SHARED_ITVL,
+    [BLE_SCAN_MODE_BACKGROUND] = BLE_SCAN_BG_ITVL,
+};
+static const uint16_t scan_window[BLE_SCAN_MODE_NUM] = {
+    [BLE_SCAN_MODE_AGGRESSIVE] = BLE_SCAN_FAST_ITVL,
+    [BLE_SCAN_MODE_SHARED]     = BLE_SCAN_SHARED_WINDOW,
+    [BLE_SCAN_MODE_BACKGROUND] = BLE_SCAN_BG_WINDOW,
+};
+
+/* * * * * * * * * * * * * * * *
+ * * * * FN DEFINITIONS * * * *
+ * * * * * * * * * * * * * * * */
+
+/* API */
+ble_scan_mode_t ble_scan_mode_pick(uint8_t missing, uint8_t links, bool listen)
+{
+    if (missing) {
+        return links ? BLE_SCAN_MODE_SHARED : BLE_SCAN_MODE_AGGRESSIVE;
+    }
+    return ((BLE_SCAN_BACKGROUND && links) || listen) ? BLE_SCAN_MODE_BACKGROUND : BLE_SCAN_MODE_OFF;
+}
+
+void ble_scan_mode_params(ble_scan_mode_t mode, esp_ble_scan_params_t *params)
+{
+    if (mode == BLE_SCAN_MODE_OFF || mode >= BLE_SCAN_MODE_NUM) {
+        return;
+    }
+    /* Peers are matched on the advertised name, the scan response only matters while looking for them */
+    params->scan_type      = (mode == BLE_SCAN_MODE_BACKGROUND) ? BLE_SCAN_TYPE_PASSIVE : BLE_SCAN_TYPE_ACTIVE;
+    params->scan_interval  = scan_itvl[mode];
+    params->scan_window    = scan_window[mode];
+    /* Duplicates are told apart by address and data (CONFIG_BT_CTRL_SCAN_DUPL_TYPE_DATA_DEVICE, on the ESP32
+     * CONFIG_BTDM_SCAN_DUPL_TYPE_DATA_DEVICE, in sdkconfig.defaults.<target>): a peer is reported once per scan
+     * start, which is all the matching needs, a sensor again when its reading changes */
+    params->scan_duplicate = BLE_SCAN_DUPLICATE_ENABLE;
+}
+
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+void ble_scan_ext_params(const esp_ble_scan_params_t *params, esp_ble_ext_scan_params_t *ext)
+{
+    esp_ble_ext_scan_cfg_t cfg = {
+        .scan_type     = params->scan_type,
+        .scan_interval = params->scan_interval,
+        .scan_window   = params->scan_window,
+    };
+    ext->own_addr_type  = params->own_addr_type;
+    ext->filter_policy  = params->scan_filter_policy;
+    ext->scan_duplicate = params->scan_duplicate;
+    ext->cfg_mask       = ESP_BLE_GAP_EXT_SCAN_CFG_UNCODE_MASK | (BLE_SCAN_CODED ? ESP_BLE_GAP_EXT_SCAN_CFG_CODE_MASK : 0);
+    ext->uncoded_cfg    = cfg;
+    ext->coded_cfg      = cfg;
+}
+#endif
+
+const char *ble_scan_mode_name(ble_scan_mode_t mode)
+{
+    return (mode < BLE_SCAN_MODE_NUM) ? scan_names[mode] : "?";
+}
+
+ble_scan_mode_t ble_scan_mode_get(void)
+{
+    return scan_mode;
+}
+
+void ble_scan_stats_update(ble_scan_mode_t mode, int64_t now_us, uint8_t links, uint32_t link_pdus)
+{
+    if (mode >= BLE_SCAN_MODE_NUM) {
+        return;
+    }
+    portENTER_CRITICAL(&scan_mux);
+    ble_scan_mode_stats_t *st = &scan_stats[scan_mode];
+    if (scan_since_us && now_us > scan_since_us) {
+        uint64_t span = (uint64_t)(now_us - scan_since_us);
+        st->time_us   += span;
+        st->link_us   += span * scan_links;
+        st->link_pdus += link_pdus - scan_pdus;
+        if (scan_mode != BLE_SCAN_MODE_OFF) {
+            st->listen_us += span * scan_window[scan_mode] / scan_itvl[scan_mode];
+        }
+    }
+    if (mode != scan_mode && mode != BLE_SCAN_MODE_OFF) {
+        scan_stats[mode].starts++;
+    }
+    scan_mode     = mode;
+    scan_since_us = now_us;
+    scan_links    = links;
+    scan_pdus     = link_pdus;
+    portEXIT_CRITICAL(&scan_mux);
+}
+
+void ble_scan_stats_report(void)
+{
+    portENTER_CRITICAL(&scan_mux);
+    scan_stats[scan_mode].reports++;
+    portEXIT_CRITICAL(&scan_mux);
+}
+
+void ble_scan_stats_found(int64_t us)
+{
+    uint32_t v = (us < 0) ? 0U : (us > (int64_t)UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+    portENTER_CRITICAL(&scan_mux);
+    ble_scan_mode_stats_t *st = &scan_stats[scan_mode];
+    st->found++;
+    st->found_us_sum += v;
+    if (v > st->found_us_max) {
+        st->found_us_max = v;
+    }
+    portEXIT_CRITICAL(&scan_mux);
+}
+
+esp_err_t ble_scan_get_stats(ble_scan_mode_t mode, ble_scan_mode_stats_t *stats)
+{
+    if (mode >= BLE_SCAN_MODE_NUM || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&scan_mux);
+    *stats = scan_stats[mode];
+    portEXIT_CRITICAL(&scan_mux);
+    return ESP_OK;
+}
+
+void ble_scan_stats_reset(void)
+{
+    portENTER_CRITICAL(&scan_mux);
+    memset(scan_stats, 0, sizeof(scan_stats));
+    portEXIT_CRITICAL(&scan_mux);
+}
+
+void ble_scan_log(void)
+{
+    for (uint32_t m = 0; m < BLE_SCAN_MODE_NUM; m++)
+    {
+        ble_scan_mode_stats_t st;
+        ble_scan_get_stats((ble_scan_mode_t)m, &st);
+        if (st.time_us == 0U) {
+            continue;
+        }
+        /* Link PDUs per second of link time: what a connection carried on average while the mode ran */
+        ESP_LOGI(TAG, "%-10s %u ms, listening %u%%, %u starts, %u reports, %u found (avg %u, max %u ms), %u PDUs/s per link",
+                 scan_names[m], (unsigned)(st.time_us / 1000U), (unsigned)(st.listen_us * 100U / st.time_us),
+                 (unsigned)st.starts, (unsigned)st.reports, (unsigned)st.found,
+                 (unsigned)(st.found ? st.found_us_sum / st.found / 1000U : 0U), (unsigned)(st.found_us_max / 1000U),
+                 (unsigned)(st.link_us ? st.link_pdus * 1000000U / st.link_us : 0U));
+    }
+}
@@ -0,0 +1,113 @@
+/**
+ * @file ble_scan.h
+ *
+ *
+ * @brief Scan scheduling. The client scans in one of three modes: aggressive
+ *          (full duty, active) while peers are missing and no link is up,
+ *          shared (active, within the radio time BLE_CONN_AIRTIME_PCT leaves
+ *          to scanning) while peers are missing beside live links, and
+ *          background (passive, low duty, until stopped) once every peer is
+ *          ready. All of them let the controller drop duplicate reports.
+ *          Time, reports, discoveries and the link traffic carried meanwhile
+ *          are accounted per mode, so that the discovery latency a mode buys
+ *          can be weighed against what it costs the connections.
+ *          Where the BLE 5.0 API is built in (CONFIG_BT_BLE_50_FEATURES_SUPPORTED)
+ *          the same modes run as extended scans, on LE 1M and LE Coded in turn.
+ *
+ */
+
+
+#pragma once
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * INCLUDES * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* STD */
+#include <stdbool.h>
+#include <stdint.h>
+/* ESP32 API */
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_gap_ble_api.h"
+/* API */
+#include "ble_conn_params.h"
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * DEFINES * * * * * *
+ * * * * * * * * * * * * * * * */
+
+#ifdef CONFIG_BLE_CLIENT_LOW_POWER
+#define BLE_SCAN_BACKGROUND     0       /* Stop scanning once every peer is ready, disconnects restart it */
+#else
+#define BLE_SCAN_BACKGROUND     1       /* Keep a background scan running once every peer is ready */
+#endif
+
+/* Scan interval and window, 0.625 ms units */
+#define BLE_SCAN_FAST_ITVL      0x50U   /* 50 ms, aggressive scans with window = interval */
+#define BLE_SCAN_SHARED_WINDOW  0xB0U   /* 110 ms, longer than a 100 ms advertising interval plus advDelay */
+#define BLE_SCAN_SHARED_ITVL    (BLE_SCAN_SHARED_WINDOW * 100U / (100U - BLE_CONN_AIRTIME_PCT))
+#define BLE_SCAN_BG_ITVL        0x640U  /* 1 s */
+#define BLE_SCAN_BG_WINDOW      0x30U   /* 30 ms, 3% duty */
+#define BLE_SCAN_CODED          1       /* Extended scans also listen on LE Coded, for long range advertisers */
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * STRUCTS * * * * * *
+ * * * * * * * * * * * * * * * */
+
+typedef enum {
+    BLE_SCAN_MODE_OFF = 0,              /* Not scanning */
+    BLE_SCAN_MODE_AGGRESSIVE,           /* Peers missing, no link up: the whole radio */
+    BLE_SCAN_MODE_SHARED,               /* Peers missing beside live links */
+    BLE_SCAN_MODE_BACKGROUND,           /* Every peer ready */
+    BLE_SCAN_MODE_NUM
+} ble_scan_mode_t;
+
+typedef struct ble_scan_mode_stats {
+    uint64_t    time_us;                /* Time spent in the mode */
+    uint64_t    listen_us;              /* Of which inside scan windows */
+    uint32_t    starts;
+    uint32_t    reports;                /* Advertising reports that reached the host */
+    uint32_t    found;                  /* Missing peers found, with the time from scan start to their report */
+    uint64_t    found_us_sum;
+    uint32_t    found_us_max;
+    uint64_t    link_us;                /* Sum over the links up of their time in the mode */
+    uint64_t    link_pdus;              /* Data PDUs those links carried meanwhile */
+} ble_scan_mode_stats_t;
+
+/* * * * * * * * * * * * * * * *
+ * * * * * * * API * * * * * * *
+ * * * * * * * * * * * * * * * */
+
+/* Mode for a scan with missing peers still to find and links up, OFF if there is no reason to scan. listen
+ * keeps a background scan for advertisers read without connecting, whatever BLE_SCAN_BACKGROUND says. */
+ble_scan_mode_t ble_scan_mode_pick(uint8_t missing, uint8_t links, bool listen);
+
+/* Scan type, interval, window and duplicate filtering of a mode; address type and filter policy are kept */
+void ble_scan_mode_params(ble_scan_mode_t mode, esp_ble_scan_params_t *params);
+
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+/* Extended scan parameters equivalent to legacy ones, on LE 1M and with BLE_SCAN_CODED on LE Coded. The
+ * controller alternates the PHYs from one window to the next, so the duty cycle holds and each PHY gets half. */
+void ble_scan_ext_params(const esp_ble_scan_params_t *params, esp_ble_ext_scan_params_t *ext);
+#endif
+
+const char *ble_scan_mode_name(ble_scan_mode_t mode);
+
+/* Mode the accounting currently runs for */
+ble_scan_mode_t ble_scan_mode_get(void);
+
+/* Credits the time since the last update to the running mode, then runs mode. links and link_pdus (a running
+ * total) are sampled here, call it on every mode change and periodically. */
+void ble_scan_stats_update(ble_scan_mode_t mode, int64_t now_us, uint8_t links, uint32_t link_pdus);
+
+/* Called from the scan result path */
+void ble_scan_stats_report(void);
+void ble_scan_stats_found(int64_t us);
+
+esp_err_t ble_scan_get_stats(ble_scan_mode_t mode, ble_scan_mode_stats_t *stats);
+
+void ble_scan_stats_reset(void);
+
+/* One line per mode used so far */
+void ble_scan_log(void);